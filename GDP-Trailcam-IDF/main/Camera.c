@@ -95,7 +95,7 @@ esp_err_t cam_POST(const camera_config_t config)
     }
 
     // Setup frame settings
-    default_frame_settings(TEMP_GLOBAL_IMAGE_SET);
+    default_frame_settings(DEFAULT_IMAGE_PRESET, NULL);
 
     // Take an image
     ESP_LOGI(CAM_TAG, "Grabbing frame buffer");
@@ -152,21 +152,44 @@ esp_err_t POST_all_cams()
 /// ------------------------------------------
 esp_err_t start_camera(const camera_config_t cam_config)
 {
-    ESP_LOGI(CAM_TAG, "Powering up camera");
-    gpio_set_level(cam_config.pin_pwdn, CAM_POWER_ON);
+    return start_powered_camera(cam_config, power_on_camera(cam_config.pin_pwdn));
+}
+
+/// ------------------------------------------
+int64_t power_on_camera(const int power_down_pin)
+{
+    ESP_LOGI(CAM_TAG, "Powering up camera on pin %i", power_down_pin);
+    gpio_set_level(power_down_pin, CAM_POWER_ON);
+    boot_timeline_mark(BOOT_PHASE_CAM_POWER_ON);
+
+    return esp_timer_get_time();
+}
 
-    // Must wait whilst the camera goes through powerup sequence
-    vTaskDelay(pdMS_TO_TICKS(CAM_WAKEUP_DELAY_MS));
+/// ------------------------------------------
+esp_err_t start_powered_camera(const camera_config_t cam_config, const int64_t power_on_time_us)
+{
+    TRACE_BEGIN(TRACE_SPAN_CAM_START);
+
+    // Must wait whilst the camera goes through powerup sequence, any time already spent
+    // since power on counts towards this
+    int64_t powered_ms = (esp_timer_get_time() - power_on_time_us) / 1000;
+    if (powered_ms < CAM_WAKEUP_DELAY_MS)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CAM_WAKEUP_DELAY_MS - powered_ms));
+    }
 
     ESP_LOGI(CAM_TAG, "Initialising camera");
     esp_err_t err = esp_camera_init(&cam_config);
     if (err != ESP_OK)
     {
         ESP_LOGE(CAM_TAG, "Camera Init Failed, err: %s", esp_err_to_name(err));
+        TRACE_END(TRACE_SPAN_CAM_START);
         return err;
     }
 
     esp_camera_return_all();
+    boot_timeline_mark(BOOT_PHASE_CAM_INIT);
+    TRACE_END(TRACE_SPAN_CAM_START);
 
     ESP_LOGI(CAM_TAG, "Camera Init Success");
     return ESP_OK;
@@ -202,16 +225,54 @@ esp_err_t stop_camera(const camera_config_t cam_config)
 /// ------------------------------------------
 jpg_image_t extract_camera_buffer(const camera_fb_t* fb)
 {
+    TRACE_BEGIN(TRACE_SPAN_EXTRACT);
     jpg_image_t img_data;
     img_data.buf = (uint8_t*) malloc(fb->len);
+    if (img_data.buf == NULL)
+    {
+        ESP_LOGE(CAM_TAG, "Failed to allocate %u bytes for frame", fb->len);
+        img_data.len = 0;
+        TRACE_END(TRACE_SPAN_EXTRACT);
+        return img_data;
+    }
     memcpy(img_data.buf, fb->buf, fb->len);
     img_data.len = fb->len;
     img_data.height = fb->height;
     img_data.width = fb->width;
+    TRACE_END(TRACE_SPAN_EXTRACT);
 
     return img_data;
 }
 
+/// ------------------------------------------
+esp_err_t copy_camera_buffer(const camera_fb_t* fb, jpg_image_t* img, const size_t buf_len)
+{
+    if (fb->len > buf_len)
+    {
+        ESP_LOGE(CAM_TAG, "Frame of %u bytes does not fit in %u", fb->len, buf_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    TRACE_BEGIN(TRACE_SPAN_EXTRACT);
+    memcpy(img->buf, fb->buf, fb->len);
+    TRACE_END(TRACE_SPAN_EXTRACT);
+    img->len = fb->len;
+    img->height = fb->height;
+    img->width = fb->width;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+size_t get_max_jpg_len(const framesize_t frame_size)
+{
+    // Matches the receive buffer cam_hal sizes for jpeg mode
+#ifdef CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO
+    return (size_t)resolution[frame_size].width * resolution[frame_size].height / 5;
+#else
+    return CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE;
+#endif
+}
+
 /// ------------------------------------------
 esp_err_t write_fb_to_SD(const char* save_path, const camera_fb_t* fb)
 {
@@ -224,76 +285,261 @@ esp_err_t write_jpg_data_to_SD(const char* path, const jpg_image_t jpg_data)
     return write_data_SDSPI(path, jpg_data.buf, jpg_data.len);
 }
 
+/// @brief Full settings table for the daylight preset, the base all other presets are diffed against
+static const Camera_setting_value_t daylight_preset[] = {
+    {CAM_SET_BRIGHTNESS,     0},    // -2 to 2
+    {CAM_SET_CONTRAST,       0},    // -2 to 2
+    {CAM_SET_SATURATION,     0},    // -2 to 2
+    {CAM_SET_SPECIAL_EFFECT, 0},    // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
+    {CAM_SET_WHITEBAL,       1},    // 0 = disable , 1 = enable
+    {CAM_SET_AWB_GAIN,       1},    // 0 = disable , 1 = enable
+    {CAM_SET_WB_MODE,        2},    // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
+    {CAM_SET_EXPOSURE_CTRL,  1},    // 0 = disable , 1 = enable
+    {CAM_SET_AEC2,           1},    // 0 = disable , 1 = enable
+    {CAM_SET_AE_LEVEL,       2},    // -2 to 2
+    {CAM_SET_AEC_VALUE,      300},  // 0 to 1200
+    {CAM_SET_GAIN_CTRL,      1},    // 0 = disable , 1 = enable
+    {CAM_SET_AGC_GAIN,       1},    // 0 to 30
+    {CAM_SET_GAINCEILING,    0},    // 0 to 0x3FF, the OV5640 ceiling register in 1/16x gain steps, not gainceiling_t
+    {CAM_SET_BPC,            0},    // 0 = disable , 1 = enable
+    {CAM_SET_WPC,            1},    // 0 = disable , 1 = enable
+    {CAM_SET_RAW_GMA,        1},    // 0 = disable , 1 = enable
+    {CAM_SET_LENC,           1},    // 0 = disable , 1 = enable
+    {CAM_SET_HMIRROR,        0},    // 0 = disable , 1 = enable
+    {CAM_SET_VFLIP,          0},    // 0 = disable , 1 = enable
+    {CAM_SET_DCW,            1},    // 0 = disable , 1 = enable
+    {CAM_SET_COLORBAR,       0},    // 0 = disable , 1 = enable
+    {CAM_SET_DENOISE,        8},    // 0 to 8 (0 - Auto), strongest denoise the OV5640 takes
+};
+
+/// @brief Differences from the daylight preset for low light imaging
+static const Camera_setting_value_t low_light_diff[] = {
+    {CAM_SET_BRIGHTNESS,     2},
+    {CAM_SET_CONTRAST,       -2},
+    {CAM_SET_SATURATION,     -2},
+};
+
 /// ------------------------------------------
-void default_frame_settings(Camera_image_preset_t camera_setting)
+/// @brief Reads the value the sensor driver last applied for a setting
+///
+/// @param s sensor to read
+/// @param setting setting to get the shadow value of
+///
+/// @return value held in the sensor status
+static int get_setting_shadow(const sensor_t* s, const Camera_setting_t setting)
+{
+    switch (setting)
+    {
+        case CAM_SET_BRIGHTNESS:     return s->status.brightness;
+        case CAM_SET_CONTRAST:       return s->status.contrast;
+        case CAM_SET_SATURATION:     return s->status.saturation;
+        case CAM_SET_SPECIAL_EFFECT: return s->status.special_effect;
+        case CAM_SET_WHITEBAL:       return s->status.awb;
+        case CAM_SET_AWB_GAIN:       return s->status.awb_gain;
+        case CAM_SET_WB_MODE:        return s->status.wb_mode;
+        case CAM_SET_EXPOSURE_CTRL:  return s->status.aec;
+        case CAM_SET_AEC2:           return s->status.aec2;
+        case CAM_SET_AE_LEVEL:       return s->status.ae_level;
+        case CAM_SET_AEC_VALUE:      return s->status.aec_value;
+        case CAM_SET_GAIN_CTRL:      return s->status.agc;
+        case CAM_SET_AGC_GAIN:       return s->status.agc_gain;
+        case CAM_SET_GAINCEILING:    return s->status.gainceiling;
+        case CAM_SET_BPC:            return s->status.bpc;
+        case CAM_SET_WPC:            return s->status.wpc;
+        case CAM_SET_RAW_GMA:        return s->status.raw_gma;
+        case CAM_SET_LENC:           return s->status.lenc;
+        case CAM_SET_HMIRROR:        return s->status.hmirror;
+        case CAM_SET_VFLIP:          return s->status.vflip;
+        case CAM_SET_DCW:            return s->status.dcw;
+        case CAM_SET_COLORBAR:       return s->status.colorbar;
+        case CAM_SET_DENOISE:        return s->status.denoise;
+        default:                     return -1;
+    }
+}
+
+/// ------------------------------------------
+/// @brief Converts a target value into the units the sensor status holds it in
+///
+/// @param setting setting the value is for
+/// @param value target value
+///
+/// @return value as get_setting_shadow would return it once written
+static int setting_to_shadow(const Camera_setting_t setting, const int value)
+{
+    switch (setting)
+    {
+        // The OV5640 driver writes the gainceiling argument straight into 0x3A18/0x3A19 and
+        // init_status reads that register back, so both hold the 10 bit register value
+        case CAM_SET_GAINCEILING:    return value & 0x3FF;
+        default:                     return value;
+    }
+}
+
+/// ------------------------------------------
+/// @brief Writes a setting to the sensor through the driver setter
+///
+/// @param s sensor to write
+/// @param setting setting to write
+/// @param value value to apply
+///
+/// @return 0 on sucsess, driver error otherwise
+static int write_setting(sensor_t* s, const Camera_setting_t setting, const int value)
+{
+    switch (setting)
+    {
+        case CAM_SET_BRIGHTNESS:     return s->set_brightness(s, value);
+        case CAM_SET_CONTRAST:       return s->set_contrast(s, value);
+        case CAM_SET_SATURATION:     return s->set_saturation(s, value);
+        case CAM_SET_SPECIAL_EFFECT: return s->set_special_effect(s, value);
+        case CAM_SET_WHITEBAL:       return s->set_whitebal(s, value);
+        case CAM_SET_AWB_GAIN:       return s->set_awb_gain(s, value);
+        case CAM_SET_WB_MODE:        return s->set_wb_mode(s, value);
+        case CAM_SET_EXPOSURE_CTRL:  return s->set_exposure_ctrl(s, value);
+        case CAM_SET_AEC2:           return s->set_aec2(s, value);
+        case CAM_SET_AE_LEVEL:       return s->set_ae_level(s, value);
+        case CAM_SET_AEC_VALUE:      return s->set_aec_value(s, value);
+        case CAM_SET_GAIN_CTRL:      return s->set_gain_ctrl(s, value);
+        case CAM_SET_AGC_GAIN:       return s->set_agc_gain(s, value);
+        case CAM_SET_GAINCEILING:    return s->set_gainceiling(s, (gainceiling_t)value);
+        case CAM_SET_BPC:            return s->set_bpc(s, value);
+        case CAM_SET_WPC:            return s->set_wpc(s, value);
+        case CAM_SET_RAW_GMA:        return s->set_raw_gma(s, value);
+        case CAM_SET_LENC:           return s->set_lenc(s, value);
+        case CAM_SET_HMIRROR:        return s->set_hmirror(s, value);
+        case CAM_SET_VFLIP:          return s->set_vflip(s, value);
+        case CAM_SET_DCW:            return s->set_dcw(s, value);
+        case CAM_SET_COLORBAR:       return s->set_colorbar(s, value);
+        case CAM_SET_DENOISE:        return s->set_denoise(s, value);
+        default:                     return -1;
+    }
+}
+
+/// ------------------------------------------
+size_t apply_frame_settings(const Camera_setting_value_t* settings, const size_t count)
 {
     sensor_t* s = esp_camera_sensor_get();
     if (s == NULL)
     {
         ESP_LOGE(CAM_TAG, "Failed to grab sensor ptr");
-        return;
+        return 0;
+    }
+
+    // Collapse the table into one target per setting so overridden entries cost nothing
+    int16_t targets[CAM_SET_COUNT];
+    bool target_set[CAM_SET_COUNT] = {false};
+    for (size_t i = 0; i < count; i++)
+    {
+        if (settings[i].setting < CAM_SET_COUNT)
+        {
+            targets[settings[i].setting] = settings[i].value;
+            target_set[settings[i].setting] = true;
+        }
+    }
+
+    // The driver keeps the status updated on every set, so it acts as a shadow of the register
+    // state. On init most of it is read from the registers, but brightness, contrast, saturation,
+    // ae_level, special_effect and wb_mode are set to 0, what the reset defaults amount to
+    size_t writes = 0;
+    for (size_t setting = 0; setting < CAM_SET_COUNT; setting++)
+    {
+        if (!target_set[setting] || get_setting_shadow(s, setting) == setting_to_shadow(setting, targets[setting]))
+        {
+            continue;
+        }
+
+        if (write_setting(s, setting, targets[setting]) != 0)
+        {
+            ESP_LOGW(CAM_TAG, "Sensor rejected setting %u = %i", setting, targets[setting]);
+        }
+        writes++;
     }
 
+    return writes;
+}
+
+/// ------------------------------------------
+void default_frame_settings(Camera_image_preset_t camera_setting, const exposure_state_t* seed)
+{
+    const size_t daylight_count = sizeof(daylight_preset) / sizeof(daylight_preset[0]);
+    const size_t low_light_count = sizeof(low_light_diff) / sizeof(low_light_diff[0]);
+    const size_t seed_count = 2;
+
+    Camera_setting_value_t preset[daylight_count + low_light_count + seed_count];
+    size_t preset_count = daylight_count;
+    memcpy(preset, daylight_preset, sizeof(daylight_preset));
+
     if (camera_setting == LOW_LIGHT)
     {
-        s->set_brightness(s, 2);     // -2 to 2
-        s->set_contrast(s, -2);       // -2 to 2
-        s->set_saturation(s, -2);     // -2 to 2
-        s->set_special_effect(s, 0); // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
-        s->set_whitebal(s, 1);       // 0 = disable , 1 = ednable
-        s->set_awb_gain(s, 1);       // 0 = disable , 1 = enable
-        s->set_wb_mode(s, 2);        // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
-        s->set_exposure_ctrl(s, 1);  // 0 = disable , 1 = enable
-        s->set_aec2(s, 1);           // 0 = disable , 1 = enabled
-        s->set_ae_level(s, 2);       // -2 to 2
-        s->set_aec_value(s, 300);    // 0 to 1200
-        s->set_gain_ctrl(s, 1);      // 0 = disable , 1 = enable
-        s->set_agc_gain(s, 1);       // 0 to 30
-        s->set_gainceiling(s, (gainceiling_t)0);  // 0 to 6
-        s->set_bpc(s, 0);            // 0 = disable , 1 = enable
-        s->set_wpc(s, 1);            // 0 = disable , 1 = enable
-        s->set_raw_gma(s, 1);        // 0 = disable , 1 = enable
-        s->set_lenc(s, 1);           // 0 = disable , 1 = enable
-        s->set_hmirror(s, 0);        // 0 = disable , 1 = enable
-        s->set_vflip(s, 0);          // 0 = disable , 1 = enable
-        s->set_dcw(s, 1);            // 0 = disable , 1 = enable
-        s->set_colorbar(s, 0);       // 0 = disable , 1 = enable
-        s->set_denoise(s, 10);
-
-        ESP_LOGI(CAM_TAG, "Setup imaging for low light");
-    }
-    else if (camera_setting == DAYLIGHT)
-    {
-        s->set_brightness(s, 0);     // -2 to 2
-        s->set_contrast(s, 0);       // -2 to 2
-        s->set_saturation(s, 0);     // -2 to 2
-        s->set_special_effect(s, 0); // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
-        s->set_whitebal(s, 1);       // 0 = disable , 1 = ednable
-        s->set_awb_gain(s, 1);       // 0 = disable , 1 = enable
-        s->set_wb_mode(s, 2);        // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
-        s->set_exposure_ctrl(s, 1);  // 0 = disable , 1 = enable
-        s->set_aec2(s, 1);           // 0 = disable , 1 = enabled
-        s->set_ae_level(s, 2);       // -2 to 2
-        s->set_aec_value(s, 300);    // 0 to 1200
-        s->set_gain_ctrl(s, 1);      // 0 = disable , 1 = enable
-        s->set_agc_gain(s, 1);       // 0 to 30
-        s->set_gainceiling(s, (gainceiling_t)0);  // 0 to 6
-        s->set_bpc(s, 0);            // 0 = disable , 1 = enable
-        s->set_wpc(s, 1);            // 0 = disable , 1 = enable
-        s->set_raw_gma(s, 1);        // 0 = disable , 1 = enable
-        s->set_lenc(s, 1);           // 0 = disable , 1 = enable
-        s->set_hmirror(s, 0);        // 0 = disable , 1 = enable
-        s->set_vflip(s, 0);          // 0 = disable , 1 = enable
-        s->set_dcw(s, 1);            // 0 = disable , 1 = enable
-        s->set_colorbar(s, 0);       // 0 = disable , 1 = enable
-        s->set_denoise(s, 10);
-
-        ESP_LOGI(CAM_TAG, "Setup imaging for daylight");
+        memcpy(&preset[preset_count], low_light_diff, sizeof(low_light_diff));
+        preset_count += low_light_count;
     }
-    else
+    else if (camera_setting != DAYLIGHT)
     {
         ESP_LOGI(CAM_TAG, "Invalid imaging preset num, no change made.");
+        return;
     }
+
+    if (seed != NULL)
+    {
+        // Seed is read back as 6.4 fixed point gain, the setter takes whole steps
+        preset[preset_count++] = (Camera_setting_value_t){CAM_SET_AEC_VALUE, seed->aec_value};
+        preset[preset_count++] = (Camera_setting_value_t){CAM_SET_AGC_GAIN, (seed->agc_gain + 1) >> 4};
+        ESP_LOGI(CAM_TAG, "Seeding exposure with aec %i, gain %i", seed->aec_value, seed->agc_gain);
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    size_t writes = apply_frame_settings(preset, preset_count);
+    ESP_LOGI(CAM_TAG, "Setup imaging for %s, %u of %u settings written in %lldus",
+             camera_setting == LOW_LIGHT ? "low light" : "daylight",
+             writes, CAM_SET_COUNT, esp_timer_get_time() - start_time);
+}
+
+/// @brief Light level thresholds for each preset, checked in order, first preset the level reaches is used
+static const struct
+{
+    // Minimum light sensor reading for this preset
+    int min_level;
+
+    // Preset to use
+    Camera_image_preset_t preset;
+} light_level_presets[] = {
+    {LOW_LIGHT_LEVEL, DAYLIGHT},
+    {0,               LOW_LIGHT},
+};
+
+/// ------------------------------------------
+Camera_image_preset_t select_image_preset()
+{
+    int light_level;
+    if (read_light_level(&light_level) != ESP_OK)
+    {
+        return DEFAULT_IMAGE_PRESET;
+    }
+
+    size_t preset_count = sizeof(light_level_presets) / sizeof(light_level_presets[0]);
+    for (size_t i = 0; i < preset_count; i++)
+    {
+        if (light_level >= light_level_presets[i].min_level)
+        {
+            return light_level_presets[i].preset;
+        }
+    }
+
+    return DEFAULT_IMAGE_PRESET;
+}
+
+/// ------------------------------------------
+uint8_t get_cam_num(const int power_down_pin)
+{
+    for (size_t i = 0; i < CAM_POWER_DOWN_PIN_COUNT; i++)
+    {
+        if (cam_power_down_pins[i] == power_down_pin)
+        {
+            return i;
+        }
+    }
+
+    return 0;
 }
 
 /// ------------------------------------------
@@ -320,49 +566,142 @@ void setup_all_cam_power_down_pins()
 /// ------------------------------------------
 jpg_motion_data_t* get_motion_capture(camera_config_t config)
 {
+    size_t img_buf_len = get_max_jpg_len(config.frame_size);
     jpg_motion_data_t* motion = malloc(sizeof(jpg_motion_data_t));
+    if (motion == NULL)
+    {
+        ESP_LOGE(CAM_TAG, "Failed to allocate motion capture");
+        return NULL;
+    }
+    motion->data_valid = false;
+    motion->img1.buf = heap_caps_malloc(img_buf_len, MALLOC_CAP_SPIRAM);
+    motion->img2.buf = heap_caps_malloc(img_buf_len, MALLOC_CAP_SPIRAM);
+    if (motion->img1.buf == NULL || motion->img2.buf == NULL)
+    {
+        ESP_LOGE(CAM_TAG, "Failed to allocate image buffers");
+        return motion;
+    }
+
+    get_pipelined_motion_capture(config, select_image_preset(), power_on_camera(config.pin_pwdn), -1, NULL,
+                                 motion, img_buf_len);
+    return motion;
+}
+
+/// ------------------------------------------
+/// @brief Powers the next camera in a pipelined capture if it has not been already
+///
+/// @param next_power_down_pin pin of the next camera, -1 if none
+/// @param[out] next_power_on_time_us set to the power on time, left as is if already non zero
+static void power_on_next_camera(const int next_power_down_pin, int64_t* next_power_on_time_us)
+{
+    if (next_power_down_pin < 0 || next_power_on_time_us == NULL || *next_power_on_time_us != 0)
+    {
+        return;
+    }
+
+    *next_power_on_time_us = power_on_camera(next_power_down_pin);
+}
+
+/// ------------------------------------------
+void get_pipelined_motion_capture(camera_config_t config,
+                                  const Camera_image_preset_t preset,
+                                  const int64_t power_on_time_us,
+                                  const int next_power_down_pin,
+                                  int64_t* next_power_on_time_us,
+                                  jpg_motion_data_t* motion,
+                                  const size_t img_buf_len)
+{
+    if (next_power_on_time_us != NULL)
+    {
+        *next_power_on_time_us = 0;
+    }
+
     motion->data_valid = false;
-    motion->img1.buf = NULL;
-    motion->img2.buf = NULL;
+    motion->cam_num = get_cam_num(config.pin_pwdn);
+    motion->image_preset = preset;
+    motion->exposure_converged = false;
+    motion->exposure_converge_ms = 0;
+    motion->exposure_discarded_frames = 0;
+    motion->aec_value = 0;
+    motion->agc_gain = 0;
 
     ESP_LOGI(CAM_TAG, "Starting camera");
-    if (start_camera(config) != ESP_OK)
+    if (start_powered_camera(config, power_on_time_us) != ESP_OK)
     {
         ESP_LOGE(CAM_TAG, "Failed to start Camera");
-        return motion;
+        // Make sure the failed camera is powered down before the next one is brought up
+        stop_camera(config);
+        power_on_next_camera(next_power_down_pin, next_power_on_time_us);
+        return;
     }
 
-    default_frame_settings(TEMP_GLOBAL_IMAGE_SET);
+    // Start auto exposure from where this camera last settled, if known
+    exposure_state_t seed;
+    bool seeded = get_exposure_seed(motion->cam_num, &seed);
+    default_frame_settings(preset, seeded ? &seed : NULL);
+
+    // Frames taken before AEC/AGC settle differ in brightness, which shows up as whole frame motion
+    exposure_report_t exposure;
+    wait_for_exposure_convergence(&exposure);
+    if (exposure.converged)
+    {
+        store_exposure_seed(motion->cam_num, &exposure.state);
+    }
+    boot_timeline_mark(BOOT_PHASE_EXPOSURE_SETTLED);
+    motion->exposure_converged = exposure.converged;
+    motion->exposure_converge_ms = exposure.converge_ms;
+    motion->exposure_discarded_frames = exposure.discarded_frames;
+    motion->aec_value = exposure.state.aec_value;
+    motion->agc_gain = exposure.state.agc_gain;
 
     ESP_LOGI(CAM_TAG, "Grabbing frame buffer");
     size_t capture1_milli = esp_log_timestamp();
+    TRACE_BEGIN(TRACE_SPAN_GRAB);
     camera_fb_t* frame1 = esp_camera_fb_get();
+    TRACE_END(TRACE_SPAN_GRAB);
+    boot_timeline_mark(BOOT_PHASE_FIRST_FRAME);
+    size_t capture2_milli = 0;
+    camera_fb_t* frame2 = NULL;
     if (!frame1) {
         ESP_LOGE(CAM_TAG, "Frame buffer could not be acquired");
-        stop_camera(config);
-        free(motion);
-        return NULL;
     }
-    ESP_LOGI(CAM_TAG, "Camera buffer grabbed sucsessfully");
-    ESP_LOGI(CAM_TAG, "Image is %u bytes", frame1->len);
+    else
+    {
+        ESP_LOGI(CAM_TAG, "Camera buffer grabbed sucsessfully");
+        ESP_LOGI(CAM_TAG, "Image is %u bytes", frame1->len);
+
+        ESP_LOGI(CAM_TAG, "Grabbing frame buffer");
+        capture2_milli = esp_log_timestamp();
+        TRACE_BEGIN(TRACE_SPAN_GRAB);
+        frame2 = esp_camera_fb_get();
+        TRACE_END(TRACE_SPAN_GRAB);
+    }
+
+    // Both frames are now held by the driver and the sensor is no longer needed,
+    // start the next camera's powerup whilst this one is read out and shut down
+    power_on_next_camera(next_power_down_pin, next_power_on_time_us);
 
-    ESP_LOGI(CAM_TAG, "Grabbing frame buffer");
-    size_t capture2_milli = esp_log_timestamp();
-    camera_fb_t* frame2 = esp_camera_fb_get();
     if (!frame2) {
-        ESP_LOGE(CAM_TAG, "Frame buffer could not be acquired");
+        if (frame1)
+        {
+            ESP_LOGE(CAM_TAG, "Frame buffer could not be acquired");
+            esp_camera_fb_return(frame1);
+        }
         stop_camera(config);
-        free(motion);
-        return NULL;
+        return;
     }
     ESP_LOGI(CAM_TAG, "Camera buffer grabbed sucsessfully");
     ESP_LOGI(CAM_TAG, "Image is %u bytes", frame2->len);
 
     ESP_LOGI(CAM_TAG, "Frame diff is %ums", capture2_milli - capture1_milli);
 
-    jpg_image_t img1 = extract_camera_buffer(frame1);
+    // Copied straight into the caller's buffers, nothing is allocated per capture
+    esp_err_t copy_err = copy_camera_buffer(frame1, &motion->img1, img_buf_len);
     esp_camera_fb_return(frame1);
-    jpg_image_t img2 = extract_camera_buffer(frame2);
+    if (copy_err == ESP_OK)
+    {
+        copy_err = copy_camera_buffer(frame2, &motion->img2, img_buf_len);
+    }
     esp_camera_fb_return(frame2);
 
     ESP_LOGI(CAM_TAG, "Stopping camera");
@@ -371,12 +710,14 @@ jpg_motion_data_t* get_motion_capture(camera_config_t config)
         ESP_LOGE(CAM_TAG, "Failed to stop camera");
     }
 
-    motion->img1 = img1;
-    motion->img2 = img2;
+    if (copy_err != ESP_OK)
+    {
+        return;
+    }
+
     motion->t1 = capture1_milli;
     motion->t2 = capture2_milli;
 
     ESP_LOGI(CAM_TAG, "Motion capture image grab sucsess");
     motion->data_valid = true;
-    return motion;
 }
\ No newline at end of file
@@ -10,14 +10,20 @@
 #include <esp_system.h>
 #include "esp_camera.h"
 #include <esp_psram.h>
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
 #include "driver/rtc_io.h"
+#include "esp_timer.h"
 
 #include "SDSPI.h"
 #include "image_types.h"
+#include "exposure_control.h"
+#include "light_sensor.h"
+#include "boot_timeline.h"
+#include "trace.h"
 
 typedef enum
 {
@@ -25,9 +31,51 @@ typedef enum
     LOW_LIGHT
 } Camera_image_preset_t;
 
+/// @brief Individual sensor settings that make up an imaging preset
+typedef enum
+{
+    CAM_SET_BRIGHTNESS,
+    CAM_SET_CONTRAST,
+    CAM_SET_SATURATION,
+    CAM_SET_SPECIAL_EFFECT,
+    CAM_SET_WHITEBAL,
+    CAM_SET_AWB_GAIN,
+    CAM_SET_WB_MODE,
+    CAM_SET_EXPOSURE_CTRL,
+    CAM_SET_AEC2,
+    CAM_SET_AE_LEVEL,
+    CAM_SET_AEC_VALUE,
+    CAM_SET_GAIN_CTRL,
+    CAM_SET_AGC_GAIN,
+    CAM_SET_GAINCEILING,
+    CAM_SET_BPC,
+    CAM_SET_WPC,
+    CAM_SET_RAW_GMA,
+    CAM_SET_LENC,
+    CAM_SET_HMIRROR,
+    CAM_SET_VFLIP,
+    CAM_SET_DCW,
+    CAM_SET_COLORBAR,
+    CAM_SET_DENOISE,
+    CAM_SET_COUNT
+} Camera_setting_t;
+
+/// @brief A single entry of a preset table, the value a setting should be set to
+typedef struct
+{
+    // Setting to change
+    Camera_setting_t setting;
+
+    // Value to apply
+    int16_t value;
+} Camera_setting_value_t;
+
 /// @brief List of powerdown pins for all attached cameras
 static const int cam_power_down_pins[] = {CONFIG_PIN_CAM_PWRDN_1, CONFIG_PIN_CAM_PWRDN_2, CONFIG_PIN_CAM_PWRDN_3, CONFIG_PIN_CAM_PWRDN_4};
 
+/// @brief Number of entries in cam_power_down_pins, including unused (-1) entries
+#define CAM_POWER_DOWN_PIN_COUNT (sizeof(cam_power_down_pins) / sizeof(cam_power_down_pins[0]))
+
 /// @brief Logic level for camera power off
 #define CAM_POWER_OFF 0
 
@@ -43,8 +91,11 @@ static const int cam_power_down_pins[] = {CONFIG_PIN_CAM_PWRDN_1, CONFIG_PIN_CAM
 /// @brief Target delay in time between the two images in the motion capture
 #define CAM_MOTION_CAPTURE_WAIT_MS 50
 
-/// @brief Light adjustment setting for camera captures, prob best to set this via light level detection at some point
-#define TEMP_GLOBAL_IMAGE_SET DAYLIGHT
+/// @brief Light adjustment setting for camera captures when no light sensor reading is available
+#define DEFAULT_IMAGE_PRESET DAYLIGHT
+
+/// @brief Light sensor reading below which the low light preset is used
+#define LOW_LIGHT_LEVEL CONFIG_LIGHT_SENSOR_LOW_LIGHT_LEVEL
 
 /// ------------------------------------------
 /// @brief Creates a default camera config sturct to use for initializing and deinitializing a camera
@@ -79,6 +130,25 @@ esp_err_t POST_all_cams();
 /// @return ESP_OK if sucsessful
 esp_err_t start_camera(const camera_config_t cam_config);
 
+/// ------------------------------------------
+/// @brief Pulls the given power down pin into the ON state, starting the camera powerup sequence
+/// without initialising the camera driver
+///
+/// @param power_down_pin pin used for controlling power to the camera
+///
+/// @return esp_timer timestamp (us) of the moment the camera was powered
+int64_t power_on_camera(const int power_down_pin);
+
+/// ------------------------------------------
+/// @brief Starts a camera that has already been powered with power_on_camera
+/// Only waits for whatever remains of CAM_WAKEUP_DELAY_MS since power_on_time_us
+///
+/// @param cam_config configuration to use when starting the camera
+/// @param power_on_time_us timestamp returned by power_on_camera for this camera
+///
+/// @return ESP_OK if sucsessful
+esp_err_t start_powered_camera(const camera_config_t cam_config, const int64_t power_on_time_us);
+
 /// ------------------------------------------
 /// @brief De-intializes the camera and closes connection
 /// Pulls power down pin into OFF state
@@ -95,9 +165,28 @@ esp_err_t stop_camera(const camera_config_t cam_config);
 ///
 /// @param fb frame buffer to extract
 ///
-/// @return structure of image data
+/// @return structure of image data, buf is null if it could not be allocated
 jpg_image_t extract_camera_buffer(const camera_fb_t* fb);
 
+/// ------------------------------------------
+/// @brief Copies the image data of the frame buffer into an existing buffer
+///
+/// @param fb frame buffer to copy
+/// @param[in,out] img image to fill, buf must already point at buf_len bytes
+/// @param buf_len length of img's buffer
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_INVALID_SIZE if the frame does not fit
+esp_err_t copy_camera_buffer(const camera_fb_t* fb, jpg_image_t* img, const size_t buf_len);
+
+/// ------------------------------------------
+/// @brief Gets the largest jpg the driver can hand back at a frame size, frames are
+/// received into buffers of this size so no jpg can be longer
+///
+/// @param frame_size frame size the camera is configured for
+///
+/// @return length in bytes
+size_t get_max_jpg_len(const framesize_t frame_size);
+
 /// ------------------------------------------
 /// @brief Writes the given frame buffer to the given path
 ///
@@ -121,7 +210,36 @@ esp_err_t write_jpg_data_to_SD(const char* path, const jpg_image_t jpg_data);
 
 /// ------------------------------------------
 /// @brief Sets all camera image settings to sensible values
-void default_frame_settings(Camera_image_preset_t camera_setting);
+///
+/// @note Settings already at the target value in the sensor's status shadow are not written
+///
+/// @param camera_setting preset to apply
+/// @param seed exposure to start auto exposure from instead of the preset default, NULL for none
+void default_frame_settings(Camera_image_preset_t camera_setting, const exposure_state_t* seed);
+
+/// ------------------------------------------
+/// @brief Chooses the imaging preset for the current ambient light level
+///
+/// @return preset to use, DEFAULT_IMAGE_PRESET if the light sensor cannot be read
+Camera_image_preset_t select_image_preset();
+
+/// ------------------------------------------
+/// @brief Finds which camera a power down pin belongs to
+///
+/// @param power_down_pin pin to look up
+///
+/// @return index into cam_power_down_pins, 0 if the pin is not in the list
+uint8_t get_cam_num(const int power_down_pin);
+
+/// ------------------------------------------
+/// @brief Applies a list of settings to the active sensor, skipping any whose value
+/// already matches the sensor's status shadow
+///
+/// @param settings table of settings to apply, later entries override earlier ones
+/// @param count number of entries in settings
+///
+/// @return number of settings that were written to the sensor
+size_t apply_frame_settings(const Camera_setting_value_t* settings, const size_t count);
 
 /// ------------------------------------------
 /// @brief Sets up the power down pins given in cam_power_down_pins as a driven outputs
@@ -134,4 +252,27 @@ void setup_all_cam_power_down_pins();
 /// @param config config of the camera to use
 ///
 /// @return struct containing two images, if data_valid is false then capture failed
-jpg_motion_data_t* get_motion_capture(camera_config_t config);
\ No newline at end of file
+/// (NOTE: the struct and both img bufs must be freed), null if the struct could not be allocated
+jpg_motion_data_t* get_motion_capture(camera_config_t config);
+
+/// ------------------------------------------
+/// @brief Motion capture for a camera that has already been powered with power_on_camera
+/// Once both frames are held by the driver the next camera is powered up, so that its
+/// powerup delay overlaps with the buffer extraction and deinit of this camera
+///
+/// @param config config of the camera to use
+/// @param preset imaging preset to apply before capturing
+/// @param power_on_time_us timestamp returned by power_on_camera for this camera
+/// @param next_power_down_pin power down pin of the next camera to capture on, -1 if none
+/// @param[out] next_power_on_time_us timestamp the next camera was powered at, untouched if
+/// next_power_down_pin is -1. The next camera is always powered, even if this capture fails
+/// @param[out] motion filled with the two images, its img bufs must already point at buffers
+/// of img_buf_len. If data_valid is false then capture failed
+/// @param img_buf_len length of motion's img bufs, at least get_max_jpg_len of the frame size
+void get_pipelined_motion_capture(camera_config_t config,
+                                  const Camera_image_preset_t preset,
+                                  const int64_t power_on_time_us,
+                                  const int next_power_down_pin,
+                                  int64_t* next_power_on_time_us,
+                                  jpg_motion_data_t* motion,
+                                  const size_t img_buf_len);
\ No newline at end of file
@@ -5,6 +5,8 @@
 /// ------------------------------------------
 
 #include "SDSPI.h"
+#include "ff.h"
+#include "diskio_sdmmc.h"
 
 /// @brief Semaphore that holds a mutex, controlling read/write acsess to the SD card
 SemaphoreHandle_t SD_SPI_Mutex;
@@ -12,6 +14,24 @@ SemaphoreHandle_t SD_SPI_Mutex;
 /// @brief Debugging string tag
 static const char *SDSPI_TAG = "SDSPI";
 
+/// @brief Internal RAM buffer large writes are copied through, DMA capable unlike PSRAM
+static void* sd_bounce_buf = NULL;
+
+/// @brief Semaphore that holds a mutex, controlling acsess to the bounce buffer
+static SemaphoreHandle_t sd_bounce_mutex = NULL;
+
+/// @brief FatFs drive the card is mounted as, e.g. "0:", directories are read through FatFs directly
+static char sd_drive[4] = "";
+
+/// @brief State of a directory open for reading
+struct SDSPI_dir_iter_t {
+    // FatFs directory, stays open between batches
+    FF_DIR dir;
+
+    // Entry read by FatFs, holds a full long file name so is kept off the stack
+    FILINFO info;
+};
+
 ///--------------------------------------------------------
 void connect_to_SDSPI(const int miso,
                       const int mosi,
@@ -58,7 +78,7 @@ void connect_to_SDSPI(const int miso,
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
         .format_if_mount_failed = false,
         .max_files = 5,
-        .allocation_unit_size = 16 * 1024
+        .allocation_unit_size = SD_ALLOCATION_UNIT_SIZE
     };
 
     ESP_LOGI(SDSPI_TAG, "Mounting filesystem");
@@ -76,9 +96,18 @@ void connect_to_SDSPI(const int miso,
     // Connection sucsessful, set connection data
     connection->host = host;
     connection->card = card;
+    snprintf(sd_drive, sizeof(sd_drive), "%u:", ff_diskio_get_pdrv_card(card));
 
     // setup SD acsess mutex
     SD_SPI_Mutex = xSemaphoreCreateMutex();
+
+    // Allocated once, internal RAM is too fragmented later on to find a large DMA block
+    sd_bounce_mutex = xSemaphoreCreateMutex();
+    sd_bounce_buf = heap_caps_malloc(SD_WRITE_CHUNK_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (sd_bounce_buf == NULL)
+    {
+        ESP_LOGW(SDSPI_TAG, "No internal RAM for bounce buffer, large writes go straight from source");
+    }
 }
 
 ///--------------------------------------------------------
@@ -170,6 +199,94 @@ esp_err_t SDSPI_POST()
     return ESP_OK;
 }
 
+///--------------------------------------------------------
+esp_err_t fwrite_chunked_SDSPI(FILE* f,
+                               const size_t file_offset,
+                               const void* data,
+                               const size_t len,
+                               void* bounce_buf,
+                               const size_t chunk_size)
+{
+    const uint8_t* src = data;
+    size_t written = 0;
+    while (written < len)
+    {
+        // First chunk only runs up to the next boundary, all after it are whole and aligned
+        size_t chunk = chunk_size - ((file_offset + written) % chunk_size);
+        if (chunk > len - written)
+        {
+            chunk = len - written;
+        }
+
+        const void* chunk_src = src + written;
+        if (bounce_buf != NULL)
+        {
+            memcpy(bounce_buf, chunk_src, chunk);
+            chunk_src = bounce_buf;
+        }
+
+        if (fwrite(chunk_src, 1, chunk, f) != chunk)
+        {
+            ESP_LOGE(SDSPI_TAG, "Chunk write failed at %u, errno: %d", file_offset + written, errno);
+            return ESP_FAIL;
+        }
+        written += chunk;
+    }
+
+    return ESP_OK;
+}
+
+///--------------------------------------------------------
+esp_err_t write_chunked_SDSPI(FILE* f, const size_t file_offset, const void* data, const size_t len)
+{
+    if (sd_bounce_buf == NULL || !xSemaphoreTake(sd_bounce_mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    {
+        return fwrite_chunked_SDSPI(f, file_offset, data, len, NULL, SD_WRITE_CHUNK_SIZE);
+    }
+
+    esp_err_t err = fwrite_chunked_SDSPI(f, file_offset, data, len, sd_bounce_buf, SD_WRITE_CHUNK_SIZE);
+    xSemaphoreGive(sd_bounce_mutex);
+    return err;
+}
+
+///--------------------------------------------------------
+/// @brief Writes a large buffer into a file preallocated contiguously at its final size
+///
+/// @note SD mutex must be held
+///
+/// @param path to file to write data into
+/// @param data buffer of byte data
+/// @param len length of buffer to write
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t write_preallocated_SDSPI(const char* path, const void* data, const size_t len)
+{
+    // Preallocation only works on an empty file
+    unlink(path);
+    esp_err_t err = esp_vfs_fat_create_contiguous_file(MOUNT_POINT, path, len, true);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(SDSPI_TAG, "Failed to preallocate %s, %s", path, esp_err_to_name(err));
+        return err;
+    }
+
+    FILE *f = fopen(path, "r+b");
+    if (f == NULL) {
+        ESP_LOGE(SDSPI_TAG, "Failed to open file for writing, errno: %d", errno);
+        return ESP_FAIL;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+
+    err = write_chunked_SDSPI(f, 0, data, len);
+    fclose(f);
+
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(SDSPI_TAG, "File written, %u bytes preallocated", len);
+    }
+    return err;
+}
+
 ///--------------------------------------------------------
 esp_err_t write_data_SDSPI(const char* path, const void* data, const size_t len)
 {
@@ -179,6 +296,14 @@ esp_err_t write_data_SDSPI(const char* path, const void* data, const size_t len)
         return ESP_FAIL;
     }
 
+    if (len >= SD_CHUNKED_WRITE_MIN_LEN)
+    {
+        ESP_LOGI(SDSPI_TAG, "Opening file %s", path);
+        esp_err_t err = write_preallocated_SDSPI(path, data, len);
+        xSemaphoreGive(SD_SPI_Mutex);
+        return err;
+    }
+
     ESP_LOGI(SDSPI_TAG, "Opening file %s", path);
     FILE *f = fopen(path, "wb");
     if (f == NULL) {
@@ -204,6 +329,36 @@ esp_err_t write_data_SDSPI(const char* path, const void* data, const size_t len)
     }
 }
 
+///--------------------------------------------------------
+esp_err_t append_data_SDSPI(const char* path, const void* data, const size_t len)
+{
+    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    {
+        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(SDSPI_TAG, "Opening file %s", path);
+    FILE *f = fopen(path, "ab");
+    if (f == NULL) {
+        xSemaphoreGive(SD_SPI_Mutex);
+        ESP_LOGE(SDSPI_TAG, "Failed to open file for appending, errno: %d", errno);
+        return ESP_FAIL;
+    }
+
+    size_t write_bytes = fwrite(data, 1, len, f);
+    fclose(f);
+
+    xSemaphoreGive(SD_SPI_Mutex);
+
+    if (write_bytes != len)
+    {
+        ESP_LOGE(SDSPI_TAG, "Append incomplete, %u of %u bytes", write_bytes, len);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 ///--------------------------------------------------------
 esp_err_t write_text_SDSPI(const char* path, const char* text)
 {
@@ -322,6 +477,68 @@ long fsize_SDSPI(const char* path)
     }
 }
 
+///--------------------------------------------------------
+esp_err_t stat_SDSPI(const char* path, size_t* size_out, bool* is_dir_out)
+{
+    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    {
+        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        return ESP_FAIL;
+    }
+
+    struct stat sb;
+    int ret = stat(path, &sb);
+    xSemaphoreGive(SD_SPI_Mutex);
+
+    if (ret != 0)
+    {
+        return errno == ENOENT ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+    }
+
+    *is_dir_out = S_ISDIR(sb.st_mode);
+    *size_out = *is_dir_out ? 0 : sb.st_size;
+    return ESP_OK;
+}
+
+///--------------------------------------------------------
+esp_err_t space_SDSPI(uint64_t* total_out, uint64_t* free_out)
+{
+    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    {
+        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = esp_vfs_fat_info(MOUNT_POINT, total_out, free_out);
+    xSemaphoreGive(SD_SPI_Mutex);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(SDSPI_TAG, "Failed to get card space, %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+///--------------------------------------------------------
+esp_err_t rename_SDSPI(const char* from, const char* to)
+{
+    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    {
+        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        return ESP_FAIL;
+    }
+
+    int ret = rename(from, to);
+    xSemaphoreGive(SD_SPI_Mutex);
+
+    if (ret != 0)
+    {
+        ESP_LOGE(SDSPI_TAG, "Failed to rename %s to %s, errno: %d", from, to, errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 ///--------------------------------------------------------
 esp_err_t delete_file_SDSPI(const char* path)
 {
@@ -442,84 +659,166 @@ esp_err_t delete_dir_SDSPI(const char* path)
 }
 
 ///--------------------------------------------------------
-void get_filenm_in_dir_SDSPI(const char* path, const size_t dir_num, char* name_out)
+esp_err_t open_dir_iter_SDSPI(const char* path, SDSPI_dir_iter_t** iter_out)
 {
+    size_t mount_len = strlen(MOUNT_POINT);
+    if (strncmp(path, MOUNT_POINT, mount_len) != 0 || sd_drive[0] == '\0')
+    {
+        ESP_LOGE(SDSPI_TAG, "Cannot iterate %s, not on a mounted card", path);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char ff_path[FILENAME_MAX_SIZE];
+    snprintf(ff_path, sizeof(ff_path), "%s%s", sd_drive, path + mount_len);
+
+    SDSPI_dir_iter_t* iter = malloc(sizeof(SDSPI_dir_iter_t));
+    if (iter == NULL)
+    {
+        ESP_LOGE(SDSPI_TAG, "Failed to allocate directory iterator");
+        return ESP_ERR_NO_MEM;
+    }
+
     if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
     {
         ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        free(iter);
+        return ESP_ERR_TIMEOUT;
     }
 
-    ESP_LOGI(SDSPI_TAG, "Getting file %u from dir %s", dir_num, path);
+    FRESULT res = f_opendir(&iter->dir, ff_path);
+    xSemaphoreGive(SD_SPI_Mutex);
 
-    DIR* dir = opendir(path);
-    if (dir == NULL)
+    if (res != FR_OK)
     {
-        ESP_LOGE(SDSPI_TAG, "Failed to open directory, errno: %d", errno);
-        name_out = NULL;
-        return;
+        ESP_LOGE(SDSPI_TAG, "Failed to open directory %s, FatFs error: %d", path, res);
+        free(iter);
+        return (res == FR_NO_PATH || res == FR_NO_FILE) ? ESP_ERR_NOT_FOUND : ESP_FAIL;
     }
 
-    struct dirent* entry;
-    struct dirent* nth_entry = NULL;
-    size_t num = 0;
-    while((entry = readdir(dir)) != NULL)
+    *iter_out = iter;
+    return ESP_OK;
+}
+
+///--------------------------------------------------------
+esp_err_t read_dir_iter_SDSPI(SDSPI_dir_iter_t* iter, SDSPI_dir_entry_t* entries, const size_t max, size_t* count_out)
+{
+    *count_out = 0;
+    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    {
+        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t err = ESP_OK;
+    while (*count_out < max)
     {
-        // Filter "." and "..", strcmp returns 0 on equal
-        bool not_filelinks = strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0;
-        if (num == dir_num && not_filelinks)
+        FRESULT res = f_readdir(&iter->dir, &iter->info);
+        if (res != FR_OK)
         {
-            nth_entry = entry;
+            ESP_LOGE(SDSPI_TAG, "Failed to read directory, FatFs error: %d", res);
+            err = ESP_FAIL;
             break;
         }
 
-        if (not_filelinks)
+        // An empty name marks the end of the directory, FatFs never returns "." and ".."
+        if (iter->info.fname[0] == '\0')
         {
-            num++;
+            break;
+        }
+
+        if (strlen(iter->info.fname) >= SD_DIR_NAME_MAX)
+        {
+            ESP_LOGW(SDSPI_TAG, "Skipping %s, name too long", iter->info.fname);
+            continue;
         }
+
+        SDSPI_dir_entry_t* entry = &entries[(*count_out)++];
+        strcpy(entry->name, iter->info.fname);
+        entry->is_dir = (iter->info.fattrib & AM_DIR) != 0;
+        entry->size = entry->is_dir ? 0 : iter->info.fsize;
     }
 
-    closedir(dir);
     xSemaphoreGive(SD_SPI_Mutex);
+    return err;
+}
 
-    if (nth_entry == NULL)
+///--------------------------------------------------------
+void close_dir_iter_SDSPI(SDSPI_dir_iter_t* iter)
+{
+    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
     {
-        ESP_LOGI(SDSPI_TAG, "File %u not found", dir_num);
-        name_out = NULL;
+        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
     }
     else
     {
-        ESP_LOGI(SDSPI_TAG, "File %u found: %s", dir_num, nth_entry->d_name);
-        strcpy(name_out, nth_entry->d_name);
+        f_closedir(&iter->dir);
+        xSemaphoreGive(SD_SPI_Mutex);
     }
+    free(iter);
 }
 
 ///--------------------------------------------------------
-void print_dir_content_in_info_SDSPI(const char* path)
+esp_err_t get_filenm_in_dir_SDSPI(const char* path, const size_t dir_num, char* name_out)
 {
-    if (!xSemaphoreTake(SD_SPI_Mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS)))
+    ESP_LOGI(SDSPI_TAG, "Getting file %u from dir %s", dir_num, path);
+
+    SDSPI_dir_iter_t* iter;
+    esp_err_t err = open_dir_iter_SDSPI(path, &iter);
+    if (err != ESP_OK)
     {
-        ESP_LOGE(SDSPI_TAG, "Unable to grab SD mutex!");
+        return err;
     }
 
+    SDSPI_dir_entry_t entries[SD_DIR_BATCH_LEN];
+    size_t num = 0;
+    size_t count;
+    err = ESP_ERR_NOT_FOUND;
+    while (read_dir_iter_SDSPI(iter, entries, SD_DIR_BATCH_LEN, &count) == ESP_OK && count > 0)
+    {
+        if (dir_num < num + count)
+        {
+            strcpy(name_out, entries[dir_num - num].name);
+            err = ESP_OK;
+            break;
+        }
+        num += count;
+    }
+    close_dir_iter_SDSPI(iter);
+
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(SDSPI_TAG, "File %u found: %s", dir_num, name_out);
+    }
+    else
+    {
+        ESP_LOGI(SDSPI_TAG, "File %u not found", dir_num);
+    }
+    return err;
+}
+
+///--------------------------------------------------------
+void print_dir_content_in_info_SDSPI(const char* path)
+{
     ESP_LOGI(SDSPI_TAG, "Reading dir contents %s", path);
 
-    DIR* dir = opendir(path);
-    if (dir == NULL)
+    SDSPI_dir_iter_t* iter;
+    if (open_dir_iter_SDSPI(path, &iter) != ESP_OK)
     {
-        xSemaphoreGive(SD_SPI_Mutex);
-        ESP_LOGE(SDSPI_TAG, "Failed to open directory, errno: %d", errno);
         return;
     }
 
-    struct dirent* entry;
-    size_t count = 0;
-    while((entry = readdir(dir)) != NULL)
+    // Logged outside of the SD mutex, logging is slow
+    SDSPI_dir_entry_t entries[SD_DIR_BATCH_LEN];
+    size_t num = 0;
+    size_t count;
+    while (read_dir_iter_SDSPI(iter, entries, SD_DIR_BATCH_LEN, &count) == ESP_OK && count > 0)
     {
-        ESP_LOGI(SDSPI_TAG, "%u: %s", count++, entry->d_name);
+        for (size_t i = 0; i < count; i++)
+        {
+            ESP_LOGI(SDSPI_TAG, "%u: %s", num++, entries[i].name);
+        }
     }
-
-    closedir(dir);
-    xSemaphoreGive(SD_SPI_Mutex);
+    close_dir_iter_SDSPI(iter);
 }
 
 ///--------------------------------------------------------
@@ -548,23 +847,3 @@ bool check_file_SDSPI(const char* path)
     ESP_LOGI(SDSPI_TAG, "Found %s", path);
     return true;
 }
-
-///--------------------------------------------------------
-size_t get_next_capture_num()
-{
-    char *capture_dir = malloc(32);
-
-    bool dir_exists = true;
-    size_t num = 0;
-    while(dir_exists)
-    {
-        num++;
-        sprintf(capture_dir,  MOUNT_POINT"/"CAPTURE_DIR_PREFIX"%u", num);
-        dir_exists = check_dir_SDSPI(capture_dir);
-    }
-
-    free(capture_dir);
-
-    ESP_LOGI(SDSPI_TAG, "Next capture number is: %u", num);
-    return num;
-}
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "sdmmc_cmd.h"
 #include "esp_mac.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
@@ -46,6 +47,15 @@
 /// @brief prefix for the directories for all captures made by the camera
 #define CAPTURE_DIR_PREFIX "CAPTURE"
 
+/// @brief Allocation unit the card is mounted with, files are allocated in clusters of this size
+#define SD_ALLOCATION_UNIT_SIZE (16 * 1024)
+
+/// @brief Size of the chunks large writes are split into, chunks are aligned to this within the file
+#define SD_WRITE_CHUNK_SIZE (CONFIG_SD_WRITE_CHUNK_KB * 1024)
+
+/// @brief Writes at least this long are preallocated and written in chunks
+#define SD_CHUNKED_WRITE_MIN_LEN SD_WRITE_CHUNK_SIZE
+
 /// @brief Maximum wait allowed for using SD SPI functions
 #define MAX_SD_WAIT_MS (30 * 1000)
 
@@ -53,6 +63,28 @@
 /// @brief Max length allowed for a filename under unix
 #define FILENAME_MAX_SIZE 256
 
+/// @brief Max length of a name read by the directory iterator, including null terminator,
+/// longer names are skipped
+#define SD_DIR_NAME_MAX 64
+
+/// @brief Entries read per batch when a whole directory is walked, 16 entries is ~1 KB of stack
+#define SD_DIR_BATCH_LEN 16
+
+/// @brief A directory entry read by read_dir_iter_SDSPI
+typedef struct {
+    // Name of the entry, relative to the directory
+    char name[SD_DIR_NAME_MAX];
+
+    // Size in bytes, 0 for directories
+    size_t size;
+
+    // Is this a directory?
+    bool is_dir;
+} SDSPI_dir_entry_t;
+
+/// @brief A directory open for reading in batches, see open_dir_iter_SDSPI
+typedef struct SDSPI_dir_iter_t SDSPI_dir_iter_t;
+
 /// @brief Stores the needed comms info for a SDSPI reader connection
 /// Card should be considered the active indicator,
 /// functions will null this to indicate error or to invalidate connections
@@ -98,6 +130,9 @@ esp_err_t SDSPI_POST();
 ///--------------------------------------------------------
 /// @brief Writes a binary buffer to given filepath
 ///
+/// @note Buffers of at least SD_CHUNKED_WRITE_MIN_LEN are preallocated contiguously at their
+/// final size and written in cluster aligned chunks
+///
 /// @param path to file to write data into, root is '/sdcard'
 /// @param data buffer of byte data
 /// @param len length of buffer to write
@@ -105,6 +140,51 @@ esp_err_t SDSPI_POST();
 /// @return ESP_OK if sucsessful
 esp_err_t write_data_SDSPI(const char* path, const void* data, const size_t len);
 
+///--------------------------------------------------------
+/// @brief Writes a buffer at the current position of an open file in chunks aligned to
+/// chunk_size within the file, so whole clusters go to the card in multi block writes
+///
+/// @note Buffers in PSRAM cannot be sent by SPI DMA directly, the driver otherwise copies them a
+/// sector at a time. File should be unbuffered (_IONBF) so chunks go straight to FatFs.
+///
+/// @param f open file, positioned at file_offset
+/// @param file_offset current position in the file
+/// @param data buffer of byte data
+/// @param len length of buffer to write
+/// @param bounce_buf DMA capable buffer of at least chunk_size each chunk is copied through, null
+/// to write straight from data
+/// @param chunk_size size and alignment of each chunk
+///
+/// @return ESP_OK if sucsessful
+esp_err_t fwrite_chunked_SDSPI(FILE* f,
+                               const size_t file_offset,
+                               const void* data,
+                               const size_t len,
+                               void* bounce_buf,
+                               const size_t chunk_size);
+
+///--------------------------------------------------------
+/// @brief Writes a buffer at the current position of an open file in SD_WRITE_CHUNK_SIZE chunks
+/// through the shared internal RAM bounce buffer
+///
+/// @param f open file, positioned at file_offset
+/// @param file_offset current position in the file
+/// @param data buffer of byte data
+/// @param len length of buffer to write
+///
+/// @return ESP_OK if sucsessful
+esp_err_t write_chunked_SDSPI(FILE* f, const size_t file_offset, const void* data, const size_t len);
+
+///--------------------------------------------------------
+/// @brief Appends a binary buffer to the given filepath, creating the file if missing
+///
+/// @param path to file to append data to, root is '/sdcard'
+/// @param data buffer of byte data
+/// @param len length of buffer to write
+///
+/// @return ESP_OK if sucsessful
+esp_err_t append_data_SDSPI(const char* path, const void* data, const size_t len);
+
 ///--------------------------------------------------------
 /// @brief Writes a string to the given filepath, if file exists then text will be
 /// appended.
@@ -145,6 +225,36 @@ esp_err_t read_text_SDSPI(const char* path, char* out_text, const size_t len);
 /// @return size in bytes, read fail will return negative
 long fsize_SDSPI(const char* path);
 
+///--------------------------------------------------------
+/// @brief Gets the size and type of the file or directory at the path
+///
+/// @param path to stat, root is '/sdcard'
+/// @param[out] size_out size in bytes
+/// @param[out] is_dir_out is the path a directory?
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NOT_FOUND if the path does not exist
+esp_err_t stat_SDSPI(const char* path, size_t* size_out, bool* is_dir_out);
+
+///--------------------------------------------------------
+/// @brief Gets the size and free space of the card
+///
+/// @note Can scan the whole FAT if the card's free cluster count is not cached, avoid on the capture path
+///
+/// @param[out] total_out size of the FAT volume in bytes
+/// @param[out] free_out free bytes on the volume
+///
+/// @return ESP_OK if sucsessful
+esp_err_t space_SDSPI(uint64_t* total_out, uint64_t* free_out);
+
+///--------------------------------------------------------
+/// @brief Renames a file or directory
+///
+/// @param from current path, root is '/sdcard'
+/// @param to new path, must not exist
+///
+/// @return ESP_OK if sucsessful
+esp_err_t rename_SDSPI(const char* from, const char* to);
+
 ///--------------------------------------------------------
 /// @brief Deletes the file at the given path
 ///
@@ -180,15 +290,49 @@ esp_err_t create_dir_SDSPI(const char* path);
 esp_err_t delete_dir_SDSPI(const char* path);
 
 ///--------------------------------------------------------
-/// @brief Get the name of the nth file in a directory
-/// Returns null if there is no nth file, count starts at 0
+/// @brief Opens a directory for reading its entries in batches with read_dir_iter_SDSPI
+///
+/// @note Entries are read straight from FatFs, so sizes and types come from the directory
+/// itself rather than a stat per entry, which searches the directory again each time
+///
+/// @param path to the directory, root is '/sdcard'
+/// @param[out] iter_out opened directory, close with close_dir_iter_SDSPI
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NOT_FOUND if the directory does not exist
+esp_err_t open_dir_iter_SDSPI(const char* path, SDSPI_dir_iter_t** iter_out);
+
+///--------------------------------------------------------
+/// @brief Reads the next batch of entries from an open directory
+///
+/// @note The SD mutex is only held for the batch, so writers are not starved whilst a large
+/// directory is listed. Entries added or removed between batches may or may not be seen.
+///
+/// @param iter directory to read
+/// @param[out] entries array of at least max entries to fill
+/// @param max number of entries to read
+/// @param[out] count_out number of entries read, 0 once the directory has been read
+///
+/// @return ESP_OK if sucsessful
+esp_err_t read_dir_iter_SDSPI(SDSPI_dir_iter_t* iter, SDSPI_dir_entry_t* entries, const size_t max, size_t* count_out);
+
+///--------------------------------------------------------
+/// @brief Closes a directory opened with open_dir_iter_SDSPI
+///
+/// @param iter directory to close
+void close_dir_iter_SDSPI(SDSPI_dir_iter_t* iter);
+
+///--------------------------------------------------------
+/// @brief Get the name of the nth file in a directory, count starts at 0
 ///
-/// @note "." and ".." are filtered and are not counted when finding nth file
+/// @note "." and ".." are filtered and are not counted when finding nth file. Reads the
+/// directory up to the nth entry on every call, use the directory iterator to list a directory
 ///
 /// @param path to the directory
 /// @param dir_num the number of the file to find
-/// @param name_out output ptr to place the name into, should be sized to FILENAME_MAX_SIZE
-void get_filenm_in_dir_SDSPI(const char* path, const size_t dir_num, char* name_out);
+/// @param name_out output ptr to place the name into, should be sized to SD_DIR_NAME_MAX
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NOT_FOUND if there is no nth file
+esp_err_t get_filenm_in_dir_SDSPI(const char* path, const size_t dir_num, char* name_out);
 
 ///--------------------------------------------------------
 /// @brief Check if a file exists
@@ -203,8 +347,3 @@ bool check_file_SDSPI(const char* path);
 ///
 /// @param path to print contents
 void print_dir_content_in_info_SDSPI(const char* path);
-
-///--------------------------------------------------------
-/// @brief Finds the next avalible number of capture to be written
-/// @return next avalible number
-size_t get_next_capture_num();
\ No newline at end of file
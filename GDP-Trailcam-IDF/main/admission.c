@@ -0,0 +1,303 @@
+/// ------------------------------------------
+/// @file admission.c
+///
+/// @brief Source file for admission control in front of the processing pipeline
+/// ------------------------------------------
+
+#include "admission.h"
+
+/// @brief Debugging string tag
+static const char* ADMISSION_TAG = "admission";
+
+/// @brief Event bit set whilst no captures are waiting or being submitted
+#define ADMISSION_IDLE_BIT BIT0
+
+/// @brief A capture waiting for the pipeline
+typedef struct
+{
+    // Item offered
+    void* item;
+
+    // Score it was offered with
+    uint32_t score;
+
+    // Order it was offered in, breaks ties in favour of the oldest
+    uint32_t seq;
+} admission_entry_t;
+
+/// @brief Waiting captures, unordered as there are only ever a few to scan
+static admission_entry_t pending[ADMISSION_MAX_PENDING];
+
+/// @brief Number of waiting captures
+static size_t pending_len = 0;
+
+/// @brief Captures that can wait
+static size_t pending_capacity = 0;
+
+/// @brief Is the feeder submitting a capture?
+static bool feeding = false;
+
+/// @brief Next entry seq
+static uint32_t next_seq = 0;
+
+/// @brief Counters, protected by admission_mutex
+static admission_stats_t stats;
+
+/// @brief Protects everything above
+static SemaphoreHandle_t admission_mutex = NULL;
+
+/// @brief Counts the waiting captures, taken by the feeder
+static SemaphoreHandle_t pending_count = NULL;
+
+/// @brief Holds ADMISSION_IDLE_BIT
+static EventGroupHandle_t admission_events = NULL;
+
+/// @brief Pipeline admitted captures are submitted to
+static pipeline_t* target_pipeline = NULL;
+
+/// @brief Called with every capture shed
+static admission_shed_fn_t shed_fn = NULL;
+
+/// ------------------------------------------
+/// @brief Finds the waiting capture to submit next, the highest score then the oldest
+///
+/// @return index into pending, pending_len must be above 0
+static size_t find_best()
+{
+    size_t best = 0;
+    for (size_t i = 1; i < pending_len; i++)
+    {
+        if (pending[i].score > pending[best].score ||
+            (pending[i].score == pending[best].score && pending[i].seq < pending[best].seq))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/// ------------------------------------------
+/// @brief Finds the waiting capture to shed first, the lowest score then the newest
+///
+/// @return index into pending, pending_len must be above 0
+static size_t find_worst()
+{
+    size_t worst = 0;
+    for (size_t i = 1; i < pending_len; i++)
+    {
+        if (pending[i].score < pending[worst].score ||
+            (pending[i].score == pending[worst].score && pending[i].seq > pending[worst].seq))
+        {
+            worst = i;
+        }
+    }
+    return worst;
+}
+
+/// ------------------------------------------
+/// @brief Counts a shed capture, admission_mutex must be held
+///
+/// @param score of the shed capture
+static void note_shed(const uint32_t score)
+{
+    stats.shed++;
+    if (score > stats.max_shed_score)
+    {
+        stats.max_shed_score = score;
+    }
+}
+
+/// ------------------------------------------
+/// @brief Feeder task, submits the best waiting capture whenever the pipeline takes one
+static void admission_feeder_task()
+{
+    while (1)
+    {
+        xSemaphoreTake(pending_count, portMAX_DELAY);
+
+        xSemaphoreTake(admission_mutex, portMAX_DELAY);
+        size_t best = find_best();
+        admission_entry_t entry = pending[best];
+        pending[best] = pending[--pending_len];
+        feeding = true;
+        xSemaphoreGive(admission_mutex);
+
+        // Blocks whilst the first stage is full, captures offered meanwhile compete for the next turn
+        pipeline_submit(target_pipeline, entry.item, portMAX_DELAY);
+
+        xSemaphoreTake(admission_mutex, portMAX_DELAY);
+        feeding = false;
+        stats.admitted++;
+        if (pending_len == 0)
+        {
+            xEventGroupSetBits(admission_events, ADMISSION_IDLE_BIT);
+        }
+        xSemaphoreGive(admission_mutex);
+    }
+}
+
+/// ------------------------------------------
+esp_err_t admission_start(pipeline_t* pipeline, const size_t capacity, admission_shed_fn_t shed_cb)
+{
+    if (admission_mutex != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (pipeline == NULL || capacity == 0 || capacity > ADMISSION_MAX_PENDING)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pending_count = xSemaphoreCreateCounting(ADMISSION_MAX_PENDING, 0);
+    admission_events = xEventGroupCreate();
+    admission_mutex = xSemaphoreCreateMutex();
+    if (pending_count == NULL || admission_events == NULL || admission_mutex == NULL)
+    {
+        ESP_LOGE(ADMISSION_TAG, "Failed to allocate admission");
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(admission_events, ADMISSION_IDLE_BIT);
+
+    target_pipeline = pipeline;
+    pending_capacity = capacity;
+    shed_fn = shed_cb;
+
+    if (xTaskCreatePinnedToCore(admission_feeder_task, "Admission feeder", 1024 * 3, NULL, 5, NULL, 0) != pdPASS)
+    {
+        ESP_LOGE(ADMISSION_TAG, "Failed to start feeder task");
+        vSemaphoreDelete(admission_mutex);
+        admission_mutex = NULL;
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(ADMISSION_TAG, "Admitting up to %u waiting captures", capacity);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t admission_offer(void* item, const uint32_t score)
+{
+    if (admission_mutex == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    void* shed_item = NULL;
+    uint32_t shed_score = 0;
+
+    xSemaphoreTake(admission_mutex, portMAX_DELAY);
+    stats.offered++;
+
+    admission_entry_t entry = {
+        .item = item,
+        .score = score,
+        .seq = next_seq++,
+    };
+
+    bool admitted = true;
+    if (pending_len < pending_capacity)
+    {
+        pending[pending_len++] = entry;
+        xEventGroupClearBits(admission_events, ADMISSION_IDLE_BIT);
+    }
+    else
+    {
+        // Full, whichever of the offered and the least significant waiting capture scores lower goes
+        size_t worst = find_worst();
+        if (pending[worst].score < score)
+        {
+            shed_item = pending[worst].item;
+            shed_score = pending[worst].score;
+            pending[worst] = entry;
+        }
+        else
+        {
+            shed_item = item;
+            shed_score = score;
+            admitted = false;
+        }
+        note_shed(shed_score);
+    }
+
+    if (pending_len > stats.max_pending)
+    {
+        stats.max_pending = pending_len;
+    }
+    xSemaphoreGive(admission_mutex);
+
+    // Replacing a waiting capture leaves the count as it was
+    if (admitted && shed_item == NULL)
+    {
+        xSemaphoreGive(pending_count);
+    }
+
+    if (shed_item != NULL)
+    {
+        ESP_LOGW(ADMISSION_TAG, "Pipeline saturated, shedding capture with score %lu", shed_score);
+        if (shed_fn != NULL)
+        {
+            shed_fn(shed_item, shed_score);
+        }
+    }
+
+    return admitted ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+/// ------------------------------------------
+esp_err_t admission_shed_lowest()
+{
+    // Every token is a waiting capture the feeder has not claimed, without one there is nothing to take
+    if (pending_count == NULL || xSemaphoreTake(pending_count, 0) != pdTRUE)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(admission_mutex, portMAX_DELAY);
+    size_t worst = find_worst();
+    admission_entry_t entry = pending[worst];
+    pending[worst] = pending[--pending_len];
+    note_shed(entry.score);
+    if (pending_len == 0 && feeding == false)
+    {
+        xEventGroupSetBits(admission_events, ADMISSION_IDLE_BIT);
+    }
+    xSemaphoreGive(admission_mutex);
+
+    ESP_LOGW(ADMISSION_TAG, "Making room, shedding capture with score %lu", entry.score);
+    if (shed_fn != NULL)
+    {
+        shed_fn(entry.item, entry.score);
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t admission_wait_idle(const TickType_t wait)
+{
+    if (admission_events == NULL)
+    {
+        return ESP_OK;
+    }
+
+    if (xEventGroupWaitBits(admission_events, ADMISSION_IDLE_BIT, pdFALSE, pdFALSE, wait) & ADMISSION_IDLE_BIT)
+    {
+        return ESP_OK;
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+/// ------------------------------------------
+void admission_get_stats(admission_stats_t* stats_out)
+{
+    if (admission_mutex == NULL)
+    {
+        memset(stats_out, 0, sizeof(admission_stats_t));
+        return;
+    }
+
+    xSemaphoreTake(admission_mutex, portMAX_DELAY);
+    *stats_out = stats;
+    stats_out->pending = pending_len;
+    xSemaphoreGive(admission_mutex);
+}
@@ -0,0 +1,100 @@
+/// ------------------------------------------
+/// @file admission.h
+///
+/// @brief Header file for admission control in front of the processing pipeline, keeps
+/// the most significant captures of a burst waiting and sheds the rest
+///
+/// @note Captures are offered with a cheap score taken when they are captured. Up to the
+/// admission capacity wait here, and a feeder task hands the highest scoring one to the
+/// pipeline whenever its first stage has room. Offering to a full admission sheds the
+/// lowest scoring capture, which may be the one offered. So whilst the pipeline is
+/// saturated the processing time goes to the captures with the most motion, rather than
+/// to whichever arrived first.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "pipeline.h"
+
+/// @brief Most captures that can wait for the pipeline
+#define ADMISSION_MAX_PENDING 8
+
+/// @brief Called with every capture shed, it is never passed to the pipeline
+///
+/// @param item that was offered
+/// @param score it was offered with
+typedef void (*admission_shed_fn_t)(void* item, const uint32_t score);
+
+/// @brief Counters since admission was started
+typedef struct
+{
+    // Captures offered
+    uint32_t offered;
+
+    // Captures passed on to the pipeline
+    uint32_t admitted;
+
+    // Captures shed
+    uint32_t shed;
+
+    // Highest score of a shed capture, how significant the work turned away was
+    uint32_t max_shed_score;
+
+    // Captures waiting now
+    size_t pending;
+
+    // Most captures seen waiting at once
+    size_t max_pending;
+} admission_stats_t;
+
+///--------------------------------------------------------
+/// @brief Starts the feeder task passing admitted captures on to a pipeline
+///
+/// @param pipeline admitted captures are submitted to
+/// @param capacity captures that can wait, at most ADMISSION_MAX_PENDING
+/// @param shed_cb called with every capture shed, from the task that offered
+///
+/// @return ESP_OK if sucsessful
+esp_err_t admission_start(pipeline_t* pipeline, const size_t capacity, admission_shed_fn_t shed_cb);
+
+///--------------------------------------------------------
+/// @brief Offers a capture for processing, never blocks
+///
+/// @note If admission is full either this capture or the lowest scoring waiting capture
+/// is shed before returning, equal scores keep the capture that was waiting
+///
+/// @param item to process, handed to the pipeline as is
+/// @param score of the capture, higher is more significant
+///
+/// @return ESP_OK if the capture is waiting, ESP_ERR_NOT_FOUND if it was shed,
+/// ESP_ERR_INVALID_STATE if admission was not started and nothing was done with it
+esp_err_t admission_offer(void* item, const uint32_t score);
+
+///--------------------------------------------------------
+/// @brief Sheds the lowest scoring waiting capture, to free what it holds for a new capture
+///
+/// @return ESP_OK if a capture was shed, ESP_ERR_NOT_FOUND if none were waiting
+esp_err_t admission_shed_lowest();
+
+///--------------------------------------------------------
+/// @brief Waits until every admitted capture has been submitted to the pipeline
+///
+/// @param wait maximum ticks to wait
+///
+/// @return ESP_OK if nothing is waiting, ESP_ERR_TIMEOUT otherwise
+esp_err_t admission_wait_idle(const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Gets the counters since admission was started
+///
+/// @param[out] stats_out filled with the counters
+void admission_get_stats(admission_stats_t* stats_out);
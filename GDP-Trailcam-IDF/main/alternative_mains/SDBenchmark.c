@@ -0,0 +1,196 @@
+/// ------------------------------------------
+/// @file main.c
+///
+/// @brief SD card write throughput benchmark, sweeps file size, chunk size, buffer
+/// placement and preallocation and reports MB/s for each
+///
+/// @note Swap in for main.c to run, results are logged and appended to SDBENCH.CSV
+/// on the card. tools/sd_bench_host.c runs the same sweep against a host file.
+/// ------------------------------------------
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "SDSPI.h"
+
+static const char *MAIN_TAG = "main";
+
+SDSPI_connection_t connection;
+
+/// @brief File the benchmark writes to
+#define BENCH_FILE MOUNT_POINT"/BENCH.BIN"
+
+/// @brief File the results are appended to
+#define BENCH_RESULTS_FILE MOUNT_POINT"/SDBENCH.CSV"
+
+/// @brief Times each configuration is repeated, the mean is reported
+#define BENCH_REPEATS 3
+
+static const size_t file_sizes[] = {256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+static const size_t chunk_sizes[] = {4 * 1024, 8 * 1024, 16 * 1024, 32 * 1024, 64 * 1024};
+
+/// @brief Ways the source buffer reaches the card
+typedef enum
+{
+    // One fwrite of the whole buffer with default stdio buffering, as write_data_SDSPI used to
+    PLACEMENT_STDIO,
+
+    // Chunks written straight from PSRAM
+    PLACEMENT_PSRAM,
+
+    // Chunks copied through an internal RAM DMA buffer
+    PLACEMENT_INTERNAL_BOUNCE,
+
+    PLACEMENT_COUNT
+} bench_placement_t;
+
+static const char* placement_names[PLACEMENT_COUNT] = {"stdio", "psram", "bounce"};
+
+/// ------------------------------------------
+/// @brief Writes the benchmark file once
+///
+/// @param src source buffer in PSRAM
+/// @param file_size bytes to write
+/// @param chunk_size chunk size, unused for PLACEMENT_STDIO
+/// @param placement how the buffer is written
+/// @param bounce internal RAM buffer of at least chunk_size
+/// @param preallocate preallocate the file contiguously first?
+///
+/// @return time taken in us, negative on failure
+static int64_t bench_write(const uint8_t* src,
+                           const size_t file_size,
+                           const size_t chunk_size,
+                           const bench_placement_t placement,
+                           void* bounce,
+                           const bool preallocate)
+{
+    unlink(BENCH_FILE);
+
+    int64_t start_time = esp_timer_get_time();
+
+    FILE* f = NULL;
+    if (preallocate)
+    {
+        if (esp_vfs_fat_create_contiguous_file(MOUNT_POINT, BENCH_FILE, file_size, true) != ESP_OK)
+        {
+            return -1;
+        }
+        f = fopen(BENCH_FILE, "r+b");
+    }
+    else
+    {
+        f = fopen(BENCH_FILE, "wb");
+    }
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (placement == PLACEMENT_STDIO)
+    {
+        err = fwrite(src, 1, file_size, f) == file_size ? ESP_OK : ESP_FAIL;
+    }
+    else
+    {
+        setvbuf(f, NULL, _IONBF, 0);
+        err = fwrite_chunked_SDSPI(f, 0, src, file_size,
+                                   placement == PLACEMENT_INTERNAL_BOUNCE ? bounce : NULL, chunk_size);
+    }
+
+    fsync(fileno(f));
+    fclose(f);
+
+    if (err != ESP_OK)
+    {
+        return -1;
+    }
+    return esp_timer_get_time() - start_time;
+}
+
+void app_main(void)
+{
+    ESP_LOGI(MAIN_TAG, "Starting SDSPI comms.");
+    connect_to_SDSPI(PIN_NUM_MISO, PIN_NUM_MOSI, PIN_NUM_CLK, PIN_NUM_CS, &connection);
+    if (connection.card == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start SDSPI");
+        return;
+    }
+
+    size_t max_file_size = file_sizes[sizeof(file_sizes) / sizeof(file_sizes[0]) - 1];
+    size_t max_chunk_size = chunk_sizes[sizeof(chunk_sizes) / sizeof(chunk_sizes[0]) - 1];
+
+    uint8_t* src = heap_caps_malloc(max_file_size, MALLOC_CAP_SPIRAM);
+    void* bounce = heap_caps_malloc(max_chunk_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (src == NULL || bounce == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to allocate benchmark buffers");
+        return;
+    }
+
+    // Incompressible-ish data, some cards special case runs of 0x00/0xFF
+    for (size_t i = 0; i < max_file_size; i++)
+    {
+        src[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+
+    write_text_SDSPI(BENCH_RESULTS_FILE, "file_bytes,chunk_bytes,placement,preallocated,mb_per_s\n");
+
+    for (size_t fi = 0; fi < sizeof(file_sizes) / sizeof(file_sizes[0]); fi++)
+    {
+        for (size_t ci = 0; ci < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ci++)
+        {
+            for (int placement = 0; placement < PLACEMENT_COUNT; placement++)
+            {
+                // Stdio ignores the chunk size, only measure it once per file size
+                if (placement == PLACEMENT_STDIO && ci > 0)
+                {
+                    continue;
+                }
+
+                for (int preallocate = 0; preallocate <= 1; preallocate++)
+                {
+                    int64_t total_us = 0;
+                    bool failed = false;
+                    for (int r = 0; r < BENCH_REPEATS; r++)
+                    {
+                        int64_t us = bench_write(src, file_sizes[fi], chunk_sizes[ci], placement,
+                                                 bounce, preallocate);
+                        if (us < 0)
+                        {
+                            failed = true;
+                            break;
+                        }
+                        total_us += us;
+                    }
+
+                    if (failed)
+                    {
+                        ESP_LOGE(MAIN_TAG, "%u bytes, %u chunk, %s, prealloc %i: failed",
+                                 file_sizes[fi], chunk_sizes[ci], placement_names[placement], preallocate);
+                        continue;
+                    }
+
+                    // bytes/us is MB/s
+                    float mb_per_s = (float)file_sizes[fi] * BENCH_REPEATS / total_us;
+                    ESP_LOGI(MAIN_TAG, "%u bytes, %u chunk, %s, prealloc %i: %.2f MB/s",
+                             file_sizes[fi], chunk_sizes[ci], placement_names[placement], preallocate, mb_per_s);
+
+                    char line[64];
+                    sprintf(line, "%u,%u,%s,%i,%.3f\n", file_sizes[fi], chunk_sizes[ci],
+                            placement_names[placement], preallocate, mb_per_s);
+                    write_text_SDSPI(BENCH_RESULTS_FILE, line);
+                }
+            }
+        }
+    }
+
+    unlink(BENCH_FILE);
+    heap_caps_free(bounce);
+    heap_caps_free(src);
+    ESP_LOGI(MAIN_TAG, "Benchmark done");
+}
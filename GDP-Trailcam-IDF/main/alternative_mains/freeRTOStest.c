@@ -101,8 +101,10 @@ void motion_processing_task()
 
             size_t motion_t1 = jpg_motion_data.t1;
 
+            capture_arena_t* arena = capture_arena_acquire(portMAX_DELAY);
+
             ESP_LOGI(MAIN_TAG, "Analysing motion on caputre");
-            grayscale_image_t sub_img = perform_motion_analysis(&jpg_motion_data);
+            grayscale_image_t sub_img = perform_motion_analysis(&jpg_motion_data, arena);
 
             if (sub_img.buf != NULL)
             {
@@ -118,10 +120,8 @@ void motion_processing_task()
 
                 point_t bb_origin;
                 ESP_LOGI(MAIN_TAG, "Attempting to find centre of motion");
-                if (find_motion_centre(&sub_img, &bb_origin))
+                if (find_motion_centre(&sub_img, &bb_origin, NULL))
                 {
-                    free(sub_img.buf);
-
                     ESP_LOGI(MAIN_TAG, "Motion bounding box from (%u,%u) to (%u,%u)",
                             bb_origin.x,
                             bb_origin.y,
@@ -140,7 +140,7 @@ void motion_processing_task()
                     free(box_filenm);
 
                     ESP_LOGI(MAIN_TAG, "Cropping jpg image");
-                    jpg_image_t box_img = crop_jpg_img(&jpg_motion_data.img1, bb_origin);
+                    jpg_image_t box_img = crop_jpg_img(&jpg_motion_data.img1, bb_origin, arena);
                     free_jpg_motion_data(&jpg_motion_data);
 
                     if (box_img.buf == NULL)
@@ -157,13 +157,10 @@ void motion_processing_task()
                             ESP_LOGE(MAIN_TAG, "Failed to write cropped img to SD");
                         }
                         free(box_img_filenm);
-
-                        free(box_img.buf);
                     }
                 }
                 else
                 {
-                    free(sub_img.buf);
                     ESP_LOGI(MAIN_TAG, "Image not motion significant");
                 }
             }
@@ -171,6 +168,9 @@ void motion_processing_task()
             {
                 ESP_LOGI(MAIN_TAG, "Analysis failed!");
             }
+
+            // Writes here are synchronous, so everything in the arena is done with
+            capture_arena_release(arena);
         }
     }
 }
@@ -212,6 +212,11 @@ void app_main(void)
 
     cam_queue = xQueueCreate(5, sizeof(int));
     motion_proc_queue = xQueueCreate(5, sizeof(jpg_motion_data_t));
+    if (capture_arena_pool_init(1, CONFIG_CAPTURE_ARENA_KB * 1024) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "No memory for capture arena");
+        esp_restart();
+    }
 
     xTaskCreate(PIR_state_latch, "PIR_state_latch", 1024 * 8, NULL, 3, &PIR_trig_handle);
     xTaskCreate(motion_processing_task, "Motion processing task", 1024 * 16, &motion_proc_queue, 3, NULL);
@@ -244,6 +249,10 @@ void app_main(void)
             config = get_default_camera_config(cam_pwr_pin);
 
             jpg_motion_data_t* motion = get_motion_capture(config);
+            if (motion == NULL)
+            {
+                continue;
+            }
 
             ESP_LOGI(MAIN_TAG, "Time between is: %ums", motion->t2 - motion->t1);
 
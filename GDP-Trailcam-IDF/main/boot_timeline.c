@@ -0,0 +1,88 @@
+/// ------------------------------------------
+/// @file boot_timeline.c
+///
+/// @brief Source file for timestamping each phase of a wakeup, from boot to deep sleep
+/// ------------------------------------------
+
+#include "boot_timeline.h"
+
+/// @brief Logging tag
+static const char* TIMELINE_TAG = "boot_timeline";
+
+/// @brief Time each phase was reached, 0 if not yet reached
+static int64_t boot_phase_times[BOOT_PHASE_COUNT];
+
+/// @brief Printable names of each phase
+static const char* boot_phase_names[BOOT_PHASE_COUNT] = {
+    "app_main",
+    "cam_power_on",
+    "cam_init",
+    "exposure_settled",
+    "first_frame",
+    "sd_mounted",
+    "nvs_ready",
+    "first_write",
+    "processing_done",
+    "shutdown_ready",
+};
+
+/// @brief Wakes recorded since power on
+RTC_DATA_ATTR static uint32_t awake_wake_count = 0;
+
+/// @brief Total awake time of every recorded wake
+RTC_DATA_ATTR static uint64_t awake_total_us = 0;
+
+/// @brief Awake time of the last recorded wake
+RTC_DATA_ATTR static int64_t awake_last_us = 0;
+
+/// ------------------------------------------
+void boot_timeline_mark(const boot_phase_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT || boot_phase_times[phase] != 0)
+    {
+        return;
+    }
+
+    boot_phase_times[phase] = esp_timer_get_time();
+    ESP_LOGI(TIMELINE_TAG, "%s at %lldus", boot_phase_names[phase], boot_phase_times[phase]);
+}
+
+/// ------------------------------------------
+int64_t boot_timeline_get(const boot_phase_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT)
+    {
+        return 0;
+    }
+
+    return boot_phase_times[phase];
+}
+
+/// ------------------------------------------
+void boot_timeline_format(char* record_out)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        len += snprintf(record_out + len, BOOT_TIMELINE_RECORD_LEN - len, "%s: %lld\n",
+                        boot_phase_names[i], boot_phase_times[i]);
+        if (len >= BOOT_TIMELINE_RECORD_LEN)
+        {
+            return;
+        }
+    }
+
+    uint64_t mean_us = awake_wake_count > 0 ? awake_total_us / awake_wake_count : 0;
+    snprintf(record_out + len, BOOT_TIMELINE_RECORD_LEN - len, "prev_awake: %lld\nmean_awake: %llu\nwakes: %lu\n",
+             awake_last_us, mean_us, awake_wake_count);
+}
+
+/// ------------------------------------------
+void boot_timeline_record_awake()
+{
+    awake_last_us = esp_timer_get_time();
+    awake_total_us += awake_last_us;
+    awake_wake_count++;
+    ESP_LOGI(TIMELINE_TAG, "Awake for %lldms, mean %llums over %lu wakes", awake_last_us / 1000,
+             awake_total_us / awake_wake_count / 1000, awake_wake_count);
+}
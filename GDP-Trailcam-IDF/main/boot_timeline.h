@@ -0,0 +1,61 @@
+/// ------------------------------------------
+/// @file boot_timeline.h
+///
+/// @brief Header file for timestamping each phase of a wakeup, from boot to deep sleep
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+
+/// @brief Phases of a wake, in the order they are expected to happen
+typedef enum
+{
+    BOOT_PHASE_APP_MAIN,
+    BOOT_PHASE_CAM_POWER_ON,
+    BOOT_PHASE_CAM_INIT,
+    BOOT_PHASE_EXPOSURE_SETTLED,
+    BOOT_PHASE_FIRST_FRAME,
+    BOOT_PHASE_SD_MOUNTED,
+    BOOT_PHASE_NVS_READY,
+    BOOT_PHASE_FIRST_WRITE,
+    BOOT_PHASE_PROCESSING_DONE,
+    BOOT_PHASE_SHUTDOWN_READY,
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+/// @brief Max length of a formatted boot timeline record
+#define BOOT_TIMELINE_RECORD_LEN 512
+
+/// ------------------------------------------
+/// @brief Records the time a phase was reached, only the first call for each phase is kept
+///
+/// @note Times are us since esp_timer started, so do not include ROM and bootloader time
+///
+/// @param phase phase that has been reached
+void boot_timeline_mark(const boot_phase_t phase);
+
+/// ------------------------------------------
+/// @brief Gets the time a phase was reached
+///
+/// @param phase phase to get
+///
+/// @return us since boot, 0 if the phase was not reached
+int64_t boot_timeline_get(const boot_phase_t phase);
+
+/// ------------------------------------------
+/// @brief Formats the timeline into a single text record, one phase per line followed
+/// by the awake times of earlier wakes
+///
+/// @param[out] record_out buffer sized to at least BOOT_TIMELINE_RECORD_LEN
+void boot_timeline_format(char* record_out);
+
+/// ------------------------------------------
+/// @brief Records how long this wake was awake, kept in RTC memory over deep sleep so
+/// the mean awake time per trigger can be followed between wakes
+///
+/// @note Call just before deep sleep, only on wakes that should count towards the mean
+void boot_timeline_record_awake();
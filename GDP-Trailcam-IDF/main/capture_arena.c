@@ -0,0 +1,180 @@
+/// ------------------------------------------
+/// @file capture_arena.c
+///
+/// @brief Source file for capture arenas
+/// ------------------------------------------
+
+#include "capture_arena.h"
+
+/// @brief Debugging string tag
+static const char* ARENA_TAG = "capture_arena";
+
+/// @brief Every arena in the pool
+static capture_arena_t arenas[CAPTURE_ARENA_MAX_COUNT];
+
+/// @brief Number of arenas in the pool
+static size_t arena_count = 0;
+
+/// @brief Indices of the free arenas
+static QueueHandle_t free_arenas = NULL;
+
+/// @brief Most any arena has had in use at once
+static volatile size_t high_water = 0;
+
+/// ------------------------------------------
+/// @brief Rounds a length up to the arena alignment
+static size_t align_len(const size_t len)
+{
+    return (len + CAPTURE_ARENA_ALIGN - 1) & ~(size_t)(CAPTURE_ARENA_ALIGN - 1);
+}
+
+/// ------------------------------------------
+/// @brief Records the bytes an arena has in use after an allocation
+static void note_usage(capture_arena_t* arena)
+{
+    size_t used = arena->low + arena->high;
+    if (used > arena->peak)
+    {
+        arena->peak = used;
+    }
+}
+
+/// ------------------------------------------
+esp_err_t capture_arena_pool_init(const size_t count, const size_t capacity)
+{
+    if (free_arenas != NULL)
+    {
+        return ESP_OK;
+    }
+
+    if (count == 0 || count > CAPTURE_ARENA_MAX_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    free_arenas = xQueueCreate(count, sizeof(uint8_t));
+    if (free_arenas == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t arena_capacity = align_len(capacity);
+    for (size_t i = 0; i < count; i++)
+    {
+        arenas[i].base = heap_caps_aligned_alloc(CAPTURE_ARENA_ALIGN, arena_capacity, MALLOC_CAP_SPIRAM);
+        if (arenas[i].base == NULL)
+        {
+            ESP_LOGE(ARENA_TAG, "Failed to allocate arena %u of %u bytes", i, arena_capacity);
+            for (size_t j = 0; j < i; j++)
+            {
+                heap_caps_free(arenas[j].base);
+                arenas[j].base = NULL;
+            }
+            vQueueDelete(free_arenas);
+            free_arenas = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+
+        arenas[i].capacity = arena_capacity;
+        arenas[i].index = i;
+        uint8_t index = i;
+        xQueueSend(free_arenas, &index, 0);
+    }
+
+    arena_count = count;
+    ESP_LOGI(ARENA_TAG, "%u arenas of %u bytes allocated", count, arena_capacity);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+capture_arena_t* capture_arena_acquire(const TickType_t wait)
+{
+    uint8_t index;
+    if (free_arenas == NULL || xQueueReceive(free_arenas, &index, wait) != pdTRUE)
+    {
+        return NULL;
+    }
+
+    capture_arena_t* arena = &arenas[index];
+    arena->low = 0;
+    arena->high = 0;
+    arena->peak = 0;
+    return arena;
+}
+
+/// ------------------------------------------
+void capture_arena_release(capture_arena_t* arena)
+{
+    // Only a metric, arenas released at the same time losing an update does not matter
+    if (arena->peak > high_water)
+    {
+        high_water = arena->peak;
+    }
+    ESP_LOGI(ARENA_TAG, "Arena %u released, peak %u of %u bytes", arena->index, arena->peak, arena->capacity);
+
+    arena->low = 0;
+    arena->high = 0;
+    xQueueSend(free_arenas, &arena->index, 0);
+}
+
+/// ------------------------------------------
+void* capture_arena_alloc(capture_arena_t* arena, const size_t len)
+{
+    size_t aligned = align_len(len);
+    if (aligned > arena->capacity - arena->low - arena->high)
+    {
+        ESP_LOGE(ARENA_TAG, "Arena %u full, %u bytes wanted with %u of %u in use", arena->index, len,
+                 arena->low + arena->high, arena->capacity);
+        mem_telemetry_note_arena(arena->low + arena->high, false);
+        return NULL;
+    }
+
+    void* buf = arena->base + arena->low;
+    arena->low += aligned;
+    note_usage(arena);
+    mem_telemetry_note_arena(arena->low + arena->high, true);
+    return buf;
+}
+
+/// ------------------------------------------
+void* capture_arena_alloc_output(capture_arena_t* arena, const size_t len)
+{
+    size_t aligned = align_len(len);
+    if (aligned > arena->capacity - arena->low - arena->high)
+    {
+        ESP_LOGE(ARENA_TAG, "Arena %u full, %u output bytes wanted with %u of %u in use", arena->index, len,
+                 arena->low + arena->high, arena->capacity);
+        mem_telemetry_note_arena(arena->low + arena->high, false);
+        return NULL;
+    }
+
+    arena->high += aligned;
+    note_usage(arena);
+    mem_telemetry_note_arena(arena->low + arena->high, true);
+    return arena->base + arena->capacity - arena->high;
+}
+
+/// ------------------------------------------
+void capture_arena_pop(capture_arena_t* arena, void* buf)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    size_t offset = (uint8_t*)buf - arena->base;
+    if (offset < arena->low)
+    {
+        arena->low = offset;
+    }
+}
+
+/// ------------------------------------------
+size_t capture_arena_get_high_water(size_t* capacity_out)
+{
+    if (capacity_out != NULL)
+    {
+        *capacity_out = arena_count > 0 ? arenas[0].capacity : 0;
+    }
+    return high_water;
+}
@@ -0,0 +1,107 @@
+/// ------------------------------------------
+/// @file capture_arena.h
+///
+/// @brief Header file for capture arenas, bump allocators that hold every image
+/// processing buffer of a single capture
+///
+/// @note Arenas are allocated in PSRAM once per wake and handed to captures from a pool.
+/// Working buffers are taken from the bottom of an arena and popped like a stack once
+/// done with. Buffers that must outlive the stage that made them, such as files waiting
+/// for the SD writer, are taken from the top. Releasing the arena frees everything in
+/// one go, so analysis never goes through the general heap and cannot fragment it.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "mem_telemetry.h"
+
+/// @brief Alignment of every arena allocation
+#define CAPTURE_ARENA_ALIGN 16
+
+/// @brief Most arenas the pool can hold
+#define CAPTURE_ARENA_MAX_COUNT 8
+
+/// @brief A capture's arena, only used by one task at a time
+typedef struct
+{
+    // Start of the arena's memory
+    uint8_t* base;
+
+    // Length of the arena's memory
+    size_t capacity;
+
+    // Bytes taken from the bottom by working buffers
+    size_t low;
+
+    // Bytes taken from the top by output buffers
+    size_t high;
+
+    // Most bytes in use at once since the arena was acquired
+    size_t peak;
+
+    // Index of this arena in the pool
+    uint8_t index;
+} capture_arena_t;
+
+///--------------------------------------------------------
+/// @brief Allocates the pool of arenas
+///
+/// @param count number of arenas, at most CAPTURE_ARENA_MAX_COUNT
+/// @param capacity length of each arena, the most a single capture may use at once
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NO_MEM if PSRAM could not fit the pool
+esp_err_t capture_arena_pool_init(const size_t count, const size_t capacity);
+
+///--------------------------------------------------------
+/// @brief Takes an empty arena from the pool
+///
+/// @param wait time to wait for an arena to be released if none are free
+///
+/// @return arena, null if none were released in time or the pool is not initialised
+capture_arena_t* capture_arena_acquire(const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Frees everything in an arena and returns it to the pool
+///
+/// @param arena to release
+void capture_arena_release(capture_arena_t* arena);
+
+///--------------------------------------------------------
+/// @brief Takes a working buffer from the bottom of an arena
+///
+/// @param arena to allocate from
+/// @param len bytes needed
+///
+/// @return buffer, null if the arena is full
+void* capture_arena_alloc(capture_arena_t* arena, const size_t len);
+
+///--------------------------------------------------------
+/// @brief Takes an output buffer from the top of an arena, it is only freed by releasing the arena
+///
+/// @param arena to allocate from
+/// @param len bytes needed
+///
+/// @return buffer, null if the arena is full
+void* capture_arena_alloc_output(capture_arena_t* arena, const size_t len);
+
+///--------------------------------------------------------
+/// @brief Frees a working buffer and every working buffer taken after it
+///
+/// @param arena buf was taken from
+/// @param buf working buffer returned by capture_arena_alloc, null does nothing
+void capture_arena_pop(capture_arena_t* arena, void* buf);
+
+///--------------------------------------------------------
+/// @brief Gets the most any arena has had in use at once this wake
+///
+/// @param[out] capacity_out length of each arena, may be null
+///
+/// @return peak bytes in use
+size_t capture_arena_get_high_water(size_t* capacity_out);
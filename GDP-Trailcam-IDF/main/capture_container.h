@@ -0,0 +1,122 @@
+/// ------------------------------------------
+/// @file capture_container.h
+///
+/// @brief On card layout of the append only capture container file
+///
+/// @note Shared with the host side tools, must only depend on the C standard library
+///
+/// A container is a single preallocated file holding the files of many captures:
+///
+///     [container header][padding to CONTAINER_DATA_START]
+///     [segment header][segment data][padding to CONTAINER_SEGMENT_ALIGN]
+///     [segment header][segment data][padding to CONTAINER_SEGMENT_ALIGN]
+///     ...
+///     [unused preallocated space]
+///
+/// Each segment holds one file of one capture (img1.jpg, info.txt, ...). Segments
+/// appended in a session are followed by an index segment listing them. Only bytes
+/// before the header's tail offset are committed, anything after may be a
+/// partial write from a power loss. All values are little endian.
+/// ------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Container header magic, "TCAP"
+#define CONTAINER_MAGIC 0x50414354
+
+/// @brief Segment header magic, "TSEG"
+#define CONTAINER_SEGMENT_MAGIC 0x47455354
+
+/// @brief Version of the container layout
+#define CONTAINER_VERSION 1
+
+/// @brief Offset of the first segment, the header is given a whole sector so data stays aligned
+#define CONTAINER_DATA_START 4096
+
+/// @brief Alignment of each segment header
+#define CONTAINER_SEGMENT_ALIGN 4
+
+/// @brief Max length of a segment name, including null terminator
+#define CONTAINER_NAME_LEN 12
+
+/// @brief Capture number used by index segments
+#define CONTAINER_INDEX_CAPTURE_NUM 0xFFFFFFFF
+
+/// @brief Name used by index segments
+#define CONTAINER_INDEX_NAME "INDEX"
+
+/// @brief Container file header, at offset 0
+typedef struct __attribute__((packed))
+{
+    // CONTAINER_MAGIC
+    uint32_t magic;
+
+    // CONTAINER_VERSION
+    uint32_t version;
+
+    // Preallocated size of the container in bytes
+    uint32_t capacity;
+
+    // End of the last committed segment
+    uint32_t tail;
+
+    // Number of committed segments, including index segments
+    uint32_t segment_count;
+
+    // One above the highest capture number committed to this container
+    uint32_t next_capture_num;
+
+    // CRC32 of all previous fields
+    uint32_t header_crc;
+} container_header_t;
+
+/// @brief Header placed before every segment's data
+typedef struct __attribute__((packed))
+{
+    // CONTAINER_SEGMENT_MAGIC
+    uint32_t magic;
+
+    // Capture the segment belongs to, CONTAINER_INDEX_CAPTURE_NUM for index segments
+    uint32_t capture_num;
+
+    // Null terminated file name of the segment within its capture
+    char name[CONTAINER_NAME_LEN];
+
+    // Length of the segment data, not including padding
+    uint32_t len;
+
+    // CRC32 of the segment data
+    uint32_t data_crc;
+
+    // CRC32 of all previous fields
+    uint32_t header_crc;
+} container_segment_header_t;
+
+/// @brief Entry of an index segment, the data of an index segment is an array of these
+typedef struct __attribute__((packed))
+{
+    // Capture the indexed segment belongs to
+    uint32_t capture_num;
+
+    // Name of the indexed segment
+    char name[CONTAINER_NAME_LEN];
+
+    // Offset of the indexed segment's header in the container
+    uint32_t offset;
+
+    // Length of the indexed segment's data
+    uint32_t len;
+} container_index_entry_t;
+
+/// ------------------------------------------
+/// @brief Rounds a segment length up to the next segment alignment
+///
+/// @param len length to pad
+///
+/// @return padded length
+static inline uint32_t container_pad_len(const uint32_t len)
+{
+    return (len + CONTAINER_SEGMENT_ALIGN - 1) & ~(uint32_t)(CONTAINER_SEGMENT_ALIGN - 1);
+}
@@ -0,0 +1,602 @@
+/// ------------------------------------------
+/// @file capture_index.c
+///
+/// @brief Source file for the capture metadata index
+/// ------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_index.h"
+
+#ifdef STORAGE_HOST_BUILD
+#define INDEX_LOCK()
+#define INDEX_UNLOCK()
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_rom_crc.h"
+
+/// @brief Mutex controlling acsess to the index, appends come from the SD writer and queries from anywhere
+static SemaphoreHandle_t index_mutex = NULL;
+
+#define INDEX_LOCK() xSemaphoreTake(index_mutex, portMAX_DELAY)
+#define INDEX_UNLOCK() xSemaphoreGive(index_mutex)
+#endif
+
+/// @brief Checkpoint being written, renamed over CAPTURE_INDEX_CHECKPOINT_FILE once complete
+#define CHECKPOINT_TEMP_FILE "CAPIDX.TMP"
+
+/// @brief Length of a record
+#define RECORD_LEN sizeof(capture_index_record_t)
+
+/// @brief Offset of the first sorted record of a checkpoint
+#define CHECKPOINT_RECORDS_START sizeof(capture_index_checkpoint_header_t)
+
+/// @brief Backend the index is stored on, null until initialised
+static storage_backend_t* index_backend = NULL;
+
+/// @brief Records in the log, including bad ones
+static uint32_t log_records = 0;
+
+/// @brief Log records covered by the checkpoint
+static uint32_t checkpoint_log_records = 0;
+
+/// @brief Sorted records in the checkpoint
+static uint32_t checkpoint_record_count = 0;
+
+/// @brief CRC32 of the checkpoint's block summaries
+static uint32_t checkpoint_summary_crc = 0;
+
+/// ------------------------------------------
+/// @brief Gets the CRC32 of a buffer
+static uint32_t index_crc(const void* data, const size_t len)
+{
+#ifdef STORAGE_HOST_BUILD
+    // Standard reflected CRC32, matches esp_rom_crc32_le with a starting crc of 0
+    const uint8_t* bytes = data;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+#else
+    return esp_rom_crc32_le(0, data, len);
+#endif
+}
+
+/// ------------------------------------------
+/// @brief Checks a record's magic and crc
+///
+/// @return is the record intact?
+static bool record_valid(const capture_index_record_t* record)
+{
+    return record->magic == CAPTURE_INDEX_MAGIC &&
+           record->crc == index_crc(record, offsetof(capture_index_record_t, crc));
+}
+
+/// ------------------------------------------
+/// @brief Checks a record against a query
+///
+/// @return does the record match?
+static bool record_matches(const capture_index_query_t* query, const capture_index_record_t* record)
+{
+    return record->time_ms >= query->from_ms && record->time_ms <= query->to_ms &&
+           record->motion_pixels >= query->min_motion_pixels && record->motion_pixels <= query->max_motion_pixels;
+}
+
+/// ------------------------------------------
+/// @brief Orders records by time, then capture number
+static int compare_records(const void* a, const void* b)
+{
+    const capture_index_record_t* ra = a;
+    const capture_index_record_t* rb = b;
+    if (ra->time_ms != rb->time_ms)
+    {
+        return ra->time_ms < rb->time_ms ? -1 : 1;
+    }
+    if (ra->capture_num != rb->capture_num)
+    {
+        return ra->capture_num < rb->capture_num ? -1 : 1;
+    }
+    return 0;
+}
+
+/// ------------------------------------------
+/// @brief Pads a log torn by power loss out to a whole number of records, the padded
+/// record fails its crc and is skipped
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t align_log()
+{
+    storage_stat_t stat;
+    if (index_backend->stat(index_backend, CAPTURE_INDEX_LOG_FILE, &stat) != ESP_OK)
+    {
+        log_records = 0;
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    size_t torn = stat.size % RECORD_LEN;
+    if (torn != 0)
+    {
+        uint8_t padding[sizeof(capture_index_record_t)] = {0};
+        err = index_backend->append_file(index_backend, CAPTURE_INDEX_LOG_FILE, padding, RECORD_LEN - torn);
+    }
+    log_records = (stat.size + RECORD_LEN - 1) / RECORD_LEN;
+    return err;
+}
+
+/// ------------------------------------------
+/// @brief Reads the intact log records from a record on, sorted by time
+///
+/// @param first record of the log to start from
+/// @param query records must match, null for all records
+/// @param[out] records_out read records, must be freed by the caller, null if there are none
+/// @param[out] count_out number of records read
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t read_log_tail(const uint32_t first, const capture_index_query_t* query,
+                               capture_index_record_t** records_out, size_t* count_out)
+{
+    *records_out = NULL;
+    *count_out = 0;
+    if (first >= log_records)
+    {
+        return ESP_OK;
+    }
+
+    storage_handle_t log;
+    esp_err_t err = index_backend->open(index_backend, CAPTURE_INDEX_LOG_FILE, 0, &log);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    capture_index_record_t* chunk = malloc(CAPTURE_INDEX_BLOCK_LEN * RECORD_LEN);
+    capture_index_record_t* records = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    if (chunk == NULL)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t pos = first; pos < log_records && err == ESP_OK; pos += CAPTURE_INDEX_BLOCK_LEN)
+    {
+        size_t n = log_records - pos < CAPTURE_INDEX_BLOCK_LEN ? log_records - pos : CAPTURE_INDEX_BLOCK_LEN;
+        err = index_backend->pread(index_backend, log, (size_t)pos * RECORD_LEN, chunk, n * RECORD_LEN);
+        for (size_t i = 0; i < n && err == ESP_OK; i++)
+        {
+            if (record_valid(&chunk[i]) == false || (query != NULL && record_matches(query, &chunk[i]) == false))
+            {
+                continue;
+            }
+
+            if (count == capacity)
+            {
+                capture_index_record_t* grown = realloc(records, (capacity + CAPTURE_INDEX_BLOCK_LEN) * RECORD_LEN);
+                if (grown == NULL)
+                {
+                    err = ESP_ERR_NO_MEM;
+                    break;
+                }
+                records = grown;
+                capacity += CAPTURE_INDEX_BLOCK_LEN;
+            }
+            records[count++] = chunk[i];
+        }
+    }
+
+    index_backend->close(index_backend, log);
+    free(chunk);
+    if (err != ESP_OK)
+    {
+        free(records);
+        return err;
+    }
+
+    if (count > 1)
+    {
+        qsort(records, count, RECORD_LEN, compare_records);
+    }
+    *records_out = records;
+    *count_out = count;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+/// @brief Summarises a block of sorted records
+static void summarise_block(const capture_index_record_t* records, const size_t count, capture_index_block_t* block)
+{
+    block->first_time_ms = records[0].time_ms;
+    block->last_time_ms = records[count - 1].time_ms;
+    block->min_motion_pixels = UINT32_MAX;
+    block->max_motion_pixels = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (records[i].motion_pixels < block->min_motion_pixels)
+        {
+            block->min_motion_pixels = records[i].motion_pixels;
+        }
+        if (records[i].motion_pixels > block->max_motion_pixels)
+        {
+            block->max_motion_pixels = records[i].motion_pixels;
+        }
+    }
+}
+
+/// ------------------------------------------
+/// @brief Merges the current checkpoint with the log records after it into a new checkpoint
+///
+/// @note The new checkpoint is written to CHECKPOINT_TEMP_FILE and renamed over the old one,
+/// power loss at any point leaves either checkpoint or none, the log covers all three
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t write_checkpoint()
+{
+    capture_index_record_t* tail;
+    size_t tail_count;
+    esp_err_t err = read_log_tail(checkpoint_log_records, NULL, &tail, &tail_count);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    size_t old_count = checkpoint_record_count;
+    size_t total = old_count + tail_count;
+    size_t block_count = capture_index_block_count(total);
+    size_t summaries_offset = CHECKPOINT_RECORDS_START + total * RECORD_LEN;
+
+    capture_index_block_t* blocks = calloc(block_count + 1, sizeof(capture_index_block_t));
+    capture_index_record_t* in_chunk = malloc(CAPTURE_INDEX_BLOCK_LEN * RECORD_LEN);
+    capture_index_record_t* out_chunk = malloc(CAPTURE_INDEX_BLOCK_LEN * RECORD_LEN);
+    storage_handle_t old_checkpoint = NULL;
+    storage_handle_t new_checkpoint = NULL;
+    if (blocks == NULL || in_chunk == NULL || out_chunk == NULL)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    // Left over if power was lost mid checkpoint
+    index_backend->remove(index_backend, CHECKPOINT_TEMP_FILE);
+
+    if (err == ESP_OK && old_count > 0)
+    {
+        err = index_backend->open(index_backend, CAPTURE_INDEX_CHECKPOINT_FILE, 0, &old_checkpoint);
+    }
+    if (err == ESP_OK)
+    {
+        err = index_backend->open(index_backend, CHECKPOINT_TEMP_FILE,
+                                  summaries_offset + block_count * sizeof(capture_index_block_t), &new_checkpoint);
+    }
+
+    // Both inputs are sorted, merge them a block at a time
+    size_t in_pos = 0;
+    size_t in_len = 0;
+    size_t in_idx = 0;
+    size_t tail_idx = 0;
+    for (size_t out = 0; out < total && err == ESP_OK;)
+    {
+        if (in_idx == in_len && in_pos < old_count)
+        {
+            in_len = old_count - in_pos < CAPTURE_INDEX_BLOCK_LEN ? old_count - in_pos : CAPTURE_INDEX_BLOCK_LEN;
+            in_idx = 0;
+            err = index_backend->pread(index_backend, old_checkpoint, CHECKPOINT_RECORDS_START + in_pos * RECORD_LEN,
+                                       in_chunk, in_len * RECORD_LEN);
+            in_pos += in_len;
+            if (err != ESP_OK)
+            {
+                break;
+            }
+        }
+
+        if (in_idx < in_len && (tail_idx == tail_count || compare_records(&in_chunk[in_idx], &tail[tail_idx]) <= 0))
+        {
+            out_chunk[out % CAPTURE_INDEX_BLOCK_LEN] = in_chunk[in_idx++];
+        }
+        else
+        {
+            out_chunk[out % CAPTURE_INDEX_BLOCK_LEN] = tail[tail_idx++];
+        }
+        out++;
+
+        if (out % CAPTURE_INDEX_BLOCK_LEN == 0 || out == total)
+        {
+            size_t n = (out - 1) % CAPTURE_INDEX_BLOCK_LEN + 1;
+            summarise_block(out_chunk, n, &blocks[(out - 1) / CAPTURE_INDEX_BLOCK_LEN]);
+            err = index_backend->pwrite(index_backend, new_checkpoint, CHECKPOINT_RECORDS_START + (out - n) * RECORD_LEN,
+                                        out_chunk, n * RECORD_LEN);
+        }
+    }
+
+    capture_index_checkpoint_header_t header = {
+        .magic = CAPTURE_INDEX_CHECKPOINT_MAGIC,
+        .version = CAPTURE_INDEX_VERSION,
+        .log_records = log_records,
+        .record_count = total,
+        .summary_crc = index_crc(blocks, block_count * sizeof(capture_index_block_t)),
+    };
+    header.header_crc = index_crc(&header, offsetof(capture_index_checkpoint_header_t, header_crc));
+
+    if (err == ESP_OK && block_count > 0)
+    {
+        err = index_backend->pwrite(index_backend, new_checkpoint, summaries_offset,
+                                    blocks, block_count * sizeof(capture_index_block_t));
+    }
+    if (err == ESP_OK)
+    {
+        err = index_backend->pwrite(index_backend, new_checkpoint, 0, &header, sizeof(header));
+    }
+    if (err == ESP_OK)
+    {
+        err = index_backend->sync(index_backend, new_checkpoint);
+    }
+
+    if (old_checkpoint != NULL)
+    {
+        index_backend->close(index_backend, old_checkpoint);
+    }
+    if (new_checkpoint != NULL)
+    {
+        index_backend->close(index_backend, new_checkpoint);
+    }
+
+    if (err == ESP_OK)
+    {
+        // Renames cannot replace, a missing checkpoint is rebuilt from the log
+        index_backend->remove(index_backend, CAPTURE_INDEX_CHECKPOINT_FILE);
+        if (index_backend->rename(index_backend, CHECKPOINT_TEMP_FILE, CAPTURE_INDEX_CHECKPOINT_FILE) == ESP_OK)
+        {
+            checkpoint_log_records = header.log_records;
+            checkpoint_record_count = header.record_count;
+            checkpoint_summary_crc = header.summary_crc;
+        }
+        else
+        {
+            // The old checkpoint is gone, queries read the whole log until the next checkpoint
+            checkpoint_log_records = 0;
+            checkpoint_record_count = 0;
+            err = ESP_FAIL;
+        }
+    }
+
+    free(tail);
+    free(blocks);
+    free(in_chunk);
+    free(out_chunk);
+    return err;
+}
+
+/// ------------------------------------------
+esp_err_t capture_index_init(storage_backend_t* backend)
+{
+#ifndef STORAGE_HOST_BUILD
+    if (index_mutex == NULL)
+    {
+        index_mutex = xSemaphoreCreateMutex();
+        if (index_mutex == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+#endif
+
+    INDEX_LOCK();
+    index_backend = backend;
+    esp_err_t err = align_log();
+
+    checkpoint_log_records = 0;
+    checkpoint_record_count = 0;
+    checkpoint_summary_crc = 0;
+
+    capture_index_checkpoint_header_t header;
+    size_t read_len;
+    if (backend->read_file(backend, CAPTURE_INDEX_CHECKPOINT_FILE, &header, sizeof(header), &read_len) == ESP_OK &&
+        read_len == sizeof(header) &&
+        header.magic == CAPTURE_INDEX_CHECKPOINT_MAGIC &&
+        header.version == CAPTURE_INDEX_VERSION &&
+        header.header_crc == index_crc(&header, offsetof(capture_index_checkpoint_header_t, header_crc)) &&
+        header.log_records <= log_records)
+    {
+        checkpoint_log_records = header.log_records;
+        checkpoint_record_count = header.record_count;
+        checkpoint_summary_crc = header.summary_crc;
+    }
+
+    INDEX_UNLOCK();
+    return err;
+}
+
+/// ------------------------------------------
+esp_err_t capture_index_append(capture_index_record_t* record)
+{
+    record->magic = CAPTURE_INDEX_MAGIC;
+    record->crc = index_crc(record, offsetof(capture_index_record_t, crc));
+
+    if (index_backend == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    INDEX_LOCK();
+    esp_err_t err = index_backend->append_file(index_backend, CAPTURE_INDEX_LOG_FILE, record, RECORD_LEN);
+    if (err == ESP_OK)
+    {
+        log_records++;
+    }
+    else
+    {
+        // A partial append would shift every later record
+        align_log();
+    }
+    INDEX_UNLOCK();
+    return err;
+}
+
+/// ------------------------------------------
+esp_err_t capture_index_checkpoint(const bool force)
+{
+    if (index_backend == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    INDEX_LOCK();
+    esp_err_t err = ESP_OK;
+    uint32_t pending = log_records - checkpoint_log_records;
+    if (pending > 0 && (force || pending >= CAPTURE_INDEX_CHECKPOINT_INTERVAL))
+    {
+        err = write_checkpoint();
+    }
+    INDEX_UNLOCK();
+    return err;
+}
+
+/// @brief State of a query, matching log records are merged into the checkpoint's order
+typedef struct
+{
+    // Matching log records after the checkpoint, sorted by time
+    const capture_index_record_t* tail;
+
+    // Number of tail records
+    size_t tail_count;
+
+    // Next tail record to emit
+    size_t tail_idx;
+
+    // Called for each match
+    capture_index_cb_t cb;
+
+    // Passed to cb
+    void* arg;
+
+    // Cleared once cb asks to stop
+    bool running;
+} index_query_t;
+
+/// ------------------------------------------
+/// @brief Emits the tail records that sort before a record, or all remaining if record is null
+static void emit_tail_before(index_query_t* query, const capture_index_record_t* record)
+{
+    while (query->running && query->tail_idx < query->tail_count &&
+           (record == NULL || compare_records(&query->tail[query->tail_idx], record) < 0))
+    {
+        query->running = query->cb(&query->tail[query->tail_idx++], query->arg);
+    }
+}
+
+/// ------------------------------------------
+/// @brief Emits the matching checkpoint records, skipping blocks whose summaries cannot match
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t query_checkpoint(const capture_index_query_t* query, index_query_t* state)
+{
+    size_t block_count = capture_index_block_count(checkpoint_record_count);
+    size_t summaries_offset = CHECKPOINT_RECORDS_START + (size_t)checkpoint_record_count * RECORD_LEN;
+
+    storage_handle_t checkpoint;
+    esp_err_t err = index_backend->open(index_backend, CAPTURE_INDEX_CHECKPOINT_FILE, 0, &checkpoint);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    capture_index_block_t* blocks = malloc(block_count * sizeof(capture_index_block_t));
+    capture_index_record_t* chunk = malloc(CAPTURE_INDEX_BLOCK_LEN * RECORD_LEN);
+    if (blocks == NULL || chunk == NULL)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    // Damaged summaries only lose the skipping, every block is read instead
+    bool summaries_valid = false;
+    if (err == ESP_OK &&
+        index_backend->pread(index_backend, checkpoint, summaries_offset, blocks,
+                             block_count * sizeof(capture_index_block_t)) == ESP_OK)
+    {
+        summaries_valid = index_crc(blocks, block_count * sizeof(capture_index_block_t)) == checkpoint_summary_crc;
+    }
+
+    for (size_t b = 0; b < block_count && err == ESP_OK && state->running; b++)
+    {
+        if (summaries_valid)
+        {
+            // Blocks are in time order, nothing later can match
+            if (blocks[b].first_time_ms > query->to_ms)
+            {
+                break;
+            }
+            if (blocks[b].last_time_ms < query->from_ms ||
+                blocks[b].max_motion_pixels < query->min_motion_pixels ||
+                blocks[b].min_motion_pixels > query->max_motion_pixels)
+            {
+                continue;
+            }
+        }
+
+        size_t first = b * CAPTURE_INDEX_BLOCK_LEN;
+        size_t n = checkpoint_record_count - first < CAPTURE_INDEX_BLOCK_LEN
+            ? checkpoint_record_count - first
+            : CAPTURE_INDEX_BLOCK_LEN;
+        err = index_backend->pread(index_backend, checkpoint, CHECKPOINT_RECORDS_START + first * RECORD_LEN,
+                                   chunk, n * RECORD_LEN);
+        for (size_t i = 0; i < n && err == ESP_OK && state->running; i++)
+        {
+            if (record_valid(&chunk[i]) && record_matches(query, &chunk[i]))
+            {
+                emit_tail_before(state, &chunk[i]);
+                if (state->running)
+                {
+                    state->running = state->cb(&chunk[i], state->arg);
+                }
+            }
+        }
+    }
+
+    index_backend->close(index_backend, checkpoint);
+    free(blocks);
+    free(chunk);
+    return err;
+}
+
+/// ------------------------------------------
+esp_err_t capture_index_query(const capture_index_query_t* query, capture_index_cb_t cb, void* arg)
+{
+    if (index_backend == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    INDEX_LOCK();
+    capture_index_record_t* tail;
+    size_t tail_count;
+    esp_err_t err = read_log_tail(checkpoint_log_records, query, &tail, &tail_count);
+
+    index_query_t state = {
+        .tail = tail,
+        .tail_count = tail_count,
+        .tail_idx = 0,
+        .cb = cb,
+        .arg = arg,
+        .running = true,
+    };
+
+    if (err == ESP_OK && checkpoint_record_count > 0)
+    {
+        err = query_checkpoint(query, &state);
+    }
+    if (err == ESP_OK)
+    {
+        emit_tail_before(&state, NULL);
+    }
+
+    INDEX_UNLOCK();
+    free(tail);
+    return err;
+}
@@ -0,0 +1,82 @@
+/// ------------------------------------------
+/// @file capture_index.h
+///
+/// @brief Header file for the capture metadata index, see capture_index_format.h for the
+/// on card layout. Records are appended as captures are analysed and the log is folded
+/// into a time sorted checkpoint every CAPTURE_INDEX_CHECKPOINT_INTERVAL records.
+///
+/// @note Built on storage_backend.h alone so host tools query a card image with the same
+/// code as the device. Define STORAGE_HOST_BUILD to build outside of IDF.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "storage_backend.h"
+#include "capture_index_format.h"
+
+/// @brief Query matching every record
+#define CAPTURE_INDEX_QUERY_ALL {INT64_MIN, INT64_MAX, 0, UINT32_MAX}
+
+/// @brief Records to match, all ranges are inclusive
+typedef struct
+{
+    // Time range of the first image, see capture_index_record_t
+    int64_t from_ms;
+    int64_t to_ms;
+
+    // Range of motion_pixels
+    uint32_t min_motion_pixels;
+    uint32_t max_motion_pixels;
+} capture_index_query_t;
+
+/// @brief Called for each record matching a query, in time order
+///
+/// @param record matching record
+/// @param arg passed to capture_index_query
+///
+/// @return true to continue, false to stop the query
+typedef bool (*capture_index_cb_t)(const capture_index_record_t* record, void* arg);
+
+///--------------------------------------------------------
+/// @brief Opens the index on a backend, realigning the log if its last record was torn
+///
+/// @param backend the index is stored on
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_index_init(storage_backend_t* backend);
+
+///--------------------------------------------------------
+/// @brief Appends a capture's record to the log
+///
+/// @param record to append, magic and crc are filled in
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_index_append(capture_index_record_t* record);
+
+///--------------------------------------------------------
+/// @brief Folds the log into a new sorted checkpoint if CAPTURE_INDEX_CHECKPOINT_INTERVAL
+/// records have been appended since the last one
+///
+/// @note Rewrites the whole checkpoint, call once the capture path is idle. The log stays the
+/// source of truth, a checkpoint lost to power loss is rebuilt from it.
+///
+/// @param force checkpoint even if fewer records were appended
+///
+/// @return ESP_OK if sucsessful or no checkpoint was due
+esp_err_t capture_index_checkpoint(const bool force);
+
+///--------------------------------------------------------
+/// @brief Calls cb for every record matching a query, in time order
+///
+/// @note Only checkpoint blocks whose summaries overlap the query are read, then the log
+/// records since the checkpoint
+///
+/// @param query records to match
+/// @param cb called for each matching record
+/// @param arg passed to cb
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_index_query(const capture_index_query_t* query, capture_index_cb_t cb, void* arg);
@@ -0,0 +1,180 @@
+/// ------------------------------------------
+/// @file capture_index_format.h
+///
+/// @brief On card layout of the capture metadata index, a fixed size binary record
+/// per capture so captures can be found by time and motion without opening info.txt
+///
+/// @note Shared with the host side tools, must only depend on the C standard library
+///
+/// The index is two files at the root of the card:
+///
+/// CAPTURE_INDEX_LOG_FILE: append only array of capture_index_record_t, in the order
+/// captures were analysed. This is the source of truth, a record with a bad crc (e.g.
+/// torn by power loss, or padding written to realign the log) is skipped.
+///
+///     [record][record][record]...
+///
+/// CAPTURE_INDEX_CHECKPOINT_FILE: the first log_records records of the log sorted by
+/// time, rewritten every CAPTURE_INDEX_CHECKPOINT_INTERVAL records. Each block of
+/// CAPTURE_INDEX_BLOCK_LEN sorted records has a summary so queries only read blocks
+/// that can match. Queries read the checkpoint and then the log records after it.
+///
+///     [capture_index_checkpoint_header_t][sorted records][block summaries]
+///
+/// All values are little endian.
+/// ------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Record magic, "TIDX"
+#define CAPTURE_INDEX_MAGIC 0x58444954
+
+/// @brief Checkpoint header magic, "TCKP"
+#define CAPTURE_INDEX_CHECKPOINT_MAGIC 0x504B4354
+
+/// @brief Version of the index layout
+#define CAPTURE_INDEX_VERSION 1
+
+/// @brief Append only log of records
+#define CAPTURE_INDEX_LOG_FILE "CAPIDX.LOG"
+
+/// @brief Sorted checkpoint of the log
+#define CAPTURE_INDEX_CHECKPOINT_FILE "CAPIDX.CKP"
+
+/// @brief Log records appended between checkpoints
+#define CAPTURE_INDEX_CHECKPOINT_INTERVAL 64
+
+/// @brief Sorted records per checkpoint block summary
+#define CAPTURE_INDEX_BLOCK_LEN 64
+
+/// @brief Box coordinate used when the capture had no significant motion
+#define CAPTURE_INDEX_NO_BOX 0xFFFF
+
+/// @brief Record flag, the capture's motion was analysed
+#define CAPTURE_INDEX_FLAG_ANALYSED 0x01
+
+/// @brief Record flag, the capture's motion was significant and a box was cropped
+#define CAPTURE_INDEX_FLAG_MOTION 0x02
+
+/// @brief Record flag, auto exposure settled before the first image
+#define CAPTURE_INDEX_FLAG_EXPOSURE_SETTLED 0x04
+
+/// @brief Record flag, the capture is stored in a container rather than a directory
+#define CAPTURE_INDEX_FLAG_CONTAINER 0x08
+
+/// @brief Record flag, the capture was shed by admission control whilst processing was saturated
+#define CAPTURE_INDEX_FLAG_SHED 0x10
+
+/// @brief Record flag, the DC pre-filter found no motion so the capture was not fully analysed
+#define CAPTURE_INDEX_FLAG_PREFILTERED 0x20
+
+/// @brief Record flag, the capture had no significant motion but its frames were kept as an audit sample
+#define CAPTURE_INDEX_FLAG_AUDIT 0x40
+
+/// @brief Record flag, the capture had no significant motion and its frames were not stored
+#define CAPTURE_INDEX_FLAG_DISCARDED 0x80
+
+/// @brief Metadata of one capture
+typedef struct __attribute__((packed))
+{
+    // CAPTURE_INDEX_MAGIC
+    uint32_t magic;
+
+    // Capture number
+    uint32_t capture_num;
+
+    // Time of the first image in ms, since the epoch if the clock was set, otherwise since power on
+    int64_t time_ms;
+
+    // Time between the two images in ms
+    uint32_t gap_ms;
+
+    // Number of pixels that passed the motion threshold, the capture's score
+    uint32_t motion_pixels;
+
+    // Top left of the motion bounding box, CAPTURE_INDEX_NO_BOX if motion was not significant
+    uint16_t box_x;
+    uint16_t box_y;
+
+    // Resolution of the images
+    uint16_t width;
+    uint16_t height;
+
+    // Index of the camera that took the capture
+    uint8_t cam_num;
+
+    // Imaging preset the camera was set to
+    uint8_t image_preset;
+
+    // CAPTURE_INDEX_FLAG_ bits
+    uint8_t flags;
+
+    // Unused, 0
+    uint8_t reserved;
+
+    // Sensor exposure value and gain the images were taken with
+    int32_t aec_value;
+    int32_t agc_gain;
+
+    // ms spent waiting for auto exposure to settle
+    uint32_t exposure_converge_ms;
+
+    // Container holding the capture, 0 unless CAPTURE_INDEX_FLAG_CONTAINER is set
+    uint32_t container_num;
+
+    // Offsets of the images' segment headers within the container, and their lengths
+    uint32_t img1_offset;
+    uint32_t img1_len;
+    uint32_t img2_offset;
+    uint32_t img2_len;
+
+    // CRC32 of all previous fields
+    uint32_t crc;
+} capture_index_record_t;
+
+/// @brief Checkpoint file header, at offset 0
+typedef struct __attribute__((packed))
+{
+    // CAPTURE_INDEX_CHECKPOINT_MAGIC
+    uint32_t magic;
+
+    // CAPTURE_INDEX_VERSION
+    uint32_t version;
+
+    // Number of log records the checkpoint covers, the log is read from here on
+    uint32_t log_records;
+
+    // Number of sorted records in the checkpoint, bad log records are left out
+    uint32_t record_count;
+
+    // CRC32 of the block summaries, records carry their own crc
+    uint32_t summary_crc;
+
+    // CRC32 of all previous fields
+    uint32_t header_crc;
+} capture_index_checkpoint_header_t;
+
+/// @brief Summary of a block of sorted checkpoint records
+typedef struct __attribute__((packed))
+{
+    // Time of the first and last record of the block
+    int64_t first_time_ms;
+    int64_t last_time_ms;
+
+    // Lowest and highest motion_pixels of the block
+    uint32_t min_motion_pixels;
+    uint32_t max_motion_pixels;
+} capture_index_block_t;
+
+/// ------------------------------------------
+/// @brief Gets the number of block summaries of a checkpoint
+///
+/// @param record_count sorted records in the checkpoint
+///
+/// @return number of blocks
+static inline size_t capture_index_block_count(const size_t record_count)
+{
+    return (record_count + CAPTURE_INDEX_BLOCK_LEN - 1) / CAPTURE_INDEX_BLOCK_LEN;
+}
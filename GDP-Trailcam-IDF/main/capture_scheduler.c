@@ -0,0 +1,116 @@
+/// ------------------------------------------
+/// @file capture_scheduler.c
+///
+/// @brief Source file for scheduling motion captures across all connected cameras
+/// ------------------------------------------
+
+#include "capture_scheduler.h"
+
+/// @brief Logging tag
+static const char* SCHED_TAG = "capture_scheduler";
+
+/// @brief Running motion score of each camera, kept in RTC memory so the order survives deep sleep
+RTC_DATA_ATTR static uint32_t cam_motion_scores[CAM_POWER_DOWN_PIN_COUNT];
+
+/// ------------------------------------------
+size_t get_capture_order(uint8_t* order_out)
+{
+    size_t cam_count = 0;
+    for (size_t i = 0; i < CAM_POWER_DOWN_PIN_COUNT; i++)
+    {
+        if (cam_power_down_pins[i] < 0)
+        {
+            continue;
+        }
+
+        // Insertion sort by descending score, equal scores keep pin list order
+        size_t pos = cam_count;
+        while (pos > 0 && cam_motion_scores[order_out[pos - 1]] < cam_motion_scores[i])
+        {
+            order_out[pos] = order_out[pos - 1];
+            pos--;
+        }
+        order_out[pos] = i;
+        cam_count++;
+    }
+
+    return cam_count;
+}
+
+/// ------------------------------------------
+size_t capture_all_cams(motion_slot_t** slots_out)
+{
+    uint8_t order[CAM_POWER_DOWN_PIN_COUNT];
+    size_t cam_count = get_capture_order(order);
+    if (cam_count == 0)
+    {
+        ESP_LOGE(SCHED_TAG, "No cameras connected");
+        return 0;
+    }
+
+    int64_t start_time = esp_timer_get_time();
+
+    // Light level is the same for every camera, only read it once per trigger
+    Camera_image_preset_t preset = select_image_preset();
+
+    int64_t power_on_time = power_on_camera(cam_power_down_pins[order[0]]);
+    size_t slot_count = 0;
+    for (size_t i = 0; i < cam_count; i++)
+    {
+        // Only ever waits when a burst has outrun analysis and the SD writer, the least
+        // significant capture still waiting for analysis makes way for a new one
+        motion_slot_t* slot = motion_slot_acquire(0);
+        if (slot == NULL)
+        {
+            admission_shed_lowest();
+            slot = motion_slot_acquire(pdMS_TO_TICKS(CAPTURE_SLOT_WAIT_MS));
+        }
+        if (slot == NULL)
+        {
+            ESP_LOGE(SCHED_TAG, "No motion slot free, skipping %u cameras", cam_count - i);
+            gpio_set_level(cam_power_down_pins[order[i]], CAM_POWER_OFF);
+            break;
+        }
+
+        int next_pin = -1;
+        if (i + 1 < cam_count)
+        {
+            next_pin = cam_power_down_pins[order[i + 1]];
+        }
+
+        ESP_LOGI(SCHED_TAG, "Capturing on camera %u (pin %i), %u of %u",
+                 order[i] + 1, cam_power_down_pins[order[i]], i + 1, cam_count);
+
+        int64_t cam_start_time = esp_timer_get_time();
+        int64_t next_power_on_time = 0;
+        camera_config_t config = get_default_camera_config(cam_power_down_pins[order[i]]);
+        get_pipelined_motion_capture(config, preset, power_on_time, next_pin, &next_power_on_time,
+                                     &slot->motion, motion_slot_img_buf_len());
+        slots_out[slot_count++] = slot;
+
+        ESP_LOGI(SCHED_TAG, "Camera %u capture took %lldms", order[i] + 1,
+                 (esp_timer_get_time() - cam_start_time) / 1000);
+        power_on_time = next_power_on_time;
+    }
+
+    ESP_LOGI(SCHED_TAG, "Captured %u cameras in %lldms", slot_count,
+             (esp_timer_get_time() - start_time) / 1000);
+    return slot_count;
+}
+
+/// ------------------------------------------
+void report_cam_motion(const uint8_t cam_num, const bool motion_significant)
+{
+    if (cam_num >= CAM_POWER_DOWN_PIN_COUNT)
+    {
+        ESP_LOGW(SCHED_TAG, "Motion reported for invalid camera %u", cam_num);
+        return;
+    }
+
+    // Exponential moving average, older results decay as new captures are analysed
+    uint32_t sample = motion_significant ? CAM_MOTION_SCORE_MAX : 0;
+    cam_motion_scores[cam_num] = ((cam_motion_scores[cam_num] * (256 - CAM_MOTION_SCORE_WEIGHT))
+                                  + (sample * CAM_MOTION_SCORE_WEIGHT)) / 256;
+
+    ESP_LOGI(SCHED_TAG, "Camera %u motion score now %lu", cam_num + 1, cam_motion_scores[cam_num]);
+}
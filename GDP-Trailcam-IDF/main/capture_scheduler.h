@@ -0,0 +1,56 @@
+/// ------------------------------------------
+/// @file capture_scheduler.h
+///
+/// @brief Header file for scheduling motion captures across all connected cameras
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "Camera.h"
+#include "image_types.h"
+#include "motion_slots.h"
+#include "admission.h"
+
+/// @brief Most time to wait for analysis or the SD writer to give a motion slot back
+#define CAPTURE_SLOT_WAIT_MS 5000
+
+/// @brief Weight (out of 256) the newest motion result has on a camera's motion score
+#define CAM_MOTION_SCORE_WEIGHT 64
+
+/// @brief Score a camera receives for a single motion significant capture
+#define CAM_MOTION_SCORE_MAX 1024
+
+/// ------------------------------------------
+/// @brief Gets the order cameras should be captured on for the next trigger
+/// Cameras that recently saw motion are placed first, unused pins are skipped
+///
+/// @param[out] order_out filled with indexes into cam_power_down_pins, sized to CAM_POWER_DOWN_PIN_COUNT
+///
+/// @return number of cameras placed into order_out
+size_t get_capture_order(uint8_t* order_out);
+
+/// ------------------------------------------
+/// @brief Takes a motion capture from every connected camera
+/// Each camera is powered up whilst the previous one is being read out and shut down, so
+/// the total time is close to the sum of the camera readouts rather than full init cycles
+///
+/// @note Every capture is taken into a slot from the motion slot pool, if no slot is given
+/// back in time the remaining cameras are skipped
+///
+/// @param[out] slots_out filled with one slot per camera, sized to CAM_POWER_DOWN_PIN_COUNT,
+/// each slot's capture must be checked for data_valid and the slot released once done with
+///
+/// @return number of slots placed into slots_out
+size_t capture_all_cams(motion_slot_t** slots_out);
+
+/// ------------------------------------------
+/// @brief Feeds the result of motion analysis back into the camera ordering
+///
+/// @param cam_num index into cam_power_down_pins of the camera the capture came from
+/// @param motion_significant was motion found in the capture?
+void report_cam_motion(const uint8_t cam_num, const bool motion_significant);
@@ -0,0 +1,1232 @@
+/// ------------------------------------------
+/// @file capture_store.c
+///
+/// @brief Source file for storing the files of each capture on the SD card
+/// ------------------------------------------
+
+#include "capture_store.h"
+
+#ifdef STORAGE_HOST_BUILD
+#define STORE_LOGE(fmt, ...) fprintf(stderr, "capture_store: " fmt "\n", ##__VA_ARGS__)
+#define STORE_LOGW(fmt, ...) fprintf(stderr, "capture_store: " fmt "\n", ##__VA_ARGS__)
+#define STORE_LOGI(fmt, ...) ((void)0)
+#define STORE_LOCK() true
+#define STORE_UNLOCK()
+
+/// ------------------------------------------
+/// @brief Standard reflected CRC32, matches the ROM function of the same name
+static uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/// ------------------------------------------
+/// @brief Gets a printable error, just the number off target
+static const char* esp_err_to_name(const esp_err_t err)
+{
+    static char name[16];
+    snprintf(name, sizeof(name), "error 0x%x", err);
+    return name;
+}
+#else
+/// @brief Debugging string tag
+static const char* STORE_TAG = "capture_store";
+
+#define STORE_LOGE(fmt, ...) ESP_LOGE(STORE_TAG, fmt, ##__VA_ARGS__)
+#define STORE_LOGW(fmt, ...) ESP_LOGW(STORE_TAG, fmt, ##__VA_ARGS__)
+#define STORE_LOGI(fmt, ...) ESP_LOGI(STORE_TAG, fmt, ##__VA_ARGS__)
+#define STORE_LOCK() xSemaphoreTake(store_mutex, pdMS_TO_TICKS(MAX_SD_WAIT_MS))
+#define STORE_UNLOCK() xSemaphoreGive(store_mutex)
+#endif
+
+/// @brief Backend captures are stored on
+static storage_backend_t* store_backend = NULL;
+
+/// ------------------------------------------
+/// @brief Gets the space a file takes on the card
+///
+/// @param len length of the file
+///
+/// @return len rounded up to whole clusters
+static uint64_t allocated_len(const size_t len)
+{
+    return ((uint64_t)len + SD_ALLOCATION_UNIT_SIZE - 1) / SD_ALLOCATION_UNIT_SIZE * SD_ALLOCATION_UNIT_SIZE;
+}
+
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+
+/// @brief Number of the container in use, kept in RTC memory so wakes skip searching for it
+RTC_DATA_ATTR static uint32_t current_container_num = 0;
+
+#ifndef STORAGE_HOST_BUILD
+/// @brief Mutex controlling acsess to the open container, FatFs locks the volume itself
+static SemaphoreHandle_t store_mutex = NULL;
+#endif
+
+/// @brief Open container file, null when closed
+static storage_handle_t container_file = NULL;
+
+/// @brief In memory copy of the open container's header
+static container_header_t container_header;
+
+/// @brief Index entries of segments written this wake, appended as an index segment on close
+static container_index_entry_t* index_entries = NULL;
+
+/// @brief Number of entries in index_entries
+static size_t index_count = 0;
+
+/// @brief Allocated length of index_entries
+static size_t index_size = 0;
+
+/// ------------------------------------------
+/// @brief Writes and syncs the in memory header to the start of the container
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t write_container_header()
+{
+    container_header.header_crc = esp_rom_crc32_le(0, (const uint8_t*)&container_header,
+                                                   offsetof(container_header_t, header_crc));
+
+    if (store_backend->sync(store_backend, container_file) != ESP_OK ||
+        store_backend->pwrite(store_backend, container_file, 0, &container_header, sizeof(container_header)) != ESP_OK ||
+        store_backend->sync(store_backend, container_file) != ESP_OK)
+    {
+        STORE_LOGE("Failed to write container header");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+/// @brief Opens an existing container and checks its header
+///
+/// @param path of the container
+///
+/// @return ESP_OK if the container is usable, ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_CRC if corrupt
+static esp_err_t open_existing_container(const char* path)
+{
+    if (store_backend->open(store_backend, path, 0, &container_file) != ESP_OK)
+    {
+        container_file = NULL;
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (store_backend->pread(store_backend, container_file, 0, &container_header, sizeof(container_header)) != ESP_OK ||
+        container_header.magic != CONTAINER_MAGIC ||
+        container_header.version != CONTAINER_VERSION ||
+        container_header.header_crc != esp_rom_crc32_le(0, (const uint8_t*)&container_header,
+                                                        offsetof(container_header_t, header_crc)) ||
+        container_header.tail < CONTAINER_DATA_START ||
+        container_header.tail > container_header.capacity)
+    {
+        STORE_LOGE("Container %s has a bad header", path);
+        store_backend->close(store_backend, container_file);
+        container_file = NULL;
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Anything past the tail was never committed and is overwritten by the next segment
+    STORE_LOGI("Opened %s, %lu segments, %lu of %lu bytes used", path,
+             container_header.segment_count, container_header.tail, container_header.capacity);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+/// @brief Creates a new preallocated container and writes its header
+///
+/// @note Opening an existing container would rewrite its header over its captures, so
+/// an existing file is never reused
+///
+/// @param path of the container
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_INVALID_STATE if the file already exists
+static esp_err_t create_container(const char* path)
+{
+    storage_stat_t stat;
+    if (store_backend->stat(store_backend, path, &stat) == ESP_OK)
+    {
+        STORE_LOGE("Not creating %s, it already exists", path);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    STORE_LOGI("Creating %s, %lu bytes", path, CONTAINER_CAPACITY);
+
+    // Preallocated in full so appends never touch the FAT
+    esp_err_t err = store_backend->open(store_backend, path, CONTAINER_CAPACITY, &container_file);
+    if (err != ESP_OK)
+    {
+        STORE_LOGE("Failed to create %s, %s", path, esp_err_to_name(err));
+        container_file = NULL;
+        return err;
+    }
+    retention_note_allocated(allocated_len(CONTAINER_CAPACITY));
+
+    container_header.magic = CONTAINER_MAGIC;
+    container_header.version = CONTAINER_VERSION;
+    container_header.capacity = CONTAINER_CAPACITY;
+    container_header.tail = CONTAINER_DATA_START;
+    container_header.segment_count = 0;
+    container_header.next_capture_num = 0;
+
+    err = write_container_header();
+    if (err != ESP_OK)
+    {
+        store_backend->close(store_backend, container_file);
+        container_file = NULL;
+    }
+    return err;
+}
+
+/// @brief Lowest and highest numbered containers on the card
+typedef struct
+{
+    // Container left out of the search, 0 for none
+    uint32_t skip;
+
+    // Lowest container number found, 0 if none
+    uint32_t lowest;
+
+    // Highest container number found, 0 if none
+    uint32_t highest;
+} container_range_t;
+
+/// ------------------------------------------
+/// @brief storage_visit_cb_t folding each container file into a container_range_t
+static bool note_container(const storage_dir_entry_t* entry, void* arg)
+{
+    container_range_t* range = arg;
+
+    // Only names the store would have written, so CAP1.TCC or CAP00001.TCC.BAK are left alone
+    unsigned long num;
+    char path[32];
+    if (sscanf(entry->name, "CAP%5lu.TCC", &num) != 1 || num == 0 || num == range->skip)
+    {
+        return true;
+    }
+    sprintf(path, CONTAINER_PATH_FORMAT, (uint32_t)num);
+    if (strcmp(path, entry->name) != 0)
+    {
+        return true;
+    }
+
+    if (range->lowest == 0 || num < range->lowest)
+    {
+        range->lowest = num;
+    }
+    if (num > range->highest)
+    {
+        range->highest = num;
+    }
+    return true;
+}
+
+/// ------------------------------------------
+/// @brief Lists the card for the lowest and highest numbered containers
+///
+/// @note Retention deletes from the lowest up, so there is a gap below the containers
+/// left rather than above them and numbers cannot be probed for from 1
+///
+/// @param skip container to leave out, 0 for none
+/// @param[out] range_out lowest and highest found, both 0 if there are none
+///
+/// @return ESP_OK if the card was listed
+static esp_err_t find_containers(const uint32_t skip, container_range_t* range_out)
+{
+    range_out->skip = skip;
+    range_out->lowest = 0;
+    range_out->highest = 0;
+
+    storage_dir_filter_t filter = {
+        .prefix = "CAP",
+        .suffix = ".TCC",
+        .kind = STORAGE_DIR_FILES,
+    };
+    esp_err_t err = storage_visit_dir(store_backend, "", &filter, note_container, range_out);
+    if (err != ESP_OK)
+    {
+        STORE_LOGE("Failed to list containers, %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+/// ------------------------------------------
+/// @brief Moves on to a new container after the current one
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t create_next_container()
+{
+    current_container_num++;
+    char path[32];
+    sprintf(path, CONTAINER_PATH_FORMAT, current_container_num);
+    esp_err_t err = create_container(path);
+    if (err != ESP_ERR_INVALID_STATE)
+    {
+        return err;
+    }
+
+    // The card holds newer containers than this wake knew of, carry on after the last of them
+    container_range_t range;
+    err = find_containers(0, &range);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    current_container_num = range.highest + 1;
+    sprintf(path, CONTAINER_PATH_FORMAT, current_container_num);
+    return create_container(path);
+}
+
+/// ------------------------------------------
+/// @brief Opens the current container, moving on to a new one if it is unusable
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t open_current_container()
+{
+    char path[32];
+
+    // A power on starts from the highest container, a new card from 1
+    if (current_container_num == 0)
+    {
+        container_range_t range;
+        esp_err_t err = find_containers(0, &range);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        current_container_num = range.highest > 0 ? range.highest : 1;
+    }
+
+    sprintf(path, CONTAINER_PATH_FORMAT, current_container_num);
+    esp_err_t err = open_existing_container(path);
+    if (err == ESP_OK)
+    {
+        return ESP_OK;
+    }
+
+    // Leave a damaged container for the extractor to salvage
+    if (err != ESP_ERR_NOT_FOUND)
+    {
+        return create_next_container();
+    }
+
+    return create_container(path);
+}
+
+/// ------------------------------------------
+/// @brief Adds an entry to this wake's index
+///
+/// @param capture_num capture the segment belongs to
+/// @param name of the segment
+/// @param offset of the segment header
+/// @param len of the segment data
+static void add_index_entry(const uint32_t capture_num, const char* name, const uint32_t offset, const uint32_t len)
+{
+    if (index_count == index_size)
+    {
+        container_index_entry_t* grown = realloc(index_entries,
+                                                 (index_size + CONTAINER_INDEX_GROW_STEP) * sizeof(container_index_entry_t));
+        if (grown == NULL)
+        {
+            // Segments are still found by walking the container, only the index is lost
+            STORE_LOGW("Failed to grow index, %s not indexed", name);
+            return;
+        }
+        index_entries = grown;
+        index_size += CONTAINER_INDEX_GROW_STEP;
+    }
+
+    container_index_entry_t* entry = &index_entries[index_count++];
+    entry->capture_num = capture_num;
+    strncpy(entry->name, name, CONTAINER_NAME_LEN);
+    entry->offset = offset;
+    entry->len = len;
+}
+
+/// ------------------------------------------
+/// @brief Appends a segment at the container tail, does not commit the header
+///
+/// @param capture_num capture the segment belongs to
+/// @param name of the segment
+/// @param data buffer of byte data
+/// @param len length of buffer to write
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NO_MEM if the container has no room for the segment
+static esp_err_t append_segment(const uint32_t capture_num, const char* name, const void* data, const uint32_t len)
+{
+    uint32_t offset = container_header.tail;
+    uint32_t padded_len = container_pad_len(len);
+    if (offset + sizeof(container_segment_header_t) + padded_len > container_header.capacity)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    container_segment_header_t segment = {
+        .magic = CONTAINER_SEGMENT_MAGIC,
+        .capture_num = capture_num,
+        .len = len,
+        .data_crc = esp_rom_crc32_le(0, data, len),
+    };
+    strncpy(segment.name, name, CONTAINER_NAME_LEN - 1);
+    segment.header_crc = esp_rom_crc32_le(0, (const uint8_t*)&segment,
+                                          offsetof(container_segment_header_t, header_crc));
+
+    // Container is contiguous from a cluster boundary, so chunks aligned within it are aligned on the card
+    static const uint8_t padding[CONTAINER_SEGMENT_ALIGN] = {0};
+    size_t data_offset = offset + sizeof(segment);
+    if (store_backend->pwrite(store_backend, container_file, offset, &segment, sizeof(segment)) != ESP_OK ||
+        store_backend->pwrite(store_backend, container_file, data_offset, data, len) != ESP_OK ||
+        store_backend->pwrite(store_backend, container_file, data_offset + len, padding, padded_len - len) != ESP_OK)
+    {
+        STORE_LOGE("Failed to append %s", name);
+        return ESP_FAIL;
+    }
+
+    container_header.tail = offset + sizeof(segment) + padded_len;
+    container_header.segment_count++;
+    if (capture_num != CONTAINER_INDEX_CAPTURE_NUM && capture_num >= container_header.next_capture_num)
+    {
+        container_header.next_capture_num = capture_num + 1;
+    }
+
+    if (capture_num != CONTAINER_INDEX_CAPTURE_NUM)
+    {
+        add_index_entry(capture_num, segment.name, offset, len);
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+/// @brief Appends this wake's index segment and commits the header
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t append_index_and_commit()
+{
+    esp_err_t err = ESP_OK;
+    if (index_count > 0)
+    {
+        err = append_segment(CONTAINER_INDEX_CAPTURE_NUM, CONTAINER_INDEX_NAME,
+                             index_entries, index_count * sizeof(container_index_entry_t));
+        if (err != ESP_OK)
+        {
+            // Index is only an accelerator, the segments are still committed below
+            STORE_LOGW("Failed to append index, %s", esp_err_to_name(err));
+        }
+        index_count = 0;
+    }
+
+    err = write_container_header();
+    return err;
+}
+
+/// ------------------------------------------
+/// @brief Closes the full container and starts the next one
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t roll_over_container()
+{
+    STORE_LOGI("Container %lu full, starting next", current_container_num);
+
+    append_index_and_commit();
+    store_backend->close(store_backend, container_file);
+    container_file = NULL;
+
+    return create_next_container();
+}
+
+#else
+
+/// @brief A file written since the last commit
+typedef struct
+{
+    // Capture the file belongs to
+    uint32_t capture_num;
+
+    // File name within the capture
+    char name[CONTAINER_NAME_LEN];
+
+    // Did the capture have no directory yet, so its temporary directory becomes it on commit?
+    bool new_dir;
+} pending_file_t;
+
+/// @brief Files written since the last commit
+static pending_file_t pending_files[CAPTURE_MAX_PENDING];
+
+/// @brief Number of entries in pending_files
+static size_t pending_count = 0;
+
+/// @brief Highest capture number committed to the manifest, kept in RTC memory for numbering
+RTC_DATA_ATTR static uint32_t manifest_last_num = 0;
+
+/// @brief Set once the store is closed, recovery is skipped on the deep sleep wake that follows
+RTC_DATA_ATTR static bool store_closed_cleanly = false;
+
+/// @brief Set when a commit fails this wake, its temporary directory is left for recovery
+static bool orphans_left = false;
+
+/// @brief Names of the files in a capture directory being deleted
+typedef struct
+{
+    // File names
+    char names[CAPTURE_MAX_FILES][STORAGE_PATH_MAX];
+
+    // Number of names
+    size_t count;
+
+    // Space taken by the files
+    uint64_t bytes;
+} capture_dir_files_t;
+
+/// ------------------------------------------
+/// @brief Directory visit callback collecting the files of a capture
+static bool collect_capture_file(const storage_dir_entry_t* entry, void* arg)
+{
+    capture_dir_files_t* files = arg;
+    if (files->count >= CAPTURE_MAX_FILES)
+    {
+        return false;
+    }
+
+    strcpy(files->names[files->count], entry->name);
+    files->count++;
+    files->bytes += allocated_len(entry->stat.size);
+    return true;
+}
+
+/// ------------------------------------------
+/// @brief Removes the files of a capture directory, and the directory itself
+///
+/// @param path of the capture directory
+/// @param[out] freed_out bytes freed on the card
+/// @param[out] removed_dir_out set if the directory itself was removed
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t remove_capture_dir(const char* path, uint64_t* freed_out, bool* removed_dir_out)
+{
+    capture_dir_files_t* files = calloc(1, sizeof(capture_dir_files_t));
+    if (files == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    storage_dir_filter_t filter = {
+        .suffix = NULL,
+        .kind = STORAGE_DIR_FILES,
+    };
+    esp_err_t err = storage_visit_dir(store_backend, path, &filter, collect_capture_file, files);
+    for (size_t i = 0; i < files->count && err == ESP_OK; i++)
+    {
+        char file_path[STORAGE_PATH_MAX * 2];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, files->names[i]);
+        err = store_backend->remove(store_backend, file_path);
+    }
+
+    // A directory too full to list in one go is finished off by the next call
+    *removed_dir_out = false;
+    if (err == ESP_OK && files->count < CAPTURE_MAX_FILES)
+    {
+        err = store_backend->remove(store_backend, path);
+        files->bytes += SD_ALLOCATION_UNIT_SIZE;
+        *removed_dir_out = err == ESP_OK;
+    }
+
+    *freed_out = files->bytes;
+    free(files);
+    return err;
+}
+
+/// ------------------------------------------
+/// @brief Is a pending file part of a commit?
+static bool pending_in_commit(const pending_file_t* file, const uint32_t capture_num, const bool all)
+{
+    return all || file->capture_num == capture_num;
+}
+
+/// ------------------------------------------
+/// @brief Renames the pending files of a capture, or of every capture, to their final names and
+/// appends a manifest record for each capture committed
+///
+/// @param capture_num capture to commit, ignored if all is set
+/// @param all commit every pending file?
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t commit_pending_files(const uint32_t capture_num, const bool all)
+{
+    capture_manifest_record_t records[CAPTURE_MAX_PENDING];
+    size_t record_count = 0;
+    esp_err_t err = ESP_OK;
+
+    for (size_t i = 0; i < pending_count && err == ESP_OK; i++)
+    {
+        const pending_file_t* file = &pending_files[i];
+        if (pending_in_commit(file, capture_num, all) == false)
+        {
+            continue;
+        }
+
+        // Writes of capture and analysis interleave, so a capture's files may not be adjacent
+        capture_manifest_record_t* record = NULL;
+        for (size_t r = 0; r < record_count; r++)
+        {
+            if (records[r].capture_num == file->capture_num)
+            {
+                record = &records[r];
+            }
+        }
+
+        if (record == NULL)
+        {
+            record = &records[record_count++];
+            memset(record, 0, sizeof(*record));
+            record->magic = CAPTURE_MANIFEST_MAGIC;
+            record->capture_num = file->capture_num;
+
+            // Files are closed (and so synced) as they are written, a new capture's directory is moved in one rename
+            if (file->new_dir)
+            {
+                char temp_path[STORAGE_PATH_MAX];
+                char path[STORAGE_PATH_MAX];
+                sprintf(temp_path, CAPTURE_TEMP_DIR_FORMAT, file->capture_num);
+                sprintf(path, CAPTURE_DIR_PREFIX"%lu", file->capture_num);
+                err = store_backend->rename(store_backend, temp_path, path);
+            }
+        }
+
+        // Files added to a committed capture are moved into its directory one at a time
+        if (err == ESP_OK && file->new_dir == false)
+        {
+            char temp_path[STORAGE_PATH_MAX];
+            char path[STORAGE_PATH_MAX];
+            sprintf(temp_path, CAPTURE_TEMP_DIR_FORMAT"/%s", file->capture_num, file->name);
+            sprintf(path, CAPTURE_DIR_PREFIX"%lu/%s", file->capture_num, file->name);
+            err = store_backend->rename(store_backend, temp_path, path);
+        }
+        record->file_count++;
+    }
+
+    // Emptied temporary directories are only removed once every file is moved out of them
+    for (size_t i = 0; i < pending_count && err == ESP_OK; i++)
+    {
+        if (pending_in_commit(&pending_files[i], capture_num, all) && pending_files[i].new_dir == false)
+        {
+            char temp_path[STORAGE_PATH_MAX];
+            storage_stat_t stat;
+            sprintf(temp_path, CAPTURE_TEMP_DIR_FORMAT, pending_files[i].capture_num);
+            if (store_backend->stat(store_backend, temp_path, &stat) == ESP_OK)
+            {
+                err = store_backend->remove(store_backend, temp_path);
+            }
+        }
+    }
+
+    // Files of other captures stay pending, a failed capture is left to recovery
+    size_t kept = 0;
+    for (size_t i = 0; i < pending_count; i++)
+    {
+        if (pending_in_commit(&pending_files[i], capture_num, all) == false)
+        {
+            pending_files[kept++] = pending_files[i];
+        }
+    }
+    pending_count = kept;
+
+    if (err != ESP_OK)
+    {
+        STORE_LOGE("Failed to commit pending files, %s", esp_err_to_name(err));
+        orphans_left = true;
+        return err;
+    }
+    if (record_count == 0)
+    {
+        return ESP_OK;
+    }
+
+    for (size_t i = 0; i < record_count; i++)
+    {
+        records[i].crc = esp_rom_crc32_le(0, (const uint8_t*)&records[i], offsetof(capture_manifest_record_t, crc));
+        if (records[i].capture_num > manifest_last_num)
+        {
+            manifest_last_num = records[i].capture_num;
+        }
+    }
+
+    // One append for the whole commit, recovery only trusts captures with a record
+    return store_backend->append_file(store_backend, CAPTURE_MANIFEST_FILE, records,
+                                      record_count * sizeof(capture_manifest_record_t));
+}
+
+/// ------------------------------------------
+/// @brief Reads the last records of the manifest
+///
+/// @param[out] records buffer of CAPTURE_RECOVERY_TAIL_RECORDS records
+///
+/// @return number of valid records read
+static size_t read_manifest_tail(capture_manifest_record_t* records)
+{
+    storage_stat_t stat;
+    if (store_backend->stat(store_backend, CAPTURE_MANIFEST_FILE, &stat) != ESP_OK)
+    {
+        return 0;
+    }
+
+    // A torn final record from a power loss is dropped by only reading whole records
+    size_t total = stat.size / sizeof(capture_manifest_record_t);
+    size_t count = total < CAPTURE_RECOVERY_TAIL_RECORDS ? total : CAPTURE_RECOVERY_TAIL_RECORDS;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    storage_handle_t handle;
+    if (store_backend->open(store_backend, CAPTURE_MANIFEST_FILE, 0, &handle) != ESP_OK)
+    {
+        return 0;
+    }
+
+    size_t offset = (total - count) * sizeof(capture_manifest_record_t);
+    esp_err_t err = store_backend->pread(store_backend, handle, offset, records,
+                                         count * sizeof(capture_manifest_record_t));
+    store_backend->close(store_backend, handle);
+    if (err != ESP_OK)
+    {
+        return 0;
+    }
+
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (records[i].magic == CAPTURE_MANIFEST_MAGIC &&
+            records[i].crc == esp_rom_crc32_le(0, (const uint8_t*)&records[i], offsetof(capture_manifest_record_t, crc)))
+        {
+            records[valid++] = records[i];
+        }
+    }
+    return valid;
+}
+
+/// @brief Temporary directories found by one listing of the card
+typedef struct
+{
+    // Capture numbers of the directories
+    uint32_t nums[CAPTURE_RECOVERY_BATCH];
+
+    // Number of directories
+    size_t count;
+} temp_dirs_t;
+
+/// ------------------------------------------
+/// @brief storage_visit_cb_t collecting temporary capture directories into a temp_dirs_t
+static bool note_temp_dir(const storage_dir_entry_t* entry, void* arg)
+{
+    temp_dirs_t* dirs = arg;
+
+    // Only names the store would have written
+    unsigned long num;
+    char path[STORAGE_PATH_MAX];
+    if (sscanf(entry->name, "TMP%lu", &num) != 1)
+    {
+        return true;
+    }
+    sprintf(path, CAPTURE_TEMP_DIR_FORMAT, (uint32_t)num);
+    if (strcmp(path, entry->name) != 0)
+    {
+        return true;
+    }
+
+    dirs->nums[dirs->count++] = num;
+    return dirs->count < CAPTURE_RECOVERY_BATCH;
+}
+
+/// ------------------------------------------
+/// @brief Removes whatever an interrupted wake left uncommitted and finds the last committed
+/// capture from the manifest tail
+///
+/// @note Nothing is pending before the store is opened, so every temporary directory on the
+/// card is an orphan whichever capture number it was handed out as
+static void recover_uncommitted()
+{
+    capture_manifest_record_t* records = malloc(CAPTURE_RECOVERY_TAIL_RECORDS * sizeof(capture_manifest_record_t));
+    temp_dirs_t* dirs = malloc(sizeof(temp_dirs_t));
+    if (records == NULL || dirs == NULL)
+    {
+        free(records);
+        free(dirs);
+        return;
+    }
+
+    size_t count = read_manifest_tail(records);
+    manifest_last_num = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (records[i].capture_num > manifest_last_num)
+        {
+            manifest_last_num = records[i].capture_num;
+        }
+    }
+
+    storage_dir_filter_t filter = {
+        .prefix = "TMP",
+        .suffix = NULL,
+        .kind = STORAGE_DIR_DIRS,
+    };
+    char path[STORAGE_PATH_MAX];
+    uint64_t freed;
+    uint64_t freed_total = 0;
+    bool removed_dir;
+    size_t removed = 0;
+
+    // Listed again after each batch is removed, until a listing comes back short
+    esp_err_t err = ESP_OK;
+    do
+    {
+        dirs->count = 0;
+        err = storage_visit_dir(store_backend, "", &filter, note_temp_dir, dirs);
+        for (size_t i = 0; i < dirs->count && err == ESP_OK; i++)
+        {
+            sprintf(path, CAPTURE_TEMP_DIR_FORMAT, dirs->nums[i]);
+            err = remove_capture_dir(path, &freed, &removed_dir);
+            freed_total += freed;
+            removed += removed_dir ? 1 : 0;
+        }
+    } while (err == ESP_OK && dirs->count == CAPTURE_RECOVERY_BATCH);
+
+    if (err != ESP_OK)
+    {
+        STORE_LOGE("Failed to remove uncommitted captures, %s", esp_err_to_name(err));
+    }
+
+    // The orphans were counted as allocated when written, or the free space is queried afresh
+    retention_note_freed(freed_total);
+
+    STORE_LOGI("Recovery checked %u manifest records, last commit %lu, %u cleaned up, %llu bytes freed",
+             count, manifest_last_num, removed, freed_total);
+    free(dirs);
+    free(records);
+}
+
+/// ------------------------------------------
+/// @brief storage_visit_cb_t keeping the lowest capture directory number in a uint32_t
+static bool note_capture_dir(const storage_dir_entry_t* entry, void* arg)
+{
+    uint32_t* lowest = arg;
+
+    // Only names the store would have written
+    unsigned long num;
+    char path[STORAGE_PATH_MAX];
+    if (sscanf(entry->name, CAPTURE_DIR_PREFIX"%lu", &num) != 1 || num == 0)
+    {
+        return true;
+    }
+    sprintf(path, CAPTURE_DIR_PREFIX"%lu", num);
+    if (strcmp(path, entry->name) != 0)
+    {
+        return true;
+    }
+
+    if (*lowest == 0 || num < *lowest)
+    {
+        *lowest = num;
+    }
+    return true;
+}
+
+/// ------------------------------------------
+/// @brief Lists the card for the lowest numbered capture directory
+///
+/// @param[out] lowest_out lowest found, 0 if there are none
+///
+/// @return ESP_OK if the card was listed
+static esp_err_t find_lowest_capture_dir(uint32_t* lowest_out)
+{
+    *lowest_out = 0;
+    storage_dir_filter_t filter = {
+        .prefix = CAPTURE_DIR_PREFIX,
+        .suffix = NULL,
+        .kind = STORAGE_DIR_DIRS,
+    };
+    esp_err_t err = storage_visit_dir(store_backend, "", &filter, note_capture_dir, lowest_out);
+    if (err != ESP_OK)
+    {
+        STORE_LOGE("Failed to list capture directories, %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+#endif // CONFIG_CAPTURE_STORAGE_CONTAINER
+
+/// ------------------------------------------
+esp_err_t capture_store_init(storage_backend_t* backend)
+{
+    store_backend = backend;
+    STORE_LOGI("Storing captures on %s", backend->name);
+
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+#ifndef STORAGE_HOST_BUILD
+    if (store_mutex == NULL)
+    {
+        store_mutex = xSemaphoreCreateMutex();
+    }
+#endif
+
+    if (!STORE_LOCK())
+    {
+        STORE_LOGE("Unable to grab store mutex!");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (container_file == NULL)
+    {
+        err = open_current_container();
+    }
+
+    STORE_UNLOCK();
+    return err;
+#else
+    // A deep sleep wake after a clean close has nothing to recover, only power loss needs the check
+    if (store_closed_cleanly == false)
+    {
+        recover_uncommitted();
+    }
+    store_closed_cleanly = false;
+    return ESP_OK;
+#endif
+}
+
+/// ------------------------------------------
+esp_err_t capture_store_write(const uint32_t capture_num, const char* name, const void* data, const size_t len)
+{
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    if (!STORE_LOCK())
+    {
+        STORE_LOGE("Unable to grab store mutex!");
+        return ESP_FAIL;
+    }
+
+    if (container_file == NULL)
+    {
+        STORE_UNLOCK();
+        STORE_LOGE("No open container for %s", name);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = append_segment(capture_num, name, data, len);
+    if (err == ESP_ERR_NO_MEM && container_header.tail > CONTAINER_DATA_START)
+    {
+        err = roll_over_container();
+        if (err == ESP_OK)
+        {
+            err = append_segment(capture_num, name, data, len);
+        }
+    }
+
+    STORE_UNLOCK();
+
+    if (err != ESP_OK)
+    {
+        STORE_LOGE("Failed to store %lu/%s, %s", capture_num, name, esp_err_to_name(err));
+    }
+    return err;
+#else
+    // Only reached if commits are failing or never asked for, the oldest capture is committed as it stands
+    if (pending_count == CAPTURE_MAX_PENDING)
+    {
+        STORE_LOGW("Too many uncommitted files, committing capture %lu early", pending_files[0].capture_num);
+        if (commit_pending_files(pending_files[0].capture_num, false) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+    }
+
+    // Until committed every file is written into the capture's temporary directory, which
+    // becomes the capture's directory if it has none yet
+    char path[STORAGE_PATH_MAX];
+    storage_stat_t stat;
+    pending_file_t* pending = &pending_files[pending_count];
+    sprintf(path, CAPTURE_DIR_PREFIX"%lu", capture_num);
+    pending->new_dir = store_backend->stat(store_backend, path, &stat) != ESP_OK;
+
+    sprintf(path, CAPTURE_TEMP_DIR_FORMAT, capture_num);
+    if (store_backend->stat(store_backend, path, &stat) != ESP_OK)
+    {
+        if (store_backend->make_dir(store_backend, path) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+        // A directory's entries take a cluster of their own
+        retention_note_allocated(SD_ALLOCATION_UNIT_SIZE);
+    }
+    sprintf(path, CAPTURE_TEMP_DIR_FORMAT"/%s", capture_num, name);
+
+    esp_err_t err = store_backend->write_file(store_backend, path, data, len);
+    if (err == ESP_OK)
+    {
+        retention_note_allocated(allocated_len(len));
+        pending->capture_num = capture_num;
+        strncpy(pending->name, name, CONTAINER_NAME_LEN - 1);
+        pending->name[CONTAINER_NAME_LEN - 1] = '\0';
+        pending_count++;
+    }
+    return err;
+#endif
+}
+
+/// ------------------------------------------
+esp_err_t capture_store_commit(const uint32_t capture_num)
+{
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    if (!STORE_LOCK())
+    {
+        STORE_LOGE("Unable to grab store mutex!");
+        return ESP_FAIL;
+    }
+
+    // The header tail covers every segment appended so far, other captures' files written before
+    // this one's are committed with it
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (container_file != NULL)
+    {
+        err = write_container_header();
+    }
+
+    STORE_UNLOCK();
+    return err;
+#else
+    return commit_pending_files(capture_num, false);
+#endif
+}
+
+/// ------------------------------------------
+esp_err_t capture_store_close()
+{
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    if (!STORE_LOCK())
+    {
+        STORE_LOGE("Unable to grab store mutex!");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (container_file != NULL)
+    {
+        err = append_index_and_commit();
+        store_backend->close(store_backend, container_file);
+        container_file = NULL;
+    }
+
+    free(index_entries);
+    index_entries = NULL;
+    index_count = 0;
+    index_size = 0;
+
+    STORE_UNLOCK();
+    return err;
+#else
+    esp_err_t err = commit_pending_files(0, true);
+    store_closed_cleanly = err == ESP_OK && orphans_left == false;
+    orphans_left = false;
+    return err;
+#endif
+}
+
+/// ------------------------------------------
+esp_err_t capture_store_locate(const uint32_t capture_num, const char* name, capture_location_t* location_out)
+{
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    if (!STORE_LOCK())
+    {
+        STORE_LOGE("Unable to grab store mutex!");
+        return ESP_FAIL;
+    }
+
+    // Only this wake's segments are indexed in memory, newest last
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    for (size_t i = index_count; i > 0; i--)
+    {
+        const container_index_entry_t* entry = &index_entries[i - 1];
+        if (entry->capture_num == capture_num && strncmp(entry->name, name, CONTAINER_NAME_LEN) == 0)
+        {
+            location_out->container_num = current_container_num;
+            location_out->offset = entry->offset;
+            location_out->len = entry->len;
+            err = ESP_OK;
+            break;
+        }
+    }
+
+    STORE_UNLOCK();
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/// ------------------------------------------
+/// @brief Checks if the directory of a capture exists
+///
+/// @param num capture number
+///
+/// @return does CAPTURE<num> exist?
+static bool capture_dir_exists(const size_t num)
+{
+    char path[STORAGE_PATH_MAX];
+    sprintf(path, CAPTURE_DIR_PREFIX"%u", num);
+
+    storage_stat_t stat;
+    return store_backend->stat(store_backend, path, &stat) == ESP_OK && stat.is_dir;
+}
+
+/// ------------------------------------------
+uint32_t capture_store_find_next_capture_num(const uint32_t hint)
+{
+    size_t num = hint;
+
+    capture_hwm_record_t record = {0};
+    size_t read_len = 0;
+    if (store_backend->read_file(store_backend, CAPTURE_HWM_FILE, &record, sizeof(record), &read_len) == ESP_OK &&
+        read_len == sizeof(record) &&
+        record.next_num == ~record.next_num_inv &&
+        record.next_num > num)
+    {
+        num = record.next_num;
+    }
+
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    // Container records the last capture committed, covering counts never written back
+    if (container_file != NULL && container_header.next_capture_num > num)
+    {
+        num = container_header.next_capture_num;
+    }
+#else
+    // Manifest records the last capture committed, covering counts never written back
+    if (manifest_last_num + 1 > num)
+    {
+        num = manifest_last_num + 1;
+    }
+#endif
+
+    // A free slot at the mark is trusted, gaps below it are harmless
+    if (num > 0 && capture_dir_exists(num) == false)
+    {
+        STORE_LOGI("Next capture number is: %u", num);
+        return num;
+    }
+
+    // Mark is lost or stale, gallop up from it to bracket the first free number
+    size_t used = num;
+    size_t step = 1;
+    size_t free_num = num + step;
+    while (capture_dir_exists(free_num))
+    {
+        used = free_num;
+        step *= 2;
+        free_num = num + step;
+    }
+
+    // Binary search between the last used and first free numbers found
+    while (free_num - used > 1)
+    {
+        size_t mid = used + (free_num - used) / 2;
+        if (capture_dir_exists(mid))
+        {
+            used = mid;
+        }
+        else
+        {
+            free_num = mid;
+        }
+    }
+
+    STORE_LOGI("Next capture number is: %u", free_num);
+    return free_num;
+}
+
+/// ------------------------------------------
+esp_err_t capture_store_set_next_capture_num(const uint32_t next_num)
+{
+    capture_hwm_record_t record = {
+        .next_num = next_num,
+        .next_num_inv = ~next_num,
+    };
+    return store_backend->write_file(store_backend, CAPTURE_HWM_FILE, &record, sizeof(record));
+}
+
+/// ------------------------------------------
+esp_err_t capture_store_delete_oldest(uint32_t* cursor, const uint32_t limit, uint64_t* freed_out)
+{
+    char path[STORAGE_PATH_MAX];
+    storage_stat_t stat;
+
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    // Containers are listed rather than counted from the cursor, a power on may leave
+    // older containers numbered anywhere below the open one
+    container_range_t range;
+    esp_err_t err = find_containers(current_container_num, &range);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (range.lowest == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    sprintf(path, CONTAINER_PATH_FORMAT, range.lowest);
+    err = store_backend->stat(store_backend, path, &stat);
+    if (err == ESP_OK)
+    {
+        STORE_LOGI("Deleting %s", path);
+        err = store_backend->remove(store_backend, path);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    *freed_out = allocated_len(stat.size);
+    *cursor = range.lowest + 1;
+    return ESP_OK;
+#else
+    // The cursor is lost with RTC memory on power loss, retention has deleted from the bottom
+    // so the card is listed rather than every number from 1 stat'd
+    if (*cursor == 0)
+    {
+        uint32_t lowest;
+        esp_err_t err = find_lowest_capture_dir(&lowest);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        *cursor = lowest > 0 ? lowest : limit;
+    }
+
+    // Numbers below the cursor are known to be gone, those above it may have gaps from failed captures
+    uint32_t num = *cursor;
+    for (; num < limit; num++)
+    {
+        sprintf(path, CAPTURE_DIR_PREFIX"%lu", num);
+        if (store_backend->stat(store_backend, path, &stat) != ESP_OK)
+        {
+            continue;
+        }
+
+        STORE_LOGI("Deleting %s", path);
+        bool removed_dir;
+        esp_err_t err = remove_capture_dir(path, freed_out, &removed_dir);
+        *cursor = removed_dir ? num + 1 : num;
+        return err;
+    }
+
+    *cursor = num;
+    return ESP_ERR_NOT_FOUND;
+#endif
+}
@@ -0,0 +1,215 @@
+/// ------------------------------------------
+/// @file capture_store.h
+///
+/// @brief Header file for storing the files of each capture on the SD card, either
+/// appended to a preallocated container file or as one directory per capture
+///
+/// @note The container layout is described in capture_container.h, tools/tcc_extract.c
+/// unpacks a container back into the directory layout. Define STORAGE_HOST_BUILD
+/// to build outside of IDF, tools/storage_bench_host.c benchmarks it on the POSIX and RAM
+/// disk backends
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STORAGE_HOST_BUILD
+// As SDSPI.h and Kconfig, which need IDF
+#define CAPTURE_DIR_PREFIX "CAPTURE"
+#define SD_ALLOCATION_UNIT_SIZE (16 * 1024)
+#define RTC_DATA_ATTR
+#ifndef CONFIG_CAPTURE_CONTAINER_SIZE_MB
+#define CONFIG_CAPTURE_CONTAINER_SIZE_MB 256
+#endif
+#else
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "SDSPI.h"
+#endif
+
+#include "storage_backend.h"
+#include "storage_dir.h"
+#include "capture_container.h"
+
+#ifdef STORAGE_HOST_BUILD
+/// @brief Provided by the host tool in place of retention.c
+void retention_note_allocated(const uint64_t bytes);
+void retention_note_freed(const uint64_t bytes);
+#else
+#include "retention.h"
+#endif
+
+/// @brief Path format of container files, takes the container number
+#define CONTAINER_PATH_FORMAT "CAP%05lu.TCC"
+
+/// @brief Preallocated size of each container file in bytes
+#define CONTAINER_CAPACITY ((uint32_t)CONFIG_CAPTURE_CONTAINER_SIZE_MB * 1024 * 1024)
+
+/// @brief Number of index entries the index buffer grows by when full
+#define CONTAINER_INDEX_GROW_STEP 32
+
+/// @brief Max files in one capture directory that can be deleted
+#define CAPTURE_MAX_FILES 16
+
+/// @brief Path format of the directory a capture's files are written to until committed,
+/// takes the capture number. Kept within 8.3 names up to capture 99999
+#define CAPTURE_TEMP_DIR_FORMAT "TMP%lu"
+
+/// @brief Append only manifest of committed captures, directory layout only
+#define CAPTURE_MANIFEST_FILE "CAPMAN.BIN"
+
+/// @brief Manifest record magic, "CMAN"
+#define CAPTURE_MANIFEST_MAGIC 0x4E414D43
+
+/// @brief Uncommitted files that can be pending at once, more forces an early commit of the oldest capture
+#define CAPTURE_MAX_PENDING 32
+
+/// @brief Manifest records read back by recovery
+#define CAPTURE_RECOVERY_TAIL_RECORDS 16
+
+/// @brief Temporary directories recovery collects per listing of the card
+#define CAPTURE_RECOVERY_BATCH 16
+
+/// @brief Record appended to the manifest for each capture touched by a commit
+typedef struct __attribute__((packed))
+{
+    // CAPTURE_MANIFEST_MAGIC
+    uint32_t magic;
+
+    // Capture the record commits
+    uint32_t capture_num;
+
+    // Files of the capture committed by this record
+    uint16_t file_count;
+
+    // Unused, 0
+    uint16_t reserved;
+
+    // CRC32 of all previous fields
+    uint32_t crc;
+} capture_manifest_record_t;
+
+/// @brief File holding the capture number high water mark
+#define CAPTURE_HWM_FILE "CAPHWM.BIN"
+
+/// @brief Contents of the capture number high water mark file
+typedef struct {
+    // Next capture number to be written
+    uint32_t next_num;
+
+    // Bitwise inverse of next_num, detects a torn or corrupt record
+    uint32_t next_num_inv;
+} capture_hwm_record_t;
+
+///--------------------------------------------------------
+/// @brief Opens the current capture container, creating a new one if there is none
+/// or the current one is unusable.
+///
+/// @note Backend must be ready for use, containers are only opened when storing in containers
+///
+/// @param backend to store captures on
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_store_init(storage_backend_t* backend);
+
+///--------------------------------------------------------
+/// @brief Writes one file of a capture
+///
+/// @note In container mode the file is not durable until capture_store_commit is called
+///
+/// @param capture_num number of the capture the file belongs to
+/// @param name file name within the capture, at most CONTAINER_NAME_LEN - 1 characters
+/// @param data buffer of byte data
+/// @param len length of buffer to write
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_store_write(const uint32_t capture_num, const char* name, const void* data, const size_t len);
+
+///--------------------------------------------------------
+/// @brief Makes the files written so far for a capture durable, leaving other captures
+/// being written alongside it uncommitted
+///
+/// @note In container mode this updates the header tail and syncs the container to the card,
+/// which commits every segment appended so far whichever capture it belongs to. A capture cut
+/// off part way keeps the files that were already complete
+///
+/// @param capture_num capture to commit
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_store_commit(const uint32_t capture_num);
+
+///--------------------------------------------------------
+/// @brief Appends the index of all files written this wake, commits and closes the container.
+/// In directory mode every capture still uncommitted is committed as it stands.
+/// Should be called once all writes are done, before deep sleep.
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_store_close();
+
+///--------------------------------------------------------
+/// @brief Finds the next avalible number of capture to be written
+///
+/// @note Starts from the largest of the hint, the high water mark file and the open container,
+/// only falling back to a galloping search over the capture directories if all are lost
+/// or stale, so a handful of lookups are made however many captures exist
+///
+/// @param hint last known next capture number (e.g. from NVS), 0 if unknown
+///
+/// @return next avalible number
+uint32_t capture_store_find_next_capture_num(const uint32_t hint);
+
+///--------------------------------------------------------
+/// @brief Records the next capture number in the high water mark file
+///
+/// @param next_num next capture number to be written
+///
+/// @return ESP_OK if sucsessful
+esp_err_t capture_store_set_next_capture_num(const uint32_t next_num);
+
+/// @brief Where a file of a capture is stored within a container
+typedef struct
+{
+    // Number of the container
+    uint32_t container_num;
+
+    // Offset of the file's segment header
+    uint32_t offset;
+
+    // Length of the file
+    uint32_t len;
+} capture_location_t;
+
+///--------------------------------------------------------
+/// @brief Finds where a file written this wake is stored within its container
+///
+/// @param capture_num capture the file belongs to
+/// @param name of the file within the capture
+/// @param[out] location_out container and offset of the file
+///
+/// @return ESP_OK if found, ESP_ERR_NOT_FOUND if not written this wake, ESP_ERR_NOT_SUPPORTED
+/// when storing captures as directories
+esp_err_t capture_store_locate(const uint32_t capture_num, const char* name, capture_location_t* location_out);
+
+///--------------------------------------------------------
+/// @brief Deletes the oldest capture directory, or the oldest container when storing in containers
+///
+/// @note The container in use is never deleted. Containers are found by listing the card,
+/// the cursor only bounds the search for capture directories. A cursor of 0 (lost on power
+/// loss) is seeded from a listing of the lowest capture directory
+///
+/// @param[in,out] cursor lowest number that may still exist, advanced past the deleted one
+/// @param limit captures from this number on are never deleted, unused for containers
+/// @param[out] freed_out bytes freed on the card, rounded up to whole clusters
+///
+/// @return ESP_OK if one was deleted, ESP_ERR_NOT_FOUND if there is nothing left to delete
+esp_err_t capture_store_delete_oldest(uint32_t* cursor, const uint32_t limit, uint64_t* freed_out);
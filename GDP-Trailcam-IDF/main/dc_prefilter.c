@@ -0,0 +1,569 @@
+/// ------------------------------------------
+/// @file dc_prefilter.c
+///
+/// @brief Source file for the compressed domain motion pre-filter
+/// ------------------------------------------
+
+#include "dc_prefilter.h"
+
+#include <string.h>
+
+/// @brief Most components a frame can have, the camera only produces 1 or 3
+#define MAX_COMPONENTS 3
+
+/// @brief Most blocks a component can have in one MCU
+#define MAX_SAMPLING 4
+
+/// @brief A component of the frame and the tables its scan uses
+typedef struct
+{
+    // Component id from the frame header
+    uint8_t id;
+
+    // Horizontal and vertical sampling factors
+    uint8_t h;
+    uint8_t v;
+
+    // Quantization table
+    uint8_t tq;
+
+    // Huffman tables from the scan header
+    const dc_prefilter_huff_t* dc;
+    const dc_prefilter_huff_t* ac;
+
+    // DC predictor
+    int32_t pred;
+} component_t;
+
+/// @brief Reads entropy coded bits, removing stuffed bytes and stopping at markers
+typedef struct
+{
+    // Next byte to read
+    const uint8_t* pos;
+
+    // End of the jpg
+    const uint8_t* end;
+
+    // Buffered bits, MSB first
+    uint32_t bits;
+
+    // Number of buffered bits
+    int count;
+
+    // Has a marker been reached? Zeros are read from then on
+    bool at_marker;
+} bit_reader_t;
+
+/// ------------------------------------------
+/// @brief Reads a big endian 16 bit value
+static inline uint16_t get_u16(const uint8_t* buf)
+{
+    return (buf[0] << 8) | buf[1];
+}
+
+/// ------------------------------------------
+/// @brief Tops up the bit buffer to at least 25 bits
+static inline void fill_bits(bit_reader_t* reader)
+{
+    while (reader->count <= 24)
+    {
+        uint32_t byte = 0;
+        if (reader->at_marker == false && reader->pos < reader->end)
+        {
+            byte = *reader->pos;
+            if (byte == 0xFF)
+            {
+                // 0xFF00 is a stuffed 0xFF, anything else ends the entropy coded data
+                if (reader->pos + 1 < reader->end && reader->pos[1] == 0x00)
+                {
+                    reader->pos += 2;
+                }
+                else
+                {
+                    reader->at_marker = true;
+                    byte = 0;
+                }
+            }
+            else
+            {
+                reader->pos++;
+            }
+        }
+
+        reader->bits |= byte << (24 - reader->count);
+        reader->count += 8;
+    }
+}
+
+/// ------------------------------------------
+/// @brief Drops bits from the buffer, at most 16 after a fill
+static inline void skip_bits(bit_reader_t* reader, const int n)
+{
+    reader->bits <<= n;
+    reader->count -= n;
+}
+
+/// ------------------------------------------
+/// @brief Reads a coefficient's extra bits and sign extends them
+///
+/// @param reader to read from
+/// @param size number of bits, 1 to 16
+///
+/// @return signed value
+static inline int32_t receive_extend(bit_reader_t* reader, const int size)
+{
+    fill_bits(reader);
+    int32_t value = reader->bits >> (32 - size);
+    skip_bits(reader, size);
+    if (value < (1 << (size - 1)))
+    {
+        value -= (1 << size) - 1;
+    }
+    return value;
+}
+
+/// ------------------------------------------
+/// @brief Decodes one Huffman symbol
+///
+/// @return symbol, -1 if the bits do not match any code
+static inline int decode_symbol(bit_reader_t* reader, const dc_prefilter_huff_t* table)
+{
+    fill_bits(reader);
+    uint32_t prefix = reader->bits >> (32 - DC_PREFILTER_HUFF_LOOKAHEAD);
+    int len = table->lookup_len[prefix];
+    if (len > 0)
+    {
+        skip_bits(reader, len);
+        return table->lookup_sym[prefix];
+    }
+
+    for (len = DC_PREFILTER_HUFF_LOOKAHEAD + 1; len <= 16; len++)
+    {
+        int32_t code = reader->bits >> (32 - len);
+        if (code <= table->maxcode[len])
+        {
+            skip_bits(reader, len);
+            return table->vals[(table->valoffset[len] + code) & 0xFF];
+        }
+    }
+    return -1;
+}
+
+/// ------------------------------------------
+/// @brief Parses the tables of a DHT segment
+///
+/// @return DC_PREFILTER_OK if sucsessful
+static int parse_dht(dc_prefilter_decoder_t* decoder, const uint8_t* seg, size_t len)
+{
+    while (len > 17)
+    {
+        uint8_t table_class = seg[0] >> 4;
+        uint8_t table_id = seg[0] & 0x0F;
+        if (table_class > 1 || table_id >= DC_PREFILTER_HUFF_TABLES)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+
+        const uint8_t* counts = seg + 1;
+        size_t total = 0;
+        for (size_t i = 0; i < 16; i++)
+        {
+            total += counts[i];
+        }
+        if (total > 256 || 17 + total > len)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+
+        dc_prefilter_huff_t* table = table_class == 0 ? &decoder->dc[table_id] : &decoder->ac[table_id];
+        memset(table->lookup_len, 0, sizeof(table->lookup_len));
+        memcpy(table->vals, seg + 17, total);
+
+        // Canonical codes, each length's codes follow on from the last length's shifted up a bit
+        int32_t code = 0;
+        int32_t k = 0;
+        for (int bits = 1; bits <= 16; bits++)
+        {
+            table->valoffset[bits] = k - code;
+            for (size_t i = 0; i < counts[bits - 1]; i++, code++, k++)
+            {
+                if (bits <= DC_PREFILTER_HUFF_LOOKAHEAD)
+                {
+                    int shift = DC_PREFILTER_HUFF_LOOKAHEAD - bits;
+                    for (int32_t fill = 0; fill < (1 << shift); fill++)
+                    {
+                        table->lookup_len[(code << shift) | fill] = bits;
+                        table->lookup_sym[(code << shift) | fill] = table->vals[k];
+                    }
+                }
+            }
+            table->maxcode[bits] = counts[bits - 1] > 0 ? code - 1 : -1;
+            code <<= 1;
+        }
+        table->defined = true;
+
+        seg += 17 + total;
+        len -= 17 + total;
+    }
+    return DC_PREFILTER_OK;
+}
+
+/// ------------------------------------------
+/// @brief Parses the DC entries of a DQT segment
+///
+/// @return DC_PREFILTER_OK if sucsessful
+static int parse_dqt(dc_prefilter_decoder_t* decoder, const uint8_t* seg, size_t len)
+{
+    while (len > 0)
+    {
+        bool wide = (seg[0] >> 4) != 0;
+        uint8_t table_id = seg[0] & 0x0F;
+        size_t table_len = wide ? 129 : 65;
+        if (table_id >= 4 || table_len > len)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+
+        // Zigzag order starts with the DC entry
+        decoder->dc_quant[table_id] = wide ? get_u16(seg + 1) : seg[1];
+        seg += table_len;
+        len -= table_len;
+    }
+    return DC_PREFILTER_OK;
+}
+
+/// ------------------------------------------
+/// @brief Moves the reader past the next restart marker and resets the DC predictors
+///
+/// @return DC_PREFILTER_OK if a restart marker was found
+static int restart(bit_reader_t* reader, component_t* components, const size_t component_count)
+{
+    // Any buffered bits are padding, the marker is at or shortly after the read position
+    const uint8_t* pos = reader->pos;
+    while (pos + 1 < reader->end && (pos[0] != 0xFF || pos[1] < 0xD0 || pos[1] > 0xD7))
+    {
+        pos++;
+    }
+    if (pos + 1 >= reader->end)
+    {
+        return DC_PREFILTER_ERR_FORMAT;
+    }
+
+    reader->pos = pos + 2;
+    reader->bits = 0;
+    reader->count = 0;
+    reader->at_marker = false;
+    for (size_t c = 0; c < component_count; c++)
+    {
+        components[c].pred = 0;
+    }
+    return DC_PREFILTER_OK;
+}
+
+/// ------------------------------------------
+/// @brief Decodes one block, returning its DC and skipping past its AC coefficients
+///
+/// @param reader to read from
+/// @param component the block belongs to
+/// @param[out] dc_out dequantization is left to the caller
+///
+/// @return DC_PREFILTER_OK if sucsessful
+static inline int decode_block(bit_reader_t* reader, component_t* component, int32_t* dc_out)
+{
+    int size = decode_symbol(reader, component->dc);
+    if (size < 0 || size > 16)
+    {
+        return DC_PREFILTER_ERR_FORMAT;
+    }
+    if (size > 0)
+    {
+        component->pred += receive_extend(reader, size);
+    }
+    *dc_out = component->pred;
+
+    for (int k = 1; k < 64;)
+    {
+        int symbol = decode_symbol(reader, component->ac);
+        if (symbol < 0)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+
+        int run = symbol >> 4;
+        size = symbol & 0x0F;
+        if (size > 0)
+        {
+            fill_bits(reader);
+            skip_bits(reader, size);
+            k += run + 1;
+        }
+        else if (run == 15)
+        {
+            k += 16;
+        }
+        else
+        {
+            // End of block
+            break;
+        }
+    }
+    return DC_PREFILTER_OK;
+}
+
+/// ------------------------------------------
+int dc_prefilter_thumbnail(dc_prefilter_decoder_t* decoder, const uint8_t* jpg, const size_t jpg_len,
+                           uint8_t* thumb_out, const size_t thumb_len, size_t* width_out, size_t* height_out)
+{
+    if (jpg_len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8)
+    {
+        return DC_PREFILTER_ERR_FORMAT;
+    }
+
+    for (size_t t = 0; t < DC_PREFILTER_HUFF_TABLES; t++)
+    {
+        decoder->dc[t].defined = false;
+        decoder->ac[t].defined = false;
+    }
+    memset(decoder->dc_quant, 0, sizeof(decoder->dc_quant));
+
+    component_t components[MAX_COMPONENTS];
+    size_t component_count = 0;
+    size_t width = 0;
+    size_t height = 0;
+    uint32_t restart_interval = 0;
+
+    // Walk the segments up to the start of scan
+    const uint8_t* pos = jpg + 2;
+    const uint8_t* end = jpg + jpg_len;
+    while (1)
+    {
+        // Markers may be padded with any number of 0xFF
+        while (pos < end && *pos != 0xFF)
+        {
+            pos++;
+        }
+        while (pos < end && *pos == 0xFF)
+        {
+            pos++;
+        }
+        if (pos + 3 > end)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+
+        uint8_t marker = *pos++;
+        if (marker == 0xD9)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            continue;
+        }
+
+        size_t seg_len = get_u16(pos);
+        if (seg_len < 2 || pos + seg_len > end)
+        {
+            return DC_PREFILTER_ERR_FORMAT;
+        }
+        const uint8_t* seg = pos + 2;
+        size_t len = seg_len - 2;
+        pos += seg_len;
+
+        int err = DC_PREFILTER_OK;
+        if (marker == 0xC0 || marker == 0xC1)
+        {
+            if (len < 6 || seg[0] != 8)
+            {
+                return DC_PREFILTER_ERR_UNSUPPORTED;
+            }
+            height = get_u16(seg + 1);
+            width = get_u16(seg + 3);
+            component_count = seg[5];
+            if (width == 0 || height == 0 || component_count == 0 || component_count > MAX_COMPONENTS ||
+                len < 6 + component_count * 3)
+            {
+                return DC_PREFILTER_ERR_UNSUPPORTED;
+            }
+
+            for (size_t c = 0; c < component_count; c++)
+            {
+                const uint8_t* spec = seg + 6 + c * 3;
+                components[c].id = spec[0];
+                components[c].h = spec[1] >> 4;
+                components[c].v = spec[1] & 0x0F;
+                components[c].tq = spec[2] & 0x03;
+                if (components[c].h == 0 || components[c].h > MAX_SAMPLING ||
+                    components[c].v == 0 || components[c].v > MAX_SAMPLING)
+                {
+                    return DC_PREFILTER_ERR_UNSUPPORTED;
+                }
+            }
+        }
+        else if ((marker >= 0xC2 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            // Progressive, lossless, hierarchical or arithmetic coded
+            return DC_PREFILTER_ERR_UNSUPPORTED;
+        }
+        else if (marker == 0xC4)
+        {
+            err = parse_dht(decoder, seg, len);
+        }
+        else if (marker == 0xDB)
+        {
+            err = parse_dqt(decoder, seg, len);
+        }
+        else if (marker == 0xDD)
+        {
+            restart_interval = len >= 2 ? get_u16(seg) : 0;
+        }
+        else if (marker == 0xDA)
+        {
+            // Only a single scan with every component, as the camera writes
+            if (component_count == 0 || len < 1 || seg[0] != component_count || len < 1 + component_count * 2)
+            {
+                return DC_PREFILTER_ERR_UNSUPPORTED;
+            }
+            for (size_t c = 0; c < component_count; c++)
+            {
+                const uint8_t* spec = seg + 1 + c * 2;
+                if (spec[0] != components[c].id)
+                {
+                    return DC_PREFILTER_ERR_UNSUPPORTED;
+                }
+                uint8_t dc_id = spec[1] >> 4;
+                uint8_t ac_id = spec[1] & 0x0F;
+                if (dc_id >= DC_PREFILTER_HUFF_TABLES || ac_id >= DC_PREFILTER_HUFF_TABLES ||
+                    decoder->dc[dc_id].defined == false || decoder->ac[ac_id].defined == false)
+                {
+                    return DC_PREFILTER_ERR_FORMAT;
+                }
+                components[c].dc = &decoder->dc[dc_id];
+                components[c].ac = &decoder->ac[ac_id];
+                components[c].pred = 0;
+            }
+            break;
+        }
+
+        if (err != DC_PREFILTER_OK)
+        {
+            return err;
+        }
+    }
+
+    size_t thumb_width = (width + 7) / 8;
+    size_t thumb_height = (height + 7) / 8;
+    if (thumb_width * thumb_height > thumb_len)
+    {
+        return DC_PREFILTER_ERR_SIZE;
+    }
+    if (width_out != NULL)
+    {
+        *width_out = thumb_width;
+    }
+    if (height_out != NULL)
+    {
+        *height_out = thumb_height;
+    }
+
+    // A single component is coded one block at a time whatever its sampling factors
+    uint8_t h_max = 1;
+    uint8_t v_max = 1;
+    if (component_count == 1)
+    {
+        components[0].h = 1;
+        components[0].v = 1;
+    }
+    for (size_t c = 0; c < component_count; c++)
+    {
+        h_max = components[c].h > h_max ? components[c].h : h_max;
+        v_max = components[c].v > v_max ? components[c].v : v_max;
+    }
+    size_t mcus_x = (width + 8 * h_max - 1) / (8 * h_max);
+    size_t mcus_y = (height + 8 * v_max - 1) / (8 * v_max);
+
+    // Luma is the first component, its DC is 8 times the block's mean level less 128
+    component_t* luma = &components[0];
+    int32_t luma_quant = decoder->dc_quant[luma->tq];
+
+    bit_reader_t reader = {
+        .pos = pos,
+        .end = end,
+    };
+
+    size_t mcu_count = mcus_x * mcus_y;
+    for (size_t mcu = 0; mcu < mcu_count; mcu++)
+    {
+        if (restart_interval > 0 && mcu > 0 && mcu % restart_interval == 0)
+        {
+            int err = restart(&reader, components, component_count);
+            if (err != DC_PREFILTER_OK)
+            {
+                return err;
+            }
+        }
+
+        size_t mcu_x = mcu % mcus_x;
+        size_t mcu_y = mcu / mcus_x;
+        for (size_t c = 0; c < component_count; c++)
+        {
+            component_t* component = &components[c];
+            for (uint8_t by = 0; by < component->v; by++)
+            {
+                for (uint8_t bx = 0; bx < component->h; bx++)
+                {
+                    int32_t dc;
+                    int err = decode_block(&reader, component, &dc);
+                    if (err != DC_PREFILTER_OK)
+                    {
+                        return err;
+                    }
+
+                    if (component != luma)
+                    {
+                        continue;
+                    }
+
+                    // Blocks in the MCU padding past the edge of the image are dropped
+                    size_t col = mcu_x * luma->h + bx;
+                    size_t row = mcu_y * luma->v + by;
+                    if (col < thumb_width && row < thumb_height)
+                    {
+                        int32_t level = 128 + (dc * luma_quant) / 8;
+                        thumb_out[row * thumb_width + col] = level < 0 ? 0 : (level > 255 ? 255 : level);
+                    }
+                }
+            }
+        }
+    }
+
+    return DC_PREFILTER_OK;
+}
+
+/// ------------------------------------------
+size_t dc_prefilter_changed_blocks(const uint8_t* thumb1, const uint8_t* thumb2, const size_t len,
+                                   const unsigned threshold)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    uint32_t diff_sum = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        diff_sum += thumb1[i] > thumb2[i] ? thumb1[i] - thumb2[i] : thumb2[i] - thumb1[i];
+    }
+    uint32_t needed_diff = diff_sum / len + threshold;
+
+    size_t changed = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint32_t diff = thumb1[i] > thumb2[i] ? thumb1[i] - thumb2[i] : thumb2[i] - thumb1[i];
+        if (diff >= needed_diff)
+        {
+            changed++;
+        }
+    }
+    return changed;
+}
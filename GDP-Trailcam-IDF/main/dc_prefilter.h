@@ -0,0 +1,127 @@
+/// ------------------------------------------
+/// @file dc_prefilter.h
+///
+/// @brief Header file for the compressed domain motion pre-filter, rejects captures
+/// without motion from the DC coefficients of their jpgs alone
+///
+/// @note Shared with the host side tools, must only depend on the C standard library
+///
+/// The DC coefficient of each 8x8 block is the block's mean level, so entropy decoding
+/// just the DCs gives a 1/8 scale luma thumbnail without any IDCT or colour conversion.
+/// AC coefficients still have to be Huffman decoded to find where each block ends, but
+/// their values are skipped. The thumbnails of a capture's two images are compared in
+/// the same way as the full resolution subtraction, with a threshold above the average
+/// change, and a capture with too few changed blocks is rejected before any pixel decode.
+///
+/// Only baseline and extended sequential Huffman jpgs are supported, with 8 bit samples
+/// and every component in a single scan, as the camera produces.
+/// ------------------------------------------
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Decode sucsessful
+#define DC_PREFILTER_OK 0
+
+/// @brief Not a jpg, or the data is truncated or corrupt
+#define DC_PREFILTER_ERR_FORMAT -1
+
+/// @brief A jpg coding the decoder does not handle, such as progressive or arithmetic
+#define DC_PREFILTER_ERR_UNSUPPORTED -2
+
+/// @brief Thumbnail buffer is smaller than the image needs
+#define DC_PREFILTER_ERR_SIZE -3
+
+/// @brief Bits of code looked up in one step, longer codes are walked a bit at a time
+#define DC_PREFILTER_HUFF_LOOKAHEAD 8
+
+/// @brief Number of Huffman tables of each class a jpg can define
+#define DC_PREFILTER_HUFF_TABLES 4
+
+/// @brief A decoded Huffman table
+typedef struct
+{
+    // Code length of each DC_PREFILTER_HUFF_LOOKAHEAD bit prefix, 0 if the code is longer
+    uint8_t lookup_len[1 << DC_PREFILTER_HUFF_LOOKAHEAD];
+
+    // Symbol of each DC_PREFILTER_HUFF_LOOKAHEAD bit prefix
+    uint8_t lookup_sym[1 << DC_PREFILTER_HUFF_LOOKAHEAD];
+
+    // Largest code of each length, -1 if there are none
+    int32_t maxcode[17];
+
+    // Offset from a code of each length to its symbol in vals
+    int32_t valoffset[17];
+
+    // Symbols in code order
+    uint8_t vals[256];
+
+    // Has the jpg defined this table?
+    bool defined;
+} dc_prefilter_huff_t;
+
+/// @brief Tables of the jpg being decoded, large enough to be worth keeping off the stack
+typedef struct
+{
+    // DC tables then AC tables
+    dc_prefilter_huff_t dc[DC_PREFILTER_HUFF_TABLES];
+    dc_prefilter_huff_t ac[DC_PREFILTER_HUFF_TABLES];
+
+    // First (DC) entry of each quantization table
+    uint16_t dc_quant[4];
+} dc_prefilter_decoder_t;
+
+/// ------------------------------------------
+/// @brief Gets the length of the thumbnail of an image, one pixel per 8x8 block
+///
+/// @param width of the image
+/// @param height of the image
+///
+/// @return thumbnail length in bytes
+static inline size_t dc_prefilter_thumbnail_len(const size_t width, const size_t height)
+{
+    return ((width + 7) / 8) * ((height + 7) / 8);
+}
+
+///--------------------------------------------------------
+/// @brief Builds the 1/8 scale luma thumbnail of a jpg from its DC coefficients
+///
+/// @param decoder workspace, its contents are not kept between calls
+/// @param jpg jpg data
+/// @param jpg_len length of the jpg data
+/// @param[out] thumb_out thumbnail, row major with one byte per 8x8 luma block
+/// @param thumb_len length of thumb_out
+/// @param[out] width_out thumbnail width, may be null
+/// @param[out] height_out thumbnail height, may be null
+///
+/// @return DC_PREFILTER_OK if sucsessful, otherwise a DC_PREFILTER_ERR_ code
+int dc_prefilter_thumbnail(dc_prefilter_decoder_t* decoder, const uint8_t* jpg, const size_t jpg_len,
+                           uint8_t* thumb_out, const size_t thumb_len, size_t* width_out, size_t* height_out);
+
+///--------------------------------------------------------
+/// @brief Counts the blocks that changed between two thumbnails, a block changes when its
+/// difference is at least threshold above the average difference
+///
+/// @param thumb1 first thumbnail
+/// @param thumb2 second thumbnail, the same size
+/// @param len length of each thumbnail
+/// @param threshold level above the average difference a block must change by
+///
+/// @return number of changed blocks
+size_t dc_prefilter_changed_blocks(const uint8_t* thumb1, const uint8_t* thumb2, const size_t len,
+                                   const unsigned threshold);
+
+///--------------------------------------------------------
+/// @brief Decides whether two thumbnails could hold significant motion
+///
+/// @param changed_blocks from dc_prefilter_changed_blocks
+/// @param len length of each thumbnail
+/// @param min_permille changed blocks, per mille of all blocks, needed to pass
+///
+/// @return true if the capture should go on to full analysis
+static inline bool dc_prefilter_passes(const size_t changed_blocks, const size_t len, const unsigned min_permille)
+{
+    return (uint64_t)changed_blocks * 1000 >= (uint64_t)len * min_permille;
+}
@@ -0,0 +1,203 @@
+/// ------------------------------------------
+/// @file exposure_control.c
+///
+/// @brief Source file for tracking the sensor auto exposure so frames are only
+/// used once exposure has settled
+/// ------------------------------------------
+
+#include "exposure_control.h"
+
+/// @brief Logging tag
+static const char* EXPOSURE_TAG = "exposure_control";
+
+/// @brief Settled exposure of each camera, kept in RTC memory so it survives deep sleep
+RTC_DATA_ATTR static exposure_seed_t exposure_seeds[EXPOSURE_SEED_COUNT];
+
+/// ------------------------------------------
+/// @brief Checks two values are within a percentage tolerance of each other
+///
+/// @param a first value
+/// @param b second value
+/// @param tolerance_pct allowed difference as a percentage of the larger value
+///
+/// @return are the two values within tolerance?
+static bool within_tolerance(const int a, const int b, const int tolerance_pct)
+{
+    int larger = a > b ? a : b;
+    return abs(a - b) * 100 <= larger * tolerance_pct;
+}
+
+/// ------------------------------------------
+esp_err_t read_exposure_state(sensor_t* s, exposure_state_t* state_out)
+{
+    // 0x3500-0x3502 hold exposure as 4.4 fixed point in a 20 bit field, low 4 bits are fractional
+    int exposure_raw = s->get_reg(s, OV5640_REG_AEC_EXPOSURE, 0x0FFFFF);
+    int gain_raw = s->get_reg(s, OV5640_REG_AGC_GAIN, 0x03FF);
+    if (exposure_raw < 0 || gain_raw < 0)
+    {
+        ESP_LOGE(EXPOSURE_TAG, "Failed to read exposure registers");
+        return ESP_FAIL;
+    }
+
+    state_out->aec_value = exposure_raw >> 4;
+    state_out->agc_gain = gain_raw;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t wait_for_exposure_convergence(exposure_report_t* report_out)
+{
+    report_out->converged = false;
+    report_out->converge_ms = 0;
+    report_out->discarded_frames = 0;
+
+    sensor_t* s = esp_camera_sensor_get();
+    if (s == NULL)
+    {
+        ESP_LOGE(EXPOSURE_TAG, "Failed to grab sensor ptr");
+        return ESP_FAIL;
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    int64_t timeout_us = (int64_t)EXPOSURE_CONVERGE_TIMEOUT_MS * 1000;
+
+    exposure_state_t last_state = {0};
+    size_t last_len = 0;
+    size_t stable_frames = 0;
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+    while (esp_timer_get_time() - start_time < timeout_us)
+    {
+        // Frames are only used to pace the loop to the sensor's AEC updates, which happen once per frame
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb)
+        {
+            ESP_LOGE(EXPOSURE_TAG, "Frame buffer could not be acquired");
+            ret = ESP_FAIL;
+            break;
+        }
+        size_t len = fb->len;
+        esp_camera_fb_return(fb);
+        report_out->discarded_frames++;
+
+        exposure_state_t state;
+        if (read_exposure_state(s, &state) != ESP_OK)
+        {
+            ret = ESP_FAIL;
+            break;
+        }
+
+        if (report_out->discarded_frames > 1
+            && within_tolerance(state.aec_value, last_state.aec_value, EXPOSURE_STABLE_TOLERANCE_PCT)
+            && within_tolerance(state.agc_gain, last_state.agc_gain, EXPOSURE_STABLE_TOLERANCE_PCT)
+            && within_tolerance(len, last_len, EXPOSURE_JPEG_LEN_TOLERANCE_PCT))
+        {
+            stable_frames++;
+        }
+        else
+        {
+            stable_frames = 0;
+        }
+
+        last_state = state;
+        last_len = len;
+
+        if (stable_frames >= EXPOSURE_STABLE_FRAMES)
+        {
+            report_out->converged = true;
+            ret = ESP_OK;
+            break;
+        }
+    }
+
+    report_out->state = last_state;
+    report_out->converge_ms = (esp_timer_get_time() - start_time) / 1000;
+
+    if (report_out->converged)
+    {
+        ESP_LOGI(EXPOSURE_TAG, "Exposure settled in %lums, %lu frames discarded (aec %i, gain %i)",
+                 report_out->converge_ms, report_out->discarded_frames,
+                 last_state.aec_value, last_state.agc_gain);
+    }
+    else
+    {
+        ESP_LOGW(EXPOSURE_TAG, "Exposure not settled after %lums, %lu frames discarded",
+                 report_out->converge_ms, report_out->discarded_frames);
+    }
+
+    return ret;
+}
+
+
+/// ------------------------------------------
+bool get_exposure_seed(const uint8_t cam_num, exposure_state_t* seed_out)
+{
+    if (cam_num >= EXPOSURE_SEED_COUNT || !exposure_seeds[cam_num].valid)
+    {
+        return false;
+    }
+
+    *seed_out = exposure_seeds[cam_num].state;
+    return true;
+}
+
+/// ------------------------------------------
+void store_exposure_seed(const uint8_t cam_num, const exposure_state_t* state)
+{
+    if (cam_num >= EXPOSURE_SEED_COUNT)
+    {
+        return;
+    }
+
+    exposure_seeds[cam_num].state = *state;
+    exposure_seeds[cam_num].valid = true;
+}
+
+/// ------------------------------------------
+esp_err_t load_exposure_seeds_from_nvs()
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(EXPOSURE_SEED_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    exposure_seed_t seeds[EXPOSURE_SEED_COUNT];
+    size_t size = sizeof(seeds);
+    err = nvs_get_blob(handle, EXPOSURE_SEED_NVS_KEY, seeds, &size);
+    nvs_close(handle);
+
+    if (err != ESP_OK || size != sizeof(seeds))
+    {
+        ESP_LOGW(EXPOSURE_TAG, "No exposure seeds in NVS");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    memcpy(exposure_seeds, seeds, sizeof(seeds));
+    ESP_LOGI(EXPOSURE_TAG, "Exposure seeds loaded from NVS");
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t save_exposure_seeds_to_nvs()
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(EXPOSURE_SEED_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = nvs_set_blob(handle, EXPOSURE_SEED_NVS_KEY, exposure_seeds, sizeof(exposure_seeds));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(EXPOSURE_TAG, "Failed to save exposure seeds, %s", esp_err_to_name(err));
+    }
+    return err;
+}
\ No newline at end of file
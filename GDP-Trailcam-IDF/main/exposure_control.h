@@ -0,0 +1,134 @@
+/// ------------------------------------------
+/// @file exposure_control.h
+///
+/// @brief Header file for tracking the sensor auto exposure so frames are only
+/// used once exposure has settled
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "nvs.h"
+
+/// @brief OV5640 register holding the top bits of the current exposure, read as 24 bits with the next two
+#define OV5640_REG_AEC_EXPOSURE 0x3500
+
+/// @brief OV5640 register holding the current real gain, read as 16 bits with the next
+#define OV5640_REG_AGC_GAIN 0x350A
+
+/// @brief Maximum time allowed for exposure to settle before frames are used anyway
+#define EXPOSURE_CONVERGE_TIMEOUT_MS 1500
+
+/// @brief Number of consecutive frames that must agree before exposure is considered stable
+#define EXPOSURE_STABLE_FRAMES 2
+
+/// @brief Percent the exposure or gain can change between frames and still count as stable
+#define EXPOSURE_STABLE_TOLERANCE_PCT 3
+
+/// @brief Percent the JPEG size can change between frames and still count as stable
+#define EXPOSURE_JPEG_LEN_TOLERANCE_PCT 5
+
+/// @brief NVS namespace exposure seeds are kept in
+#define EXPOSURE_SEED_NVS_NAMESPACE "storage"
+
+/// @brief NVS key exposure seeds are kept under
+#define EXPOSURE_SEED_NVS_KEY "exp_seeds"
+
+/// @brief Number of cameras exposure seeds are kept for, matches the number of power down pins
+#define EXPOSURE_SEED_COUNT 4
+
+/// @brief Current exposure state of the sensor
+typedef struct
+{
+    // Exposure time in sensor lines
+    int aec_value;
+
+    // Real gain, 6.4 fixed point
+    int agc_gain;
+} exposure_state_t;
+
+/// @brief Last settled exposure of a camera, used to start the next capture near the right exposure
+typedef struct
+{
+    // Has a settled exposure been recorded for this camera?
+    bool valid;
+
+    // Exposure state the camera settled at
+    exposure_state_t state;
+} exposure_seed_t;
+
+/// @brief Report on how long the auto exposure took to settle
+typedef struct
+{
+    // Did exposure settle before the timeout?
+    bool converged;
+
+    // ms between starting the wait and exposure settling (or timing out)
+    uint32_t converge_ms;
+
+    // Frames grabbed and thrown away whilst waiting
+    uint32_t discarded_frames;
+
+    // Exposure state at the point of settling
+    exposure_state_t state;
+} exposure_report_t;
+
+/// ------------------------------------------
+/// @brief Reads the current exposure and gain directly from the sensor
+///
+/// @param s sensor to read from
+/// @param[out] state_out filled with the current exposure state
+///
+/// @return ESP_OK if sucsessful
+esp_err_t read_exposure_state(sensor_t* s, exposure_state_t* state_out);
+
+/// ------------------------------------------
+/// @brief Grabs and discards frames from the active camera until the auto exposure
+/// and gain have stopped changing, or EXPOSURE_CONVERGE_TIMEOUT_MS has passed
+///
+/// @note The next frame grabbed after this returns will be exposed with settled values
+///
+/// @param[out] report_out filled with convergence time and discarded frame count
+///
+/// @return ESP_OK if exposure settled, ESP_ERR_TIMEOUT if the timeout was hit,
+/// ESP_FAIL if the camera could not be read
+esp_err_t wait_for_exposure_convergence(exposure_report_t* report_out);
+
+
+/// ------------------------------------------
+/// @brief Gets the exposure a camera last settled at
+///
+/// @param cam_num index into cam_power_down_pins of the camera
+/// @param[out] seed_out filled with the settled exposure state
+///
+/// @return true if a seed exists for this camera
+bool get_exposure_seed(const uint8_t cam_num, exposure_state_t* seed_out);
+
+/// ------------------------------------------
+/// @brief Records the exposure a camera settled at, kept in RTC memory across deep sleep
+///
+/// @param cam_num index into cam_power_down_pins of the camera
+/// @param state settled exposure state
+void store_exposure_seed(const uint8_t cam_num, const exposure_state_t* state);
+
+/// ------------------------------------------
+/// @brief Restores exposure seeds from NVS, used when RTC memory was lost (power on)
+///
+/// @note Requires nvs_flash_init to have been run
+///
+/// @return ESP_OK if seeds were loaded
+esp_err_t load_exposure_seeds_from_nvs();
+
+/// ------------------------------------------
+/// @brief Saves the exposure seeds into NVS so they survive power loss
+///
+/// @note Requires nvs_flash_init to have been run
+///
+/// @return ESP_OK if seeds were saved
+esp_err_t save_exposure_seeds_to_nvs();
\ No newline at end of file
@@ -30,7 +30,7 @@ size_t map_pixel_to_bufidx(point_t pixel, size_t img_width, size_t bytes_per_pix
 }
 
 /// ------------------------------------------
-bool find_motion_centre(grayscale_image_t* motion_img, point_t* outPoint)
+bool find_motion_centre(grayscale_image_t* motion_img, point_t* outPoint, size_t* motion_pix_count_out)
 {
     quantize_motion_img(motion_img);
 
@@ -51,6 +51,10 @@ bool find_motion_centre(grayscale_image_t* motion_img, point_t* outPoint)
     }
 
     ESP_LOGI(CROP_TAG, "Image has %u motion pixels", motion_pix_count);
+    if (motion_pix_count_out != NULL)
+    {
+        *motion_pix_count_out = motion_pix_count;
+    }
 
     size_t needed_pixels = MOTION_PIX_REQ_PERCENT * motion_img->width * motion_img->height;
 
@@ -83,6 +87,7 @@ bool find_motion_centre(grayscale_image_t* motion_img, point_t* outPoint)
 /// ------------------------------------------
 void quantize_motion_img(grayscale_image_t* motion_img)
 {
+    TRACE_BEGIN(TRACE_SPAN_QUANTIZE);
     uint32_t pixel_avg = 0;
     for (size_t i = 0; i < motion_img->len; i++)
     {
@@ -101,6 +106,7 @@ void quantize_motion_img(grayscale_image_t* motion_img)
             motion_img->buf[i] = 0;
         }
     }
+    TRACE_END(TRACE_SPAN_QUANTIZE);
 }
 
 /// ------------------------------------------
@@ -147,66 +153,267 @@ void draw_motion_box(grayscale_image_t* motion_img, point_t box_origin)
 }
 
 /// ------------------------------------------
-jpg_image_t crop_jpg_img(const jpg_image_t* source_img, point_t crop_origin)
+/// @brief Appends a LEB128 varint to a buffer
+///
+/// @param buf buffer to write into
+/// @param pos write position, advanced past the varint
+/// @param cap capacity of the buffer
+/// @param value value to write
+///
+/// @return false if the buffer is full
+static bool put_varint(uint8_t* buf, size_t* pos, const size_t cap, size_t value)
 {
-    jpg_image_t cropped_jpg;
-    cropped_jpg.buf = NULL;
+    do
+    {
+        if (*pos >= cap)
+        {
+            return false;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf[(*pos)++] = value ? byte | 0x80 : byte;
+    } while (value);
 
-    ESP_LOGI(CROP_TAG, "jpg image cropping started");
+    return true;
+}
 
-    // First, convert whole image to rgb565
-    uint8_t* source_rgb = malloc(source_img->height * source_img->width * 2);
-    if (jpg2rgb565(source_img->buf, source_img->len, source_rgb, JPG_SCALE_NONE) == false)
+/// ------------------------------------------
+esp_err_t encode_motion_mask(const grayscale_image_t* motion_img, const point_t* box_origin,
+                             capture_arena_t* arena, uint8_t** out_buf, size_t* out_len)
+{
+    // Bit packing bounds the output, run lengths only win whilst they fit within it
+    size_t bitpack_len = motion_mask_bitpack_len(motion_img->width, motion_img->height);
+    uint8_t* buf = capture_arena_alloc_output(arena, sizeof(motion_mask_header_t) + bitpack_len);
+    if (buf == NULL)
     {
-        ESP_LOGI(CROP_TAG, "JPG to RGB565 conversion failed");
-        free(source_rgb);
-        return cropped_jpg;
+        ESP_LOGE(CROP_TAG, "Failed to allocate %u bytes for motion mask", sizeof(motion_mask_header_t) + bitpack_len);
+        return ESP_ERR_NO_MEM;
     }
 
+    uint8_t* payload = buf + sizeof(motion_mask_header_t);
+    size_t payload_len = 0;
+    size_t set_count = 0;
+    bool rle_fits = true;
 
-    rgb565_image_t cropped_rgb;
-    // setup crop buffer to extract crop into
-    cropped_rgb.len = BOUNDING_BOX_EDGE_LEN * BOUNDING_BOX_EDGE_LEN * 2;
-    cropped_rgb.width = BOUNDING_BOX_EDGE_LEN;
-    cropped_rgb.height = BOUNDING_BOX_EDGE_LEN;
-    cropped_rgb.buf = malloc(cropped_rgb.len);
-
-    point_t crop_end;
-    crop_end.x = crop_origin.x + BOUNDING_BOX_EDGE_LEN;
-    crop_end.y = crop_origin.y + BOUNDING_BOX_EDGE_LEN;
-    size_t crop_idx = 0;
-    for (size_t y = crop_origin.y; y < crop_end.y; y++)
+    bool run_set = false;
+    size_t run_len = 0;
+    for (size_t i = 0; i < motion_img->len && rle_fits; i++)
     {
-        for (size_t x = crop_origin.x; x < crop_end.x; x++)
+        bool pix_set = motion_img->buf[i] != 0;
+        set_count += pix_set;
+        if (pix_set != run_set)
         {
-            point_t cur_p;
-            cur_p.x = x;
-            cur_p.y = y;
-            size_t cur_source_idx = map_pixel_to_bufidx(cur_p, source_img->width, 2);
+            rle_fits = put_varint(payload, &payload_len, bitpack_len, run_len);
+            run_set = pix_set;
+            run_len = 0;
+        }
+        run_len++;
+    }
+    rle_fits = rle_fits && put_varint(payload, &payload_len, bitpack_len, run_len);
 
-            cropped_rgb.buf[crop_idx] = source_rgb[cur_source_idx];
-            cropped_rgb.buf[crop_idx+1] = source_rgb[cur_source_idx+1];
+    uint8_t encoding = MOTION_MASK_ENCODING_RLE;
+    if (rle_fits == false)
+    {
+        encoding = MOTION_MASK_ENCODING_BITPACK;
+        payload_len = bitpack_len;
+        memset(payload, 0, bitpack_len);
 
-            crop_idx += 2;
+        set_count = 0;
+        for (size_t i = 0; i < motion_img->len; i++)
+        {
+            if (motion_img->buf[i] != 0)
+            {
+                payload[i / 8] |= 0x80 >> (i % 8);
+                set_count++;
+            }
         }
     }
 
-    free(source_rgb);
+    motion_mask_header_t header = {
+        .magic = MOTION_MASK_MAGIC,
+        .version = MOTION_MASK_VERSION,
+        .encoding = encoding,
+        .width = motion_img->width,
+        .height = motion_img->height,
+        .box_x = box_origin ? box_origin->x : MOTION_MASK_NO_BOX,
+        .box_y = box_origin ? box_origin->y : MOTION_MASK_NO_BOX,
+        .box_len = BOUNDING_BOX_EDGE_LEN,
+        .set_count = set_count,
+        .payload_len = payload_len,
+    };
+    memcpy(buf, &header, sizeof(header));
+
+    ESP_LOGI(CROP_TAG, "Motion mask encoded to %u bytes (%s), from %u",
+             sizeof(header) + payload_len, encoding == MOTION_MASK_ENCODING_RLE ? "rle" : "bitpack", motion_img->len);
+
+    *out_buf = buf;
+    *out_len = sizeof(header) + payload_len;
+    return ESP_OK;
+}
+
+/// @brief Output of fmt2jpg_cb into a fixed buffer
+typedef struct
+{
+    // Buffer to write into
+    uint8_t* buf;
 
-    if (fmt2jpg(cropped_rgb.buf, cropped_rgb.len, cropped_rgb.width, cropped_rgb.height, PIXFORMAT_RGB565, 240, &cropped_jpg.buf, &cropped_jpg.len) == false)
+    // Capacity of the buffer
+    size_t capacity;
+
+    // Bytes written so far
+    size_t len;
+
+    // Set if the encoder produced more than the buffer holds
+    bool overflowed;
+} jpg_out_buffer_t;
+
+/// ------------------------------------------
+/// @brief fmt2jpg_cb callback appending encoded jpg data to a jpg_out_buffer_t
+///
+/// @return bytes taken
+static size_t write_jpg_out(void* arg, size_t index, const void* data, size_t len)
+{
+    jpg_out_buffer_t* out = arg;
+    if (data == NULL)
+    {
+        // End of image
+        return 0;
+    }
+    if (len > out->capacity - out->len)
+    {
+        // The encoder carries on regardless, the caller checks the flag
+        out->overflowed = true;
+        return 0;
+    }
+
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+    return len;
+}
+
+/// ------------------------------------------
+jpg_image_t crop_jpg_img(const jpg_image_t* source_img, point_t crop_origin, capture_arena_t* arena)
+{
+    jpg_image_t cropped_jpg;
+    cropped_jpg.buf = NULL;
+
+    ESP_LOGI(CROP_TAG, "jpg image cropping started");
+
+    rgb565_image_t cropped_rgb;
+    cropped_rgb.len = BOUNDING_BOX_EDGE_LEN * BOUNDING_BOX_EDGE_LEN * 2;
+    cropped_rgb.width = BOUNDING_BOX_EDGE_LEN;
+    cropped_rgb.height = BOUNDING_BOX_EDGE_LEN;
+    cropped_rgb.buf = capture_arena_alloc(arena, cropped_rgb.len);
+    if (cropped_rgb.buf == NULL)
+    {
+        ESP_LOGE(CROP_TAG, "No room for rgb565 crop");
+        return cropped_jpg;
+    }
+
+    // Only the crop is kept as the jpg is decoded, the whole image is never held as rgb565
+    TRACE_BEGIN(TRACE_SPAN_CROP_DECODE);
+    bool decoded = jpg2rgb565_crop(source_img->buf, source_img->len, cropped_rgb.buf, crop_origin.x, crop_origin.y,
+                                   cropped_rgb.width, cropped_rgb.height);
+    TRACE_END(TRACE_SPAN_CROP_DECODE);
+    if (decoded == false)
+    {
+        ESP_LOGI(CROP_TAG, "JPG to RGB565 conversion failed");
+        capture_arena_pop(arena, cropped_rgb.buf);
+        return cropped_jpg;
+    }
+
+    // The crop is encoded straight into the arena, it is never larger than the raw pixels
+    jpg_out_buffer_t out = {
+        .buf = capture_arena_alloc_output(arena, cropped_rgb.len),
+        .capacity = cropped_rgb.len,
+        .len = 0,
+        .overflowed = false,
+    };
+    bool encoded = false;
+    if (out.buf != NULL)
+    {
+        TRACE_BEGIN(TRACE_SPAN_ENCODE);
+        encoded = fmt2jpg_cb(cropped_rgb.buf, cropped_rgb.len, cropped_rgb.width, cropped_rgb.height,
+                             PIXFORMAT_RGB565, 240, write_jpg_out, &out);
+        TRACE_END(TRACE_SPAN_ENCODE);
+    }
+    if (encoded == false || out.overflowed)
     {
         ESP_LOGI(CROP_TAG, "RGB565 to JPG conversion failed");
-        free(cropped_rgb.buf);
-        if (cropped_jpg.buf != NULL)
-        {
-            free(cropped_jpg.buf);
-            cropped_jpg.buf = NULL;
-        }
+        capture_arena_pop(arena, cropped_rgb.buf);
         return cropped_jpg;
     }
+    capture_arena_pop(arena, cropped_rgb.buf);
 
-    cropped_rgb.height = BOUNDING_BOX_EDGE_LEN;
-    cropped_rgb.width = BOUNDING_BOX_EDGE_LEN;
+    cropped_jpg.buf = out.buf;
+    cropped_jpg.len = out.len;
+    cropped_jpg.height = BOUNDING_BOX_EDGE_LEN;
+    cropped_jpg.width = BOUNDING_BOX_EDGE_LEN;
     ESP_LOGI(CROP_TAG, "Cropping done");
     return cropped_jpg;
-}
\ No newline at end of file
+}
+
+/// ------------------------------------------
+jpg_image_t encode_motion_preview(const grayscale_image_t* motion_img, capture_arena_t* arena)
+{
+    jpg_image_t preview_jpg;
+    preview_jpg.buf = NULL;
+
+    grayscale_image_t preview;
+    preview.width = motion_img->width / MOTION_PREVIEW_SCALE;
+    preview.height = motion_img->height / MOTION_PREVIEW_SCALE;
+    preview.len = preview.width * preview.height;
+    preview.buf = capture_arena_alloc(arena, preview.len);
+    if (preview.buf == NULL)
+    {
+        ESP_LOGE(CROP_TAG, "No room for motion preview");
+        return preview_jpg;
+    }
+
+    for (size_t y = 0; y < preview.height; y++)
+    {
+        for (size_t x = 0; x < preview.width; x++)
+        {
+            uint32_t sum = 0;
+            for (size_t by = 0; by < MOTION_PREVIEW_SCALE; by++)
+            {
+                const uint8_t* row = motion_img->buf + (y * MOTION_PREVIEW_SCALE + by) * motion_img->width +
+                                     x * MOTION_PREVIEW_SCALE;
+                for (size_t bx = 0; bx < MOTION_PREVIEW_SCALE; bx++)
+                {
+                    sum += row[bx];
+                }
+            }
+            preview.buf[y * preview.width + x] = sum / (MOTION_PREVIEW_SCALE * MOTION_PREVIEW_SCALE);
+        }
+    }
+
+    // A difference image is mostly flat, its jpg is far smaller than the pixels and overflow is only logged
+    jpg_out_buffer_t out = {
+        .buf = capture_arena_alloc_output(arena, preview.len / 2),
+        .capacity = preview.len / 2,
+        .len = 0,
+        .overflowed = false,
+    };
+    bool encoded = false;
+    if (out.buf != NULL)
+    {
+        TRACE_BEGIN(TRACE_SPAN_ENCODE);
+        encoded = fmt2jpg_cb(preview.buf, preview.len, preview.width, preview.height,
+                             PIXFORMAT_GRAYSCALE, 80, write_jpg_out, &out);
+        TRACE_END(TRACE_SPAN_ENCODE);
+    }
+    capture_arena_pop(arena, preview.buf);
+    if (encoded == false || out.overflowed)
+    {
+        ESP_LOGI(CROP_TAG, "Motion preview to JPG conversion failed");
+        return preview_jpg;
+    }
+
+    preview_jpg.buf = out.buf;
+    preview_jpg.len = out.len;
+    preview_jpg.width = preview.width;
+    preview_jpg.height = preview.height;
+    ESP_LOGI(CROP_TAG, "Motion preview encoded to %u bytes", out.len);
+    return preview_jpg;
+}
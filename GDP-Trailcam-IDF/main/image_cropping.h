@@ -13,7 +13,10 @@
 #include "esp_camera.h"
 
 #include "image_types.h"
+#include "capture_arena.h"
+#include "motion_mask.h"
 #include "SDSPI.h"
+#include "trace.h"
 
 /// @brief The length in pixels of the created square bounding box
 #define BOUNDING_BOX_EDGE_LEN 640
@@ -24,6 +27,12 @@
 /// @brief Percent of an images pixels required to be above motion threshold to count as a relevant image
 #define MOTION_PIX_REQ_PERCENT 0.005
 
+/// @brief Divisor of each side of the motion image for its grayscale jpg preview
+#define MOTION_PREVIEW_SCALE 4
+
+/// @brief Name of the motion preview file within a capture
+#define MOTION_PREVIEW_FILE_NAME "motion.jpg"
+
 /// @brief Struct for storing a point in an image, origin is at top left and coord space runs (0,0) -> (w-1,h-1)
 /// where w is image width and h is image height
 typedef struct
@@ -70,9 +79,10 @@ size_t map_pixel_to_bufidx(point_t pixel, size_t img_width, size_t bytes_per_pix
 ///
 /// @param motion_img input motion image for evaluation
 /// @param[out] outPoint origin for the bounding box, invalid if return is false
+/// @param[out] motion_pix_count_out number of pixels passing the motion threshold, may be null
 ///
 /// @return does this image contain significant motion?
-bool find_motion_centre(grayscale_image_t* motion_img, point_t* outPoint);
+bool find_motion_centre(grayscale_image_t* motion_img, point_t* outPoint, size_t* motion_pix_count_out);
 
 /// ------------------------------------------
 /// @brief Draw the square bounding box onto the grayscale image using white pixels
@@ -89,12 +99,46 @@ void draw_motion_box(grayscale_image_t* motion_img, point_t box_origin);
 /// @param motion_img input image
 void quantize_motion_img(grayscale_image_t* motion_img);
 
+/// ------------------------------------------
+/// @brief Encodes a quantized motion image into the compact mask file layout of motion_mask.h,
+/// run length encoded unless bit packing is smaller
+///
+/// @note Pixels are treated as set if non-zero, the box must not have been drawn on the image yet
+///
+/// @param motion_img quantized motion image
+/// @param box_origin origin of the bounding box, null if motion was not significant
+/// @param arena the encoded file is taken from, as an output buffer
+/// @param[out] out_buf encoded file, freed with the arena
+/// @param[out] out_len length of the encoded file
+///
+/// @return ESP_OK if sucsessful
+esp_err_t encode_motion_mask(const grayscale_image_t* motion_img, const point_t* box_origin,
+                             capture_arena_t* arena, uint8_t** out_buf, size_t* out_len);
+
 /// ------------------------------------------
 /// @brief Extracts a square frame from the source image of size BOUNDING_BOX_EDGE_LEN
 /// at the origin crop_origin
 ///
+/// @note Only the crop is decoded into a working buffer of the arena and popped again once
+/// encoded, the full frame is never held
+///
 /// @param source_img source image to extract crop from
 /// @param crop_origin the origin of the square to extract
+/// @param arena buffers are taken from, the cropped jpg as an output buffer
+///
+/// @return output cropped frame, buf is null if conversion fails, freed with the arena
+jpg_image_t crop_jpg_img(const jpg_image_t* source_img, point_t crop_origin, capture_arena_t* arena);
+
+/// ------------------------------------------
+/// @brief Encodes a MOTION_PREVIEW_SCALE downscaled grayscale jpg of a motion image, each
+/// pixel the average of the block it covers
+///
+/// @note Must be called before the image is quantized, the preview keeps the difference
+/// levels the mask throws away
+///
+/// @param motion_img motion image as subtracted
+/// @param arena the downscaled image is taken from as a working buffer and popped again,
+/// the jpg is an output buffer
 ///
-/// @return output cropped frame, buf is null if conversion fails
-jpg_image_t crop_jpg_img(const jpg_image_t* source_img, point_t crop_origin);
\ No newline at end of file
+/// @return preview jpg, buf is null if it could not be encoded, freed with the arena
+jpg_image_t encode_motion_preview(const grayscale_image_t* motion_img, capture_arena_t* arena);
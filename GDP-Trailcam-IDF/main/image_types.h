@@ -75,6 +75,27 @@ typedef struct
 
     // Count of the capture
     uint32_t capture_count;
+
+    // Index into cam_power_down_pins of the camera that took the capture
+    uint8_t cam_num;
+
+    // Imaging preset the camera was set to, a Camera_image_preset_t
+    uint8_t image_preset;
+
+    // ms spent waiting for auto exposure to settle before the first image
+    uint32_t exposure_converge_ms;
+
+    // Frames thrown away whilst waiting for auto exposure to settle
+    uint32_t exposure_discarded_frames;
+
+    // Did auto exposure settle before the timeout?
+    bool exposure_converged;
+
+    // Sensor exposure value the images were taken with
+    int aec_value;
+
+    // Sensor gain the images were taken with
+    int agc_gain;
 } jpg_motion_data_t;
 
 /// @brief Struct to gather data and buffer for a grayscale image
@@ -115,6 +136,8 @@ typedef struct
 /// ------------------------------------------
 /// @brief Frees all buffer data in jpg motion data sturct, checks for null
 ///
+/// @note Not for captures held in a motion_slot_t, their buffers belong to the pool
+///
 /// @param data struct to free
 /// data_valid will be set to false
 void free_jpg_motion_data(jpg_motion_data_t* data);
@@ -0,0 +1,56 @@
+/// ------------------------------------------
+/// @file light_sensor.c
+///
+/// @brief Source file for reading the ambient light level from the photoresistor
+/// ------------------------------------------
+
+#include "light_sensor.h"
+
+/// @brief Logging tag
+static const char* LIGHT_TAG = "light_sensor";
+
+/// ------------------------------------------
+esp_err_t read_light_level(int* level_out)
+{
+    if (LIGHT_SENSOR_ADC_CHANNEL < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    adc_oneshot_unit_handle_t adc_handle;
+    adc_oneshot_unit_init_cfg_t unit_config = {
+        .unit_id = ADC_UNIT_1,
+    };
+    esp_err_t err = adc_oneshot_new_unit(&unit_config, &adc_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LIGHT_TAG, "Failed to start ADC unit, err: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    adc_oneshot_chan_cfg_t channel_config = {
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_12,
+    };
+    err = adc_oneshot_config_channel(adc_handle, LIGHT_SENSOR_ADC_CHANNEL, &channel_config);
+
+    int level_sum = 0;
+    for (size_t i = 0; i < LIGHT_SENSOR_SAMPLES && err == ESP_OK; i++)
+    {
+        int sample;
+        err = adc_oneshot_read(adc_handle, LIGHT_SENSOR_ADC_CHANNEL, &sample);
+        level_sum += sample;
+    }
+
+    adc_oneshot_del_unit(adc_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LIGHT_TAG, "Failed to read light level, err: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    *level_out = level_sum / LIGHT_SENSOR_SAMPLES;
+    ESP_LOGI(LIGHT_TAG, "Light level is %i", *level_out);
+    return ESP_OK;
+}
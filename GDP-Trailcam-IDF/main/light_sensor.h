@@ -0,0 +1,26 @@
+/// ------------------------------------------
+/// @file light_sensor.h
+///
+/// @brief Header file for reading the ambient light level from the photoresistor
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_adc/adc_oneshot.h"
+
+/// @brief ADC1 channel of the photoresistor, negative if not connected
+#define LIGHT_SENSOR_ADC_CHANNEL CONFIG_LIGHT_SENSOR_ADC_CHANNEL
+
+/// @brief Number of ADC samples averaged for a single light reading
+#define LIGHT_SENSOR_SAMPLES 8
+
+/// ------------------------------------------
+/// @brief Reads the ambient light level, higher values are brighter
+///
+/// @param[out] level_out raw averaged ADC reading (0-4095)
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NOT_FOUND if no light sensor is configured
+esp_err_t read_light_level(int* level_out);
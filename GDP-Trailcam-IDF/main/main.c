@@ -8,16 +8,33 @@
 #include "freertos/timers.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/event_groups.h"
 #include "driver/gpio.h"
 #include "esp_pm.h"
 #include "driver/rtc_io.h"
 #include "esp_sleep.h"
+#include "esp_random.h"
+#include <sys/time.h>
 
 #include "SDSPI.h"
 #include "Camera.h"
 #include "motion_analysis.h"
 #include "image_cropping.h"
 #include "status_led.h"
+#include "capture_scheduler.h"
+#include "boot_timeline.h"
+#include "storage_backend.h"
+#include "capture_store.h"
+#include "sd_writer.h"
+#include "retention.h"
+#include "capture_index.h"
+#include "motion_slots.h"
+#include "pipeline.h"
+#include "capture_arena.h"
+#include "pir_burst.h"
+#include "admission.h"
+#include "trace.h"
+#include "mem_telemetry.h"
 
 static const char* MAIN_TAG = "main";
 
@@ -26,14 +43,117 @@ camera_config_t config;
 
 #define NVS_CAP_COUNT_KEY "next_cap_num"
 
-#define PIR_PIN 2
-#define PIR_TRIG_LEVEL 0
-
 #define MAX_CONT_CAP 5
 
-QueueHandle_t motion_proc_queue;
+// One motion slot per continuous capture, a full trigger must fit in the pool whilst analysis is idle
+_Static_assert(MAX_CONT_CAP >= CAM_POWER_DOWN_PIN_COUNT, "Motion slot pool smaller than a trigger's captures");
+
+/// @brief File each wake's boot timeline record is appended to
+#define BOOT_TIMELINE_FILE "BOOTLOG.TXT"
+
+/// @brief File each wake's memory telemetry record is appended to
+#define MEM_TELEMETRY_FILE "MEMLOG.TXT"
+
+/// @brief Chrome trace of each wake, named by the capture number the next wake starts from
+#define TRACE_FILE_FORMAT "TR%06lu.JSN"
+
+/// @brief Event bit set by the storage bringup task once the SD and NVS are usable
+#define STORAGE_READY_BIT BIT0
+
+/// @brief Event bit set by the storage bringup task if the SD could not be mounted
+#define STORAGE_FAILED_BIT BIT1
+
+/// @brief Shutdown barrier bit set once the processing pipeline is idle
+#define SHUTDOWN_PROCESSING_BIT BIT0
+
+/// @brief Shutdown barrier bit set once every write is on the card and the store is closed
+#define SHUTDOWN_STORAGE_BIT BIT1
+
+/// @brief Shutdown barrier bit set once the capture count and exposure seeds are in NVS
+#define SHUTDOWN_NVS_BIT BIT2
+
+/// @brief Every part of the shutdown barrier
+#define SHUTDOWN_ALL_BITS (SHUTDOWN_PROCESSING_BIT | SHUTDOWN_STORAGE_BIT | SHUTDOWN_NVS_BIT)
+
+/// @brief Why a capture's frames were stored, or that they were not
+typedef enum
+{
+    // Not decided yet
+    PERSIST_PENDING,
+
+    // Stored before analysis, as CONFIG_CAPTURE_PERSIST_ALWAYS
+    PERSIST_ALWAYS,
+
+    // Analysis found significant motion
+    PERSIST_MOTION,
+
+    // No significant motion, kept as a sample for auditing the analysis
+    PERSIST_AUDIT,
+
+    // Never analysed, kept as nothing could decide against it
+    PERSIST_UNANALYSED,
+
+    // No significant motion, the frames were dropped
+    PERSIST_DISCARDED,
+} persist_decision_t;
+
+/// @brief Line of info.txt recording each persist decision
+static const char* persist_decision_text[] = {
+    "pending",
+    "stored before analysis",
+    "stored, motion significant",
+    "stored as an audit sample, not motion significant",
+    "stored unanalysed",
+    "discarded",
+};
+
+/// @brief A capture on its way through the processing pipeline
+typedef struct
+{
+    // Capture number, kept here as the slot may be recycled before the job is finished
+    uint32_t capture_num;
+
+    // Slot holding the capture's jpgs
+    motion_slot_t* slot;
+
+    // Arena every processing buffer of the capture is taken from, null until decoding
+    capture_arena_t* arena;
+
+    // Does the pipeline still hold the slot?
+    bool slot_held;
+
+    // Subtraction of the grayscale images, passed from decode to analyse
+    grayscale_image_t sub_img;
+
+    // Origin of the motion bounding box, passed from analyse to crop
+    point_t bb_origin;
+
+    // Index record, filled in as the stages run and owned by the writer once submitted
+    capture_index_record_t* index_record;
+
+    // Motion estimated from the jpgs, decides which captures are processed when saturated
+    uint32_t motion_score;
+
+    // Whether the capture's frames were stored and why
+    persist_decision_t persist;
+} capture_job_t;
+
+/// @brief Pipeline state of each motion slot's capture, indexed by slot index
+capture_job_t capture_jobs[MAX_CONT_CAP];
 
-volatile bool processing_active = false;
+/// @brief Runs captures through decode, analyse and crop
+pipeline_t* processing_pipeline = NULL;
+
+EventGroupHandle_t storage_events;
+
+/// @brief Shutdown barrier, deep sleep is entered as soon as every bit is set
+EventGroupHandle_t shutdown_events;
+
+nvs_handle_t my_handle;
+uint32_t next_capture_count;
+
+/// @brief Backend captures and logs are stored on
+storage_backend_t* storage = NULL;
 
 void setup_ext0_wakeup()
 {
@@ -43,6 +163,32 @@ void setup_ext0_wakeup()
     ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(PIR_PIN));
 }
 
+/// @brief Brings up the storage backend selected in the config
+///
+/// @return ESP_OK if the backend is ready for use
+esp_err_t bring_up_storage()
+{
+#ifdef CONFIG_STORAGE_BACKEND_RAMDISK
+    // Nothing survives deep sleep, only for measuring the pipeline without the card
+    storage = storage_ramdisk_create(CONFIG_STORAGE_RAMDISK_SIZE_KB * 1024);
+    if (storage == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to create RAM disk");
+        return ESP_ERR_NO_MEM;
+    }
+#else
+    // Most SDSPI functions assume that there exists a working connection already
+    connect_to_SDSPI(PIN_NUM_MISO, PIN_NUM_MOSI, PIN_NUM_CLK, PIN_NUM_CS, &connection);
+    if (connection.card == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start SDSPI");
+        return ESP_FAIL;
+    }
+    storage = storage_sdspi_backend();
+#endif
+    return ESP_OK;
+}
+
 void enter_deep_sleep()
 {
     gpio_deep_sleep_hold_en();
@@ -55,289 +201,1132 @@ void enter_deep_sleep()
     esp_deep_sleep_start();
 }
 
-void motion_processing_task()
+/// @brief SD writer callback for buffers taken from a capture's arena, they are freed
+/// together when the arena is released
+void leave_in_arena(const esp_err_t err, void* data, void* arg)
+{
+}
+
+/// @brief Hands a buffer in a capture's arena to the SD writer
+///
+/// @note The arena must not be released until the writer has reached this write
+///
+/// @param capture_num capture the file belongs to
+/// @param name file name within the capture
+/// @param buf buffer to write
+/// @param len length of the buffer
+void submit_arena_write(const uint32_t capture_num, const char* name, void* buf, const size_t len)
+{
+    sd_write_job_t job = {
+        .capture_num = capture_num,
+        .data = buf,
+        .len = len,
+        .done_cb = leave_in_arena,
+    };
+    strncpy(job.name, name, CONTAINER_NAME_LEN - 1);
+
+    if (sd_writer_submit(&job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to queue %s of capture %lu", name, capture_num);
+    }
+}
+
+/// @brief SD writer callback queued behind the last file of a capture, frees its arena
+void release_written_arena(const esp_err_t err, void* data, void* arg)
+{
+    capture_arena_release((capture_arena_t*)arg);
+}
+
+/// @brief SD writer callback for the jpgs of a capture, drops the writer's hold on its slot
+void release_written_jpg(const esp_err_t err, void* data, void* arg)
+{
+    motion_slot_release((motion_slot_t*)arg);
+}
+
+/// @brief Keeps the subtraction before find_motion_centre quantizes it in place, for the debug images
+///
+/// @param sub_img subtraction image as perform_motion_analysis left it
+/// @param arena of the capture, what is kept is an output buffer in it
+/// @param[out] len_out length of what is kept
+///
+/// @return a full copy for sub.bin or a jpg preview alongside the mask, null if none is
+/// needed or it could not be made
+uint8_t* keep_motion_difference(const grayscale_image_t* sub_img, capture_arena_t* arena, size_t* len_out)
+{
+    *len_out = 0;
+#if defined(CONFIG_MOTION_ARTIFACTS_MASK)
+    // The mask only says where motion was, the preview keeps how strong it was
+    jpg_image_t preview = encode_motion_preview(sub_img, arena);
+    *len_out = preview.len;
+    return preview.buf;
+#elif defined(CONFIG_MOTION_ARTIFACTS_RAW)
+    uint8_t* raw_sub = capture_arena_alloc_output(arena, sub_img->len);
+    if (raw_sub == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "No room to keep image subtraction");
+        return NULL;
+    }
+    memcpy(raw_sub, sub_img->buf, sub_img->len);
+    *len_out = sub_img->len;
+    return raw_sub;
+#else
+    return NULL;
+#endif
+}
+
+/// @brief Hands the debug images of a capture's motion analysis to the SD writer
+///
+/// @param capture_num capture the images belong to
+/// @param sub_img quantized subtraction image, a working buffer at the bottom of the arena
+/// @param diff_buf subtraction before quantizing from keep_motion_difference, null if not kept
+/// @param diff_len length of diff_buf
+/// @param box_origin origin of the motion bounding box, null if motion was not significant
+/// @param arena of the capture, the images are written from it
+void write_motion_artifacts(const uint32_t capture_num, grayscale_image_t* sub_img, uint8_t* diff_buf,
+                            const size_t diff_len, const point_t* box_origin, capture_arena_t* arena)
+{
+#if defined(CONFIG_MOTION_ARTIFACTS_MASK)
+    // The box is stored as its origin and redrawn by tools/mask_decode.c
+    ESP_LOGI(MAIN_TAG, "Writing motion mask");
+    uint8_t* mask_buf;
+    size_t mask_len;
+    if (encode_motion_mask(sub_img, box_origin, arena, &mask_buf, &mask_len) == ESP_OK)
+    {
+        submit_arena_write(capture_num, MOTION_MASK_FILE_NAME, mask_buf, mask_len);
+    }
+    if (diff_buf != NULL)
+    {
+        submit_arena_write(capture_num, MOTION_PREVIEW_FILE_NAME, diff_buf, diff_len);
+    }
+
+    // Only the mask and preview are written, the subtraction makes way for cropping
+    capture_arena_pop(arena, sub_img->buf);
+#elif defined(CONFIG_MOTION_ARTIFACTS_RAW)
+    // The subtraction as it was before quantizing, it stays in the arena until written
+    if (diff_buf != NULL)
+    {
+        ESP_LOGI(MAIN_TAG, "Writing image subtraction");
+        submit_arena_write(capture_num, "sub.bin", diff_buf, diff_len);
+    }
+
+    if (box_origin == NULL)
+    {
+        capture_arena_pop(arena, sub_img->buf);
+        sub_img->buf = NULL;
+        return;
+    }
+
+    draw_motion_box(sub_img, *box_origin);
+
+    ESP_LOGI(MAIN_TAG, "Writing box image");
+    submit_arena_write(capture_num, "box.bin", sub_img->buf, sub_img->len);
+#else
+    capture_arena_pop(arena, sub_img->buf);
+#endif
+    sub_img->buf = NULL;
+}
+
+/// @brief Gets the wall clock time of an uptime timestamp
+///
+/// @param uptime_ms esp_log_timestamp of the event
+///
+/// @return ms since the epoch if the clock was set, otherwise since power on
+int64_t uptime_to_wall_ms(const uint32_t uptime_ms)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000 - (esp_log_timestamp() - uptime_ms);
+}
+
+/// @brief Fills the capture fields of an index record, analysis fields are left unset
+///
+/// @param motion capture to describe
+/// @param[out] record to fill
+void fill_index_record(const jpg_motion_data_t* motion, capture_index_record_t* record)
+{
+    memset(record, 0, sizeof(capture_index_record_t));
+    record->capture_num = motion->capture_count;
+    record->time_ms = uptime_to_wall_ms(motion->t1);
+    record->gap_ms = motion->t2 - motion->t1;
+    record->box_x = CAPTURE_INDEX_NO_BOX;
+    record->box_y = CAPTURE_INDEX_NO_BOX;
+    record->width = motion->img1.width;
+    record->height = motion->img1.height;
+    record->cam_num = motion->cam_num;
+    record->image_preset = motion->image_preset;
+    record->flags = motion->exposure_converged ? CAPTURE_INDEX_FLAG_EXPOSURE_SETTLED : 0;
+    record->aec_value = motion->aec_value;
+    record->agc_gain = motion->agc_gain;
+    record->exposure_converge_ms = motion->exposure_converge_ms;
+}
+
+/// @brief SD writer callback appending a capture's index record, queued behind the capture's
+/// files so their place in the container is known
+void append_index_record(const esp_err_t err, void* data, void* arg)
+{
+    capture_index_record_t* record = data;
+
+    capture_location_t img1;
+    capture_location_t img2;
+    if (capture_store_locate(record->capture_num, "img1.jpg", &img1) == ESP_OK &&
+        capture_store_locate(record->capture_num, "img2.jpg", &img2) == ESP_OK)
+    {
+        record->flags |= CAPTURE_INDEX_FLAG_CONTAINER;
+        record->container_num = img1.container_num;
+        record->img1_offset = img1.offset;
+        record->img1_len = img1.len;
+        record->img2_offset = img2.offset;
+        record->img2_len = img2.len;
+    }
+
+    if (capture_index_append(record) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to index capture %lu", record->capture_num);
+    }
+    free(record);
+}
+
+/// @brief Queues a capture's index record behind the files already queued for it
+///
+/// @param record to append, owned by the writer from here on
+void submit_index_record(capture_index_record_t* record)
+{
+    sd_write_job_t index_job = {
+        .capture_num = record->capture_num,
+        .data = record,
+        .done_cb = append_index_record,
+    };
+    if (sd_writer_submit(&index_job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to queue index record of capture %lu", record->capture_num);
+        free(record);
+    }
+}
+
+/// @brief Queues a capture's jpgs and info.txt to the SD writer
+///
+/// @param job capture to store, its slot must still be held by the pipeline
+/// @param decision why the frames are stored, recorded in info.txt and the index
+void store_capture_frames(capture_job_t* job, const persist_decision_t decision)
+{
+    motion_slot_t* slot = job->slot;
+    jpg_motion_data_t* motion = &slot->motion;
+    uint32_t capture_num = job->capture_num;
+    job->persist = decision;
+    if (decision == PERSIST_AUDIT && job->index_record != NULL)
+    {
+        job->index_record->flags |= CAPTURE_INDEX_FLAG_AUDIT;
+    }
+
+    // Writer and analysis both hold the slot, whichever finishes last gives it back to the pool
+    motion_slot_hold(slot, 2);
+
+    sd_write_job_t img_job = {
+        .capture_num = capture_num,
+        .name = "img1.jpg",
+        .data = motion->img1.buf,
+        .len = motion->img1.len,
+        .done_cb = release_written_jpg,
+        .cb_arg = slot,
+    };
+    if (sd_writer_submit(&img_job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to queue img1.jpg of capture %lu", capture_num);
+        motion_slot_release(slot);
+    }
+
+    strcpy(img_job.name, "img2.jpg");
+    img_job.data = motion->img2.buf;
+    img_job.len = motion->img2.len;
+    if (sd_writer_submit(&img_job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to queue img2.jpg of capture %lu", capture_num);
+        motion_slot_release(slot);
+    }
+
+    char* info_text = mem_telemetry_malloc(480 * sizeof(char), MALLOC_CAP_DEFAULT);
+    if (info_text == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "No memory for info.txt of capture %lu", capture_num);
+        return;
+    }
+    sprintf(info_text, "Images were taken %ums apart.\nImage 1: %u\nImage 2: %u\n"
+                        "Image res is %ux%u\nCamera: %u\nPreset: %s\n"
+                        "Exposure %s in %lums, %lu frames discarded\nAEC: %i\nAGC: %i\n"
+                        "Motion score: %lu\nFrames: %s",
+                        motion->t2 - motion->t1,
+                        motion->t1, motion->t2, motion->img1.width, motion->img1.height,
+                        motion->cam_num + 1,
+                        motion->image_preset == LOW_LIGHT ? "low light" : "daylight",
+                        motion->exposure_converged ? "settled" : "timed out",
+                        motion->exposure_converge_ms, motion->exposure_discarded_frames,
+                        motion->aec_value, motion->agc_gain,
+                        job->motion_score, persist_decision_text[decision]);
+    ESP_LOGI(MAIN_TAG, "%s", info_text);
+
+    // Info is the last file of the capture, the writer commits it once written
+    sd_write_job_t info_job = {
+        .capture_num = capture_num,
+        .name = "info.txt",
+        .data = info_text,
+        .len = strlen(info_text),
+        .commit = true,
+    };
+    if (sd_writer_submit(&info_job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to queue info.txt of capture %lu", capture_num);
+        free(info_text);
+    }
+}
+
+/// @brief Decides whether a capture's frames are stored now analysis has judged it
+///
+/// @note With CONFIG_CAPTURE_PERSIST_AFTER_ANALYSIS captures without significant motion
+/// are dropped, bar a sample of CONFIG_CAPTURE_AUDIT_PERCENT kept to check analysis against
+///
+/// @param job capture analysis has decided on, its slot must still be held by the pipeline
+/// @param motion_significant did analysis find significant motion?
+///
+/// @return true if the frames are stored and analysis files should be written alongside them
+bool persist_analysed_capture(capture_job_t* job, const bool motion_significant)
 {
-    processing_active = true;
-    ESP_LOGI(MAIN_TAG, "Starting camera proc task");
-    while (1)
+    if (job->persist != PERSIST_PENDING)
+    {
+        return job->persist != PERSIST_DISCARDED;
+    }
+
+    if (motion_significant)
+    {
+        store_capture_frames(job, PERSIST_MOTION);
+        return true;
+    }
+
+    if (esp_random() % 100 < CONFIG_CAPTURE_AUDIT_PERCENT)
     {
-        jpg_motion_data_t jpg_motion_data;
-        jpg_motion_data.data_valid = false;
-        if (xQueueReceive(motion_proc_queue, &jpg_motion_data, portMAX_DELAY))
+        store_capture_frames(job, PERSIST_AUDIT);
+        return true;
+    }
+
+    ESP_LOGI(MAIN_TAG, "Capture %lu discarded, frames not stored", job->capture_num);
+    job->persist = PERSIST_DISCARDED;
+    if (job->index_record != NULL)
+    {
+        job->index_record->flags |= CAPTURE_INDEX_FLAG_DISCARDED;
+    }
+    return false;
+}
+
+/// @brief Commits and indexes a capture behind its files, then drops its hold on its slot
+///
+/// @note capture_jobs is indexed by slot, so the slot is only let go once the job is
+/// finished with. A new capture can take the slot, and overwrite the job, straight after
+///
+/// @param job capture that has been through every stage it needs
+void finish_capture_job(capture_job_t* job)
+{
+    uint32_t capture_count = job->capture_num;
+
+    // Anything analysis never decided on is kept, it must be queued whilst the slot is still held
+    if (job->persist == PERSIST_PENDING)
+    {
+        store_capture_frames(job, PERSIST_UNANALYSED);
+    }
+
+    // Commit once the writer reaches the end of this capture's analysis files, discarded captures have none
+    sd_write_job_t commit_job = {
+        .capture_num = capture_count,
+        .commit = true,
+    };
+    if (job->persist != PERSIST_DISCARDED &&
+        sd_writer_submit(&commit_job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to commit analysis of capture %lu", capture_count);
+    }
+
+    if (job->index_record != NULL)
+    {
+        submit_index_record(job->index_record);
+        job->index_record = NULL;
+    }
+
+    // The writer still has the capture's files in the arena, it is freed once they are written
+    if (job->arena != NULL)
+    {
+        sd_write_job_t arena_job = {
+            .capture_num = capture_count,
+            .done_cb = release_written_arena,
+            .cb_arg = job->arena,
+        };
+        if (sd_writer_submit(&arena_job, pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
         {
-            if (jpg_motion_data.data_valid  == false)
+            // Only safe to release once the writer is past the capture's files, otherwise it is leaked
+            ESP_LOGE(MAIN_TAG, "Failed to queue arena release of capture %lu", capture_count);
+            if (sd_writer_flush(pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_ERR_TIMEOUT)
             {
-                ESP_LOGW(MAIN_TAG, "Wait timeout, continuing");
-                continue;
+                capture_arena_release(job->arena);
             }
+        }
+        job->arena = NULL;
+    }
 
-            uint32_t capture_count = jpg_motion_data.capture_count;
+    // The writer may still be storing the jpgs, it holds the slot until done
+    if (job->slot_held)
+    {
+        job->slot_held = false;
+        motion_slot_release(job->slot);
+    }
+}
 
-            ESP_LOGI(MAIN_TAG, "Analysing motion on caputre");
-            grayscale_image_t sub_img = perform_motion_analysis(&jpg_motion_data);
+/// @brief Admission shed callback, indexes a capture as shed and lets go of it without
+/// analysis, its jpgs are still written
+///
+/// @param item the capture_job_t shed
+/// @param score it was offered with
+void shed_capture_job(void* item, const uint32_t score)
+{
+    capture_job_t* job = item;
+    ESP_LOGW(MAIN_TAG, "Capture %lu shed unanalysed, motion score %lu", job->capture_num, score);
 
-            if (sub_img.buf != NULL)
-            {
-                ESP_LOGI(MAIN_TAG, "Writing image subtraction");
-                char* sub_filenm = malloc(32);
-                sprintf(sub_filenm, MOUNT_POINT"/CAPTURE%lu/sub.bin", capture_count);
-
-                if (write_data_SDSPI(sub_filenm, sub_img.buf, sub_img.len) != ESP_OK)
-                {
-                    ESP_LOGE(MAIN_TAG, "Failed to write motion to SD");
-                }
-                free(sub_filenm);
-
-                point_t bb_origin;
-                ESP_LOGI(MAIN_TAG, "Attempting to find centre of motion");
-                if (find_motion_centre(&sub_img, &bb_origin))
-                {
-                    free(sub_img.buf);
-
-                    ESP_LOGI(MAIN_TAG, "Motion bounding box from (%u,%u) to (%u,%u)",
-                            bb_origin.x,
-                            bb_origin.y,
-                            bb_origin.x+BOUNDING_BOX_EDGE_LEN,
-                            bb_origin.y+BOUNDING_BOX_EDGE_LEN);
-
-                    draw_motion_box(&sub_img, bb_origin);
-
-                    ESP_LOGI(MAIN_TAG, "Writing box image");
-                    char* box_filenm = malloc(sizeof(char) * 32);
-                    sprintf(box_filenm, MOUNT_POINT"/CAPTURE%lu/box.bin", capture_count);
-                    if (write_data_SDSPI(box_filenm, sub_img.buf, sub_img.len) != ESP_OK)
-                    {
-                        ESP_LOGE(MAIN_TAG, "Failed to write bounding box to SD");
-                    }
-                    free(box_filenm);
-
-                    ESP_LOGI(MAIN_TAG, "Cropping jpg image");
-                    jpg_image_t box_img = crop_jpg_img(&jpg_motion_data.img1, bb_origin);
-                    free_jpg_motion_data(&jpg_motion_data);
-
-                    if (box_img.buf == NULL)
-                    {
-                        ESP_LOGE(MAIN_TAG, "Image cropping failed");
-                    }
-                    else
-                    {
-                        char* box_img_filenm = malloc(64);
-                        sprintf(box_img_filenm, MOUNT_POINT"/CAPTURE%lu/box.jpg", capture_count);
-
-                        if (write_data_SDSPI(box_img_filenm, box_img.buf, box_img.len) != ESP_OK)
-                        {
-                            ESP_LOGE(MAIN_TAG, "Failed to write cropped img to SD");
-                        }
-                        free(box_img_filenm);
-
-                        free(box_img.buf);
-                    }
-                }
-                else
-                {
-                    free(sub_img.buf);
-                    ESP_LOGI(MAIN_TAG, "Image not motion significant");
-                }
-            }
-            else
-            {
-                ESP_LOGI(MAIN_TAG, "Analysis failed!");
-            }
+    job->index_record = mem_telemetry_malloc(sizeof(capture_index_record_t), MALLOC_CAP_DEFAULT);
+    if (job->index_record != NULL)
+    {
+        fill_index_record(&job->slot->motion, job->index_record);
+        job->index_record->flags |= CAPTURE_INDEX_FLAG_SHED;
+    }
+    finish_capture_job(job);
+}
+
+/// @brief Decode stage, converts both jpgs of a capture to grayscale and subtracts them
+///
+/// @note Only the subtraction is passed on, so a capture waiting for analysis holds one
+/// grayscale image rather than three
+///
+/// @param item capture_job_t to decode
+///
+/// @return true to pass the capture on to analysis
+bool decode_stage(void* item)
+{
+    capture_job_t* job = item;
+    const jpg_motion_data_t* jpg_motion_data = &job->slot->motion;
+
+    // Filled before the jpgs are released, analysis results are added as they come
+    job->index_record = mem_telemetry_malloc(sizeof(capture_index_record_t), MALLOC_CAP_DEFAULT);
+    if (job->index_record != NULL)
+    {
+        fill_index_record(jpg_motion_data, job->index_record);
+    }
+
+    job->arena = capture_arena_acquire(pdMS_TO_TICKS(MAX_SD_WAIT_MS));
+    if (job->arena == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "No arena free, capture %lu not analysed", job->capture_num);
+        finish_capture_job(job);
+        return false;
+    }
+
+#ifdef CONFIG_MOTION_PREFILTER
+    // Most PIR triggers have no motion the cameras can see, they are dropped before any pixel decode
+    size_t changed_blocks;
+    if (prefilter_motion(jpg_motion_data, job->arena, &changed_blocks) == false)
+    {
+        ESP_LOGI(MAIN_TAG, "Capture %lu not motion significant, %u blocks changed", job->capture_num, changed_blocks);
+        report_cam_motion(jpg_motion_data->cam_num, false);
+        if (job->index_record != NULL)
+        {
+            job->index_record->flags |= CAPTURE_INDEX_FLAG_PREFILTERED;
         }
+        persist_analysed_capture(job, false);
+        finish_capture_job(job);
+        return false;
+    }
+#endif
+
+    ESP_LOGI(MAIN_TAG, "Decoding capture %lu", job->capture_num);
+    job->sub_img = perform_motion_analysis(jpg_motion_data, job->arena);
+    if (job->sub_img.buf == NULL)
+    {
+        ESP_LOGI(MAIN_TAG, "Analysis failed!");
+        finish_capture_job(job);
+        return false;
+    }
+    return true;
+}
+
+/// @brief Analyse stage, finds the centre of motion and stores the debug images
+///
+/// @param item capture_job_t to analyse
+///
+/// @return true to pass the capture on to be cropped, false if motion was not significant
+bool analyse_stage(void* item)
+{
+    capture_job_t* job = item;
+    uint32_t capture_count = job->capture_num;
+
+    size_t diff_len;
+    uint8_t* diff_buf = keep_motion_difference(&job->sub_img, job->arena, &diff_len);
 
-        if (uxQueueMessagesWaiting(motion_proc_queue) == 0)
+    size_t motion_pixels;
+    ESP_LOGI(MAIN_TAG, "Attempting to find centre of motion on capture %lu", capture_count);
+    bool motion_significant = find_motion_centre(&job->sub_img, &job->bb_origin, &motion_pixels);
+    report_cam_motion(job->slot->motion.cam_num, motion_significant);
+    if (job->index_record != NULL)
+    {
+        job->index_record->flags |= CAPTURE_INDEX_FLAG_ANALYSED;
+        job->index_record->motion_pixels = motion_pixels;
+        if (motion_significant)
         {
-            ESP_LOGI(MAIN_TAG, "Queue empty, no longer processing images");
+            job->index_record->flags |= CAPTURE_INDEX_FLAG_MOTION;
+            job->index_record->box_x = job->bb_origin.x;
+            job->index_record->box_y = job->bb_origin.y;
+        }
+    }
 
-            processing_active = false;
-            // Pause this task, if unpaused then a new capture will have been made by the PIR
-            vTaskSuspend(NULL);
+    // Frames go to the card first so analysis files follow them, as when stored before analysis
+    bool stored = persist_analysed_capture(job, motion_significant);
+    if (motion_significant == false)
+    {
+        if (stored)
+        {
+            write_motion_artifacts(capture_count, &job->sub_img, diff_buf, diff_len, NULL, job->arena);
         }
+        ESP_LOGI(MAIN_TAG, "Image not motion significant");
+        finish_capture_job(job);
+        return false;
     }
+
+    ESP_LOGI(MAIN_TAG, "Motion bounding box from (%u,%u) to (%u,%u)",
+            job->bb_origin.x,
+            job->bb_origin.y,
+            job->bb_origin.x+BOUNDING_BOX_EDGE_LEN,
+            job->bb_origin.y+BOUNDING_BOX_EDGE_LEN);
+
+    write_motion_artifacts(capture_count, &job->sub_img, diff_buf, diff_len, &job->bb_origin, job->arena);
+    return true;
 }
 
-void capture_motion_images(uint32_t capture_num)
+/// @brief Crop stage, cuts the motion box out of the first jpg and re-encodes it
+///
+/// @param item capture_job_t to crop
+///
+/// @return false, this is the last stage
+bool crop_stage(void* item)
 {
-    int cam_pwr_pin = cam_power_down_pins[0];
+    capture_job_t* job = item;
+    uint32_t capture_count = job->capture_num;
 
-    ESP_LOGI(MAIN_TAG, "Starting capture on cam_pwr_pin: %i", cam_pwr_pin);
+    ESP_LOGI(MAIN_TAG, "Cropping jpg image");
+    jpg_image_t box_img = crop_jpg_img(&job->slot->motion.img1, job->bb_origin, job->arena);
 
-    config = get_default_camera_config(cam_pwr_pin);
+    if (box_img.buf == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "Image cropping failed");
+    }
+    else
+    {
+        submit_arena_write(capture_count, "box.jpg", box_img.buf, box_img.len);
+    }
 
-    jpg_motion_data_t* motion = get_motion_capture(config);
-    motion->capture_count = capture_num;
+    finish_capture_job(job);
+    return false;
+}
 
-    ESP_LOGI(MAIN_TAG, "Time between is: %ums", motion->t2 - motion->t1);
+/// @brief Runs a pipeline stage with the memory it uses attributed to it
+///
+/// @param stage memory telemetry stage
+/// @param run stage function
+/// @param item capture_job_t to run on
+///
+/// @return what the stage returned
+bool run_measured_stage(const mem_stage_t stage, pipeline_stage_fn_t run, void* item)
+{
+    mem_telemetry_stage_enter(stage);
+    bool pass_on = run(item);
+    mem_telemetry_stage_exit();
+    return pass_on;
+}
+
+bool measured_decode_stage(void* item)
+{
+    return run_measured_stage(MEM_STAGE_DECODE, decode_stage, item);
+}
 
-    char dir[32];
-    sprintf(dir, MOUNT_POINT"/CAPTURE%lu", capture_num);
+bool measured_analyse_stage(void* item)
+{
+    return run_measured_stage(MEM_STAGE_ANALYSE, analyse_stage, item);
+}
 
-    if (create_dir_SDSPI(dir) == ESP_OK)
+bool measured_crop_stage(void* item)
+{
+    return run_measured_stage(MEM_STAGE_CROP, crop_stage, item);
+}
+
+/// @brief Allocates as many capture arenas as PSRAM can hold alongside the camera frame buffers
+///
+/// @note Motion slots are already allocated, but frame buffers are only allocated as each
+/// camera starts, so room is left for them here. Any shortfall is logged with the budget,
+/// rather than captures quietly going unanalysed
+///
+/// @param config camera config the frame buffers are allocated with
+///
+/// @return ESP_OK if at least one arena was allocated
+esp_err_t start_capture_arenas(const camera_config_t* config)
+{
+    size_t arena_len = CONFIG_CAPTURE_ARENA_KB * 1024;
+    size_t fb_len = config->fb_count * get_max_jpg_len(config->frame_size);
+    size_t psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    size_t psram_block = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+
+    size_t arena_count = 0;
+    if (psram_free > fb_len && psram_block >= arena_len)
     {
-        char filenm1[FILENAME_MAX_SIZE];
-        sprintf(filenm1, "%s/img1.jpg", dir);
+        arena_count = MIN((psram_free - fb_len) / arena_len, CONFIG_CAPTURE_ARENA_COUNT);
+    }
 
-        if (write_jpg_data_to_SD(filenm1, motion->img1) != ESP_OK)
-        {
-            ESP_LOGE(MAIN_TAG, "Failed to write %s", filenm1);
-        }
+    if (arena_count < CONFIG_CAPTURE_ARENA_COUNT)
+    {
+        ESP_LOGE(MAIN_TAG, "%u arenas of %u bytes and %u bytes of frame buffers do not fit the %u bytes of PSRAM "
+                 "(%u block) left by motion slots, lower CAPTURE_ARENA_KB or CAPTURE_ARENA_COUNT",
+                 CONFIG_CAPTURE_ARENA_COUNT, arena_len, fb_len, psram_free, psram_block);
+    }
+    if (arena_count == 0)
+    {
+        ESP_LOGE(MAIN_TAG, "No room for a capture arena, motion analysis is off this wake");
+        return ESP_ERR_NO_MEM;
+    }
+    if (arena_count < CONFIG_CAPTURE_ARENA_COUNT)
+    {
+        ESP_LOGW(MAIN_TAG, "Analysing with %u of %u arenas", arena_count, CONFIG_CAPTURE_ARENA_COUNT);
+    }
 
-        char filenm2[FILENAME_MAX_SIZE];
-        sprintf(filenm2, "%s/img2.jpg", dir);
+    return capture_arena_pool_init(arena_count, arena_len);
+}
 
-        if (write_jpg_data_to_SD(filenm2, motion->img2) != ESP_OK)
+/// @brief Starts the processing pipeline, captures go decode -> analyse -> crop and every
+/// stage hands its files to the SD writer task, which persists them on the other core
+///
+/// @return ESP_OK if sucsessful
+esp_err_t start_processing_pipeline()
+{
+    const pipeline_stage_config_t stages[] = {
         {
-            ESP_LOGE(MAIN_TAG, "Failed to write %s", filenm2);
-        }
+            .name = "Decode stage",
+            .run = measured_decode_stage,
+            .workers = CONFIG_PIPELINE_DECODE_WORKERS,
+            .core = 0,
+            .priority = 4,
+            .stack_size = 1024 * 8,
+            .queue_len = 1,
+        },
+        {
+            .name = "Analyse stage",
+            .run = measured_analyse_stage,
+            .workers = CONFIG_PIPELINE_ANALYSE_WORKERS,
+            .core = 1,
+            .priority = 4,
+            .stack_size = 1024 * 8,
+            .queue_len = 1,
+        },
+        {
+            .name = "Crop stage",
+            .run = measured_crop_stage,
+            .workers = CONFIG_PIPELINE_CROP_WORKERS,
+            .core = 0,
+            .priority = 4,
+            .stack_size = 1024 * 16,
+            .queue_len = 1,
+        },
+    };
+
+    esp_err_t err = pipeline_create(stages, sizeof(stages) / sizeof(stages[0]), &processing_pipeline);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // Captures wait in admission rather than the decode queue, so the best of them go first
+    err = admission_start(processing_pipeline, CONFIG_ADMISSION_CAPACITY, shed_capture_job);
+    if (err != ESP_OK)
+    {
+        processing_pipeline = NULL;
+    }
+    return err;
+}
 
-        char filenm_info[FILENAME_MAX_SIZE];
-        sprintf(filenm_info, "%s/info.txt", dir);
+void store_motion_capture(motion_slot_t* slot, uint32_t capture_num)
+{
+    jpg_motion_data_t* motion = &slot->motion;
+    motion->capture_count = capture_num;
 
-        char* info_text = malloc(300 * sizeof(char));
-        sprintf(info_text, "Images were taken %ums apart.\nImage 1: %u\nImage 2: %u\n"
-                            "Image res is %ux%u", motion->t2 - motion->t1,
-                            motion->t1, motion->t2, motion->img1.width, motion->img1.height);
-        ESP_LOGI(MAIN_TAG, "%s", info_text);
+    ESP_LOGI(MAIN_TAG, "Time between is: %ums", motion->t2 - motion->t1);
 
-        if (write_text_SDSPI(filenm_info, info_text) != ESP_OK)
+    // The caller's hold on the slot is passed on to the pipeline
+    capture_job_t* job = &capture_jobs[slot->index];
+    job->capture_num = capture_num;
+    job->slot = slot;
+    job->slot_held = true;
+    job->arena = NULL;
+    job->index_record = NULL;
+    job->persist = PERSIST_PENDING;
+    job->motion_score = estimate_motion_score(motion);
+    ESP_LOGI(MAIN_TAG, "Capture %lu motion score %lu", capture_num, job->motion_score);
+
+#ifdef CONFIG_CAPTURE_PERSIST_ALWAYS
+    store_capture_frames(job, PERSIST_ALWAYS);
+#endif
+
+    // A shed capture is finished with by shed_capture_job
+    ESP_LOGI(MAIN_TAG, "Sending capture to motion analysis");
+    if (processing_pipeline == NULL || admission_offer(job, job->motion_score) == ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(MAIN_TAG, "Processing not running, capture %lu not analysed", capture_num);
+        if (job->persist == PERSIST_PENDING)
         {
-            ESP_LOGE(MAIN_TAG, "Failed to write %s", filenm_info);
+            store_capture_frames(job, PERSIST_UNANALYSED);
         }
-        free(info_text);
+        motion_slot_release(slot);
     }
-
-    // The motion set should be considered transfered to the processing task
-    ESP_LOGI(MAIN_TAG, "Sending capture to motion analysis");
-    xQueueSend(motion_proc_queue, motion, 0);
 }
 
-void app_main(void)
+/// @brief Runs on the other core during a PIR wake, mounting the SD card and reading NVS
+/// whilst the camera is brought up
+void storage_bringup_task()
 {
     setup_onboard_led();
     clear_led();
 
-    // Most SDSPI functions assume that there exists a working connection already
-    connect_to_SDSPI(PIN_NUM_MISO, PIN_NUM_MOSI, PIN_NUM_CLK, PIN_NUM_CS, &connection);
+    if (bring_up_storage() != ESP_OK)
+    {
+        set_led_colour(255, 0, 0); // error colour
+        xEventGroupSetBits(storage_events, STORAGE_FAILED_BIT);
+        vTaskDelete(NULL);
+        return;
+    }
+    boot_timeline_mark(BOOT_PHASE_SD_MOUNTED);
 
-    if (connection.card == NULL)
+    if (capture_store_init(storage) != ESP_OK)
     {
-        ESP_LOGE(MAIN_TAG, "Failed to start SDSPI");
+        ESP_LOGE(MAIN_TAG, "Failed to open capture store");
         set_led_colour(255, 0, 0); // error colour
+        xEventGroupSetBits(storage_events, STORAGE_FAILED_BIT);
+        vTaskDelete(NULL);
         return;
     }
 
-    esp_sleep_source_t wakeup_reason = esp_sleep_get_wakeup_cause();
-    ESP_LOGI(MAIN_TAG, "Wakeup reason: %i", wakeup_reason);
+    // Captures are still stored without the index, they just cannot be queried
+    if (capture_index_init(storage) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to open capture index");
+    }
 
-    if (wakeup_reason == ESP_SLEEP_WAKEUP_UNDEFINED)
+    if (sd_writer_start() != ESP_OK)
     {
-        ESP_LOGI(MAIN_TAG, "Power on");
+        ESP_LOGE(MAIN_TAG, "Failed to start SD writer");
+        set_led_colour(255, 0, 0); // error colour
+        xEventGroupSetBits(storage_events, STORAGE_FAILED_BIT);
+        vTaskDelete(NULL);
+        return;
+    }
 
-        ESP_LOGI(MAIN_TAG, "Running SD SPI POST...");
-        set_led_colour(0, 120, 0); // SD card setup colour (Green)
-        if (SDSPI_POST() != ESP_OK)
-        {
-            ESP_LOGE(MAIN_TAG, "POST failed on a SD SPI");
-            set_led_colour(255, 0, 0); // error colour
-            return;
-        }
-        ESP_LOGI(MAIN_TAG, "SD SPI POST sucsess");
-        clear_led();
+#ifdef CONFIG_RETENTION_ENABLED
+    // Only starts the task, nothing is deleted until the wake's captures are flushed
+    if (retention_start(storage) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start retention, old captures will not be deleted");
+    }
+#endif
 
-        ESP_LOGI(MAIN_TAG, "NVS erase and test");
-        if (nvs_flash_init() != ESP_OK)
-        {
-            ESP_LOGE(MAIN_TAG, "POST failed on NVS");
-            set_led_colour(255, 0, 0); // error colour
-            return;
-        }
-        nvs_flash_erase();
-        nvs_flash_init();
+    nvs_flash_init();
+    uint32_t nvs_capture_count = 0;
+    if (nvs_open("storage", NVS_READWRITE, &my_handle) == ESP_OK)
+    {
+        nvs_get_u32(my_handle, NVS_CAP_COUNT_KEY, &nvs_capture_count);
+    }
 
-        nvs_handle_t my_handle;
-        if (nvs_open("storage", NVS_READWRITE, &my_handle) != ESP_OK)
-        {
-            ESP_LOGE(MAIN_TAG, "POST failed on NVS open");
-            set_led_colour(255, 0, 0); // error colour
-            return;
-        }
+    // NVS is only a hint, the store's high water mark is checked with a single lookup
+    next_capture_count = capture_store_find_next_capture_num(nvs_capture_count);
+    boot_timeline_mark(BOOT_PHASE_NVS_READY);
 
-        esp_err_t err = nvs_set_u32(my_handle, NVS_CAP_COUNT_KEY, get_next_capture_num());
-        if (err != ESP_OK)
-        {
-            ESP_LOGE(MAIN_TAG, "POST failed on NVS writing, %s", esp_err_to_name(err));
-            set_led_colour(255, 0, 0); // error colour
-            return;
-        }
+    xEventGroupSetBits(storage_events, STORAGE_READY_BIT);
+    vTaskDelete(NULL);
+}
+
+/// @brief Captures from all cameras and hands the captures on to storage and analysis
+///
+/// @return false if storage could not be brought up and the captures were dropped
+bool capture_motion_images()
+{
+    motion_slot_t* slots[CAM_POWER_DOWN_PIN_COUNT];
+    mem_telemetry_stage_enter(MEM_STAGE_CAPTURE);
+    size_t capture_count = capture_all_cams(slots);
+    mem_telemetry_stage_exit();
 
-        set_led_colour(0, 0, 120); // Cam POST indicator (Blue)
-        // This should always be run first, sets all power down pins as outputs and shuts down all cameras
-        ESP_LOGI(MAIN_TAG, "Setting up cam power pins");
-        setup_all_cam_power_down_pins();
+    // Frames are held in PSRAM, storage is only needed from this point
+    EventBits_t storage_bits = xEventGroupWaitBits(storage_events, STORAGE_READY_BIT | STORAGE_FAILED_BIT,
+                                                   pdFALSE, pdFALSE, portMAX_DELAY);
+    bool storage_ready = (storage_bits & STORAGE_READY_BIT) != 0;
 
-        ESP_LOGI(MAIN_TAG, "POSTing all cameras");
-        if (POST_all_cams() != ESP_OK)
+    for (size_t i = 0; i < capture_count; i++)
+    {
+        if (slots[i]->motion.data_valid == false || storage_ready == false)
         {
-            ESP_LOGE(MAIN_TAG, "POST failed on a camera");
-            set_led_colour(255, 0, 0); // error colour
-            return;
+            ESP_LOGE(MAIN_TAG, "Capture on camera %u failed", slots[i]->motion.cam_num + 1);
+            motion_slot_release(slots[i]);
+            continue;
         }
-        ESP_LOGI(MAIN_TAG, "Camera POST sucsess");
-        clear_led();
 
-        ESP_LOGI(MAIN_TAG, "All POSTs successful");
+        store_motion_capture(slots[i], next_capture_count++);
+        boot_timeline_mark(BOOT_PHASE_FIRST_WRITE);
+    }
 
-        enter_deep_sleep();
+    return storage_ready;
+}
+
+/// @brief Gets how many captures are waiting for or going through processing, the PIR
+/// controller spaces captures further apart the higher this is
+///
+/// @return captures in flight
+uint32_t get_processing_backlog()
+{
+    if (processing_pipeline == NULL)
+    {
+        return 0;
     }
-    else if (wakeup_reason == ESP_SLEEP_WAKEUP_EXT0)
+
+    // Captures waiting in admission are as much backlog as those in the stages
+    admission_stats_t admission;
+    admission_get_stats(&admission);
+    return pipeline_get_in_flight(processing_pipeline) + admission.pending;
+}
+
+/// @brief Commits the capture count and exposure seeds to NVS whilst the last captures
+/// are processed, part of the shutdown barrier
+void nvs_commit_task()
+{
+    // Capture number for later boots, the card's high water mark is written once the writer is idle
+    esp_err_t err = nvs_set_u32(my_handle, NVS_CAP_COUNT_KEY, next_capture_count);
+    if (err == ESP_OK)
     {
-        ESP_LOGI(MAIN_TAG, "Wakeup from PIR trigger");
+        err = nvs_commit(my_handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to commit capture count to NVS, %s", esp_err_to_name(err));
     }
 
-    setup_all_cam_power_down_pins();
+    // RTC memory keeps the exposure seeds over deep sleep, NVS keeps them over power loss
+    save_exposure_seeds_to_nvs();
+
+    xEventGroupSetBits(shutdown_events, SHUTDOWN_NVS_BIT);
+    vTaskDelete(NULL);
+}
 
-    nvs_handle_t my_handle;
-    uint32_t next_capture_count;
+/// @brief Waits for the processing pipeline to empty, then gets everything it wrote onto
+/// the card and closes the store, part of the shutdown barrier
+void storage_shutdown_task()
+{
+    // Blocks until the last capture leaves the pipeline, both cores stay free for the stages.
+    // Admission is emptied first, once it is nothing more can be submitted
+    if (processing_pipeline != NULL)
+    {
+        ESP_LOGI(MAIN_TAG, "Waiting for processing to end");
+        admission_wait_idle(portMAX_DELAY);
+        pipeline_wait_idle(processing_pipeline, portMAX_DELAY);
+        pipeline_log_stats(processing_pipeline);
+
+        admission_stats_t admission;
+        admission_get_stats(&admission);
+        ESP_LOGI(MAIN_TAG, "Admission: %lu offered, %lu processed, %lu shed with scores up to %lu, max %u waiting",
+                 admission.offered, admission.admitted, admission.shed, admission.max_shed_score,
+                 admission.max_pending);
+
+        size_t arena_capacity;
+        size_t arena_high_water = capture_arena_get_high_water(&arena_capacity);
+        ESP_LOGI(MAIN_TAG, "Capture arenas peaked at %u of %u bytes", arena_high_water, arena_capacity);
+    }
+    ESP_LOGI(MAIN_TAG, "Processing finished");
+    boot_timeline_mark(BOOT_PHASE_PROCESSING_DONE);
+    xEventGroupSetBits(shutdown_events, SHUTDOWN_PROCESSING_BIT);
+
+    size_t writer_depth;
+    size_t writer_max_depth;
+    sd_writer_get_depth(&writer_depth, &writer_max_depth);
+    ESP_LOGI(MAIN_TAG, "Persist stage: %u jobs waiting, max depth %u of %u",
+             writer_depth, writer_max_depth, SD_WRITER_QUEUE_LEN);
+
+    // Everything queued must be on the card before power is cut
+    if (sd_writer_flush(pdMS_TO_TICKS(MAX_SD_WAIT_MS)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Not all captures were written");
+    }
+
+    // Written once the writer is idle so the card is never used from two tasks at once
+    if (capture_store_set_next_capture_num(next_capture_count) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to write capture high water mark");
+    }
+    if (capture_store_close() != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to close capture store");
+    }
+    if (capture_index_checkpoint(false) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to checkpoint capture index");
+    }
+
+    xEventGroupSetBits(shutdown_events, SHUTDOWN_STORAGE_BIT);
+    vTaskDelete(NULL);
+}
+
+/// @brief Appends this wake's boot timeline to the SD card
+void write_boot_timeline()
+{
+    char* record = malloc(BOOT_TIMELINE_RECORD_LEN + 16);
+    if (record == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "No memory for boot timeline");
+        return;
+    }
+    sprintf(record, "---\n");
+    boot_timeline_format(record + strlen(record));
+    if (storage->append_file(storage, BOOT_TIMELINE_FILE, record, strlen(record)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to write boot timeline");
+    }
+    free(record);
+}
+
+/// @brief Appends this wake's memory telemetry to the SD card, after the captures it covers
+void write_mem_telemetry()
+{
+    char* record = malloc(MEM_TELEMETRY_RECORD_LEN + 48);
+    if (record == NULL)
+    {
+        ESP_LOGE(MAIN_TAG, "No memory for memory telemetry");
+        return;
+    }
+    sprintf(record, "--- next capture %lu\n", next_capture_count);
+    mem_telemetry_format(record + strlen(record));
+    ESP_LOGI(MAIN_TAG, "%s", record);
+    if (storage->append_file(storage, MEM_TELEMETRY_FILE, record, strlen(record)) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to write memory telemetry");
+    }
+    free(record);
+}
+
+/// @brief Writes this wake's trace to the SD card
+void write_trace()
+{
+    char path[STORAGE_PATH_MAX];
+    snprintf(path, sizeof(path), TRACE_FILE_FORMAT, next_capture_count);
+    if (trace_dump(storage, path) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to write trace");
+    }
+}
+
+/// @brief Runs the power on self tests of every peripheral, ends in deep sleep if all pass
+void power_on_self_test()
+{
+    setup_onboard_led();
+    clear_led();
+
+    if (bring_up_storage() != ESP_OK)
+    {
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+
+    ESP_LOGI(MAIN_TAG, "Power on");
+
+#ifdef CONFIG_STORAGE_BACKEND_SDSPI
+    ESP_LOGI(MAIN_TAG, "Running SD SPI POST...");
+    set_led_colour(0, 120, 0); // SD card setup colour (Green)
+    if (SDSPI_POST() != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "POST failed on a SD SPI");
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+    ESP_LOGI(MAIN_TAG, "SD SPI POST sucsess");
+    clear_led();
+#endif
+
+    ESP_LOGI(MAIN_TAG, "NVS erase and test");
+    if (nvs_flash_init() != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "POST failed on NVS");
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+    // Keep the exposure seeds from before power loss, they are still valid for the same site
+    load_exposure_seeds_from_nvs();
+
+    // Last capture number is a starting hint for finding the next free capture number
+    uint32_t nvs_capture_count = 0;
+    if (nvs_open("storage", NVS_READONLY, &my_handle) == ESP_OK)
+    {
+        nvs_get_u32(my_handle, NVS_CAP_COUNT_KEY, &nvs_capture_count);
+        nvs_close(my_handle);
+    }
+
+    nvs_flash_erase();
     nvs_flash_init();
+    save_exposure_seeds_to_nvs();
+
     if (nvs_open("storage", NVS_READWRITE, &my_handle) != ESP_OK)
     {
-        // Guess a value to attempt to write to
-        next_capture_count = 1000;
+        ESP_LOGE(MAIN_TAG, "POST failed on NVS open");
+        set_led_colour(255, 0, 0); // error colour
+        return;
     }
-    else
+
+    if (capture_store_init(storage) != ESP_OK)
     {
-        if (nvs_get_u32(my_handle, NVS_CAP_COUNT_KEY, &next_capture_count) != ESP_OK)
-        {
-            // Guess a value to attempt to write to
-            next_capture_count = 1000;
-        }
+        ESP_LOGE(MAIN_TAG, "POST failed on capture store");
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+
+    uint32_t next_capture_num = capture_store_find_next_capture_num(nvs_capture_count);
+    capture_store_close();
+
+    if (capture_store_set_next_capture_num(next_capture_num) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "POST failed on writing capture high water mark");
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+
+    esp_err_t err = nvs_set_u32(my_handle, NVS_CAP_COUNT_KEY, next_capture_num);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(my_handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "POST failed on NVS writing, %s", esp_err_to_name(err));
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+
+    set_led_colour(0, 0, 120); // Cam POST indicator (Blue)
+    // This should always be run first, sets all power down pins as outputs and shuts down all cameras
+    ESP_LOGI(MAIN_TAG, "Setting up cam power pins");
+    setup_all_cam_power_down_pins();
+
+    ESP_LOGI(MAIN_TAG, "POSTing all cameras");
+    if (POST_all_cams() != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "POST failed on a camera");
+        set_led_colour(255, 0, 0); // error colour
+        return;
+    }
+    ESP_LOGI(MAIN_TAG, "Camera POST sucsess");
+    clear_led();
+
+    ESP_LOGI(MAIN_TAG, "All POSTs successful");
+
+    enter_deep_sleep();
+}
+
+void app_main(void)
+{
+    boot_timeline_mark(BOOT_PHASE_APP_MAIN);
+
+    esp_sleep_source_t wakeup_reason = esp_sleep_get_wakeup_cause();
+    ESP_LOGI(MAIN_TAG, "Wakeup reason: %i", wakeup_reason);
+
+    if (wakeup_reason == ESP_SLEEP_WAKEUP_UNDEFINED)
+    {
+        power_on_self_test();
+        return;
+    }
+    else if (wakeup_reason == ESP_SLEEP_WAKEUP_EXT0)
+    {
+        ESP_LOGI(MAIN_TAG, "Wakeup from PIR trigger");
+    }
+
+#ifdef CONFIG_MEM_TELEMETRY_ENABLED
+    if (mem_telemetry_init() != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start memory telemetry");
+    }
+#endif
+#ifdef CONFIG_TRACE_ENABLED
+    if (trace_init(CONFIG_TRACE_RING_EVENTS) != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start tracing, wake not traced");
     }
+#endif
+
+    // Camera power pins come first so the first camera can be powered straight away,
+    // SD and NVS are brought up on the other core in parallel with the capture
+    setup_all_cam_power_down_pins();
 
-    motion_proc_queue = xQueueCreate(MAX_CONT_CAP, sizeof(jpg_motion_data_t));
+    storage_events = xEventGroupCreate();
+    xTaskCreatePinnedToCore(storage_bringup_task, "Storage bringup task", 1024 * 4, NULL, 5, NULL, 1);
 
-    TaskHandle_t motion_task_handle;
-    xTaskCreate(motion_processing_task, "Motion processing task", 1024 * 16, NULL, 4, &motion_task_handle);
+    // Image buffers for the whole burst are taken up front, captures never allocate
+    // Without them nothing can be captured, the wake still closes down and sleeps as normal
+    camera_config_t slot_config = get_default_camera_config(cam_power_down_pins[0]);
+    bool slots_ready = motion_slots_init(MAX_CONT_CAP, get_max_jpg_len(slot_config.frame_size)) == ESP_OK;
+    if (slots_ready == false)
+    {
+        ESP_LOGE(MAIN_TAG, "No memory for motion slots, captures dropped");
+    }
+
+    // Only slot jobs are queued, the captures stay where the camera copied them. Without
+    // arenas there is nowhere to analyse, so the pipeline is not started
+    if (start_capture_arenas(&slot_config) != ESP_OK ||
+        start_processing_pipeline() != ESP_OK)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start processing, captures will be stored unanalysed");
+    }
     vTaskPrioritySet(NULL, 4);
 
-    esp_rom_gpio_pad_select_gpio(PIR_PIN);
-    gpio_set_direction(PIR_PIN, GPIO_MODE_INPUT);
-    gpio_pulldown_dis(PIR_PIN);
-    gpio_pullup_en(PIR_PIN);
+    // Without the controller the wake's trigger is still captured, just never followed up
+    bool pir_controlled = slots_ready && pir_burst_start(get_processing_backlog) == ESP_OK;
+    if (slots_ready && pir_controlled == false)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start PIR controller, capturing the wake trigger only");
+    }
 
     size_t cont_capture_count = 0;
-    while(cont_capture_count < MAX_CONT_CAP)
+    while (slots_ready && cont_capture_count < MAX_CONT_CAP)
     {
-        capture_motion_images(next_capture_count++);
-        // Wait 5 seconds to see if motion has stopped
-        vTaskDelay(pdMS_TO_TICKS(10000));
+        pir_request_t request = {
+            .type = cont_capture_count == 0 ? PIR_REQUEST_CAPTURE : PIR_REQUEST_BURST_END,
+            .trigger_us = 0,
+        };
+        if (pir_controlled)
+        {
+            pir_burst_wait(&request, portMAX_DELAY);
+        }
+
+        if (request.type == PIR_REQUEST_BURST_END)
+        {
+            break;
+        }
 
-        if (gpio_get_level(PIR_PIN) != PIR_TRIG_LEVEL)
+        ESP_LOGI(MAIN_TAG, "Capture %u starting %lldms after motion", cont_capture_count + 1,
+                 (esp_timer_get_time() - request.trigger_us) / 1000);
+        if (capture_motion_images() == false)
         {
-            // Motion has stopped, wait for motion processing to end
+            ESP_LOGE(MAIN_TAG, "No storage, captures dropped");
             break;
         }
         cont_capture_count++;
-        vTaskResume(motion_task_handle);
+    }
+    pir_burst_stop();
+
+    // Without the card there is nothing to close down
+    EventBits_t storage_bits = xEventGroupWaitBits(storage_events, STORAGE_READY_BIT | STORAGE_FAILED_BIT,
+                                                   pdFALSE, pdFALSE, portMAX_DELAY);
+    if ((storage_bits & STORAGE_READY_BIT) == 0)
+    {
+        ESP_LOGE(MAIN_TAG, "Storage never came up, sleeping straight away");
+        enter_deep_sleep();
     }
 
     if (cont_capture_count < MAX_CONT_CAP)
@@ -349,19 +1338,38 @@ void app_main(void)
         ESP_LOGI(MAIN_TAG, "Continous motion limit hit, %i captures made.", cont_capture_count);
     }
 
-    // Save current capture number for later boot
-    nvs_set_u32(my_handle, NVS_CAP_COUNT_KEY, next_capture_count);
-
-    while(1)
+    // Processing, the card and NVS are closed down in parallel, sleep follows the last to finish
+    TRACE_BEGIN(TRACE_SPAN_SLEEP_ENTRY);
+    shutdown_events = xEventGroupCreate();
+    if (xTaskCreatePinnedToCore(nvs_commit_task, "NVS commit task", 1024 * 3, NULL, 3, NULL, 1) != pdPASS)
     {
-        if (processing_active == false)
-        {
-            ESP_LOGI(MAIN_TAG, "Processing finished");
-            enter_deep_sleep();
-        }
-
-        // Wait 1 second and check if the camera processing task has reached the end of its queue
-        ESP_LOGI(MAIN_TAG, "Processing active, waiting");
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        ESP_LOGE(MAIN_TAG, "Failed to start NVS commit, capture count not saved");
+        xEventGroupSetBits(shutdown_events, SHUTDOWN_NVS_BIT);
     }
-}
\ No newline at end of file
+    if (xTaskCreatePinnedToCore(storage_shutdown_task, "Storage shutdown task", 1024 * 4, NULL, 3, NULL, 1) != pdPASS)
+    {
+        ESP_LOGE(MAIN_TAG, "Failed to start storage shutdown, captures may be lost");
+        xEventGroupSetBits(shutdown_events, SHUTDOWN_PROCESSING_BIT | SHUTDOWN_STORAGE_BIT);
+    }
+
+    xEventGroupWaitBits(shutdown_events, SHUTDOWN_ALL_BITS, pdFALSE, pdTRUE, portMAX_DELAY);
+    boot_timeline_mark(BOOT_PHASE_SHUTDOWN_READY);
+
+#ifdef CONFIG_RETENTION_ENABLED
+    // Capture path is idle, make room for the next wake in the background
+    retention_run(next_capture_count);
+#endif
+    write_boot_timeline();
+#ifdef CONFIG_MEM_TELEMETRY_ENABLED
+    write_mem_telemetry();
+#endif
+#ifdef CONFIG_RETENTION_ENABLED
+    retention_finish(pdMS_TO_TICKS(CONFIG_RETENTION_MAX_RUN_MS));
+#endif
+    TRACE_END(TRACE_SPAN_SLEEP_ENTRY);
+#ifdef CONFIG_TRACE_ENABLED
+    write_trace();
+#endif
+    boot_timeline_record_awake();
+    enter_deep_sleep();
+}
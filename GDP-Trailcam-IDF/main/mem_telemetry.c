@@ -0,0 +1,263 @@
+/// ------------------------------------------
+/// @file mem_telemetry.c
+///
+/// @brief Source file for per stage heap and PSRAM telemetry
+/// ------------------------------------------
+
+#include "mem_telemetry.h"
+
+#include <stdarg.h>
+
+/// @brief Debugging string tag
+static const char* MEM_TAG = "mem_telemetry";
+
+/// @brief Printable names of each stage
+static const char* mem_stage_names[MEM_STAGE_COUNT] = {
+    "other",
+    "capture",
+    "decode",
+    "analyse",
+    "crop",
+    "store",
+};
+
+/// @brief What each stage has seen, protected by mem_mutex
+static mem_stage_stats_t stage_stats[MEM_STAGE_COUNT];
+
+/// @brief Snapshot taken by mem_telemetry_init
+static mem_snapshot_t wake_start;
+
+/// @brief Protects stage_stats, null until mem_telemetry_init
+static SemaphoreHandle_t mem_mutex = NULL;
+
+/// @brief Stage the calling task is in
+static __thread mem_stage_t current_stage = MEM_STAGE_OTHER;
+
+/// ------------------------------------------
+/// @brief Gets the state of one kind of memory
+///
+/// @param caps MALLOC_CAP_ flag of the memory
+/// @param[out] state_out filled with its state
+static void get_heap_state(const uint32_t caps, mem_heap_state_t* state_out)
+{
+    state_out->free = heap_caps_get_free_size(caps);
+    state_out->min_free = heap_caps_get_minimum_free_size(caps);
+    state_out->largest_block = heap_caps_get_largest_free_block(caps);
+}
+
+/// ------------------------------------------
+/// @brief Lowers each value of worst to the value in now, if it is lower
+static void fold_heap_state(mem_heap_state_t* worst, const mem_heap_state_t* now)
+{
+    worst->free = MIN(worst->free, now->free);
+    worst->min_free = MIN(worst->min_free, now->min_free);
+    worst->largest_block = MIN(worst->largest_block, now->largest_block);
+}
+
+/// ------------------------------------------
+/// @brief Lowers each value of worst to the value in now, if it is lower
+static void fold_snapshot(mem_snapshot_t* worst, const mem_snapshot_t* now)
+{
+    fold_heap_state(&worst->internal, &now->internal);
+    fold_heap_state(&worst->psram, &now->psram);
+}
+
+/// ------------------------------------------
+/// @brief Appends to a record, stopping short of its end
+///
+/// @param record being formatted
+/// @param[in,out] len length of the record so far
+/// @param format printf format of the text to append
+static void append_record(char* record, size_t* len, const char* format, ...)
+{
+    if (*len >= MEM_TELEMETRY_RECORD_LEN - 1)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(record + *len, MEM_TELEMETRY_RECORD_LEN - *len, format, args);
+    va_end(args);
+    if (written > 0)
+    {
+        *len = MIN(*len + written, MEM_TELEMETRY_RECORD_LEN - 1);
+    }
+}
+
+/// ------------------------------------------
+/// @brief Appends one snapshot to a record
+static void append_snapshot(char* record, size_t* len, const char* label, const mem_snapshot_t* snapshot)
+{
+    append_record(record, len, "  %-6s internal free %u min %u block %u, psram free %u min %u block %u\n",
+                  label, snapshot->internal.free, snapshot->internal.min_free, snapshot->internal.largest_block,
+                  snapshot->psram.free, snapshot->psram.min_free, snapshot->psram.largest_block);
+}
+
+/// ------------------------------------------
+esp_err_t mem_telemetry_init()
+{
+    if (mem_mutex != NULL)
+    {
+        return ESP_OK;
+    }
+
+    mem_mutex = xSemaphoreCreateMutex();
+    if (mem_mutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mem_telemetry_snapshot(&wake_start);
+    for (size_t i = 0; i < MEM_STAGE_COUNT; i++)
+    {
+        memset(&stage_stats[i], 0, sizeof(mem_stage_stats_t));
+        stage_stats[i].worst_before = wake_start;
+        stage_stats[i].worst_after = wake_start;
+    }
+
+    ESP_LOGI(MEM_TAG, "Wake start, internal %u free (%u block), psram %u free (%u block)",
+             wake_start.internal.free, wake_start.internal.largest_block, wake_start.psram.free,
+             wake_start.psram.largest_block);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+void mem_telemetry_snapshot(mem_snapshot_t* snapshot_out)
+{
+    get_heap_state(MALLOC_CAP_INTERNAL, &snapshot_out->internal);
+    get_heap_state(MALLOC_CAP_SPIRAM, &snapshot_out->psram);
+}
+
+/// ------------------------------------------
+void mem_telemetry_stage_enter(const mem_stage_t stage)
+{
+    if (mem_mutex == NULL || stage >= MEM_STAGE_COUNT)
+    {
+        return;
+    }
+
+    current_stage = stage;
+
+    mem_snapshot_t now;
+    mem_telemetry_snapshot(&now);
+
+    xSemaphoreTake(mem_mutex, portMAX_DELAY);
+    stage_stats[stage].runs++;
+    fold_snapshot(&stage_stats[stage].worst_before, &now);
+    xSemaphoreGive(mem_mutex);
+}
+
+/// ------------------------------------------
+void mem_telemetry_stage_exit()
+{
+    mem_stage_t stage = current_stage;
+    current_stage = MEM_STAGE_OTHER;
+    if (mem_mutex == NULL)
+    {
+        return;
+    }
+
+    mem_snapshot_t now;
+    mem_telemetry_snapshot(&now);
+
+    xSemaphoreTake(mem_mutex, portMAX_DELAY);
+    fold_snapshot(&stage_stats[stage].worst_after, &now);
+    xSemaphoreGive(mem_mutex);
+}
+
+/// ------------------------------------------
+void* mem_telemetry_malloc(const size_t len, const uint32_t caps)
+{
+    void* buf = heap_caps_malloc(len, caps);
+    if (mem_mutex == NULL)
+    {
+        return buf;
+    }
+
+    mem_stage_t stage = current_stage;
+    if (buf == NULL)
+    {
+        ESP_LOGE(MEM_TAG, "%s failed to allocate %u bytes, %u free with %u largest block", mem_stage_names[stage],
+                 len, heap_caps_get_free_size(caps), heap_caps_get_largest_free_block(caps));
+    }
+
+    xSemaphoreTake(mem_mutex, portMAX_DELAY);
+    mem_stage_stats_t* stats = &stage_stats[stage];
+    stats->heap_allocs++;
+    stats->heap_bytes += len;
+    stats->heap_largest = MAX(stats->heap_largest, len);
+    if (buf == NULL)
+    {
+        stats->heap_failures++;
+    }
+    xSemaphoreGive(mem_mutex);
+    return buf;
+}
+
+/// ------------------------------------------
+void mem_telemetry_note_arena(const size_t used, const bool fitted)
+{
+    if (mem_mutex == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(mem_mutex, portMAX_DELAY);
+    mem_stage_stats_t* stats = &stage_stats[current_stage];
+    stats->arena_peak = MAX(stats->arena_peak, used);
+    if (fitted == false)
+    {
+        stats->arena_failures++;
+    }
+    xSemaphoreGive(mem_mutex);
+}
+
+/// ------------------------------------------
+void mem_telemetry_get_stage(const mem_stage_t stage, mem_stage_stats_t* stats_out)
+{
+    if (mem_mutex == NULL || stage >= MEM_STAGE_COUNT)
+    {
+        memset(stats_out, 0, sizeof(mem_stage_stats_t));
+        return;
+    }
+
+    xSemaphoreTake(mem_mutex, portMAX_DELAY);
+    *stats_out = stage_stats[stage];
+    xSemaphoreGive(mem_mutex);
+}
+
+/// ------------------------------------------
+void mem_telemetry_format(char* record_out)
+{
+    mem_snapshot_t now;
+    mem_telemetry_snapshot(&now);
+
+    size_t len = 0;
+    record_out[0] = '\0';
+    append_record(record_out, &len, "wake:\n");
+    append_snapshot(record_out, &len, "start", &wake_start);
+    append_snapshot(record_out, &len, "end", &now);
+
+    for (size_t i = 0; i < MEM_STAGE_COUNT; i++)
+    {
+        mem_stage_stats_t stats;
+        mem_telemetry_get_stage(i, &stats);
+        if (stats.runs == 0 && stats.heap_allocs == 0)
+        {
+            continue;
+        }
+
+        append_record(record_out, &len,
+                      "%s: runs %lu, heap %lu allocs %u bytes largest %u failed %lu, arena peak %u failed %lu\n",
+                      mem_stage_names[i], stats.runs, stats.heap_allocs, stats.heap_bytes, stats.heap_largest,
+                      stats.heap_failures, stats.arena_peak, stats.arena_failures);
+
+        // Other is never entered, so has no snapshots of its own
+        if (stats.runs > 0)
+        {
+            append_snapshot(record_out, &len, "before", &stats.worst_before);
+            append_snapshot(record_out, &len, "after", &stats.worst_after);
+        }
+    }
+}
@@ -0,0 +1,155 @@
+/// ------------------------------------------
+/// @file mem_telemetry.h
+///
+/// @brief Header file for per stage heap and PSRAM telemetry, so buffers and pools can be
+/// sized against the worst case seen on the device
+///
+/// @note Each stage is bracketed by mem_telemetry_stage_enter and mem_telemetry_stage_exit,
+/// which snapshot the free, minimum free and largest free block of internal RAM and PSRAM.
+/// Snapshots are folded into the lowest seen for the stage. Allocations made through
+/// mem_telemetry_malloc, and from capture arenas, are counted against the stage the
+/// calling task is in. Their buffers are freed as normal.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/// @brief Parts of a wake memory is attributed to
+typedef enum
+{
+    // Anything outside of the stages below
+    MEM_STAGE_OTHER,
+
+    // Powering the cameras and grabbing frames
+    MEM_STAGE_CAPTURE,
+
+    // Pipeline decode stage
+    MEM_STAGE_DECODE,
+
+    // Pipeline analyse stage
+    MEM_STAGE_ANALYSE,
+
+    // Pipeline crop stage
+    MEM_STAGE_CROP,
+
+    // SD writer storing a file
+    MEM_STAGE_STORE,
+
+    MEM_STAGE_COUNT
+} mem_stage_t;
+
+/// @brief State of one kind of memory
+typedef struct
+{
+    // Bytes free
+    size_t free;
+
+    // Least bytes free since boot
+    size_t min_free;
+
+    // Largest block that could be allocated
+    size_t largest_block;
+} mem_heap_state_t;
+
+/// @brief State of internal RAM and PSRAM at one moment
+typedef struct
+{
+    mem_heap_state_t internal;
+    mem_heap_state_t psram;
+} mem_snapshot_t;
+
+/// @brief Memory seen by one stage this wake
+typedef struct
+{
+    // Times the stage was entered
+    uint32_t runs;
+
+    // Lowest of each value on entering the stage
+    mem_snapshot_t worst_before;
+
+    // Lowest of each value on leaving the stage
+    mem_snapshot_t worst_after;
+
+    // Heap allocations made through mem_telemetry_malloc
+    uint32_t heap_allocs;
+
+    // Heap allocations that returned null
+    uint32_t heap_failures;
+
+    // Bytes asked of the heap
+    size_t heap_bytes;
+
+    // Largest single heap allocation asked for
+    size_t heap_largest;
+
+    // Capture arena allocations that did not fit
+    uint32_t arena_failures;
+
+    // Most bytes of a capture arena in use during the stage
+    size_t arena_peak;
+} mem_stage_stats_t;
+
+/// @brief Max length of a formatted memory telemetry record
+#define MEM_TELEMETRY_RECORD_LEN 3072
+
+///--------------------------------------------------------
+/// @brief Starts recording, taking the snapshot the wake is compared against
+///
+/// @return ESP_OK if sucsessful
+esp_err_t mem_telemetry_init();
+
+///--------------------------------------------------------
+/// @brief Takes a snapshot of internal RAM and PSRAM
+///
+/// @param[out] snapshot_out filled with the current state
+void mem_telemetry_snapshot(mem_snapshot_t* snapshot_out);
+
+///--------------------------------------------------------
+/// @brief Marks the calling task as entering a stage
+///
+/// @param stage being entered
+void mem_telemetry_stage_enter(const mem_stage_t stage);
+
+///--------------------------------------------------------
+/// @brief Marks the calling task as leaving its stage, its allocations count as
+/// MEM_STAGE_OTHER until it enters another
+void mem_telemetry_stage_exit();
+
+///--------------------------------------------------------
+/// @brief Allocates from the heap, counted against the calling task's stage
+///
+/// @param len bytes needed
+/// @param caps MALLOC_CAP_ flags, as heap_caps_malloc
+///
+/// @return buffer to be freed with free, null if it could not be allocated
+void* mem_telemetry_malloc(const size_t len, const uint32_t caps);
+
+///--------------------------------------------------------
+/// @brief Counts a capture arena allocation against the calling task's stage
+///
+/// @param used bytes of the arena in use after the allocation
+/// @param fitted did the allocation fit?
+void mem_telemetry_note_arena(const size_t used, const bool fitted);
+
+///--------------------------------------------------------
+/// @brief Gets what a stage has seen this wake
+///
+/// @param stage to get
+/// @param[out] stats_out filled with the stage's stats
+void mem_telemetry_get_stage(const mem_stage_t stage, mem_stage_stats_t* stats_out);
+
+///--------------------------------------------------------
+/// @brief Formats the wake's telemetry into a text record, the wake start and end
+/// followed by every stage that ran
+///
+/// @param[out] record_out buffer sized to at least MEM_TELEMETRY_RECORD_LEN
+void mem_telemetry_format(char* record_out);
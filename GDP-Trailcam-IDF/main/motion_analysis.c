@@ -10,7 +10,7 @@
 static const char* MOTION_TAG = "motion_analysis";
 
 /// ------------------------------------------
-grayscale_image_t convert_jpg_to_grayscale(const jpg_image_t* jpg_image)
+grayscale_image_t convert_jpg_to_grayscale(const jpg_image_t* jpg_image, capture_arena_t* arena)
 {
     grayscale_image_t gray_image;
     gray_image.height = jpg_image->height;
@@ -18,13 +18,21 @@ grayscale_image_t convert_jpg_to_grayscale(const jpg_image_t* jpg_image)
     gray_image.len = gray_image.width * gray_image.height;
 
     ESP_LOGI(MOTION_TAG, "Allocating %u bytes for grayscale, %ux%u", gray_image.len, gray_image.width, gray_image.height);
-    gray_image.buf = malloc(gray_image.len);
+    gray_image.buf = capture_arena_alloc(arena, gray_image.len);
+    if (gray_image.buf == NULL)
+    {
+        ESP_LOGE(MOTION_TAG, "No room for grayscale image");
+        return gray_image;
+    }
 
     ESP_LOGI(MOTION_TAG, "Converting jpg to grayscale");
-    if (jpg2grayscale(jpg_image->buf, jpg_image->len, gray_image.buf, JPG_SCALE_NONE) == false)
+    TRACE_BEGIN(TRACE_SPAN_GRAYSCALE);
+    bool converted = jpg2grayscale(jpg_image->buf, jpg_image->len, gray_image.buf, JPG_SCALE_NONE);
+    TRACE_END(TRACE_SPAN_GRAYSCALE);
+    if (converted == false)
     {
         ESP_LOGE(MOTION_TAG, "Conversion from jpg to grayscale failed!");
-        free(gray_image.buf);
+        capture_arena_pop(arena, gray_image.buf);
         gray_image.buf = NULL;
     }
 
@@ -32,14 +40,15 @@ grayscale_image_t convert_jpg_to_grayscale(const jpg_image_t* jpg_image)
 }
 
 /// ------------------------------------------
-grayscale_motion_data_t convert_jpg_motion_to_grayscale(const jpg_motion_data_t* jpg_motion)
+grayscale_motion_data_t convert_jpg_motion_to_grayscale(const jpg_motion_data_t* jpg_motion,
+                                                        capture_arena_t* arena)
 {
     grayscale_motion_data_t gray_motion;
     gray_motion.t1 = jpg_motion->t1;
     gray_motion.t2 = jpg_motion->t2;
 
     ESP_LOGI(MOTION_TAG, "Converting img 1");
-    grayscale_image_t img1 = convert_jpg_to_grayscale(&jpg_motion->img1);
+    grayscale_image_t img1 = convert_jpg_to_grayscale(&jpg_motion->img1, arena);
     if (img1.buf == NULL)
     {
         gray_motion.data_valid = false;
@@ -48,11 +57,11 @@ grayscale_motion_data_t convert_jpg_motion_to_grayscale(const jpg_motion_data_t*
 
 
     ESP_LOGI(MOTION_TAG, "Converting img 2");
-    grayscale_image_t img2 = convert_jpg_to_grayscale(&jpg_motion->img2);
+    grayscale_image_t img2 = convert_jpg_to_grayscale(&jpg_motion->img2, arena);
     if (img2.buf == NULL)
     {
         gray_motion.data_valid = false;
-        free(img1.buf);
+        capture_arena_pop(arena, img1.buf);
         return gray_motion;
     }
 
@@ -63,42 +72,98 @@ grayscale_motion_data_t convert_jpg_motion_to_grayscale(const jpg_motion_data_t*
 }
 
 /// ------------------------------------------
-grayscale_image_t motion_image_subtract(const grayscale_motion_data_t* motion_set)
+grayscale_image_t motion_image_subtract(grayscale_motion_data_t* motion_set)
 {
-    grayscale_image_t sub_image;
-    sub_image.height = motion_set->img1.height;
-    sub_image.width = motion_set->img1.width;
-    sub_image.len = sub_image.height * sub_image.width;
-
-    sub_image.buf = malloc(sub_image.len);
+    grayscale_image_t sub_image = motion_set->img1;
 
+    // Each pixel of img1 is read before it is overwritten
+    TRACE_BEGIN(TRACE_SPAN_SUBTRACT);
     for (size_t pix = 0; pix < sub_image.len; pix++)
     {
         sub_image.buf[pix] = abs(motion_set->img1.buf[pix] - motion_set->img2.buf[pix]);
     }
+    TRACE_END(TRACE_SPAN_SUBTRACT);
 
     return sub_image;
 }
 
 /// ------------------------------------------
-grayscale_image_t perform_motion_analysis(const jpg_motion_data_t* motion_set)
+grayscale_image_t perform_motion_analysis(const jpg_motion_data_t* motion_set, capture_arena_t* arena)
 {
-    grayscale_image_t sub_image;
-    sub_image.buf = NULL;
-
-    ESP_LOGI(MOTION_TAG,"Converting motion to grayscale");
-    grayscale_motion_data_t gray_motion = convert_jpg_motion_to_grayscale(motion_set);
-
-    if (gray_motion.data_valid == false)
+    ESP_LOGI(MOTION_TAG,"Converting img 1 to grayscale");
+    grayscale_image_t sub_image = convert_jpg_to_grayscale(&motion_set->img1, arena);
+    if (sub_image.buf == NULL)
     {
         ESP_LOGE(MOTION_TAG, "Grayscale conversion process failed");
         return sub_image;
     }
 
-    ESP_LOGI(MOTION_TAG, "Subtracting images");
-    sub_image = motion_image_subtract(&gray_motion);
-    free_grayscale_motion_data(&gray_motion);
+    // img2 is subtracted as it is decoded, so only one grayscale image is ever held
+    ESP_LOGI(MOTION_TAG, "Subtracting img 2");
+    TRACE_BEGIN(TRACE_SPAN_SUBTRACT);
+    bool subtracted = jpg2grayscale_diff(motion_set->img2.buf, motion_set->img2.len, sub_image.buf, JPG_SCALE_NONE);
+    TRACE_END(TRACE_SPAN_SUBTRACT);
+    if (subtracted == false)
+    {
+        ESP_LOGE(MOTION_TAG, "Subtraction of img 2 failed!");
+        capture_arena_pop(arena, sub_image.buf);
+        sub_image.buf = NULL;
+        return sub_image;
+    }
 
     ESP_LOGI(MOTION_TAG, "Image subtraction done");
     return sub_image;
-}
\ No newline at end of file
+}
+/// ------------------------------------------
+uint32_t estimate_motion_score(const jpg_motion_data_t* motion_set)
+{
+    size_t len1 = motion_set->img1.len;
+    size_t len2 = motion_set->img2.len;
+    if (motion_set->data_valid == false || len1 == 0 || len2 == 0)
+    {
+        return 0;
+    }
+
+    size_t larger = len1 > len2 ? len1 : len2;
+    size_t delta = len1 > len2 ? len1 - len2 : len2 - len1;
+    return (uint64_t)delta * MOTION_SCORE_MAX / larger;
+}
+
+/// ------------------------------------------
+bool prefilter_motion(const jpg_motion_data_t* motion_set, capture_arena_t* arena, size_t* changed_blocks_out)
+{
+    *changed_blocks_out = 0;
+    int64_t start_time = esp_timer_get_time();
+
+    // Decoder goes first so popping it frees the thumbnails too
+    size_t thumb_len = dc_prefilter_thumbnail_len(motion_set->img1.width, motion_set->img1.height);
+    dc_prefilter_decoder_t* decoder = capture_arena_alloc(arena, sizeof(dc_prefilter_decoder_t));
+    if (decoder == NULL)
+    {
+        return true;
+    }
+    uint8_t* thumb1 = capture_arena_alloc(arena, thumb_len);
+    uint8_t* thumb2 = capture_arena_alloc(arena, thumb_len);
+    if (thumb1 == NULL || thumb2 == NULL)
+    {
+        capture_arena_pop(arena, decoder);
+        return true;
+    }
+
+    int err1 = dc_prefilter_thumbnail(decoder, motion_set->img1.buf, motion_set->img1.len, thumb1, thumb_len, NULL, NULL);
+    int err2 = dc_prefilter_thumbnail(decoder, motion_set->img2.buf, motion_set->img2.len, thumb2, thumb_len, NULL, NULL);
+    if (err1 != DC_PREFILTER_OK || err2 != DC_PREFILTER_OK)
+    {
+        ESP_LOGW(MOTION_TAG, "Could not pre-filter, errors %i and %i", err1, err2);
+        capture_arena_pop(arena, decoder);
+        return true;
+    }
+
+    *changed_blocks_out = dc_prefilter_changed_blocks(thumb1, thumb2, thumb_len, CONFIG_MOTION_PREFILTER_THRESHOLD);
+    bool passed = dc_prefilter_passes(*changed_blocks_out, thumb_len, CONFIG_MOTION_PREFILTER_MIN_PERMILLE);
+    capture_arena_pop(arena, decoder);
+
+    ESP_LOGI(MOTION_TAG, "Pre-filter %s, %u of %u blocks changed in %lldms", passed ? "passed" : "rejected",
+             *changed_blocks_out, thumb_len, (esp_timer_get_time() - start_time) / 1000);
+    return passed;
+}
@@ -18,37 +18,75 @@
 
 #include "Camera.h"
 #include "image_types.h"
+#include "capture_arena.h"
+#include "dc_prefilter.h"
+#include "trace.h"
+
+/// @brief Highest score estimate_motion_score gives
+#define MOTION_SCORE_MAX 1000
 
 /// ------------------------------------------
 /// @brief Generates a grayscale image from an input jpg
 ///
 /// @param jpg_image input jpg image
+/// @param arena the grayscale buffer is taken from, as a working buffer
 ///
 /// @return grayscale image struct, buf is null if conversion fails
-grayscale_image_t convert_jpg_to_grayscale(const jpg_image_t* jpg_image);
+grayscale_image_t convert_jpg_to_grayscale(const jpg_image_t* jpg_image, capture_arena_t* arena);
 
 /// ------------------------------------------
 /// @brief Converts a motion set from jpg to grayscale format
 ///
 /// @param jpg_motion input motion set
+/// @param arena the grayscale buffers are taken from, img2's directly after img1's
 ///
 /// @return grayscale motion set, check data_valid for validity
-grayscale_motion_data_t convert_jpg_motion_to_grayscale(const jpg_motion_data_t* jpg_motion);
+grayscale_motion_data_t convert_jpg_motion_to_grayscale(const jpg_motion_data_t* jpg_motion,
+                                                        capture_arena_t* arena);
 
 /// ------------------------------------------
 /// @brief Performs image subtraction on a motion set and outputs the resulting image
 ///
+/// @note The subtraction is written over img1, no buffer is allocated
+///
 /// @param motion_set motion set to perform subtraction on
 ///
-/// @return grayscale motion subtracted image
-grayscale_image_t motion_image_subtract(const grayscale_motion_data_t* motion_set);
+/// @return grayscale motion subtracted image, sharing img1's buffer
+grayscale_image_t motion_image_subtract(grayscale_motion_data_t* motion_set);
 
 /// ------------------------------------------
 /// @brief Ingests a jpg motion set and generates a subtracted image
 ///
-/// @note Frees motion set data as it processes, including input
+/// @note img2 is subtracted from img1's grayscale as it is decoded, so the arena only
+/// ever holds one grayscale image
+///
+/// @param motion_set input jpg motion set
+/// @param arena the subtracted image is taken from, as a working buffer
+///
+/// @return subtracted grayscale image, buf is null if analysis fails
+grayscale_image_t perform_motion_analysis(const jpg_motion_data_t* motion_set, capture_arena_t* arena);
+/// ------------------------------------------
+/// @brief Estimates how much motion a capture holds without decoding it, for deciding
+/// which captures are worth analysing
+///
+/// @note Uses the difference in jpg size between the two images, entropy coded data grows
+/// and shrinks with the detail a moving subject adds to or hides from the scene
+///
+/// @param motion_set input jpg motion set
+///
+/// @return score from 0 to MOTION_SCORE_MAX, 0 if the set is not valid
+uint32_t estimate_motion_score(const jpg_motion_data_t* motion_set);
+
+/// ------------------------------------------
+/// @brief Checks a motion set for possible motion from its jpgs' DC coefficients alone,
+/// see dc_prefilter.h
+///
+/// @note Only rejects what full analysis would very likely find not significant, a
+/// set that cannot be pre-filtered is always passed on
 ///
 /// @param motion_set input jpg motion set
+/// @param arena the thumbnails are taken from, they are popped before returning
+/// @param[out] changed_blocks_out blocks that changed between the thumbnails
 ///
-/// @return subtracted grayscale image
-grayscale_image_t perform_motion_analysis(const jpg_motion_data_t* motion_set);
\ No newline at end of file
+/// @return true if the set should go on to full analysis
+bool prefilter_motion(const jpg_motion_data_t* motion_set, capture_arena_t* arena, size_t* changed_blocks_out);
@@ -0,0 +1,87 @@
+/// ------------------------------------------
+/// @file motion_mask.h
+///
+/// @brief On card layout of the compact motion mask file, written with the motion.jpg
+/// preview in place of the raw sub.bin/box.bin debug images
+///
+/// @note Shared with the host side tools, must only depend on the C standard library
+///
+/// The quantized motion image only holds 0x00 and 0xff pixels, so it is stored as one
+/// bit per pixel, either run length or bit packed, whichever is smaller:
+///
+///     [motion_mask_header_t][payload]
+///
+/// MOTION_MASK_ENCODING_RLE: alternating run lengths of clear and set pixels in row major
+/// order as LEB128 varints, starting with a (possibly 0 long) clear run.
+///
+/// MOTION_MASK_ENCODING_BITPACK: one bit per pixel in row major order, MSB first.
+///
+/// The bounding box, if any, is stored as its origin so the box image can be redrawn
+/// by the decoder instead of being written a second time. All values are little endian.
+/// ------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Mask file magic, "TMSK"
+#define MOTION_MASK_MAGIC 0x4B534D54
+
+/// @brief Version of the mask layout
+#define MOTION_MASK_VERSION 1
+
+/// @brief Payload is alternating run lengths
+#define MOTION_MASK_ENCODING_RLE 0
+
+/// @brief Payload is one bit per pixel
+#define MOTION_MASK_ENCODING_BITPACK 1
+
+/// @brief Box coordinate used when the mask has no bounding box
+#define MOTION_MASK_NO_BOX 0xFFFF
+
+/// @brief Name of the mask file within a capture
+#define MOTION_MASK_FILE_NAME "motion.msk"
+
+/// @brief Mask file header, at offset 0
+typedef struct __attribute__((packed))
+{
+    // MOTION_MASK_MAGIC
+    uint32_t magic;
+
+    // MOTION_MASK_VERSION
+    uint8_t version;
+
+    // MOTION_MASK_ENCODING_RLE or MOTION_MASK_ENCODING_BITPACK
+    uint8_t encoding;
+
+    // Width of the mask in pixels
+    uint16_t width;
+
+    // Height of the mask in pixels
+    uint16_t height;
+
+    // Top left of the bounding box, MOTION_MASK_NO_BOX if motion was not significant
+    uint16_t box_x;
+    uint16_t box_y;
+
+    // Edge length of the square bounding box
+    uint16_t box_len;
+
+    // Number of set pixels, excluding the box
+    uint32_t set_count;
+
+    // Length of the payload following the header
+    uint32_t payload_len;
+} motion_mask_header_t;
+
+/// ------------------------------------------
+/// @brief Gets the length of a bit packed mask payload
+///
+/// @param width of the mask
+/// @param height of the mask
+///
+/// @return payload length in bytes
+static inline size_t motion_mask_bitpack_len(const size_t width, const size_t height)
+{
+    return (width * height + 7) / 8;
+}
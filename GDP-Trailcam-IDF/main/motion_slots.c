@@ -0,0 +1,122 @@
+/// ------------------------------------------
+/// @file motion_slots.c
+///
+/// @brief Source file for the motion slot pool
+/// ------------------------------------------
+
+#include "motion_slots.h"
+
+/// @brief Debugging string tag
+static const char* SLOTS_TAG = "motion_slots";
+
+/// @brief Every slot in the pool
+static motion_slot_t* slots = NULL;
+
+/// @brief Number of slots in the pool
+static size_t slot_count = 0;
+
+/// @brief Image buffers of every slot, one block so the pool leaves no gaps in PSRAM
+static uint8_t* img_bufs = NULL;
+
+/// @brief Length of each image buffer
+static size_t img_buf_len = 0;
+
+/// @brief Indices of the free slots
+static QueueHandle_t free_slots = NULL;
+
+/// ------------------------------------------
+esp_err_t motion_slots_init(const size_t count, const size_t buf_len)
+{
+    if (slots != NULL)
+    {
+        return (count <= slot_count && buf_len <= img_buf_len) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+
+    if (count == 0 || count > MOTION_SLOT_MAX_COUNT || buf_len == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    slots = calloc(count, sizeof(motion_slot_t));
+    img_bufs = heap_caps_malloc(count * 2 * buf_len, MALLOC_CAP_SPIRAM);
+    free_slots = xQueueCreate(count, sizeof(uint8_t));
+    if (slots == NULL || img_bufs == NULL || free_slots == NULL)
+    {
+        ESP_LOGE(SLOTS_TAG, "Failed to allocate %u slots of %u bytes", count, 2 * buf_len);
+        free(slots);
+        heap_caps_free(img_bufs);
+        if (free_slots != NULL)
+        {
+            vQueueDelete(free_slots);
+        }
+        slots = NULL;
+        img_bufs = NULL;
+        free_slots = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    slot_count = count;
+    img_buf_len = buf_len;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t index = i;
+        slots[i].index = index;
+        atomic_init(&slots[i].holders, 0);
+        xQueueSend(free_slots, &index, 0);
+    }
+
+    ESP_LOGI(SLOTS_TAG, "%u slots of %u bytes allocated", count, 2 * buf_len);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+motion_slot_t* motion_slot_acquire(const TickType_t wait)
+{
+    uint8_t index;
+    if (free_slots == NULL || xQueueReceive(free_slots, &index, wait) != pdTRUE)
+    {
+        return NULL;
+    }
+
+    motion_slot_t* slot = &slots[index];
+    memset(&slot->motion, 0, sizeof(jpg_motion_data_t));
+    slot->motion.img1.buf = img_bufs + (2 * index) * img_buf_len;
+    slot->motion.img2.buf = img_bufs + (2 * index + 1) * img_buf_len;
+    atomic_store(&slot->holders, 1);
+    return slot;
+}
+
+/// ------------------------------------------
+motion_slot_t* motion_slot_get(const uint8_t index)
+{
+    if (index >= slot_count)
+    {
+        return NULL;
+    }
+    return &slots[index];
+}
+
+/// ------------------------------------------
+void motion_slot_hold(motion_slot_t* slot, const unsigned count)
+{
+    atomic_fetch_add(&slot->holders, count);
+}
+
+/// ------------------------------------------
+void motion_slot_release(motion_slot_t* slot)
+{
+    if (atomic_fetch_sub(&slot->holders, 1) != 1)
+    {
+        return;
+    }
+
+    // The queue has room for every slot, so this can never fail
+    slot->motion.data_valid = false;
+    xQueueSend(free_slots, &slot->index, 0);
+}
+
+/// ------------------------------------------
+size_t motion_slot_img_buf_len()
+{
+    return img_buf_len;
+}
@@ -0,0 +1,86 @@
+/// ------------------------------------------
+/// @file motion_slots.h
+///
+/// @brief Header file for the motion slot pool, a fixed set of motion captures with
+/// image buffers preallocated in PSRAM once per wake
+///
+/// @note Captures are copied out of the driver's frame buffers straight into a slot and
+/// only the slot index is passed between tasks. A slot is held by everything still using
+/// its images (the SD writer and analysis) and goes back to the pool when the last holder
+/// releases it, so a burst of captures makes no heap allocations and cannot fragment PSRAM.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "image_types.h"
+
+/// @brief Most slots the pool can hold, indices are passed between tasks as a uint8_t
+#define MOTION_SLOT_MAX_COUNT UINT8_MAX
+
+/// @brief A motion capture and the buffers its images are stored in
+typedef struct
+{
+    // Capture data, the image bufs always point at this slot's buffers
+    jpg_motion_data_t motion;
+
+    // Number of holders, the slot is recycled when this reaches 0
+    atomic_uint holders;
+
+    // Index of this slot in the pool
+    uint8_t index;
+} motion_slot_t;
+
+///--------------------------------------------------------
+/// @brief Allocates the pool, every slot gets two image buffers of img_buf_len
+///
+/// @note Only allocates on the first call, later calls check the pool is large enough
+///
+/// @param slot_count number of slots, at most MOTION_SLOT_MAX_COUNT
+/// @param img_buf_len length of each image buffer, the largest jpg the camera can produce
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NO_MEM if PSRAM could not fit the pool
+esp_err_t motion_slots_init(const size_t slot_count, const size_t img_buf_len);
+
+///--------------------------------------------------------
+/// @brief Takes a free slot from the pool, it starts with a single holder and no images
+///
+/// @param wait time to wait for a holder to recycle a slot if none are free
+///
+/// @return slot, null if none were freed in time or the pool is not initialised
+motion_slot_t* motion_slot_acquire(const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Gets a slot from its index, as passed between tasks
+///
+/// @param index of the slot
+///
+/// @return slot, null if the index is out of range
+motion_slot_t* motion_slot_get(const uint8_t index);
+
+///--------------------------------------------------------
+/// @brief Adds holders to a slot, each must call motion_slot_release once done with it
+///
+/// @param slot to hold
+/// @param count holders to add
+void motion_slot_hold(motion_slot_t* slot, const unsigned count);
+
+///--------------------------------------------------------
+/// @brief Drops one holder of a slot, returning it to the pool when it was the last
+///
+/// @param slot to release
+void motion_slot_release(motion_slot_t* slot);
+
+///--------------------------------------------------------
+/// @brief Gets the length of every slot's image buffers
+///
+/// @return buffer length, 0 if the pool is not initialised
+size_t motion_slot_img_buf_len();
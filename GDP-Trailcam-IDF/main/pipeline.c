@@ -0,0 +1,316 @@
+/// ------------------------------------------
+/// @file pipeline.c
+///
+/// @brief Source file for the processing pipeline
+/// ------------------------------------------
+
+#include "pipeline.h"
+
+/// @brief Debugging string tag
+static const char* PIPELINE_TAG = "pipeline";
+
+/// @brief Event bit set whilst no items are in flight
+#define PIPELINE_IDLE_BIT BIT0
+
+/// @brief A stage and its counters
+typedef struct
+{
+    // Settings the stage was created with
+    pipeline_stage_config_t config;
+
+    // Items waiting for the stage
+    QueueHandle_t queue;
+
+    // Worker tasks started, null until started
+    TaskHandle_t workers[PIPELINE_MAX_WORKERS];
+
+    // Pipeline the stage belongs to
+    pipeline_t* pipeline;
+
+    // Index of the stage in the pipeline
+    size_t index;
+
+    // Counters, protected by the pipeline's stats_lock
+    pipeline_stage_stats_t stats;
+} pipeline_stage_t;
+
+struct pipeline_s
+{
+    // Every stage in order
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+
+    // Number of stages
+    size_t stage_count;
+
+    // Items submitted but not yet finished with
+    uint32_t in_flight;
+
+    // Protects in_flight and the stage counters
+    portMUX_TYPE stats_lock;
+
+    // Holds PIPELINE_IDLE_BIT
+    EventGroupHandle_t events;
+};
+
+/// ------------------------------------------
+/// @brief Records the depth of a stage's queue after an item was added
+///
+/// @param stage item was added to
+static void note_depth(pipeline_stage_t* stage)
+{
+    size_t depth = uxQueueMessagesWaiting(stage->queue);
+    taskENTER_CRITICAL(&stage->pipeline->stats_lock);
+    if (depth > stage->stats.max_depth)
+    {
+        stage->stats.max_depth = depth;
+    }
+    taskEXIT_CRITICAL(&stage->pipeline->stats_lock);
+}
+
+/// ------------------------------------------
+/// @brief Marks an item as finished with, setting the idle bit if it was the last
+///
+/// @param pipeline item was in
+static void finish_item(pipeline_t* pipeline)
+{
+    taskENTER_CRITICAL(&pipeline->stats_lock);
+    bool idle = --pipeline->in_flight == 0;
+    taskEXIT_CRITICAL(&pipeline->stats_lock);
+
+    if (idle)
+    {
+        xEventGroupSetBits(pipeline->events, PIPELINE_IDLE_BIT);
+    }
+}
+
+/// ------------------------------------------
+/// @brief Worker task of a stage, runs items from the stage's queue and passes them on
+///
+/// @param arg the pipeline_stage_t worked on
+static void pipeline_worker_task(void* arg)
+{
+    pipeline_stage_t* stage = arg;
+    pipeline_t* pipeline = stage->pipeline;
+    pipeline_stage_t* next = stage->index + 1 < pipeline->stage_count ? &pipeline->stages[stage->index + 1] : NULL;
+
+    while (1)
+    {
+        void* item;
+        if (xQueueReceive(stage->queue, &item, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        int64_t start_time = esp_timer_get_time();
+        bool pass_on = stage->config.run(item);
+        int64_t run_time = esp_timer_get_time();
+
+        if (pass_on && next != NULL)
+        {
+            // Blocks whilst the next stage is full, holding back this stage in turn
+            xQueueSend(next->queue, &item, portMAX_DELAY);
+            note_depth(next);
+        }
+        else
+        {
+            finish_item(pipeline);
+        }
+
+        int64_t end_time = esp_timer_get_time();
+        taskENTER_CRITICAL(&pipeline->stats_lock);
+        stage->stats.processed++;
+        stage->stats.busy_us += run_time - start_time;
+        stage->stats.blocked_us += end_time - run_time;
+        taskEXIT_CRITICAL(&pipeline->stats_lock);
+    }
+}
+
+/// ------------------------------------------
+/// @brief Frees a pipeline that failed to start, stopping any workers before the queues
+/// they block on are deleted
+///
+/// @param pipeline to free, nothing may have been submitted to it
+static void destroy_pipeline(pipeline_t* pipeline)
+{
+    for (size_t s = 0; s < pipeline->stage_count; s++)
+    {
+        for (size_t w = 0; w < PIPELINE_MAX_WORKERS; w++)
+        {
+            if (pipeline->stages[s].workers[w] != NULL)
+            {
+                vTaskDelete(pipeline->stages[s].workers[w]);
+            }
+        }
+    }
+
+    for (size_t s = 0; s < pipeline->stage_count; s++)
+    {
+        if (pipeline->stages[s].queue != NULL)
+        {
+            vQueueDelete(pipeline->stages[s].queue);
+        }
+    }
+
+    vEventGroupDelete(pipeline->events);
+    free(pipeline);
+}
+
+/// ------------------------------------------
+esp_err_t pipeline_create(const pipeline_stage_config_t* stages, const size_t stage_count,
+                          pipeline_t** pipeline_out)
+{
+    if (stage_count == 0 || stage_count > PIPELINE_MAX_STAGES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pipeline_t* pipeline = calloc(1, sizeof(pipeline_t));
+    if (pipeline == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    pipeline->stage_count = stage_count;
+    portMUX_INITIALIZE(&pipeline->stats_lock);
+
+    pipeline->events = xEventGroupCreate();
+    if (pipeline->events == NULL)
+    {
+        free(pipeline);
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(pipeline->events, PIPELINE_IDLE_BIT);
+
+    // Every queue is made before any worker starts, workers pass items straight on
+    for (size_t s = 0; s < stage_count; s++)
+    {
+        pipeline_stage_t* stage = &pipeline->stages[s];
+        stage->config = stages[s];
+        stage->pipeline = pipeline;
+        stage->index = s;
+        if (stage->config.workers == 0 || stage->config.workers > PIPELINE_MAX_WORKERS)
+        {
+            ESP_LOGE(PIPELINE_TAG, "Stage %s has %u workers", stage->config.name, stage->config.workers);
+            destroy_pipeline(pipeline);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        stage->queue = xQueueCreate(stage->config.queue_len, sizeof(void*));
+        if (stage->queue == NULL)
+        {
+            ESP_LOGE(PIPELINE_TAG, "Failed to allocate queue of stage %s", stage->config.name);
+            destroy_pipeline(pipeline);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    for (size_t s = 0; s < stage_count; s++)
+    {
+        pipeline_stage_t* stage = &pipeline->stages[s];
+        for (uint8_t w = 0; w < stage->config.workers; w++)
+        {
+            BaseType_t core = (stage->config.core + w) % portNUM_PROCESSORS;
+            if (xTaskCreatePinnedToCore(pipeline_worker_task, stage->config.name, stage->config.stack_size,
+                                        stage, stage->config.priority, &stage->workers[w], core) != pdPASS)
+            {
+                ESP_LOGE(PIPELINE_TAG, "Failed to start worker %u of stage %s", w, stage->config.name);
+                stage->workers[w] = NULL;
+                destroy_pipeline(pipeline);
+                return ESP_FAIL;
+            }
+        }
+        ESP_LOGI(PIPELINE_TAG, "Stage %s started, %u workers from core %i", stage->config.name,
+                 stage->config.workers, stage->config.core);
+    }
+
+    *pipeline_out = pipeline;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t pipeline_submit(pipeline_t* pipeline, void* item, const TickType_t wait)
+{
+    taskENTER_CRITICAL(&pipeline->stats_lock);
+    pipeline->in_flight++;
+    taskEXIT_CRITICAL(&pipeline->stats_lock);
+    xEventGroupClearBits(pipeline->events, PIPELINE_IDLE_BIT);
+
+    if (xQueueSend(pipeline->stages[0].queue, &item, wait) != pdTRUE)
+    {
+        finish_item(pipeline);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    note_depth(&pipeline->stages[0]);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t pipeline_wait_idle(pipeline_t* pipeline, const TickType_t wait)
+{
+    TickType_t start = xTaskGetTickCount();
+    while (1)
+    {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        TickType_t remaining = wait == portMAX_DELAY ? portMAX_DELAY : (elapsed < wait ? wait - elapsed : 0);
+        if ((xEventGroupWaitBits(pipeline->events, PIPELINE_IDLE_BIT, pdFALSE, pdFALSE, remaining) &
+             PIPELINE_IDLE_BIT) == 0)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+
+        if (pipeline_get_in_flight(pipeline) == 0)
+        {
+            return ESP_OK;
+        }
+
+        // A worker preempted between finishing the last item and setting the bit sets it late,
+        // over an item submitted since. Cleared and checked again, the next finish sets it
+        xEventGroupClearBits(pipeline->events, PIPELINE_IDLE_BIT);
+        if (pipeline_get_in_flight(pipeline) == 0)
+        {
+            // Finished while clearing, put the bit back for later waiters
+            xEventGroupSetBits(pipeline->events, PIPELINE_IDLE_BIT);
+            return ESP_OK;
+        }
+    }
+}
+
+/// ------------------------------------------
+uint32_t pipeline_get_in_flight(pipeline_t* pipeline)
+{
+    taskENTER_CRITICAL(&pipeline->stats_lock);
+    uint32_t in_flight = pipeline->in_flight;
+    taskEXIT_CRITICAL(&pipeline->stats_lock);
+    return in_flight;
+}
+
+/// ------------------------------------------
+esp_err_t pipeline_get_stats(pipeline_t* pipeline, const size_t stage, pipeline_stage_stats_t* stats_out)
+{
+    if (stage >= pipeline->stage_count)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&pipeline->stats_lock);
+    *stats_out = pipeline->stages[stage].stats;
+    taskEXIT_CRITICAL(&pipeline->stats_lock);
+    stats_out->depth = uxQueueMessagesWaiting(pipeline->stages[stage].queue);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+void pipeline_log_stats(pipeline_t* pipeline)
+{
+    for (size_t s = 0; s < pipeline->stage_count; s++)
+    {
+        pipeline_stage_stats_t stats;
+        pipeline_get_stats(pipeline, s, &stats);
+
+        // Busy time per worker is how long the stage would take on its own
+        const pipeline_stage_config_t* config = &pipeline->stages[s].config;
+        ESP_LOGI(PIPELINE_TAG, "%s: %lu items, %lldms busy per worker, %lldms blocked, max depth %u of %u",
+                 config->name, stats.processed, stats.busy_us / 1000 / config->workers,
+                 stats.blocked_us / 1000, stats.max_depth, config->queue_len);
+    }
+}
@@ -0,0 +1,138 @@
+/// ------------------------------------------
+/// @file pipeline.h
+///
+/// @brief Header file for a chain of processing stages, each run by its own pinned worker
+/// tasks and fed by a bounded queue
+///
+/// @note Items are pointers owned by the caller, a stage either passes its item on to the
+/// next stage or finishes with it. Passing on blocks whilst the next stage's queue is full,
+/// so a slow stage holds back the stages before it instead of letting work pile up. With
+/// every stage busy on a different item, a burst completes at close to the rate of the
+/// slowest stage rather than the sum of all of them.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+
+/// @brief Most stages a pipeline can have
+#define PIPELINE_MAX_STAGES 4
+
+/// @brief Most worker tasks a stage can have
+#define PIPELINE_MAX_WORKERS 4
+
+/// @brief Runs a stage on an item
+///
+/// @param item being processed
+///
+/// @return true to pass the item on to the next stage, false if the item is finished with
+typedef bool (*pipeline_stage_fn_t)(void* item);
+
+/// @brief Settings of a single stage
+typedef struct
+{
+    // Name of the stage, used for its tasks and in logs
+    const char* name;
+
+    // Function run on every item
+    pipeline_stage_fn_t run;
+
+    // Number of worker tasks, items may leave the stage out of order when above 1
+    uint8_t workers;
+
+    // Core the first worker is pinned to, further workers alternate between the cores
+    BaseType_t core;
+
+    // Priority of the worker tasks
+    UBaseType_t priority;
+
+    // Stack size of each worker task
+    uint32_t stack_size;
+
+    // Items that can wait for the stage before passing on to it blocks
+    size_t queue_len;
+} pipeline_stage_config_t;
+
+/// @brief Counters of a single stage
+typedef struct
+{
+    // Items waiting in the stage's queue
+    size_t depth;
+
+    // Most items seen waiting in the stage's queue
+    size_t max_depth;
+
+    // Items the stage has run on
+    uint32_t processed;
+
+    // Total time spent running items, across all workers
+    int64_t busy_us;
+
+    // Total time spent blocked passing items on to a full next stage
+    int64_t blocked_us;
+} pipeline_stage_stats_t;
+
+/// @brief A running pipeline, see pipeline_create
+typedef struct pipeline_s pipeline_t;
+
+///--------------------------------------------------------
+/// @brief Creates a pipeline and starts the worker tasks of every stage
+///
+/// @param stages settings of each stage in order, copied
+/// @param stage_count number of stages, at most PIPELINE_MAX_STAGES
+/// @param[out] pipeline_out created pipeline
+///
+/// @return ESP_OK if sucsessful
+esp_err_t pipeline_create(const pipeline_stage_config_t* stages, const size_t stage_count,
+                          pipeline_t** pipeline_out);
+
+///--------------------------------------------------------
+/// @brief Queues an item to the first stage
+///
+/// @param pipeline to queue to
+/// @param item to process, must stay valid until a stage finishes with it
+/// @param wait maximum ticks to wait for space
+///
+/// @return ESP_OK if queued, ESP_ERR_TIMEOUT if the first stage was full
+esp_err_t pipeline_submit(pipeline_t* pipeline, void* item, const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Waits until every submitted item has been finished with
+///
+/// @param pipeline to wait for
+/// @param wait maximum ticks to wait
+///
+/// @return ESP_OK if idle, ESP_ERR_TIMEOUT if items were still in flight
+esp_err_t pipeline_wait_idle(pipeline_t* pipeline, const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Gets the number of items submitted but not yet finished with
+///
+/// @param pipeline to read
+///
+/// @return items in flight
+uint32_t pipeline_get_in_flight(pipeline_t* pipeline);
+
+///--------------------------------------------------------
+/// @brief Gets the counters of a stage
+///
+/// @param pipeline to read
+/// @param stage index of the stage
+/// @param[out] stats_out filled with the counters
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_INVALID_ARG if there is no such stage
+esp_err_t pipeline_get_stats(pipeline_t* pipeline, const size_t stage, pipeline_stage_stats_t* stats_out);
+
+///--------------------------------------------------------
+/// @brief Logs the counters of every stage, the stage with the most busy time per
+/// worker is what limits throughput
+///
+/// @param pipeline to log
+void pipeline_log_stats(pipeline_t* pipeline);
@@ -0,0 +1,296 @@
+/// ------------------------------------------
+/// @file pir_burst.c
+///
+/// @brief Source file for the PIR burst controller
+/// ------------------------------------------
+
+#include "pir_burst.h"
+
+/// @brief Debugging string tag
+static const char* PIR_TAG = "pir_burst";
+
+/// @brief Edges the interrupt can queue before the controller runs, the pin is sampled
+/// again whenever the controller wakes so a full queue only loses edge times
+#define PIR_EDGE_QUEUE_LEN 16
+
+/// @brief Requests that can wait for the capture task, one capture and the burst end
+#define PIR_REQUEST_QUEUE_LEN 2
+
+/// @brief A level change seen by the interrupt
+typedef struct
+{
+    // Level of the pin after the edge
+    int level;
+
+    // Uptime of the edge
+    int64_t time_us;
+} pir_edge_t;
+
+/// @brief Edges from the interrupt to the controller
+static QueueHandle_t edge_queue = NULL;
+
+/// @brief Requests from the controller to the capture task
+static QueueHandle_t request_queue = NULL;
+
+/// @brief Controller task, null when not running
+static TaskHandle_t controller_task = NULL;
+
+/// @brief Gets the pipeline backlog, may be null
+static pir_busy_fn_t busy_fn = NULL;
+
+/// ------------------------------------------
+/// @brief Queues the level of the PIR pin on every edge
+static void IRAM_ATTR pir_edge_isr(void* arg)
+{
+    pir_edge_t edge = {
+        .level = gpio_get_level(PIR_PIN),
+        .time_us = esp_timer_get_time(),
+    };
+
+    BaseType_t task_woken = pdFALSE;
+    xQueueSendFromISR(edge_queue, &edge, &task_woken);
+    portYIELD_FROM_ISR(task_woken);
+}
+
+/// ------------------------------------------
+/// @brief Gets the time to leave after a capture request before the next, longer whilst
+/// the pipeline has captures it is still working on
+///
+/// @return spacing in microseconds
+static int64_t get_capture_spacing_us()
+{
+    uint32_t busy = busy_fn != NULL ? busy_fn() : 0;
+    int64_t spacing_ms = CONFIG_PIR_MIN_SPACING_MS + (int64_t)busy * CONFIG_PIR_BUSY_SPACING_MS;
+    if (spacing_ms > CONFIG_PIR_MAX_SPACING_MS)
+    {
+        spacing_ms = CONFIG_PIR_MAX_SPACING_MS;
+    }
+    return spacing_ms * 1000;
+}
+
+/// ------------------------------------------
+/// @brief Converts the time until a deadline into ticks to wait, rounding up
+///
+/// @param deadline_us uptime to wait until
+/// @param now_us current uptime
+///
+/// @return ticks, at least 1
+static TickType_t ticks_until(const int64_t deadline_us, const int64_t now_us)
+{
+    int64_t wait_ms = (deadline_us - now_us + 999) / 1000;
+    TickType_t ticks = pdMS_TO_TICKS(wait_ms > 0 ? wait_ms : 0);
+    return ticks > 0 ? ticks : 1;
+}
+
+/// ------------------------------------------
+/// @brief Debounces the PIR and turns motion into capture requests until the burst ends
+static void pir_controller_task(void* arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    // Raw pin level and the uptime it last changed
+    int raw_level = gpio_get_level(PIR_PIN);
+    int64_t raw_since = now;
+
+    // Debounced state, the wake counts as motion until the pin has settled
+    bool motion = true;
+    int64_t quiet_since = now;
+
+    // Motion seen but not yet covered by a capture request, and when it was first seen
+    bool pending = false;
+    int64_t pending_since = 0;
+
+    // The wake trigger is captured without waiting, its motion started before boot
+    pir_request_t request = {
+        .type = PIR_REQUEST_CAPTURE,
+        .trigger_us = 0,
+    };
+    xQueueSend(request_queue, &request, portMAX_DELAY);
+    int64_t last_request = now;
+    int64_t spacing = get_capture_spacing_us();
+
+    while (1)
+    {
+        // Sleep until an edge or the next thing due, whichever comes first
+        int64_t deadline = INT64_MAX;
+        if ((raw_level == PIR_TRIG_LEVEL) != motion)
+        {
+            deadline = raw_since + CONFIG_PIR_DEBOUNCE_MS * 1000;
+        }
+        if (pending && last_request + spacing < deadline)
+        {
+            deadline = last_request + spacing;
+        }
+        if (motion == false && pending == false && quiet_since + CONFIG_PIR_QUIET_MS * 1000 < deadline)
+        {
+            deadline = quiet_since + CONFIG_PIR_QUIET_MS * 1000;
+        }
+
+        pir_edge_t edge;
+        TickType_t wait = deadline == INT64_MAX ? portMAX_DELAY : ticks_until(deadline, esp_timer_get_time());
+        while (xQueueReceive(edge_queue, &edge, wait) == pdTRUE)
+        {
+            if (edge.level != raw_level)
+            {
+                raw_level = edge.level;
+                raw_since = edge.time_us;
+            }
+            wait = 0;
+        }
+
+        now = esp_timer_get_time();
+        int level = gpio_get_level(PIR_PIN);
+        if (level != raw_level)
+        {
+            raw_level = level;
+            raw_since = now;
+        }
+
+        // Level only counts once it has held for the debounce time
+        bool raw_motion = raw_level == PIR_TRIG_LEVEL;
+        if (raw_motion != motion && now - raw_since >= CONFIG_PIR_DEBOUNCE_MS * 1000)
+        {
+            motion = raw_motion;
+            if (motion)
+            {
+                ESP_LOGI(PIR_TAG, "Motion after %lldms quiet", (raw_since - quiet_since) / 1000);
+            }
+            else
+            {
+                quiet_since = raw_since;
+            }
+
+            if (motion && pending == false)
+            {
+                pending = true;
+                pending_since = raw_since;
+            }
+        }
+
+        // Continuous motion keeps a capture pending, taken once the spacing is up
+        if (motion && pending == false)
+        {
+            pending = true;
+            pending_since = last_request + spacing;
+        }
+
+        if (pending)
+        {
+            spacing = get_capture_spacing_us();
+            if (now >= last_request + spacing)
+            {
+                // A request still waiting for the capture task already covers this motion
+                request.type = PIR_REQUEST_CAPTURE;
+                request.trigger_us = pending_since > last_request + spacing ? pending_since : last_request + spacing;
+                if (uxQueueMessagesWaiting(request_queue) == 0)
+                {
+                    xQueueSend(request_queue, &request, 0);
+                }
+                last_request = now;
+                pending = false;
+            }
+        }
+
+        if (motion == false && pending == false && raw_motion == false &&
+            now - quiet_since >= CONFIG_PIR_QUIET_MS * 1000)
+        {
+            ESP_LOGI(PIR_TAG, "PIR quiet for %ims, burst over", CONFIG_PIR_QUIET_MS);
+            request.type = PIR_REQUEST_BURST_END;
+            request.trigger_us = now;
+            xQueueSend(request_queue, &request, portMAX_DELAY);
+
+            // Nothing more to do, deleted by pir_burst_stop
+            vTaskSuspend(NULL);
+        }
+    }
+}
+
+/// ------------------------------------------
+esp_err_t pir_burst_start(pir_busy_fn_t get_busy)
+{
+    if (controller_task != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    busy_fn = get_busy;
+
+    if (edge_queue == NULL)
+    {
+        edge_queue = xQueueCreate(PIR_EDGE_QUEUE_LEN, sizeof(pir_edge_t));
+        request_queue = xQueueCreate(PIR_REQUEST_QUEUE_LEN, sizeof(pir_request_t));
+        if (edge_queue == NULL || request_queue == NULL)
+        {
+            ESP_LOGE(PIR_TAG, "Failed to allocate queues");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xQueueReset(edge_queue);
+    xQueueReset(request_queue);
+
+    esp_rom_gpio_pad_select_gpio(PIR_PIN);
+    gpio_set_direction(PIR_PIN, GPIO_MODE_INPUT);
+    gpio_pulldown_dis(PIR_PIN);
+    gpio_pullup_en(PIR_PIN);
+
+    // Already installed is fine, another module may share the service
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(PIR_TAG, "Failed to install ISR service, %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Controller first so the wake's request does not wait behind early edges
+    if (xTaskCreate(pir_controller_task, "PIR controller", 1024 * 3, NULL, 6, &controller_task) != pdPASS)
+    {
+        ESP_LOGE(PIR_TAG, "Failed to start controller task");
+        controller_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    gpio_set_intr_type(PIR_PIN, GPIO_INTR_ANYEDGE);
+    err = gpio_isr_handler_add(PIR_PIN, pir_edge_isr, NULL);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(PIR_TAG, "Failed to add PIR interrupt, %s", esp_err_to_name(err));
+        vTaskDelete(controller_task);
+        controller_task = NULL;
+        return err;
+    }
+    gpio_intr_enable(PIR_PIN);
+
+    ESP_LOGI(PIR_TAG, "Watching pin %i, debounce %ims, quiet after %ims", PIR_PIN,
+             CONFIG_PIR_DEBOUNCE_MS, CONFIG_PIR_QUIET_MS);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t pir_burst_wait(pir_request_t* request_out, const TickType_t wait)
+{
+    if (request_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (xQueueReceive(request_queue, request_out, wait) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+void pir_burst_stop()
+{
+    if (controller_task == NULL)
+    {
+        return;
+    }
+
+    gpio_intr_disable(PIR_PIN);
+    gpio_isr_handler_remove(PIR_PIN);
+    gpio_set_intr_type(PIR_PIN, GPIO_INTR_DISABLE);
+
+    vTaskDelete(controller_task);
+    controller_task = NULL;
+}
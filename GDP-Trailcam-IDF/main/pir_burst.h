@@ -0,0 +1,74 @@
+/// ------------------------------------------
+/// @file pir_burst.h
+///
+/// @brief Header file for the PIR burst controller, turns PIR edges into capture requests
+/// for the length of a burst of motion
+///
+/// @note An edge interrupt on the PIR pin wakes the controller task, which debounces the
+/// level and asks for a capture as soon as motion is seen. Whilst motion continues a
+/// capture is requested every spacing period, the spacing growing with the number of
+/// captures the processing pipeline is still working on. Motion that starts and ends
+/// between two requests is remembered and captured once the spacing is up. The burst
+/// ends once the PIR has been quiet for the quiet time with nothing left to capture.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#define PIR_PIN 2
+#define PIR_TRIG_LEVEL 0
+
+/// @brief Type of a request from the controller
+typedef enum
+{
+    // Capture from every camera now
+    PIR_REQUEST_CAPTURE,
+
+    // PIR has gone quiet, no more captures will be requested
+    PIR_REQUEST_BURST_END,
+} pir_request_type_t;
+
+/// @brief A request from the controller to the capture task
+typedef struct
+{
+    // What is being asked for
+    pir_request_type_t type;
+
+    // Uptime the motion that caused the request was first seen, the wake itself for the first request
+    int64_t trigger_us;
+} pir_request_t;
+
+/// @brief Gets how many captures are still being worked on, used to space out captures
+typedef uint32_t (*pir_busy_fn_t)(void);
+
+///--------------------------------------------------------
+/// @brief Sets up the PIR pin and its interrupt and starts the controller task, a capture
+/// is requested straight away for the motion that caused the wake
+///
+/// @param get_busy called before every request after the first, may be null to always use the minimum spacing
+///
+/// @return ESP_OK if sucsessful
+esp_err_t pir_burst_start(pir_busy_fn_t get_busy);
+
+///--------------------------------------------------------
+/// @brief Waits for the next request from the controller
+///
+/// @param[out] request_out filled with the request
+/// @param wait maximum ticks to wait
+///
+/// @return ESP_OK if a request was received, ESP_ERR_TIMEOUT if none came in time,
+/// ESP_ERR_INVALID_STATE if the controller was never started
+esp_err_t pir_burst_wait(pir_request_t* request_out, const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Stops the controller task and the PIR interrupt, the pin is left as an input
+/// ready for the ext0 wakeup
+void pir_burst_stop();
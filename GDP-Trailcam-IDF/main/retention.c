@@ -0,0 +1,190 @@
+/// ------------------------------------------
+/// @file retention.c
+///
+/// @brief Source file for the retention manager
+/// ------------------------------------------
+
+#include "retention.h"
+#include "capture_store.h"
+
+/// @brief Debugging string tag
+static const char* RETENTION_TAG = "retention";
+
+/// @brief Event bit set whilst no retention pass is running
+#define RETENTION_IDLE_BIT BIT0
+
+/// @brief Tracked free bytes, kept in RTC memory so deep sleep wakes skip querying the card
+RTC_DATA_ATTR static uint64_t free_bytes = RETENTION_FREE_UNKNOWN;
+
+/// @brief Lowest capture (or container) number that may still exist, deletion resumes from here
+RTC_DATA_ATTR static uint32_t oldest_cursor = 0;
+
+/// @brief Protects free_bytes, it is updated from the writer and retention tasks
+static portMUX_TYPE free_bytes_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/// @brief Backend captures are stored on
+static storage_backend_t* retention_backend = NULL;
+
+/// @brief Retention task, null until started
+static TaskHandle_t retention_task_handle = NULL;
+
+/// @brief Holds RETENTION_IDLE_BIT
+static EventGroupHandle_t retention_events = NULL;
+
+/// @brief Captures from this number on are never deleted by the current pass
+static volatile uint32_t retention_limit = 0;
+
+/// @brief Set to stop the current pass at the next deletion
+static volatile bool stop_requested = false;
+
+/// ------------------------------------------
+/// @brief Deletes the oldest captures until the headroom is met, the pipeline is stopped or nothing is left
+static void enforce_headroom()
+{
+    if (retention_get_free_bytes() == RETENTION_FREE_UNKNOWN)
+    {
+        // Only needed once per power on, the card may have been swapped or filled elsewhere
+        uint64_t total;
+        uint64_t queried_free;
+        if (retention_backend->get_space(retention_backend, &total, &queried_free) != ESP_OK)
+        {
+            ESP_LOGE(RETENTION_TAG, "Failed to get free space");
+            return;
+        }
+
+        taskENTER_CRITICAL(&free_bytes_lock);
+        free_bytes = queried_free;
+        taskEXIT_CRITICAL(&free_bytes_lock);
+        ESP_LOGI(RETENTION_TAG, "Card has %llu of %llu bytes free", queried_free, total);
+    }
+
+    uint32_t deleted = 0;
+    while (retention_get_free_bytes() < RETENTION_HEADROOM_BYTES && stop_requested == false)
+    {
+        uint64_t freed = 0;
+        esp_err_t err = capture_store_delete_oldest(&oldest_cursor, retention_limit, &freed);
+        if (err == ESP_ERR_NOT_FOUND)
+        {
+            ESP_LOGW(RETENTION_TAG, "Nothing left to delete, headroom cannot be met");
+            break;
+        }
+        else if (err != ESP_OK)
+        {
+            ESP_LOGE(RETENTION_TAG, "Failed to delete oldest capture, %s", esp_err_to_name(err));
+            break;
+        }
+
+        retention_note_freed(freed);
+        deleted++;
+    }
+
+    if (deleted > 0)
+    {
+        ESP_LOGI(RETENTION_TAG, "Deleted %lu, %llu bytes now free", deleted, retention_get_free_bytes());
+    }
+}
+
+/// ------------------------------------------
+/// @brief Retention task, runs a pass each time it is notified
+static void retention_task()
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        enforce_headroom();
+        xEventGroupSetBits(retention_events, RETENTION_IDLE_BIT);
+    }
+}
+
+/// ------------------------------------------
+esp_err_t retention_start(storage_backend_t* backend)
+{
+    if (retention_task_handle != NULL)
+    {
+        return ESP_OK;
+    }
+
+    retention_backend = backend;
+    retention_events = xEventGroupCreate();
+    if (retention_events == NULL)
+    {
+        ESP_LOGE(RETENTION_TAG, "Failed to allocate retention events");
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(retention_events, RETENTION_IDLE_BIT);
+
+    if (xTaskCreatePinnedToCore(retention_task, "Retention task", RETENTION_STACK_SIZE, NULL,
+                                RETENTION_PRIORITY, &retention_task_handle, RETENTION_CORE) != pdPASS)
+    {
+        ESP_LOGE(RETENTION_TAG, "Failed to start retention task");
+        retention_task_handle = NULL;
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+void retention_note_allocated(const uint64_t bytes)
+{
+    taskENTER_CRITICAL(&free_bytes_lock);
+    if (free_bytes != RETENTION_FREE_UNKNOWN)
+    {
+        free_bytes = bytes < free_bytes ? free_bytes - bytes : 0;
+    }
+    taskEXIT_CRITICAL(&free_bytes_lock);
+}
+
+/// ------------------------------------------
+void retention_note_freed(const uint64_t bytes)
+{
+    taskENTER_CRITICAL(&free_bytes_lock);
+    if (free_bytes != RETENTION_FREE_UNKNOWN)
+    {
+        free_bytes += bytes;
+    }
+    taskEXIT_CRITICAL(&free_bytes_lock);
+}
+
+/// ------------------------------------------
+uint64_t retention_get_free_bytes()
+{
+    taskENTER_CRITICAL(&free_bytes_lock);
+    uint64_t bytes = free_bytes;
+    taskEXIT_CRITICAL(&free_bytes_lock);
+    return bytes;
+}
+
+/// ------------------------------------------
+void retention_run(const uint32_t next_capture_num)
+{
+    if (retention_task_handle == NULL)
+    {
+        return;
+    }
+
+    retention_limit = next_capture_num;
+    stop_requested = false;
+    xEventGroupClearBits(retention_events, RETENTION_IDLE_BIT);
+    xTaskNotifyGive(retention_task_handle);
+}
+
+/// ------------------------------------------
+esp_err_t retention_finish(const TickType_t budget)
+{
+    if (retention_task_handle == NULL)
+    {
+        return ESP_OK;
+    }
+
+    if (xEventGroupWaitBits(retention_events, RETENTION_IDLE_BIT, pdFALSE, pdFALSE, budget) & RETENTION_IDLE_BIT)
+    {
+        return ESP_OK;
+    }
+
+    // Over budget, the rest is picked up next wake from oldest_cursor
+    ESP_LOGW(RETENTION_TAG, "Retention over budget, stopping");
+    stop_requested = true;
+    xEventGroupWaitBits(retention_events, RETENTION_IDLE_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(MAX_SD_WAIT_MS));
+    return ESP_ERR_TIMEOUT;
+}
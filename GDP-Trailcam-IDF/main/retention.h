@@ -0,0 +1,82 @@
+/// ------------------------------------------
+/// @file retention.h
+///
+/// @brief Header file for the retention manager, deletes the oldest captures from a low
+/// priority background task to keep a headroom of free space on the card
+///
+/// @note The free space figure is queried from the card once per power on and then kept
+/// up to date from what capture_store allocates and retention frees, so nothing scans
+/// the FAT on the capture path. Deletion is only started once a wake's captures are on
+/// the card, see retention_run.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#include "storage_backend.h"
+
+/// @brief Free bytes to keep on the card
+#define RETENTION_HEADROOM_BYTES ((uint64_t)CONFIG_RETENTION_HEADROOM_MB * 1024 * 1024)
+
+/// @brief Stack size of the retention task
+#define RETENTION_STACK_SIZE (1024 * 4)
+
+/// @brief Priority of the retention task, below everything on the capture path
+#define RETENTION_PRIORITY 1
+
+/// @brief Core the retention task is pinned to, the same core as the SD writer
+#define RETENTION_CORE 1
+
+/// @brief Free space figure when it is not yet known
+#define RETENTION_FREE_UNKNOWN UINT64_MAX
+
+///--------------------------------------------------------
+/// @brief Starts the retention task, it waits for retention_run before touching the card
+///
+/// @param backend captures are stored on
+///
+/// @return ESP_OK if sucsessful
+esp_err_t retention_start(storage_backend_t* backend);
+
+///--------------------------------------------------------
+/// @brief Records space taken on the card, called by capture_store for every allocation
+///
+/// @param bytes allocated, rounded up to whole clusters
+void retention_note_allocated(const uint64_t bytes);
+
+///--------------------------------------------------------
+/// @brief Adds space back to the tracked free space, called for deletions made outside a retention pass
+///
+/// @param bytes freed, rounded up to whole clusters
+void retention_note_freed(const uint64_t bytes);
+
+///--------------------------------------------------------
+/// @brief Gets the tracked free space of the card
+///
+/// @return free bytes, RETENTION_FREE_UNKNOWN if it has not been queried since power on
+uint64_t retention_get_free_bytes();
+
+///--------------------------------------------------------
+/// @brief Starts a background pass deleting the oldest captures until the headroom is met
+///
+/// @note Should only be called once the wake's captures have been flushed to the card
+///
+/// @param next_capture_num next capture number, captures from this number on are never deleted
+void retention_run(const uint32_t next_capture_num);
+
+///--------------------------------------------------------
+/// @brief Waits for a retention pass to finish, stopping it between deletions if it runs over
+///
+/// @note Call before deep sleep so the card is never cut off mid deletion
+///
+/// @param budget time the pass may carry on for
+///
+/// @return ESP_OK if the pass finished, ESP_ERR_TIMEOUT if it was stopped early
+esp_err_t retention_finish(const TickType_t budget);
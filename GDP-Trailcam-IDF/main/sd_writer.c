@@ -0,0 +1,252 @@
+/// ------------------------------------------
+/// @file sd_writer.c
+///
+/// @brief Source file for the write behind SD writer task
+/// ------------------------------------------
+
+#include "sd_writer.h"
+
+/// @brief Debugging string tag
+static const char* WRITER_TAG = "sd_writer";
+
+/// @brief Event bit set by the writer each time it frees up pending bytes
+#define WRITER_SPACE_BIT BIT0
+
+/// @brief Jobs waiting for the writer
+static QueueHandle_t writer_queue = NULL;
+
+/// @brief Signals submitters waiting for pending bytes to drop
+static EventGroupHandle_t writer_events = NULL;
+
+/// @brief Protects pending_bytes
+static SemaphoreHandle_t pending_mutex = NULL;
+
+/// @brief Bytes queued but not yet written
+static size_t pending_bytes = 0;
+
+/// @brief Number of writes that failed since the last flush
+static volatile uint32_t failed_writes = 0;
+
+/// @brief Most jobs seen waiting for the writer
+static volatile size_t max_queue_depth = 0;
+
+/// ------------------------------------------
+/// @brief Done callback of flush barriers, wakes the flushing task
+///
+/// @param err unused
+/// @param data unused
+/// @param arg semaphore the flushing task is waiting on
+static void flush_done(const esp_err_t err, void* data, void* arg)
+{
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+/// ------------------------------------------
+/// @brief Returns a finished job's bytes to the budget and wakes waiting submitters
+///
+/// @param len bytes to return
+static void release_pending_bytes(const size_t len)
+{
+    xSemaphoreTake(pending_mutex, portMAX_DELAY);
+    pending_bytes -= len;
+    xEventGroupSetBits(writer_events, WRITER_SPACE_BIT);
+    xSemaphoreGive(pending_mutex);
+}
+
+/// ------------------------------------------
+/// @brief Writer task, stores queued jobs in order
+static void sd_writer_task()
+{
+    sd_write_job_t job;
+    while (1)
+    {
+        if (xQueueReceive(writer_queue, &job, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        esp_err_t err = ESP_OK;
+        if (job.name[0] != '\0')
+        {
+            int64_t start_time = esp_timer_get_time();
+            TRACE_BEGIN(TRACE_SPAN_SD_WRITE);
+            mem_telemetry_stage_enter(MEM_STAGE_STORE);
+            err = capture_store_write(job.capture_num, job.name, job.data, job.len);
+            mem_telemetry_stage_exit();
+            TRACE_END(TRACE_SPAN_SD_WRITE);
+            ESP_LOGI(WRITER_TAG, "Wrote %lu/%s, %u bytes in %llius", job.capture_num, job.name, job.len,
+                     esp_timer_get_time() - start_time);
+        }
+
+        if (err == ESP_OK && job.commit)
+        {
+            err = capture_store_commit(job.capture_num);
+        }
+
+        if (err != ESP_OK)
+        {
+            failed_writes++;
+            ESP_LOGE(WRITER_TAG, "Failed to write %lu/%s, %s", job.capture_num, job.name, esp_err_to_name(err));
+        }
+
+        release_pending_bytes(job.len);
+
+        if (job.done_cb != NULL)
+        {
+            job.done_cb(err, job.data, job.cb_arg);
+        }
+        else
+        {
+            free(job.data);
+        }
+    }
+}
+
+/// ------------------------------------------
+esp_err_t sd_writer_start()
+{
+    if (writer_queue != NULL)
+    {
+        return ESP_OK;
+    }
+
+    writer_events = xEventGroupCreate();
+    pending_mutex = xSemaphoreCreateMutex();
+    writer_queue = xQueueCreate(SD_WRITER_QUEUE_LEN, sizeof(sd_write_job_t));
+    if (writer_events == NULL || pending_mutex == NULL || writer_queue == NULL)
+    {
+        ESP_LOGE(WRITER_TAG, "Failed to allocate writer queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreatePinnedToCore(sd_writer_task, "SD writer task", SD_WRITER_STACK_SIZE, NULL,
+                                SD_WRITER_PRIORITY, NULL, SD_WRITER_CORE) != pdPASS)
+    {
+        ESP_LOGE(WRITER_TAG, "Failed to start writer task");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t sd_writer_submit(const sd_write_job_t* job, const TickType_t wait)
+{
+    if (writer_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    TickType_t start_ticks = xTaskGetTickCount();
+
+    // Reserve the job's bytes, a job larger than the whole budget is let through once the writer is idle
+    while (1)
+    {
+        xSemaphoreTake(pending_mutex, portMAX_DELAY);
+        if (pending_bytes == 0 || pending_bytes + job->len <= SD_WRITER_MAX_PENDING_BYTES)
+        {
+            pending_bytes += job->len;
+            xSemaphoreGive(pending_mutex);
+            break;
+        }
+        xEventGroupClearBits(writer_events, WRITER_SPACE_BIT);
+        xSemaphoreGive(pending_mutex);
+
+        TickType_t waited = xTaskGetTickCount() - start_ticks;
+        if (waited >= wait)
+        {
+            ESP_LOGW(WRITER_TAG, "Writer backlog full, %lu/%s not queued", job->capture_num, job->name);
+            return ESP_ERR_TIMEOUT;
+        }
+        xEventGroupWaitBits(writer_events, WRITER_SPACE_BIT, pdFALSE, pdFALSE, wait - waited);
+    }
+
+    TickType_t waited = xTaskGetTickCount() - start_ticks;
+    if (xQueueSend(writer_queue, job, waited >= wait ? 0 : wait - waited) != pdTRUE)
+    {
+        release_pending_bytes(job->len);
+        ESP_LOGW(WRITER_TAG, "Writer queue full, %lu/%s not queued", job->capture_num, job->name);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Only a metric, a racing submitter losing its update does not matter
+    size_t depth = uxQueueMessagesWaiting(writer_queue);
+    if (depth > max_queue_depth)
+    {
+        max_queue_depth = depth;
+    }
+
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+esp_err_t sd_writer_submit_copy(const uint32_t capture_num, const char* name, const void* data,
+                                const size_t len, const bool commit, const TickType_t wait)
+{
+    sd_write_job_t job = {
+        .capture_num = capture_num,
+        .data = mem_telemetry_malloc(len, MALLOC_CAP_DEFAULT),
+        .len = len,
+        .commit = commit,
+    };
+    if (job.data == NULL)
+    {
+        ESP_LOGE(WRITER_TAG, "Failed to allocate copy of %lu/%s", capture_num, name);
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(job.name, name, CONTAINER_NAME_LEN - 1);
+    memcpy(job.data, data, len);
+
+    esp_err_t err = sd_writer_submit(&job, wait);
+    if (err != ESP_OK)
+    {
+        free(job.data);
+    }
+    return err;
+}
+
+/// ------------------------------------------
+esp_err_t sd_writer_flush(const TickType_t wait)
+{
+    if (writer_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if (done == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Jobs are written in order, so the barrier finishing means everything before it has.
+    // Nothing is committed, a capture still being written is left for its own commit or close
+    sd_write_job_t barrier = {
+        .done_cb = flush_done,
+        .cb_arg = done,
+    };
+
+    esp_err_t err = sd_writer_submit(&barrier, wait);
+    if (err == ESP_OK && xSemaphoreTake(done, wait) != pdTRUE)
+    {
+        // Barrier still holds the semaphore, leave it allocated
+        ESP_LOGE(WRITER_TAG, "Timed out waiting for writes to finish");
+        return ESP_ERR_TIMEOUT;
+    }
+    vSemaphoreDelete(done);
+
+    if (err == ESP_OK && failed_writes > 0)
+    {
+        ESP_LOGE(WRITER_TAG, "%lu writes failed since last flush", failed_writes);
+        err = ESP_FAIL;
+    }
+    failed_writes = 0;
+    return err;
+}
+
+/// ------------------------------------------
+void sd_writer_get_depth(size_t* depth_out, size_t* max_depth_out)
+{
+    *depth_out = writer_queue != NULL ? uxQueueMessagesWaiting(writer_queue) : 0;
+    *max_depth_out = max_queue_depth;
+}
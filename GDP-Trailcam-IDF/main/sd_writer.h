@@ -0,0 +1,120 @@
+/// ------------------------------------------
+/// @file sd_writer.h
+///
+/// @brief Header file for the write behind SD writer task, capture and analysis hand
+/// their buffers over and carry on whilst the writer stores them with capture_store
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "capture_store.h"
+#include "trace.h"
+#include "mem_telemetry.h"
+
+/// @brief Number of jobs that can be waiting for the writer
+#define SD_WRITER_QUEUE_LEN 16
+
+/// @brief Bytes that can be waiting for the writer, submitting more blocks until the writer catches up
+#define SD_WRITER_MAX_PENDING_BYTES (6 * 1024 * 1024)
+
+/// @brief Stack size of the writer task
+#define SD_WRITER_STACK_SIZE (1024 * 4)
+
+/// @brief Priority of the writer task, above processing so the queue drains promptly
+#define SD_WRITER_PRIORITY 5
+
+/// @brief Core the writer task is pinned to, the same core as storage bringup
+#define SD_WRITER_CORE 1
+
+/// @brief Called from the writer task once a job is done, data is owned by the callback from then on
+///
+/// @param err result of the write
+/// @param data the job's buffer
+/// @param arg the job's cb_arg
+typedef void (*sd_write_done_cb_t)(const esp_err_t err, void* data, void* arg);
+
+/// @brief A file to be written by the writer task
+typedef struct
+{
+    // Capture the file belongs to
+    uint32_t capture_num;
+
+    // File name within the capture, an empty name writes nothing (used for barriers)
+    char name[CONTAINER_NAME_LEN];
+
+    // Buffer to write, owned by the writer until done_cb is called
+    void* data;
+
+    // Length of the buffer
+    size_t len;
+
+    // Commit the capture's files once this file is written?
+    bool commit;
+
+    // Called once written, null to have the writer free data itself
+    sd_write_done_cb_t done_cb;
+
+    // Passed to done_cb
+    void* cb_arg;
+} sd_write_job_t;
+
+///--------------------------------------------------------
+/// @brief Starts the writer task
+///
+/// @note capture_store_init must have been called first
+///
+/// @return ESP_OK if sucsessful
+esp_err_t sd_writer_start();
+
+///--------------------------------------------------------
+/// @brief Queues a file to be written, blocking if the writer is too far behind
+///
+/// @note On failure the buffer is still owned by the caller
+///
+/// @param job to queue, copied
+/// @param wait maximum ticks to wait for space
+///
+/// @return ESP_OK if queued, ESP_ERR_TIMEOUT if there was no space in time,
+/// ESP_ERR_INVALID_STATE if the writer is not running
+esp_err_t sd_writer_submit(const sd_write_job_t* job, const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Queues a copy of a buffer to be written, so the caller keeps its buffer
+///
+/// @param capture_num capture the file belongs to
+/// @param name file name within the capture
+/// @param data buffer to copy
+/// @param len length of the buffer
+/// @param commit commit the capture's files once written?
+/// @param wait maximum ticks to wait for space
+///
+/// @return ESP_OK if queued
+esp_err_t sd_writer_submit_copy(const uint32_t capture_num, const char* name, const void* data,
+                                const size_t len, const bool commit, const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Waits until every job queued before this call is written, commits are left to the
+/// jobs themselves and capture_store_close
+///
+/// @param wait maximum ticks to wait
+///
+/// @return ESP_OK if all writes finished in time and none of them failed since the last flush
+esp_err_t sd_writer_flush(const TickType_t wait);
+
+///--------------------------------------------------------
+/// @brief Gets how far behind the writer is, the persist stage of the processing pipeline
+///
+/// @param[out] depth_out jobs waiting for the writer now
+/// @param[out] max_depth_out most jobs seen waiting, out of SD_WRITER_QUEUE_LEN
+void sd_writer_get_depth(size_t* depth_out, size_t* max_depth_out);
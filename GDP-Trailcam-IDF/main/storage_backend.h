@@ -0,0 +1,157 @@
+/// ------------------------------------------
+/// @file storage_backend.h
+///
+/// @brief Header file for the storage backend interface, everything capture_store and
+/// main.c persist goes through one of these so the SD card can be swapped for a RAM
+/// disk or a (throttled) POSIX directory
+///
+/// @note Paths are relative to the root of the backend, e.g. "CAPTURE12/img1.jpg".
+/// Writes are synchronous, sd_writer provides async submission on top of any backend.
+/// Define STORAGE_HOST_BUILD to build the POSIX and RAM disk backends outside of IDF.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef STORAGE_HOST_BUILD
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_CRC 0x109
+#else
+#include "esp_err.h"
+#endif
+
+/// @brief Max length of a path within a backend, including null terminator
+#define STORAGE_PATH_MAX 64
+
+/// @brief Handle of a file opened for random acsess, null is never a valid handle
+typedef void* storage_handle_t;
+
+/// @brief Information about a file or directory
+typedef struct
+{
+    // Size in bytes, 0 for directories
+    size_t size;
+
+    // Is this a directory?
+    bool is_dir;
+} storage_stat_t;
+
+/// @brief A directory entry read by read_dir
+typedef struct
+{
+    // Name of the entry, relative to the directory
+    char name[STORAGE_PATH_MAX];
+
+    // Size and type of the entry
+    storage_stat_t stat;
+} storage_dir_entry_t;
+
+/// @brief Handle of a directory opened for reading, null is never a valid handle
+typedef void* storage_dir_t;
+
+typedef struct storage_backend_t storage_backend_t;
+
+/// @brief A storage backend, functions take the backend itself as their first argument
+struct storage_backend_t
+{
+    // Name of the backend, for logging
+    const char* name;
+
+    // Backend specific state
+    void* ctx;
+
+    // Creates or replaces a file with the given contents
+    esp_err_t (*write_file)(storage_backend_t* backend, const char* path, const void* data, const size_t len);
+
+    // Appends to a file, creating it if missing
+    esp_err_t (*append_file)(storage_backend_t* backend, const char* path, const void* data, const size_t len);
+
+    // Reads up to len bytes from the start of a file, read_len is set to the bytes read
+    esp_err_t (*read_file)(storage_backend_t* backend, const char* path, void* out_buf, const size_t len,
+                           size_t* read_len);
+
+    // Gets information about a path, ESP_ERR_NOT_FOUND if it does not exist
+    esp_err_t (*stat)(storage_backend_t* backend, const char* path, storage_stat_t* stat_out);
+
+    // Creates a directory, ESP_ERR_INVALID_ARG if it already exists
+    esp_err_t (*make_dir)(storage_backend_t* backend, const char* path);
+
+    // Removes a file or an empty directory
+    esp_err_t (*remove)(storage_backend_t* backend, const char* path);
+
+    // Renames a file or directory, the destination must not exist
+    esp_err_t (*rename)(storage_backend_t* backend, const char* from, const char* to);
+
+    // Opens a directory so its entries can be read in batches
+    esp_err_t (*open_dir)(storage_backend_t* backend, const char* path, storage_dir_t* dir_out);
+
+    // Reads up to max entries of an open directory, count_out is 0 once all have been read.
+    // Locks are only held for the batch, "." and ".." are never read
+    esp_err_t (*read_dir)(storage_backend_t* backend, storage_dir_t dir, storage_dir_entry_t* entries,
+                          const size_t max, size_t* count_out);
+
+    // Closes an open directory
+    esp_err_t (*close_dir)(storage_backend_t* backend, storage_dir_t dir);
+
+    // Opens a file for random acsess reads and writes. A missing file is created preallocated
+    // to create_len bytes, or ESP_ERR_NOT_FOUND is returned if create_len is 0
+    esp_err_t (*open)(storage_backend_t* backend, const char* path, const size_t create_len,
+                      storage_handle_t* handle_out);
+
+    // Writes to an open file at an offset
+    esp_err_t (*pwrite)(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                        const void* data, const size_t len);
+
+    // Reads len bytes from an open file at an offset
+    esp_err_t (*pread)(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                       void* out_buf, const size_t len);
+
+    // Makes all writes to an open file durable
+    esp_err_t (*sync)(storage_backend_t* backend, storage_handle_t handle);
+
+    // Closes an open file
+    esp_err_t (*close)(storage_backend_t* backend, storage_handle_t handle);
+
+    // Gets the total and free bytes of the backend, may be slow so callers should track changes themselves
+    esp_err_t (*get_space)(storage_backend_t* backend, uint64_t* total_out, uint64_t* free_out);
+};
+
+///--------------------------------------------------------
+/// @brief Gets the backend storing onto the SD card over SPI
+///
+/// @note connect_to_SDSPI must have been called first
+///
+/// @return the SD card backend
+storage_backend_t* storage_sdspi_backend();
+
+///--------------------------------------------------------
+/// @brief Creates an in memory backend, contents are lost on reset
+///
+/// @param max_bytes total file bytes the disk can hold
+///
+/// @return new backend, null if it could not be allocated
+storage_backend_t* storage_ramdisk_create(const size_t max_bytes);
+
+///--------------------------------------------------------
+/// @brief Creates a backend storing into a POSIX directory, optionally throttled to
+/// simulate the bandwidth and latency of the SD card
+///
+/// @param root directory all paths are relative to, must exist
+/// @param throttle_bytes_per_s data rate to simulate, 0 for no throttling
+/// @param throttle_op_latency_us time added to every operation that touches the card
+///
+/// @return new backend, null if it could not be allocated
+storage_backend_t* storage_posix_create(const char* root,
+                                        const uint32_t throttle_bytes_per_s,
+                                        const uint32_t throttle_op_latency_us);
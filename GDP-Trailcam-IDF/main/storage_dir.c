@@ -0,0 +1,255 @@
+/// ------------------------------------------
+/// @file storage_dir.c
+///
+/// @brief Source file for walking directories of a storage backend
+/// ------------------------------------------
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "storage_dir.h"
+
+#ifdef STORAGE_HOST_BUILD
+#define SNAPSHOT_REALLOC(ptr, len) realloc(ptr, len)
+#else
+#include "esp_heap_caps.h"
+// Snapshots of large directories are tens of KB, internal RAM is kept for DMA
+#define SNAPSHOT_REALLOC(ptr, len) heap_caps_realloc_prefer(ptr, len, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT)
+#endif
+
+/// @brief Entries a snapshot grows by when full
+#define SNAPSHOT_GROW_STEP 64
+
+/// ------------------------------------------
+bool storage_dir_filter_match(const storage_dir_filter_t* filter, const storage_dir_entry_t* entry)
+{
+    if (filter == NULL)
+    {
+        return true;
+    }
+
+    if ((filter->kind == STORAGE_DIR_FILES && entry->stat.is_dir) ||
+        (filter->kind == STORAGE_DIR_DIRS && entry->stat.is_dir == false))
+    {
+        return false;
+    }
+
+    if (filter->prefix != NULL && strncmp(entry->name, filter->prefix, strlen(filter->prefix)) != 0)
+    {
+        return false;
+    }
+
+    if (filter->suffix != NULL)
+    {
+        size_t len = strlen(entry->name);
+        size_t suffix_len = strlen(filter->suffix);
+        if (len < suffix_len || strcmp(entry->name + len - suffix_len, filter->suffix) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// ------------------------------------------
+esp_err_t storage_visit_dir(storage_backend_t* backend, const char* path, const storage_dir_filter_t* filter,
+                            storage_visit_cb_t cb, void* arg)
+{
+    storage_dir_entry_t* batch = malloc(STORAGE_DIR_BATCH_LEN * sizeof(storage_dir_entry_t));
+    if (batch == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    storage_dir_t dir;
+    esp_err_t err = backend->open_dir(backend, path, &dir);
+    if (err != ESP_OK)
+    {
+        free(batch);
+        return err;
+    }
+
+    bool visiting = true;
+    size_t count;
+    while (visiting && (err = backend->read_dir(backend, dir, batch, STORAGE_DIR_BATCH_LEN, &count)) == ESP_OK &&
+           count > 0)
+    {
+        // The batch is a copy, so callbacks run without any backend lock held
+        for (size_t i = 0; i < count && visiting; i++)
+        {
+            if (storage_dir_filter_match(filter, &batch[i]))
+            {
+                visiting = cb(&batch[i], arg);
+            }
+        }
+    }
+
+    backend->close_dir(backend, dir);
+    free(batch);
+    return err;
+}
+
+/// ------------------------------------------
+int storage_dir_name_cmp(const char* a, const char* b)
+{
+    const char* a_start = a;
+    const char* b_start = b;
+    while (*a != '\0' && *b != '\0')
+    {
+        if (isdigit((unsigned char)*a) && isdigit((unsigned char)*b))
+        {
+            while (*a == '0')
+            {
+                a++;
+            }
+            while (*b == '0')
+            {
+                b++;
+            }
+
+            size_t a_digits = 0;
+            size_t b_digits = 0;
+            while (isdigit((unsigned char)a[a_digits]))
+            {
+                a_digits++;
+            }
+            while (isdigit((unsigned char)b[b_digits]))
+            {
+                b_digits++;
+            }
+
+            // Without leading zeros the longer number is larger, equal lengths compare digit by digit
+            if (a_digits != b_digits)
+            {
+                return a_digits < b_digits ? -1 : 1;
+            }
+            int cmp = strncmp(a, b, a_digits);
+            if (cmp != 0)
+            {
+                return cmp;
+            }
+            a += a_digits;
+            b += b_digits;
+            continue;
+        }
+
+        if (*a != *b)
+        {
+            return (unsigned char)*a < (unsigned char)*b ? -1 : 1;
+        }
+        a++;
+        b++;
+    }
+
+    if (*a != *b)
+    {
+        return *a == '\0' ? -1 : 1;
+    }
+
+    // Only leading zeros differ, keep the order total so names can be searched for
+    return strcmp(a_start, b_start);
+}
+
+/// ------------------------------------------
+/// @brief qsort comparison of two snapshot entries by name
+static int compare_entries(const void* a, const void* b)
+{
+    return storage_dir_name_cmp(((const storage_dir_entry_t*)a)->name, ((const storage_dir_entry_t*)b)->name);
+}
+
+/// @brief State of a snapshot being taken
+typedef struct
+{
+    // Snapshot being filled
+    storage_dir_snapshot_t* snapshot;
+
+    // Set if the snapshot could not grow to hold every entry
+    bool out_of_memory;
+} snapshot_fill_t;
+
+/// ------------------------------------------
+/// @brief Directory visit callback appending entries to a snapshot
+///
+/// @return false if the snapshot could not grow
+static bool add_snapshot_entry(const storage_dir_entry_t* entry, void* arg)
+{
+    snapshot_fill_t* fill = arg;
+    storage_dir_snapshot_t* snapshot = fill->snapshot;
+    if (snapshot->count == snapshot->capacity)
+    {
+        size_t capacity = snapshot->capacity + SNAPSHOT_GROW_STEP;
+        storage_dir_entry_t* grown = SNAPSHOT_REALLOC(snapshot->entries, capacity * sizeof(storage_dir_entry_t));
+        if (grown == NULL)
+        {
+            fill->out_of_memory = true;
+            return false;
+        }
+        snapshot->entries = grown;
+        snapshot->capacity = capacity;
+    }
+
+    snapshot->entries[snapshot->count++] = *entry;
+    return true;
+}
+
+/// ------------------------------------------
+esp_err_t storage_dir_snapshot_take(storage_backend_t* backend, const char* path, const storage_dir_filter_t* filter,
+                                    storage_dir_snapshot_t* snapshot)
+{
+    snapshot_fill_t fill = {
+        .snapshot = snapshot,
+        .out_of_memory = false,
+    };
+
+    snapshot->count = 0;
+    esp_err_t err = storage_visit_dir(backend, path, filter, add_snapshot_entry, &fill);
+    if (err == ESP_OK && fill.out_of_memory)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    if (err != ESP_OK)
+    {
+        snapshot->count = 0;
+        return err;
+    }
+
+    qsort(snapshot->entries, snapshot->count, sizeof(storage_dir_entry_t), compare_entries);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+const storage_dir_entry_t* storage_dir_snapshot_find(const storage_dir_snapshot_t* snapshot, const char* name)
+{
+    size_t low = 0;
+    size_t high = snapshot->count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        int cmp = storage_dir_name_cmp(snapshot->entries[mid].name, name);
+        if (cmp == 0)
+        {
+            return &snapshot->entries[mid];
+        }
+        else if (cmp < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+/// ------------------------------------------
+void storage_dir_snapshot_free(storage_dir_snapshot_t* snapshot)
+{
+    free(snapshot->entries);
+    snapshot->entries = NULL;
+    snapshot->count = 0;
+    snapshot->capacity = 0;
+}
@@ -0,0 +1,128 @@
+/// ------------------------------------------
+/// @file storage_dir.h
+///
+/// @brief Header file for walking directories of a storage backend, with filtering and
+/// a sorted snapshot of a directory for listings that are paged or searched
+///
+/// @note Directories are read in batches of STORAGE_DIR_BATCH_LEN entries and backend
+/// locks are only held for a batch, so listing a card with thousands of captures is
+/// linear and does not hold off the writers. Define STORAGE_HOST_BUILD to build outside of IDF.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "storage_backend.h"
+
+/// @brief Entries read from the backend per batch
+#define STORAGE_DIR_BATCH_LEN 16
+
+/// @brief Kinds of entry a filter matches
+typedef enum
+{
+    // Files and directories
+    STORAGE_DIR_ANY,
+
+    // Files only
+    STORAGE_DIR_FILES,
+
+    // Directories only
+    STORAGE_DIR_DIRS,
+} storage_dir_kind_t;
+
+/// @brief Selects entries of a directory, fields left null or 0 match everything
+typedef struct
+{
+    // Names must start with this, null for any
+    const char* prefix;
+
+    // Names must end with this, null for any
+    const char* suffix;
+
+    // Kind of entries to match
+    storage_dir_kind_t kind;
+} storage_dir_filter_t;
+
+/// @brief Called for each matching entry of a visited directory
+///
+/// @note No backend locks are held, the callback may use the backend. Entries added or
+/// removed during a visit may or may not be seen.
+///
+/// @param entry matching entry
+/// @param arg passed to storage_visit_dir
+///
+/// @return true to continue, false to stop visiting
+typedef bool (*storage_visit_cb_t)(const storage_dir_entry_t* entry, void* arg);
+
+/// @brief Sorted copy of the matching entries of a directory
+typedef struct
+{
+    // Matching entries, numbers within names sort by value so CAPTURE9 comes before CAPTURE10
+    storage_dir_entry_t* entries;
+
+    // Number of entries
+    size_t count;
+
+    // Allocated length of entries, kept when the snapshot is retaken
+    size_t capacity;
+} storage_dir_snapshot_t;
+
+///--------------------------------------------------------
+/// @brief Checks an entry against a filter
+///
+/// @param filter to check against, null matches everything
+/// @param entry to check
+///
+/// @return does the entry match?
+bool storage_dir_filter_match(const storage_dir_filter_t* filter, const storage_dir_entry_t* entry);
+
+///--------------------------------------------------------
+/// @brief Calls cb for each entry of a directory matching the filter
+///
+/// @param backend to read from
+/// @param path of the directory
+/// @param filter entries must match, null for all entries
+/// @param cb called for each matching entry
+/// @param arg passed to cb
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NOT_FOUND if the directory does not exist
+esp_err_t storage_visit_dir(storage_backend_t* backend, const char* path, const storage_dir_filter_t* filter,
+                            storage_visit_cb_t cb, void* arg);
+
+///--------------------------------------------------------
+/// @brief Takes a sorted snapshot of the entries of a directory matching the filter
+///
+/// @note The snapshot is not updated as the directory changes, retake it when needed. Retaking
+/// reuses the existing allocation, which is put in PSRAM where available.
+///
+/// @param backend to read from
+/// @param path of the directory
+/// @param filter entries must match, null for all entries
+/// @param[in,out] snapshot zeroed or previously taken snapshot to fill
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NOT_FOUND if the directory does not exist
+esp_err_t storage_dir_snapshot_take(storage_backend_t* backend, const char* path, const storage_dir_filter_t* filter,
+                                    storage_dir_snapshot_t* snapshot);
+
+///--------------------------------------------------------
+/// @brief Finds an entry of a snapshot by name
+///
+/// @param snapshot to search
+/// @param name of the entry
+///
+/// @return entry, null if the snapshot has no entry of that name
+const storage_dir_entry_t* storage_dir_snapshot_find(const storage_dir_snapshot_t* snapshot, const char* name);
+
+///--------------------------------------------------------
+/// @brief Frees the entries of a snapshot, leaving it empty
+///
+/// @param snapshot to free
+void storage_dir_snapshot_free(storage_dir_snapshot_t* snapshot);
+
+///--------------------------------------------------------
+/// @brief Compares two names, runs of digits are compared by value
+///
+/// @return negative, 0 or positive as a sorts before, with or after b
+int storage_dir_name_cmp(const char* a, const char* b);
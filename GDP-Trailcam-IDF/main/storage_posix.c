@@ -0,0 +1,422 @@
+/// ------------------------------------------
+/// @file storage_posix.c
+///
+/// @brief Source file for the POSIX directory storage backend, used for linux target
+/// and host builds. Can be throttled to the bandwidth and latency of the SD card so
+/// the capture pipeline can be measured off target.
+/// ------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "storage_backend.h"
+
+/// @brief State of a POSIX backend
+typedef struct
+{
+    // Directory all paths are relative to
+    char root[STORAGE_PATH_MAX];
+
+    // Simulated data rate, 0 for unthrottled
+    uint32_t throttle_bytes_per_s;
+
+    // Simulated time of every operation that touches the card
+    uint32_t throttle_op_latency_us;
+} posix_storage_t;
+
+/// ------------------------------------------
+/// @brief Sleeps for the time the SD card would take to move len bytes
+///
+/// @param storage backend state
+/// @param len bytes moved by the operation
+static void throttle(const posix_storage_t* storage, const size_t len)
+{
+    uint64_t delay_us = storage->throttle_op_latency_us;
+    if (storage->throttle_bytes_per_s > 0)
+    {
+        delay_us += (uint64_t)len * 1000000 / storage->throttle_bytes_per_s;
+    }
+
+    if (delay_us > 0)
+    {
+        struct timespec ts = {
+            .tv_sec = delay_us / 1000000,
+            .tv_nsec = (delay_us % 1000000) * 1000,
+        };
+        nanosleep(&ts, NULL);
+    }
+}
+
+/// ------------------------------------------
+/// @brief Prefixes a backend path with the root directory
+///
+/// @param storage backend state
+/// @param path relative to the root
+/// @param[out] full_path_out sized to STORAGE_PATH_MAX * 2
+static void full_path(const posix_storage_t* storage, const char* path, char* full_path_out)
+{
+    while (*path == '/')
+    {
+        path++;
+    }
+    snprintf(full_path_out, STORAGE_PATH_MAX * 2, "%s/%s", storage->root, path);
+}
+
+/// ------------------------------------------
+/// @brief Writes a whole buffer to a file descriptor
+static esp_err_t write_all(const int fd, const void* data, const size_t len)
+{
+    const uint8_t* src = data;
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t ret = write(fd, src + written, len - written);
+        if (ret <= 0)
+        {
+            return ESP_FAIL;
+        }
+        written += ret;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+/// @brief Opens a file and writes a whole buffer to it
+static esp_err_t write_with_flags(storage_backend_t* backend, const char* path, const void* data, const size_t len,
+                                  const int flags)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    throttle(storage, len);
+    int fd = open(full, O_WRONLY | O_CREAT | flags, 0644);
+    if (fd < 0)
+    {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = write_all(fd, data, len);
+    close(fd);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_write_file(storage_backend_t* backend, const char* path, const void* data, const size_t len)
+{
+    return write_with_flags(backend, path, data, len, O_TRUNC);
+}
+
+/// ------------------------------------------
+static esp_err_t posix_append_file(storage_backend_t* backend, const char* path, const void* data, const size_t len)
+{
+    return write_with_flags(backend, path, data, len, O_APPEND);
+}
+
+/// ------------------------------------------
+static esp_err_t posix_read_file(storage_backend_t* backend, const char* path, void* out_buf, const size_t len,
+                                 size_t* read_len)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    int fd = open(full, O_RDONLY);
+    if (fd < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t* dst = out_buf;
+    size_t total = 0;
+    ssize_t ret;
+    while (total < len && (ret = read(fd, dst + total, len - total)) > 0)
+    {
+        total += ret;
+    }
+    close(fd);
+
+    throttle(storage, total);
+    *read_len = total;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_stat(storage_backend_t* backend, const char* path, storage_stat_t* stat_out)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    throttle(storage, 0);
+    struct stat sb;
+    if (stat(full, &sb) != 0)
+    {
+        return errno == ENOENT ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+    }
+
+    stat_out->is_dir = S_ISDIR(sb.st_mode);
+    stat_out->size = stat_out->is_dir ? 0 : sb.st_size;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_make_dir(storage_backend_t* backend, const char* path)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    throttle(storage, 0);
+    if (mkdir(full, 0755) != 0)
+    {
+        return errno == EEXIST ? ESP_ERR_INVALID_ARG : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_remove(storage_backend_t* backend, const char* path)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    throttle(storage, 0);
+    if (remove(full) != 0)
+    {
+        return errno == ENOENT ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_rename(storage_backend_t* backend, const char* from, const char* to)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full_from[STORAGE_PATH_MAX * 2];
+    char full_to[STORAGE_PATH_MAX * 2];
+    full_path(storage, from, full_from);
+    full_path(storage, to, full_to);
+
+    // POSIX rename replaces the destination, FAT refuses to
+    struct stat sb;
+    if (stat(full_to, &sb) == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    throttle(storage, 0);
+    if (rename(full_from, full_to) != 0)
+    {
+        return errno == ENOENT ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_open_dir(storage_backend_t* backend, const char* path, storage_dir_t* dir_out)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    throttle(storage, 0);
+    DIR* dir = opendir(full);
+    if (dir == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *dir_out = dir;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_read_dir(storage_backend_t* backend, storage_dir_t dir_handle, storage_dir_entry_t* entries,
+                                const size_t max, size_t* count_out)
+{
+    posix_storage_t* storage = backend->ctx;
+    DIR* dir = dir_handle;
+
+    *count_out = 0;
+    struct dirent* entry;
+    while (*count_out < max && (entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            strlen(entry->d_name) >= STORAGE_PATH_MAX)
+        {
+            continue;
+        }
+
+        // Stat relative to the open directory, no path lookup from the root per entry
+        throttle(storage, 0);
+        struct stat sb;
+        storage_dir_entry_t* out = &entries[(*count_out)++];
+        strcpy(out->name, entry->d_name);
+        out->stat.size = 0;
+        out->stat.is_dir = false;
+        if (fstatat(dirfd(dir), entry->d_name, &sb, 0) == 0)
+        {
+            out->stat.is_dir = S_ISDIR(sb.st_mode);
+            out->stat.size = out->stat.is_dir ? 0 : sb.st_size;
+        }
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_close_dir(storage_backend_t* backend, storage_dir_t dir)
+{
+    closedir(dir);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_open(storage_backend_t* backend, const char* path, const size_t create_len,
+                            storage_handle_t* handle_out)
+{
+    posix_storage_t* storage = backend->ctx;
+    char full[STORAGE_PATH_MAX * 2];
+    full_path(storage, path, full);
+
+    throttle(storage, 0);
+    int fd = open(full, O_RDWR);
+    if (fd < 0)
+    {
+        if (create_len == 0)
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        fd = open(full, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+        {
+            return ESP_FAIL;
+        }
+
+        if (ftruncate(fd, create_len) != 0)
+        {
+            close(fd);
+            return ESP_FAIL;
+        }
+    }
+
+    // Offset by one so descriptor 0 is not mistaken for a null handle
+    *handle_out = (storage_handle_t)(intptr_t)(fd + 1);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_pwrite(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                              const void* data, const size_t len)
+{
+    posix_storage_t* storage = backend->ctx;
+    int fd = (int)(intptr_t)handle - 1;
+
+    throttle(storage, len);
+    const uint8_t* src = data;
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t ret = pwrite(fd, src + written, len - written, offset + written);
+        if (ret <= 0)
+        {
+            return ESP_FAIL;
+        }
+        written += ret;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_pread(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                             void* out_buf, const size_t len)
+{
+    posix_storage_t* storage = backend->ctx;
+    int fd = (int)(intptr_t)handle - 1;
+
+    throttle(storage, len);
+    return pread(fd, out_buf, len, offset) == (ssize_t)len ? ESP_OK : ESP_FAIL;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_sync(storage_backend_t* backend, storage_handle_t handle)
+{
+    posix_storage_t* storage = backend->ctx;
+    throttle(storage, 0);
+    return fsync((int)(intptr_t)handle - 1) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_close(storage_backend_t* backend, storage_handle_t handle)
+{
+    return close((int)(intptr_t)handle - 1) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+/// ------------------------------------------
+static esp_err_t posix_get_space(storage_backend_t* backend, uint64_t* total_out, uint64_t* free_out)
+{
+    posix_storage_t* storage = backend->ctx;
+    struct statvfs vfs;
+    if (statvfs(storage->root, &vfs) != 0)
+    {
+        return ESP_FAIL;
+    }
+
+    *total_out = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+    *free_out = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+storage_backend_t* storage_posix_create(const char* root,
+                                        const uint32_t throttle_bytes_per_s,
+                                        const uint32_t throttle_op_latency_us)
+{
+    if (strlen(root) >= STORAGE_PATH_MAX)
+    {
+        return NULL;
+    }
+
+    storage_backend_t* backend = calloc(1, sizeof(storage_backend_t));
+    posix_storage_t* storage = calloc(1, sizeof(posix_storage_t));
+    if (backend == NULL || storage == NULL)
+    {
+        free(backend);
+        free(storage);
+        return NULL;
+    }
+
+    strcpy(storage->root, root);
+    storage->throttle_bytes_per_s = throttle_bytes_per_s;
+    storage->throttle_op_latency_us = throttle_op_latency_us;
+
+    backend->name = "posix";
+    backend->ctx = storage;
+    backend->write_file = posix_write_file;
+    backend->append_file = posix_append_file;
+    backend->read_file = posix_read_file;
+    backend->stat = posix_stat;
+    backend->make_dir = posix_make_dir;
+    backend->remove = posix_remove;
+    backend->rename = posix_rename;
+    backend->open_dir = posix_open_dir;
+    backend->read_dir = posix_read_dir;
+    backend->close_dir = posix_close_dir;
+    backend->open = posix_open;
+    backend->pwrite = posix_pwrite;
+    backend->pread = posix_pread;
+    backend->sync = posix_sync;
+    backend->close = posix_close;
+    backend->get_space = posix_get_space;
+    return backend;
+}
@@ -0,0 +1,628 @@
+/// ------------------------------------------
+/// @file storage_ramdisk.c
+///
+/// @brief Source file for the in memory storage backend, used to run the capture
+/// pipeline without a card and to measure it without SD time
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "storage_backend.h"
+
+#ifdef STORAGE_HOST_BUILD
+#define RAMDISK_LOCK(disk) (void)(disk)
+#define RAMDISK_UNLOCK(disk) (void)(disk)
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#define RAMDISK_LOCK(disk) xSemaphoreTake((disk)->mutex, portMAX_DELAY)
+#define RAMDISK_UNLOCK(disk) xSemaphoreGive((disk)->mutex)
+#endif
+
+/// @brief Number of entries the entry table grows by when full
+#define RAMDISK_GROW_STEP 16
+
+/// @brief A file or directory on the RAM disk
+typedef struct
+{
+    // Full path of the entry, without leading '/'
+    char path[STORAGE_PATH_MAX];
+
+    // Is this a directory?
+    bool is_dir;
+
+    // File contents
+    uint8_t* data;
+
+    // Length of the file
+    size_t len;
+
+    // Allocated length of data
+    size_t capacity;
+} ramdisk_entry_t;
+
+/// @brief State of a RAM disk
+typedef struct
+{
+    // Table of entries, removed entries leave a null slot
+    ramdisk_entry_t** entries;
+
+    // Number of slots in the table
+    size_t entry_slots;
+
+    // Total file capacity allocated
+    size_t used_bytes;
+
+    // Limit of used_bytes
+    size_t max_bytes;
+
+#ifndef STORAGE_HOST_BUILD
+    // Protects the whole disk
+    SemaphoreHandle_t mutex;
+#endif
+} ramdisk_t;
+
+/// @brief A directory open for reading
+typedef struct
+{
+    // Path of the directory, without leading '/'
+    char path[STORAGE_PATH_MAX];
+
+    // Slot of the entry table to carry on reading from. Slots are never moved, so
+    // entries added or removed whilst reading are simply seen or missed
+    size_t next_slot;
+} ramdisk_dir_t;
+
+/// ------------------------------------------
+/// @brief Skips a leading '/' of a path
+static const char* normalise_path(const char* path)
+{
+    while (*path == '/')
+    {
+        path++;
+    }
+    return path;
+}
+
+/// ------------------------------------------
+/// @brief Finds the entry at a path
+///
+/// @return entry, null if missing
+static ramdisk_entry_t* find_entry(ramdisk_t* disk, const char* path)
+{
+    path = normalise_path(path);
+    for (size_t i = 0; i < disk->entry_slots; i++)
+    {
+        if (disk->entries[i] != NULL && strcmp(disk->entries[i]->path, path) == 0)
+        {
+            return disk->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/// ------------------------------------------
+/// @brief Checks the directory a path would be created in exists
+///
+/// @return does the parent exist?
+static bool parent_exists(ramdisk_t* disk, const char* path)
+{
+    path = normalise_path(path);
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL)
+    {
+        return true;
+    }
+
+    char parent[STORAGE_PATH_MAX];
+    size_t parent_len = slash - path;
+    memcpy(parent, path, parent_len);
+    parent[parent_len] = '\0';
+
+    ramdisk_entry_t* entry = find_entry(disk, parent);
+    return entry != NULL && entry->is_dir;
+}
+
+/// ------------------------------------------
+/// @brief Adds a new empty entry
+///
+/// @return new entry, null if out of memory or the path is invalid
+static ramdisk_entry_t* add_entry(ramdisk_t* disk, const char* path, const bool is_dir)
+{
+    path = normalise_path(path);
+    if (strlen(path) >= STORAGE_PATH_MAX || parent_exists(disk, path) == false)
+    {
+        return NULL;
+    }
+
+    size_t slot = 0;
+    while (slot < disk->entry_slots && disk->entries[slot] != NULL)
+    {
+        slot++;
+    }
+
+    if (slot == disk->entry_slots)
+    {
+        ramdisk_entry_t** grown = realloc(disk->entries,
+                                          (disk->entry_slots + RAMDISK_GROW_STEP) * sizeof(ramdisk_entry_t*));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        memset(&grown[disk->entry_slots], 0, RAMDISK_GROW_STEP * sizeof(ramdisk_entry_t*));
+        disk->entries = grown;
+        disk->entry_slots += RAMDISK_GROW_STEP;
+    }
+
+    ramdisk_entry_t* entry = calloc(1, sizeof(ramdisk_entry_t));
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+    strcpy(entry->path, path);
+    entry->is_dir = is_dir;
+    disk->entries[slot] = entry;
+    return entry;
+}
+
+/// ------------------------------------------
+/// @brief Grows a file's allocation to hold at least len bytes
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_NO_MEM if the disk is full
+static esp_err_t reserve_entry(ramdisk_t* disk, ramdisk_entry_t* entry, const size_t len)
+{
+    if (len <= entry->capacity)
+    {
+        return ESP_OK;
+    }
+
+    if (disk->used_bytes - entry->capacity + len > disk->max_bytes)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t* grown = realloc(entry->data, len);
+    if (grown == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Preallocated space reads back as zeros, like a freshly expanded file
+    memset(grown + entry->capacity, 0, len - entry->capacity);
+    disk->used_bytes += len - entry->capacity;
+    entry->data = grown;
+    entry->capacity = len;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+/// @brief Writes into a file, growing it as needed
+static esp_err_t write_entry(ramdisk_t* disk, ramdisk_entry_t* entry, const size_t offset,
+                             const void* data, const size_t len)
+{
+    esp_err_t err = reserve_entry(disk, entry, offset + len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    memcpy(entry->data + offset, data, len);
+    if (offset + len > entry->len)
+    {
+        entry->len = offset + len;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_write_file(storage_backend_t* backend, const char* path, const void* data, const size_t len)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    ramdisk_entry_t* entry = find_entry(disk, path);
+    if (entry == NULL)
+    {
+        entry = add_entry(disk, path, false);
+    }
+
+    esp_err_t err = ESP_FAIL;
+    if (entry != NULL && entry->is_dir == false)
+    {
+        entry->len = 0;
+        err = write_entry(disk, entry, 0, data, len);
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_append_file(storage_backend_t* backend, const char* path, const void* data, const size_t len)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    ramdisk_entry_t* entry = find_entry(disk, path);
+    if (entry == NULL)
+    {
+        entry = add_entry(disk, path, false);
+    }
+
+    esp_err_t err = ESP_FAIL;
+    if (entry != NULL && entry->is_dir == false)
+    {
+        err = write_entry(disk, entry, entry->len, data, len);
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_read_file(storage_backend_t* backend, const char* path, void* out_buf, const size_t len,
+                                   size_t* read_len)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    ramdisk_entry_t* entry = find_entry(disk, path);
+    if (entry != NULL && entry->is_dir == false)
+    {
+        *read_len = entry->len < len ? entry->len : len;
+        memcpy(out_buf, entry->data, *read_len);
+        err = ESP_OK;
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_stat(storage_backend_t* backend, const char* path, storage_stat_t* stat_out)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    ramdisk_entry_t* entry = find_entry(disk, path);
+    if (entry != NULL)
+    {
+        stat_out->is_dir = entry->is_dir;
+        stat_out->size = entry->len;
+        err = ESP_OK;
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_make_dir(storage_backend_t* backend, const char* path)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (find_entry(disk, path) == NULL)
+    {
+        err = add_entry(disk, path, true) != NULL ? ESP_OK : ESP_FAIL;
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_remove(storage_backend_t* backend, const char* path)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    path = normalise_path(path);
+    size_t path_len = strlen(path);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    for (size_t i = 0; i < disk->entry_slots; i++)
+    {
+        ramdisk_entry_t* entry = disk->entries[i];
+        if (entry == NULL || strcmp(entry->path, path) != 0)
+        {
+            continue;
+        }
+
+        // Directories must be empty, as on FAT
+        if (entry->is_dir)
+        {
+            for (size_t j = 0; j < disk->entry_slots; j++)
+            {
+                ramdisk_entry_t* child = disk->entries[j];
+                if (child != NULL && strncmp(child->path, path, path_len) == 0 && child->path[path_len] == '/')
+                {
+                    RAMDISK_UNLOCK(disk);
+                    return ESP_FAIL;
+                }
+            }
+        }
+
+        disk->used_bytes -= entry->capacity;
+        free(entry->data);
+        free(entry);
+        disk->entries[i] = NULL;
+        err = ESP_OK;
+        break;
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_rename(storage_backend_t* backend, const char* from, const char* to)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    from = normalise_path(from);
+    to = normalise_path(to);
+    size_t from_len = strlen(from);
+    size_t to_len = strlen(to);
+
+    esp_err_t err = ESP_OK;
+    if (find_entry(disk, from) == NULL)
+    {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    else if (find_entry(disk, to) != NULL)
+    {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    else if (parent_exists(disk, to) == false)
+    {
+        err = ESP_FAIL;
+    }
+
+    // Check every moved path fits before touching any of them
+    for (size_t i = 0; i < disk->entry_slots && err == ESP_OK; i++)
+    {
+        ramdisk_entry_t* entry = disk->entries[i];
+        if (entry != NULL && strncmp(entry->path, from, from_len) == 0 &&
+            (entry->path[from_len] == '\0' || entry->path[from_len] == '/') &&
+            strlen(entry->path) - from_len + to_len >= STORAGE_PATH_MAX)
+        {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    // Moves the entry and, for a directory, everything under it
+    for (size_t i = 0; i < disk->entry_slots && err == ESP_OK; i++)
+    {
+        ramdisk_entry_t* entry = disk->entries[i];
+        if (entry != NULL && strncmp(entry->path, from, from_len) == 0 &&
+            (entry->path[from_len] == '\0' || entry->path[from_len] == '/'))
+        {
+            char moved[STORAGE_PATH_MAX];
+            snprintf(moved, sizeof(moved), "%s%s", to, entry->path + from_len);
+            strcpy(entry->path, moved);
+        }
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_open_dir(storage_backend_t* backend, const char* path, storage_dir_t* dir_out)
+{
+    ramdisk_t* disk = backend->ctx;
+    path = normalise_path(path);
+    if (strlen(path) >= STORAGE_PATH_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    RAMDISK_LOCK(disk);
+    if (strlen(path) > 0)
+    {
+        ramdisk_entry_t* dir = find_entry(disk, path);
+        if (dir == NULL || dir->is_dir == false)
+        {
+            RAMDISK_UNLOCK(disk);
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+    RAMDISK_UNLOCK(disk);
+
+    ramdisk_dir_t* dir = calloc(1, sizeof(ramdisk_dir_t));
+    if (dir == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(dir->path, path);
+    *dir_out = dir;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_read_dir(storage_backend_t* backend, storage_dir_t dir_handle, storage_dir_entry_t* entries,
+                                  const size_t max, size_t* count_out)
+{
+    ramdisk_t* disk = backend->ctx;
+    ramdisk_dir_t* dir = dir_handle;
+    size_t path_len = strlen(dir->path);
+
+    *count_out = 0;
+    RAMDISK_LOCK(disk);
+    for (; dir->next_slot < disk->entry_slots && *count_out < max; dir->next_slot++)
+    {
+        ramdisk_entry_t* entry = disk->entries[dir->next_slot];
+        if (entry == NULL)
+        {
+            continue;
+        }
+
+        // Direct children only, the root lists entries without a '/'
+        const char* name = entry->path;
+        if (path_len > 0)
+        {
+            if (strncmp(name, dir->path, path_len) != 0 || name[path_len] != '/')
+            {
+                continue;
+            }
+            name += path_len + 1;
+        }
+        if (strchr(name, '/') != NULL)
+        {
+            continue;
+        }
+
+        storage_dir_entry_t* out = &entries[(*count_out)++];
+        strcpy(out->name, name);
+        out->stat.size = entry->len;
+        out->stat.is_dir = entry->is_dir;
+    }
+    RAMDISK_UNLOCK(disk);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_close_dir(storage_backend_t* backend, storage_dir_t dir)
+{
+    free(dir);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_open(storage_backend_t* backend, const char* path, const size_t create_len,
+                              storage_handle_t* handle_out)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+
+    esp_err_t err = ESP_OK;
+    ramdisk_entry_t* entry = find_entry(disk, path);
+    if (entry == NULL)
+    {
+        if (create_len == 0)
+        {
+            err = ESP_ERR_NOT_FOUND;
+        }
+        else if ((entry = add_entry(disk, path, false)) == NULL)
+        {
+            err = ESP_FAIL;
+        }
+        else if ((err = reserve_entry(disk, entry, create_len)) == ESP_OK)
+        {
+            entry->len = create_len;
+        }
+    }
+    else if (entry->is_dir)
+    {
+        err = ESP_ERR_INVALID_ARG;
+    }
+
+    // Entries never move, so the entry itself is the handle
+    *handle_out = err == ESP_OK ? entry : NULL;
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_pwrite(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                                const void* data, const size_t len)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+    esp_err_t err = write_entry(disk, handle, offset, data, len);
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_pread(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                               void* out_buf, const size_t len)
+{
+    ramdisk_t* disk = backend->ctx;
+    ramdisk_entry_t* entry = handle;
+    RAMDISK_LOCK(disk);
+
+    esp_err_t err = ESP_ERR_INVALID_SIZE;
+    if (offset + len <= entry->len)
+    {
+        memcpy(out_buf, entry->data + offset, len);
+        err = ESP_OK;
+    }
+
+    RAMDISK_UNLOCK(disk);
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_sync(storage_backend_t* backend, storage_handle_t handle)
+{
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_close(storage_backend_t* backend, storage_handle_t handle)
+{
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t ramdisk_get_space(storage_backend_t* backend, uint64_t* total_out, uint64_t* free_out)
+{
+    ramdisk_t* disk = backend->ctx;
+    RAMDISK_LOCK(disk);
+    *total_out = disk->max_bytes;
+    *free_out = disk->max_bytes - disk->used_bytes;
+    RAMDISK_UNLOCK(disk);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+storage_backend_t* storage_ramdisk_create(const size_t max_bytes)
+{
+    storage_backend_t* backend = calloc(1, sizeof(storage_backend_t));
+    ramdisk_t* disk = calloc(1, sizeof(ramdisk_t));
+    if (backend == NULL || disk == NULL)
+    {
+        free(backend);
+        free(disk);
+        return NULL;
+    }
+
+#ifndef STORAGE_HOST_BUILD
+    disk->mutex = xSemaphoreCreateMutex();
+    if (disk->mutex == NULL)
+    {
+        free(backend);
+        free(disk);
+        return NULL;
+    }
+#endif
+
+    disk->max_bytes = max_bytes;
+    backend->name = "ramdisk";
+    backend->ctx = disk;
+    backend->write_file = ramdisk_write_file;
+    backend->append_file = ramdisk_append_file;
+    backend->read_file = ramdisk_read_file;
+    backend->stat = ramdisk_stat;
+    backend->make_dir = ramdisk_make_dir;
+    backend->remove = ramdisk_remove;
+    backend->rename = ramdisk_rename;
+    backend->open_dir = ramdisk_open_dir;
+    backend->read_dir = ramdisk_read_dir;
+    backend->close_dir = ramdisk_close_dir;
+    backend->open = ramdisk_open;
+    backend->pwrite = ramdisk_pwrite;
+    backend->pread = ramdisk_pread;
+    backend->sync = ramdisk_sync;
+    backend->close = ramdisk_close;
+    backend->get_space = ramdisk_get_space;
+    return backend;
+}
@@ -0,0 +1,266 @@
+/// ------------------------------------------
+/// @file storage_sdspi.c
+///
+/// @brief Source file for the storage backend on the SD card, built on SDSPI.c
+/// ------------------------------------------
+
+#include "storage_backend.h"
+#include "SDSPI.h"
+
+/// @brief Debugging string tag
+static const char* STORAGE_SDSPI_TAG = "storage_sdspi";
+
+_Static_assert(SD_DIR_NAME_MAX <= STORAGE_PATH_MAX, "SD directory entry names must fit storage entries");
+
+/// ------------------------------------------
+/// @brief Prefixes a backend path with the mount point
+///
+/// @param path relative to the card root
+/// @param[out] full_path_out sized to FILENAME_MAX_SIZE
+static void full_path(const char* path, char* full_path_out)
+{
+    snprintf(full_path_out, FILENAME_MAX_SIZE, MOUNT_POINT"/%s", path);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_write_file(storage_backend_t* backend, const char* path, const void* data, const size_t len)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+    return write_data_SDSPI(full, data, len);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_append_file(storage_backend_t* backend, const char* path, const void* data, const size_t len)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+    return append_data_SDSPI(full, data, len);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_read_file(storage_backend_t* backend, const char* path, void* out_buf, const size_t len,
+                                 size_t* read_len)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+
+    long size = fsize_SDSPI(full);
+    if (size < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *read_len = (size_t)size < len ? (size_t)size : len;
+    return read_data_SDSPI(full, out_buf, *read_len);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_stat(storage_backend_t* backend, const char* path, storage_stat_t* stat_out)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+    return stat_SDSPI(full, &stat_out->size, &stat_out->is_dir);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_make_dir(storage_backend_t* backend, const char* path)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+    return create_dir_SDSPI(full);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_remove(storage_backend_t* backend, const char* path)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+
+    size_t size;
+    bool is_dir;
+    esp_err_t err = stat_SDSPI(full, &size, &is_dir);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return is_dir ? delete_dir_SDSPI(full) : delete_file_SDSPI(full);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_rename(storage_backend_t* backend, const char* from, const char* to)
+{
+    char full_from[FILENAME_MAX_SIZE];
+    char full_to[FILENAME_MAX_SIZE];
+    full_path(from, full_from);
+    full_path(to, full_to);
+    return rename_SDSPI(full_from, full_to);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_open_dir(storage_backend_t* backend, const char* path, storage_dir_t* dir_out)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+
+    SDSPI_dir_iter_t* iter;
+    esp_err_t err = open_dir_iter_SDSPI(full, &iter);
+    if (err == ESP_OK)
+    {
+        *dir_out = iter;
+    }
+    return err;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_read_dir(storage_backend_t* backend, storage_dir_t dir, storage_dir_entry_t* entries,
+                                const size_t max, size_t* count_out)
+{
+    // Read in batches of the iterator's entry type, one SD mutex hold each
+    SDSPI_dir_entry_t batch[SD_DIR_BATCH_LEN];
+    *count_out = 0;
+    while (*count_out < max)
+    {
+        size_t want = max - *count_out < SD_DIR_BATCH_LEN ? max - *count_out : SD_DIR_BATCH_LEN;
+        size_t count;
+        esp_err_t err = read_dir_iter_SDSPI(dir, batch, want, &count);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            storage_dir_entry_t* entry = &entries[(*count_out)++];
+            strcpy(entry->name, batch[i].name);
+            entry->stat.size = batch[i].size;
+            entry->stat.is_dir = batch[i].is_dir;
+        }
+
+        if (count < want)
+        {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_close_dir(storage_backend_t* backend, storage_dir_t dir)
+{
+    close_dir_iter_SDSPI(dir);
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_open(storage_backend_t* backend, const char* path, const size_t create_len,
+                            storage_handle_t* handle_out)
+{
+    char full[FILENAME_MAX_SIZE];
+    full_path(path, full);
+
+    FILE* f = fopen(full, "r+b");
+    if (f == NULL)
+    {
+        if (create_len == 0)
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        // Contiguous preallocation means writes inside the file never touch the FAT
+        esp_err_t err = esp_vfs_fat_create_contiguous_file(MOUNT_POINT, full, create_len, true);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(STORAGE_SDSPI_TAG, "Failed to preallocate %s, %s", full, esp_err_to_name(err));
+            return err;
+        }
+
+        f = fopen(full, "r+b");
+        if (f == NULL)
+        {
+            ESP_LOGE(STORAGE_SDSPI_TAG, "Failed to open %s, errno: %d", full, errno);
+            return ESP_FAIL;
+        }
+    }
+
+    // Writes go straight to FatFs in aligned chunks, see write_chunked_SDSPI
+    setvbuf(f, NULL, _IONBF, 0);
+    *handle_out = f;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_pwrite(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                              const void* data, const size_t len)
+{
+    FILE* f = handle;
+    if (fseek(f, offset, SEEK_SET) != 0)
+    {
+        return ESP_FAIL;
+    }
+    return write_chunked_SDSPI(f, offset, data, len);
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_pread(storage_backend_t* backend, storage_handle_t handle, const size_t offset,
+                             void* out_buf, const size_t len)
+{
+    FILE* f = handle;
+    if (fseek(f, offset, SEEK_SET) != 0 || fread(out_buf, 1, len, f) != len)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_sync(storage_backend_t* backend, storage_handle_t handle)
+{
+    FILE* f = handle;
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0)
+    {
+        ESP_LOGE(STORAGE_SDSPI_TAG, "Failed to sync, errno: %d", errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_close(storage_backend_t* backend, storage_handle_t handle)
+{
+    return fclose((FILE*)handle) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+/// ------------------------------------------
+static esp_err_t sdspi_get_space(storage_backend_t* backend, uint64_t* total_out, uint64_t* free_out)
+{
+    return space_SDSPI(total_out, free_out);
+}
+
+/// @brief The SD card backend, there is only one card so it is never allocated
+static storage_backend_t sdspi_backend = {
+    .name = "sdspi",
+    .ctx = NULL,
+    .write_file = sdspi_write_file,
+    .append_file = sdspi_append_file,
+    .read_file = sdspi_read_file,
+    .stat = sdspi_stat,
+    .make_dir = sdspi_make_dir,
+    .remove = sdspi_remove,
+    .rename = sdspi_rename,
+    .open_dir = sdspi_open_dir,
+    .read_dir = sdspi_read_dir,
+    .close_dir = sdspi_close_dir,
+    .open = sdspi_open,
+    .pwrite = sdspi_pwrite,
+    .pread = sdspi_pread,
+    .sync = sdspi_sync,
+    .close = sdspi_close,
+    .get_space = sdspi_get_space,
+};
+
+/// ------------------------------------------
+storage_backend_t* storage_sdspi_backend()
+{
+    return &sdspi_backend;
+}
@@ -0,0 +1,340 @@
+/// ------------------------------------------
+/// @file trace.c
+///
+/// @brief Source file for span tracing of the capture hot path
+/// ------------------------------------------
+
+#ifdef STORAGE_HOST_BUILD
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#else
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#ifdef STORAGE_HOST_BUILD
+#define TRACE_LOGE(fmt, ...) fprintf(stderr, "trace: " fmt "\n", ##__VA_ARGS__)
+#else
+/// @brief Logging tag
+static const char* TRACE_TAG = "trace";
+#define TRACE_LOGE(fmt, ...) ESP_LOGE(TRACE_TAG, fmt, ##__VA_ARGS__)
+#endif
+
+/// @brief Length of a task name kept for the trace, as configMAX_TASK_NAME_LEN
+#define TRACE_TASK_NAME_LEN 16
+
+/// @brief JSON is written in chunks of this size
+#define TRACE_CHUNK_LEN 4096
+
+/// @brief Longest single JSON event written
+#define TRACE_EVENT_JSON_MAX 192
+
+/// @brief Task index of events from tasks beyond TRACE_MAX_TASKS
+#define TRACE_TASK_OTHER TRACE_MAX_TASKS
+
+/// @brief A span beginning or ending
+typedef struct
+{
+    // esp_timer time of the event
+    int64_t time_us;
+
+    // trace_span_t of the span
+    uint8_t span;
+
+    // Did the span begin rather than end?
+    uint8_t begin;
+
+    // Core the event was recorded on
+    uint8_t core;
+
+    // Index into trace_tasks, TRACE_TASK_OTHER if the table was full
+    uint8_t task;
+} trace_event_t;
+
+/// @brief Name of each span in the trace
+static const char* trace_span_names[TRACE_SPAN_COUNT] = {
+    "cam_start",
+    "grab",
+    "extract",
+    "sd_write",
+    "grayscale",
+    "subtract",
+    "quantize",
+    "crop_decode",
+    "encode",
+    "sleep_entry",
+};
+
+/// @brief Category of each span, so stages can be filtered together
+static const char* trace_span_categories[TRACE_SPAN_COUNT] = {
+    "capture",
+    "capture",
+    "capture",
+    "storage",
+    "analysis",
+    "analysis",
+    "analysis",
+    "crop",
+    "crop",
+    "power",
+};
+
+/// @brief Event ring, null until trace_init
+static trace_event_t* trace_ring = NULL;
+
+/// @brief Events the ring holds
+static size_t trace_capacity = 0;
+
+/// @brief Events ever claimed, the next event goes at trace_head % trace_capacity
+static atomic_uint trace_head;
+
+/// @brief Identity of each task seen, 0 for an unclaimed entry
+static atomic_uintptr_t trace_task_ids[TRACE_MAX_TASKS];
+
+/// @brief Name of each task seen, written by the task that claimed the entry
+static char trace_task_names[TRACE_MAX_TASKS][TRACE_TASK_NAME_LEN];
+
+/// @brief JSON being written out in chunks
+typedef struct
+{
+    // Backend written to
+    storage_backend_t* backend;
+
+    // File written
+    const char* path;
+
+    // Buffered JSON
+    char buf[TRACE_CHUNK_LEN];
+
+    // Bytes in buf
+    size_t len;
+
+    // Has the first chunk been written, so later chunks are appended?
+    bool started;
+
+    // First error writing, later output is dropped
+    esp_err_t err;
+} trace_writer_t;
+
+/// ------------------------------------------
+/// @brief Gets the time, core and identity of the calling task
+///
+/// @param[out] event time and core are set
+///
+/// @return identity of the calling task, never 0
+static uintptr_t get_caller(trace_event_t* event)
+{
+#ifdef STORAGE_HOST_BUILD
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    event->time_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    int cpu = sched_getcpu();
+    event->core = cpu < 0 ? 0 : cpu;
+    return (uintptr_t)pthread_self();
+#else
+    event->time_us = esp_timer_get_time();
+    event->core = xPortGetCoreID();
+    return (uintptr_t)xTaskGetCurrentTaskHandle();
+#endif
+}
+
+/// ------------------------------------------
+/// @brief Copies the calling task's name into the trace
+///
+/// @param[out] name_out buffer of TRACE_TASK_NAME_LEN
+static void get_caller_name(char* name_out)
+{
+#ifdef STORAGE_HOST_BUILD
+    if (pthread_getname_np(pthread_self(), name_out, TRACE_TASK_NAME_LEN) != 0)
+    {
+        name_out[0] = '\0';
+    }
+#else
+    strncpy(name_out, pcTaskGetName(NULL), TRACE_TASK_NAME_LEN - 1);
+    name_out[TRACE_TASK_NAME_LEN - 1] = '\0';
+#endif
+}
+
+/// ------------------------------------------
+/// @brief Finds the calling task's entry in the task table, claiming one on its first event
+///
+/// @param id identity of the calling task
+///
+/// @return index into the task table, TRACE_TASK_OTHER if it is full
+static uint8_t find_task(const uintptr_t id)
+{
+    for (uint8_t i = 0; i < TRACE_MAX_TASKS; i++)
+    {
+        uintptr_t entry = atomic_load_explicit(&trace_task_ids[i], memory_order_relaxed);
+        if (entry == id)
+        {
+            return i;
+        }
+
+        // Only the task itself claims its entry, so losing the race means the entry is another's
+        if (entry == 0 && atomic_compare_exchange_strong(&trace_task_ids[i], &entry, id))
+        {
+            get_caller_name(trace_task_names[i]);
+            return i;
+        }
+    }
+    return TRACE_TASK_OTHER;
+}
+
+/// ------------------------------------------
+/// @brief Adds to the JSON, writing out the buffer whenever it fills
+///
+/// @param writer JSON being written
+/// @param format printf format of the JSON to add, at most TRACE_EVENT_JSON_MAX long
+static void write_json(trace_writer_t* writer, const char* format, ...)
+{
+    if (writer->len + TRACE_EVENT_JSON_MAX > TRACE_CHUNK_LEN || format == NULL)
+    {
+        if (writer->err == ESP_OK && writer->len > 0)
+        {
+            writer->err = writer->started
+                ? writer->backend->append_file(writer->backend, writer->path, writer->buf, writer->len)
+                : writer->backend->write_file(writer->backend, writer->path, writer->buf, writer->len);
+            writer->started = true;
+        }
+        writer->len = 0;
+    }
+
+    if (format == NULL)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(writer->buf + writer->len, TRACE_CHUNK_LEN - writer->len, format, args);
+    va_end(args);
+    if (len > 0)
+    {
+        writer->len += len < TRACE_EVENT_JSON_MAX ? len : TRACE_EVENT_JSON_MAX - 1;
+    }
+}
+
+/// ------------------------------------------
+esp_err_t trace_init(const size_t events)
+{
+    if (trace_ring != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (events == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    trace_event_t* ring = calloc(events, sizeof(trace_event_t));
+    if (ring == NULL)
+    {
+        TRACE_LOGE("No memory for %u events", (unsigned)events);
+        return ESP_ERR_NO_MEM;
+    }
+
+    atomic_init(&trace_head, 0);
+    for (size_t i = 0; i < TRACE_MAX_TASKS; i++)
+    {
+        atomic_init(&trace_task_ids[i], 0);
+    }
+    trace_capacity = events;
+    trace_ring = ring;
+    return ESP_OK;
+}
+
+/// ------------------------------------------
+void trace_record(const trace_span_t span, const bool begin)
+{
+    if (trace_ring == NULL)
+    {
+        return;
+    }
+
+    trace_event_t event;
+    uintptr_t id = get_caller(&event);
+    event.span = span;
+    event.begin = begin;
+    event.task = find_task(id);
+
+    unsigned slot = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    trace_ring[slot % trace_capacity] = event;
+}
+
+/// ------------------------------------------
+esp_err_t trace_dump(storage_backend_t* backend, const char* path)
+{
+    if (trace_ring == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    trace_writer_t* writer = malloc(sizeof(trace_writer_t));
+    if (writer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    writer->backend = backend;
+    writer->path = path;
+    writer->len = 0;
+    writer->started = false;
+    writer->err = ESP_OK;
+
+    unsigned head = atomic_load(&trace_head);
+    size_t count = head < trace_capacity ? head : trace_capacity;
+
+    write_json(writer, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"events\":%u,\"overwritten\":%u},\n"
+                       "\"traceEvents\":[\n", head, (unsigned)(head - count));
+    write_json(writer, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"trailcam\"}}");
+
+    // Tids start at 1, the "other" task is last
+    for (size_t i = 0; i < TRACE_MAX_TASKS; i++)
+    {
+        if (atomic_load(&trace_task_ids[i]) != 0)
+        {
+            write_json(writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                       (unsigned)(i + 1), trace_task_names[i]);
+        }
+    }
+    write_json(writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"other\"}}",
+               TRACE_TASK_OTHER + 1);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const trace_event_t* event = &trace_ring[(head - count + i) % trace_capacity];
+        if (event->span >= TRACE_SPAN_COUNT)
+        {
+            continue;
+        }
+
+        write_json(writer, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRId64
+                           ",\"pid\":1,\"tid\":%u,\"args\":{\"core\":%u}}",
+                   trace_span_names[event->span], trace_span_categories[event->span], event->begin ? 'B' : 'E',
+                   event->time_us, event->task + 1, event->core);
+    }
+
+    write_json(writer, "\n]}\n");
+    write_json(writer, NULL);
+
+    esp_err_t err = writer->err;
+    free(writer);
+    if (err != ESP_OK)
+    {
+        TRACE_LOGE("Failed to write %s", path);
+    }
+    return err;
+}
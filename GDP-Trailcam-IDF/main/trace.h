@@ -0,0 +1,82 @@
+/// ------------------------------------------
+/// @file trace.h
+///
+/// @brief Header file for span tracing of the capture hot path, exported as Chrome trace JSON
+///
+/// @note Begin and end events are claimed from a lock free ring with a single atomic add,
+/// so any task can record without blocking another. Once full the oldest events are
+/// overwritten. Every event holds its esp_timer timestamp, the core it ran on and the
+/// task that recorded it. The ring is dumped once the wake is idle and opens in
+/// chrome://tracing or ui.perfetto.dev.
+///
+/// Without CONFIG_TRACE_ENABLED the TRACE_ macros compile to nothing. Define
+/// STORAGE_HOST_BUILD to build outside of IDF, timestamps then come from the monotonic
+/// clock and tasks are threads, giving traces in the same format as the device.
+/// ------------------------------------------
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef STORAGE_HOST_BUILD
+#include "sdkconfig.h"
+#endif
+
+#include "storage_backend.h"
+
+/// @brief Spans of the hot path, each has a name in the trace
+typedef enum
+{
+    TRACE_SPAN_CAM_START,
+    TRACE_SPAN_GRAB,
+    TRACE_SPAN_EXTRACT,
+    TRACE_SPAN_SD_WRITE,
+    TRACE_SPAN_GRAYSCALE,
+    TRACE_SPAN_SUBTRACT,
+    TRACE_SPAN_QUANTIZE,
+    TRACE_SPAN_CROP_DECODE,
+    TRACE_SPAN_ENCODE,
+    TRACE_SPAN_SLEEP_ENTRY,
+    TRACE_SPAN_COUNT
+} trace_span_t;
+
+/// @brief Most tasks told apart in a trace, events of any more are put under one "other" task
+#define TRACE_MAX_TASKS 16
+
+#ifdef CONFIG_TRACE_ENABLED
+/// @brief Starts a span on the calling task
+#define TRACE_BEGIN(span) trace_record(span, true)
+
+/// @brief Ends the calling task's last span of the same name
+#define TRACE_END(span) trace_record(span, false)
+#else
+#define TRACE_BEGIN(span) ((void)0)
+#define TRACE_END(span) ((void)0)
+#endif
+
+///--------------------------------------------------------
+/// @brief Allocates the event ring, nothing is recorded until it is
+///
+/// @param events events the ring holds, two per span
+///
+/// @return ESP_OK if sucsessful
+esp_err_t trace_init(const size_t events);
+
+///--------------------------------------------------------
+/// @brief Records a span beginning or ending, use the TRACE_ macros rather than calling directly
+///
+/// @param span that began or ended
+/// @param begin true if it began
+void trace_record(const trace_span_t span, const bool begin);
+
+///--------------------------------------------------------
+/// @brief Writes every event in the ring as Chrome trace JSON
+///
+/// @note Spans still recording whilst dumping may be missed or cut short
+///
+/// @param backend to write to
+/// @param path of the file, replaced if it exists
+///
+/// @return ESP_OK if sucsessful, ESP_ERR_INVALID_STATE if trace_init was not called
+esp_err_t trace_dump(storage_backend_t* backend, const char* path);
@@ -136,6 +136,36 @@ bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t s
 /// @return sucsess bool
 bool jpg2grayscale(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t scale);
 
+/// ------------------------------------------
+/// @brief Subtracts the grayscale of a jpg image from a grayscale image, leaving the absolute
+/// difference of each pixel
+///
+/// @note Decoded block by block, so no second full grayscale image is needed
+///
+/// @param src source buffer of jpg data
+/// @param src_len length of source buffer
+/// @param inout grayscale image of the same size, overwritten with the difference
+/// @param scale to decode jpg at
+///
+/// @return sucsess bool
+bool jpg2grayscale_diff(const uint8_t* src, size_t src_len, uint8_t* inout, jpg_scale_t scale);
+
+/// ------------------------------------------
+/// @brief Converts a region of a jpg image buf into an rgb565 image buf
+///
+/// @note Decoded block by block, only the region is ever held
+///
+/// @param src source buffer of jpg data
+/// @param src_len length of source buffer
+/// @param out output rgb565 buffer of w * h * 2 bytes
+/// @param x left edge of the region
+/// @param y top edge of the region
+/// @param w width of the region
+/// @param h height of the region
+///
+/// @return sucsess bool, false if the region does not lie within the image
+bool jpg2rgb565_crop(const uint8_t* src, size_t src_len, uint8_t* out, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "img_converters.h"
 #include "soc/efuse_reg.h"
@@ -218,6 +219,89 @@ static bool _grayscale_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uin
     return true;
 }
 
+// User created writer, subtracts the grayscale of each block from the image already in the output
+static bool _grayscale_diff_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
+    if(!data){
+        if(x == 0 && y == 0){
+            // The output must already hold an image of the same size
+            jpeg->width = w;
+            jpeg->height = h;
+            return jpeg->output != NULL;
+        }
+        return true;
+    }
+
+    size_t row_len = jpeg->width; // bytes per line of output
+    uint8_t *out = jpeg->output + jpeg->data_offset + (y * row_len) + x;
+    for(size_t iy = 0; iy < h; iy++) {
+        for(size_t ix = 0; ix < w; ix++) {
+            uint16_t gray = (data[0] + data[1] + data[2]) / 3;
+            out[ix] = abs(out[ix] - gray);
+            data += 3;
+        }
+        out += row_len;
+    }
+    return true;
+}
+
+// Region of a jpg decoded to rgb565, the rest is thrown away as it is decoded
+typedef struct {
+        rgb_jpg_decoder jpeg;
+        uint16_t crop_x;
+        uint16_t crop_y;
+        uint16_t crop_w;
+        uint16_t crop_h;
+} rgb_jpg_crop_decoder;
+
+// User created writer, keeps only the part of each block inside the crop
+static bool _rgb565_crop_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    rgb_jpg_crop_decoder * crop = (rgb_jpg_crop_decoder *)arg;
+    if(!data){
+        if(x == 0 && y == 0){
+            // The crop must lie within the image
+            crop->jpeg.width = w;
+            crop->jpeg.height = h;
+            return crop->jpeg.output != NULL &&
+                   crop->crop_x + crop->crop_w <= w && crop->crop_y + crop->crop_h <= h;
+        }
+        return true;
+    }
+
+    size_t x_start = x > crop->crop_x ? x : crop->crop_x;
+    size_t y_start = y > crop->crop_y ? y : crop->crop_y;
+    size_t x_end = x + w < crop->crop_x + crop->crop_w ? x + w : crop->crop_x + crop->crop_w;
+    size_t y_end = y + h < crop->crop_y + crop->crop_h ? y + h : crop->crop_y + crop->crop_h;
+    if(x_start >= x_end || y_start >= y_end){
+        return true;
+    }
+
+    for(size_t iy = y_start; iy < y_end; iy++) {
+        const uint8_t *src = data + (((iy - y) * w) + (x_start - x)) * 3;
+        uint8_t *o = crop->jpeg.output + crop->jpeg.data_offset +
+                     (((iy - crop->crop_y) * crop->crop_w) + (x_start - crop->crop_x)) * 2;
+        for(size_t ix = x_start; ix < x_end; ix++) {
+            uint16_t r = src[2];
+            uint16_t g = src[1];
+            uint16_t b = src[0];
+
+            // Same scaling as _rgb565_write, so a crop matches the full decode
+            r = (uint16_t)(((float)r / 255.f) * 31.f);
+            g = (uint16_t)(((float)g / 255.f) * 63.f);
+            b = (uint16_t)(((float)b / 255.f) * 31.f);
+
+            uint16_t c = ((r << 11) & 0b1111100000000000) | ((g << 5) & 0b0000011111100000) | (b & 0b0000000000011111);
+            o[0] = (c >> 8) & 0xff;
+            o[1] = c & 0xff;
+            src += 3;
+            o += 2;
+        }
+    }
+    return true;
+}
+
 //input buffer
 static unsigned int _jpg_read(void * arg, size_t index, uint8_t *buf, size_t len)
 {
@@ -274,6 +358,42 @@ bool jpg2grayscale(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t
     return true;
 }
 
+// User created converter, subtracts the grayscale of a jpg from a grayscale image in place
+bool jpg2grayscale_diff(const uint8_t* src, size_t src_len, uint8_t* inout, jpg_scale_t scale)
+{
+    rgb_jpg_decoder jpeg;
+    jpeg.width = 0;
+    jpeg.height = 0;
+    jpeg.input = src;
+    jpeg.output = inout;
+    jpeg.data_offset = 0;
+
+    if(esp_jpg_decode(src_len, scale, _jpg_read, _grayscale_diff_write, (void*)&jpeg) != ESP_OK){
+        return false;
+    }
+    return true;
+}
+
+// User created converter from a region of a jpg to rgb565
+bool jpg2rgb565_crop(const uint8_t* src, size_t src_len, uint8_t* out, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    rgb_jpg_crop_decoder crop;
+    crop.jpeg.width = 0;
+    crop.jpeg.height = 0;
+    crop.jpeg.input = src;
+    crop.jpeg.output = out;
+    crop.jpeg.data_offset = 0;
+    crop.crop_x = x;
+    crop.crop_y = y;
+    crop.crop_w = w;
+    crop.crop_h = h;
+
+    if(esp_jpg_decode(src_len, JPG_SCALE_NONE, _jpg_read, _rgb565_crop_write, (void*)&crop) != ESP_OK){
+        return false;
+    }
+    return true;
+}
+
 bool jpg2bmp(const uint8_t *src, size_t src_len, uint8_t ** out, size_t * out_len)
 {
 
@@ -0,0 +1,61 @@
+/*
+ * Coalesces register tables into SCCB bursts.
+ *
+ * Sensors with 16 bit register addresses auto increment the address on every
+ * data byte of a write, so a run of consecutive registers can be written as
+ * one transaction instead of one per register. Only depends on the C standard
+ * library so it can be built into host tools.
+ */
+#ifndef __SCCB_BURST_H__
+#define __SCCB_BURST_H__
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most data bytes sent in one burst */
+#define SCCB_BURST_MAX 32
+
+/* Writes len registers from reg on in one transaction, returns 0 on success */
+typedef int (*sccb_burst_write_t)(void *arg, uint16_t reg, const uint8_t *data, size_t len);
+
+/* Waits for ms milliseconds */
+typedef void (*sccb_burst_delay_t)(uint32_t ms);
+
+/*
+ * Writes a {reg, value} table ending in a tail entry, one burst per run of
+ * consecutive registers. Delay entries end the run before them. Registers are
+ * written in table order so the result is the same as writing one at a time.
+ */
+static inline int sccb_write_reg_table(const uint16_t (*regs)[2], uint16_t tail, uint16_t delay_reg,
+                                       sccb_burst_write_t write, sccb_burst_delay_t delay, void *arg)
+{
+    uint8_t data[SCCB_BURST_MAX];
+    size_t len = 0;
+    uint16_t start = 0;
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0; i++) {
+        uint16_t reg = regs[i][0];
+        int end = reg == tail || reg == delay_reg;
+
+        /* Flush the run if this entry does not continue it */
+        if (len > 0 && (end || reg != start + len || len == SCCB_BURST_MAX)) {
+            ret = write(arg, start, data, len);
+            len = 0;
+        }
+        if (ret != 0 || reg == tail) {
+            break;
+        }
+        if (reg == delay_reg) {
+            delay(regs[i][1]);
+            continue;
+        }
+
+        if (len == 0) {
+            start = reg;
+        }
+        data[len++] = (uint8_t)regs[i][1];
+    }
+    return ret;
+}
+
+#endif // __SCCB_BURST_H__
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "sccb.h"
+#include "sccb_burst.h"
 #include "xclk.h"
 #include "ov5640.h"
 #include "ov5640_regs.h"
@@ -142,8 +143,24 @@ static int set_reg_bits(uint8_t slv_addr, uint16_t reg, uint8_t offset, uint8_t
     return ret;
 }
 
+#ifndef REG_DEBUG_ON
+static int write_burst(void *arg, uint16_t reg, const uint8_t *data, size_t len)
+{
+    return SCCB_Write16_Burst(*(uint8_t *)arg, reg, data, len);
+}
+
+static void delay_ms(uint32_t ms)
+{
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+#endif
+
 static int write_regs(uint8_t slv_addr, const uint16_t (*regs)[2])
 {
+#ifndef REG_DEBUG_ON
+    // Runs of consecutive registers go out as one burst each
+    return sccb_write_reg_table(regs, REGLIST_TAIL, REG_DLY, write_burst, delay_ms, &slv_addr);
+#else
     int i = 0, ret = 0;
     while (!ret && regs[i][0] != REGLIST_TAIL) {
         if (regs[i][0] == REG_DLY) {
@@ -154,22 +171,33 @@ static int write_regs(uint8_t slv_addr, const uint16_t (*regs)[2])
         i++;
     }
     return ret;
+#endif
 }
 
 static int write_reg16(uint8_t slv_addr, const uint16_t reg, uint16_t value)
 {
+#ifndef REG_DEBUG_ON
+    uint8_t data[2] = {value >> 8, value & 0xff};
+    return SCCB_Write16_Burst(slv_addr, reg, data, sizeof(data));
+#else
     if (write_reg(slv_addr, reg, value >> 8) || write_reg(slv_addr, reg + 1, value)) {
         return -1;
     }
     return 0;
+#endif
 }
 
 static int write_addr_reg(uint8_t slv_addr, const uint16_t reg, uint16_t x_value, uint16_t y_value)
 {
+#ifndef REG_DEBUG_ON
+    uint8_t data[4] = {x_value >> 8, x_value & 0xff, y_value >> 8, y_value & 0xff};
+    return SCCB_Write16_Burst(slv_addr, reg, data, sizeof(data));
+#else
     if (write_reg16(slv_addr, reg, x_value) || write_reg16(slv_addr, reg + 2, y_value)) {
         return -1;
     }
     return 0;
+#endif
 }
 
 #define write_reg_bits(slv_addr, reg, mask, enable) set_reg_bits(slv_addr, reg, 0, mask, (enable)?(mask):0)
@@ -0,0 +1,198 @@
+/// ------------------------------------------
+/// @file dc_prefilter_eval.c
+///
+/// @brief Host tool checking the DC pre-filter against the full motion analysis on
+/// recorded captures, to pick thresholds that do not lose captures with motion
+///
+/// @note Build with:
+///     gcc -O2 -I../main -o dc_prefilter_eval dc_prefilter_eval.c ../main/dc_prefilter.c
+///
+/// Captures are CAPTURE<n> directories, as stored in directory mode or unpacked from
+/// containers with tcc_extract. Full analysis found a capture significant if it has a
+/// box.jpg, so the captures must have been recorded with the pre-filter off.
+///
+/// Usage: dc_prefilter_eval [-t threshold] [-m min_permille] [-v] CAPTURE_DIR [...]
+///     -t  block change threshold, CONFIG_MOTION_PREFILTER_THRESHOLD (default 8)
+///     -m  changed blocks needed per mille, CONFIG_MOTION_PREFILTER_MIN_PERMILLE (default 2)
+///     -v  print every capture, not just the significant ones the pre-filter would lose
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dc_prefilter.h"
+
+/// @brief Largest thumbnail handled, QSXGA
+#define MAX_THUMB_LEN (((2592 + 7) / 8) * ((1944 + 7) / 8))
+
+/// ------------------------------------------
+/// @brief Reads a whole file
+///
+/// @param path of the file
+/// @param[out] len_out length read
+///
+/// @return file contents to be freed, null if it could not be read
+static uint8_t* read_file(const char* path, size_t* len_out)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* buf = len > 0 ? malloc(len) : NULL;
+    if (buf == NULL || fread(buf, 1, len, file) != (size_t)len)
+    {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *len_out = len;
+    return buf;
+}
+
+/// ------------------------------------------
+/// @brief Builds the thumbnail of a capture's image
+///
+/// @return 0 if sucsessful
+static int load_thumbnail(dc_prefilter_decoder_t* decoder, const char* dir, const char* name,
+                          uint8_t* thumb_out, size_t* len_out, double* ms_out)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    size_t jpg_len;
+    uint8_t* jpg = read_file(path, &jpg_len);
+    if (jpg == NULL)
+    {
+        fprintf(stderr, "%s: could not read\n", path);
+        return -1;
+    }
+
+    size_t width;
+    size_t height;
+    clock_t start = clock();
+    int err = dc_prefilter_thumbnail(decoder, jpg, jpg_len, thumb_out, MAX_THUMB_LEN, &width, &height);
+    *ms_out += (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+    free(jpg);
+
+    if (err != DC_PREFILTER_OK)
+    {
+        fprintf(stderr, "%s: decode failed (%i)\n", path, err);
+        return -1;
+    }
+    *len_out = width * height;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threshold = 8;
+    unsigned min_permille = 2;
+    int verbose = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:m:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            threshold = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            min_permille = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t threshold] [-m min_permille] [-v] CAPTURE_DIR [...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-t threshold] [-m min_permille] [-v] CAPTURE_DIR [...]\n", argv[0]);
+        return 1;
+    }
+
+    static dc_prefilter_decoder_t decoder;
+    static uint8_t thumb1[MAX_THUMB_LEN];
+    static uint8_t thumb2[MAX_THUMB_LEN];
+
+    size_t significant = 0;
+    size_t significant_passed = 0;
+    size_t quiet = 0;
+    size_t quiet_rejected = 0;
+    size_t failed = 0;
+    double decode_ms = 0;
+
+    for (int i = optind; i < argc; i++)
+    {
+        const char* dir = argv[i];
+        size_t len1;
+        size_t len2;
+        if (load_thumbnail(&decoder, dir, "img1.jpg", thumb1, &len1, &decode_ms) != 0 ||
+            load_thumbnail(&decoder, dir, "img2.jpg", thumb2, &len2, &decode_ms) != 0 || len1 != len2)
+        {
+            failed++;
+            continue;
+        }
+
+        char box_path[1024];
+        snprintf(box_path, sizeof(box_path), "%s/box.jpg", dir);
+        int full_significant = access(box_path, F_OK) == 0;
+
+        size_t changed = dc_prefilter_changed_blocks(thumb1, thumb2, len1, threshold);
+        int passed = dc_prefilter_passes(changed, len1, min_permille);
+
+        if (full_significant)
+        {
+            significant++;
+            significant_passed += passed;
+        }
+        else
+        {
+            quiet++;
+            quiet_rejected += !passed;
+        }
+
+        // Significant captures the pre-filter rejects are what it costs, always shown
+        if (verbose || (full_significant && !passed))
+        {
+            printf("%-24s full %-11s pre-filter %-8s %6zu blocks (%.2f per mille)\n", dir,
+                   full_significant ? "significant" : "quiet", passed ? "passed" : "rejected",
+                   changed, len1 > 0 ? changed * 1000.0 / len1 : 0.0);
+        }
+    }
+
+    size_t evaluated = significant + quiet;
+    printf("\nthreshold %u, min %u per mille, %zu captures (%zu unreadable)\n", threshold, min_permille,
+           evaluated, failed);
+    if (significant > 0)
+    {
+        printf("recall:    %zu of %zu significant captures passed (%.1f%%)\n", significant_passed, significant,
+               significant_passed * 100.0 / significant);
+    }
+    if (quiet > 0)
+    {
+        printf("rejection: %zu of %zu quiet captures rejected (%.1f%%)\n", quiet_rejected, quiet,
+               quiet_rejected * 100.0 / quiet);
+    }
+    if (evaluated > 0)
+    {
+        printf("decode:    %.2fms per image on this host\n", decode_ms / (evaluated * 2));
+    }
+
+    return significant_passed == significant ? 0 : 2;
+}
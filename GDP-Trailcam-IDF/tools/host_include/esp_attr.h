@@ -0,0 +1,9 @@
+/// ------------------------------------------
+/// @file esp_attr.h
+///
+/// @brief Stand in for the IDF header of the same name, so driver tables can be built
+/// into host tools
+/// ------------------------------------------
+#pragma once
+
+#define DRAM_ATTR
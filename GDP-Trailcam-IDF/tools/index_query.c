@@ -0,0 +1,106 @@
+/// ------------------------------------------
+/// @file index_query.c
+///
+/// @brief Host tool querying the capture metadata index of a card, e.g. "all captures
+/// with significant motion last night", without opening every capture's info.txt
+///
+/// @note Build with:
+///     gcc -O2 -DSTORAGE_HOST_BUILD -I../main -o index_query index_query.c
+///         ../main/capture_index.c ../main/storage_posix.c
+///
+/// Usage: index_query [-f from] [-t to] [-m min] [-M max] [-c] CARD_DIR
+///     -f  only captures from this time on, seconds since the epoch (or power on)
+///     -t  only captures up to this time
+///     -m  only captures with at least this many motion pixels
+///     -M  only captures with at most this many motion pixels
+///     -c  fold the log into a new checkpoint first, the card must be writable
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "capture_index.h"
+
+/// ------------------------------------------
+/// @brief Prints a matching record
+static bool print_record(const capture_index_record_t* record, void* arg)
+{
+    size_t* matches = arg;
+    (*matches)++;
+
+    printf("%6" PRIu32 " %10" PRId64 ".%03" PRId64 " cam %u %-9s %4ux%-4u motion %7" PRIu32,
+           record->capture_num, record->time_ms / 1000, record->time_ms % 1000, record->cam_num + 1,
+           record->image_preset == 0 ? "daylight" : "low light", record->width, record->height,
+           record->motion_pixels);
+
+    if (record->box_x != CAPTURE_INDEX_NO_BOX)
+    {
+        printf(" box (%u,%u)", record->box_x, record->box_y);
+    }
+    if (record->flags & CAPTURE_INDEX_FLAG_CONTAINER)
+    {
+        printf(" CAP%05" PRIu32 ".TCC@%" PRIu32, record->container_num, record->img1_offset);
+    }
+    if (record->flags & CAPTURE_INDEX_FLAG_AUDIT)
+    {
+        printf(" audit");
+    }
+    if (record->flags & CAPTURE_INDEX_FLAG_DISCARDED)
+    {
+        printf(" discarded");
+    }
+    printf("\n");
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    capture_index_query_t query = CAPTURE_INDEX_QUERY_ALL;
+    bool checkpoint = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:m:M:c")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f': query.from_ms = strtoll(optarg, NULL, 10) * 1000; break;
+            case 't': query.to_ms = strtoll(optarg, NULL, 10) * 1000 + 999; break;
+            case 'm': query.min_motion_pixels = strtoul(optarg, NULL, 10); break;
+            case 'M': query.max_motion_pixels = strtoul(optarg, NULL, 10); break;
+            case 'c': checkpoint = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-f from] [-t to] [-m min] [-M max] [-c] CARD_DIR\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-f from] [-t to] [-m min] [-M max] [-c] CARD_DIR\n", argv[0]);
+        return 1;
+    }
+
+    storage_backend_t* backend = storage_posix_create(argv[optind], 0, 0);
+    if (backend == NULL || capture_index_init(backend) != ESP_OK)
+    {
+        fprintf(stderr, "Failed to open the index in %s\n", argv[optind]);
+        return 1;
+    }
+
+    if (checkpoint && capture_index_checkpoint(true) != ESP_OK)
+    {
+        fprintf(stderr, "Failed to checkpoint the index\n");
+        return 1;
+    }
+
+    size_t matches = 0;
+    if (capture_index_query(&query, print_record, &matches) != ESP_OK)
+    {
+        fprintf(stderr, "Failed to query the index\n");
+        return 1;
+    }
+
+    printf("%zu captures\n", matches);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/// ------------------------------------------
+/// @file mask_decode.c
+///
+/// @brief Host tool turning motion.msk files back into viewable images of the quantized
+/// subtraction, as box.bin (with the bounding box drawn) was. The subtraction before
+/// quantizing is only kept as the motion.jpg preview
+///
+/// @note Build with: gcc -O2 -I../main -o mask_decode mask_decode.c
+///
+/// Usage: mask_decode [-b] [-r] motion.msk OUT
+///     -b  draw the bounding box, as box.bin was
+///     -r  write raw 8 bit pixels like box.bin instead of a PGM image
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "motion_mask.h"
+
+/// ------------------------------------------
+/// @brief Reads a LEB128 varint
+///
+/// @param buf buffer to read from
+/// @param pos read position, advanced past the varint
+/// @param len length of the buffer
+/// @param[out] value read value
+///
+/// @return 0 if sucsessful, -1 if the buffer ends first
+static int get_varint(const uint8_t* buf, size_t* pos, const size_t len, size_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (*pos >= len)
+        {
+            return -1;
+        }
+        uint8_t byte = buf[(*pos)++];
+        *value |= (size_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/// ------------------------------------------
+/// @brief Expands a mask payload into 0x00/0xff pixels
+///
+/// @return 0 if sucsessful, -1 if the payload is malformed
+static int decode_payload(const motion_mask_header_t* header, const uint8_t* payload, uint8_t* pixels)
+{
+    size_t pixel_count = (size_t)header->width * header->height;
+
+    if (header->encoding == MOTION_MASK_ENCODING_BITPACK)
+    {
+        if (header->payload_len < motion_mask_bitpack_len(header->width, header->height))
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < pixel_count; i++)
+        {
+            pixels[i] = (payload[i / 8] & (0x80 >> (i % 8))) ? 0xff : 0;
+        }
+        return 0;
+    }
+
+    if (header->encoding != MOTION_MASK_ENCODING_RLE)
+    {
+        return -1;
+    }
+
+    size_t pos = 0;
+    size_t pix = 0;
+    uint8_t value = 0;
+    while (pos < header->payload_len)
+    {
+        size_t run;
+        if (get_varint(payload, &pos, header->payload_len, &run) != 0 || run > pixel_count - pix)
+        {
+            return -1;
+        }
+        memset(pixels + pix, value, run);
+        pix += run;
+        value ^= 0xff;
+    }
+    return pix == pixel_count ? 0 : -1;
+}
+
+/// ------------------------------------------
+/// @brief Draws the bounding box outline, as draw_motion_box does
+static void draw_box(const motion_mask_header_t* header, uint8_t* pixels)
+{
+    if (header->box_x == MOTION_MASK_NO_BOX)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i <= header->box_len; i++)
+    {
+        size_t edge_points[4][2] = {
+            {header->box_x + i, header->box_y},
+            {header->box_x + i, header->box_y + header->box_len},
+            {header->box_x, header->box_y + i},
+            {header->box_x + header->box_len, header->box_y + i},
+        };
+        for (int e = 0; e < 4; e++)
+        {
+            if (edge_points[e][0] < header->width && edge_points[e][1] < header->height)
+            {
+                pixels[edge_points[e][1] * header->width + edge_points[e][0]] = 0xff;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int draw_box_flag = 0;
+    int raw_output = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "br")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': draw_box_flag = 1; break;
+            case 'r': raw_output = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-b] [-r] motion.msk OUT\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (argc - optind != 2)
+    {
+        fprintf(stderr, "Usage: %s [-b] [-r] motion.msk OUT\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[optind], "rb");
+    if (in == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    motion_mask_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        header.magic != MOTION_MASK_MAGIC ||
+        header.version != MOTION_MASK_VERSION)
+    {
+        fprintf(stderr, "%s: not a motion mask\n", argv[optind]);
+        fclose(in);
+        return 1;
+    }
+
+    size_t pixel_count = (size_t)header.width * header.height;
+    uint8_t* payload = malloc(header.payload_len);
+    uint8_t* pixels = malloc(pixel_count);
+    if (payload == NULL || pixels == NULL ||
+        fread(payload, 1, header.payload_len, in) != header.payload_len)
+    {
+        fprintf(stderr, "%s: truncated\n", argv[optind]);
+        fclose(in);
+        return 1;
+    }
+    fclose(in);
+
+    if (decode_payload(&header, payload, pixels) != 0)
+    {
+        fprintf(stderr, "%s: malformed payload\n", argv[optind]);
+        return 1;
+    }
+
+    if (draw_box_flag)
+    {
+        draw_box(&header, pixels);
+    }
+
+    FILE* out = fopen(argv[optind + 1], "wb");
+    if (out == NULL)
+    {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    if (raw_output == 0)
+    {
+        fprintf(out, "P5\n%u %u\n255\n", header.width, header.height);
+    }
+    fwrite(pixels, 1, pixel_count, out);
+    fclose(out);
+
+    printf("%ux%u, %u motion pixels, %s, box %s\n", header.width, header.height, header.set_count,
+           header.encoding == MOTION_MASK_ENCODING_RLE ? "rle" : "bitpack",
+           header.box_x == MOTION_MASK_NO_BOX ? "none" : "present");
+
+    free(payload);
+    free(pixels);
+    return 0;
+}
@@ -0,0 +1,201 @@
+/// ------------------------------------------
+/// @file sccb_burst_count.c
+///
+/// @brief Host tool replaying the OV5640 driver's register tables onto a fake SCCB bus, one
+/// transaction per register as before and coalesced into bursts by sccb_burst.h. Counts the
+/// transactions and bus time of each and checks both leave the sensor in the same state.
+///
+/// @note Build with:
+///     CAM=../managed_components/espressif__esp32-camera
+///     gcc -O2 -Ihost_include -I$CAM/driver/include -I$CAM/driver/private_include
+///         -I$CAM/sensors/private_include -o sccb_burst_count sccb_burst_count.c
+///
+/// Usage: sccb_burst_count [-f SCCB Hz]
+///     -f  bus clock used for the time estimate, CONFIG_SCCB_CLK_FREQ (default 100000)
+///
+/// Exits non-zero if any table leaves different registers or writes them in a different order
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sensor.h"
+#include "sccb_burst.h"
+#include "ov5640_settings.h"
+
+/// @brief Most register writes a table replay is logged for
+#define MAX_LOGGED_WRITES 4096
+
+/// @brief A fake SCCB bus with an OV5640's 16 bit register space behind it
+typedef struct
+{
+    // Register values
+    uint8_t regs[0x10000];
+
+    // Registers written, in order
+    uint16_t log[MAX_LOGGED_WRITES];
+
+    // Entries in log
+    size_t log_count;
+
+    // Transactions started on the bus
+    size_t transactions;
+
+    // Bits clocked on the bus, start, device address, register address, data and stop
+    size_t bits;
+} fake_bus_t;
+
+/// @brief A table of the driver and its name
+typedef struct
+{
+    const char* name;
+    const uint16_t (*regs)[2];
+} reg_table_t;
+
+static const reg_table_t tables[] = {
+    {"sensor_default_regs", sensor_default_regs},
+    {"sensor_fmt_jpeg", sensor_fmt_jpeg},
+    {"sensor_fmt_raw", sensor_fmt_raw},
+    {"sensor_fmt_grayscale", sensor_fmt_grayscale},
+    {"sensor_fmt_yuv422", sensor_fmt_yuv422},
+    {"sensor_fmt_rgb565", sensor_fmt_rgb565},
+    {"sensor_regs_gamma0", sensor_regs_gamma0},
+    {"sensor_regs_gamma1", sensor_regs_gamma1},
+    {"sensor_regs_awb0", sensor_regs_awb0},
+};
+
+#define TABLE_COUNT (sizeof(tables) / sizeof(tables[0]))
+
+/// @brief Registers in the run of the synthetic table, longer than a burst
+#define SYNTHETIC_RUN_LEN (SCCB_BURST_MAX * 2 + 5)
+
+/// @brief Synthetic table: a run split over several bursts, a delay inside a run, a
+/// repeated register and a run ending at the top of the address space
+static uint16_t synthetic_regs[SYNTHETIC_RUN_LEN + 8][2];
+
+/// ------------------------------------------
+/// @brief Fills synthetic_regs
+static void build_synthetic_table()
+{
+    size_t n = 0;
+    for (size_t i = 0; i < SYNTHETIC_RUN_LEN; i++, n++)
+    {
+        synthetic_regs[n][0] = 0x5000 + i;
+        synthetic_regs[n][1] = i;
+    }
+    synthetic_regs[n][0] = 0x5000 + SYNTHETIC_RUN_LEN; synthetic_regs[n++][1] = 0xaa;
+    synthetic_regs[n][0] = REG_DLY; synthetic_regs[n++][1] = 10;
+    synthetic_regs[n][0] = 0x5001 + SYNTHETIC_RUN_LEN; synthetic_regs[n++][1] = 0xbb;
+    synthetic_regs[n][0] = 0x5001 + SYNTHETIC_RUN_LEN; synthetic_regs[n++][1] = 0xcc;
+    synthetic_regs[n][0] = 0xfffd; synthetic_regs[n++][1] = 1;
+    synthetic_regs[n][0] = 0xfffe; synthetic_regs[n++][1] = 2;
+    synthetic_regs[n][0] = REGLIST_TAIL; synthetic_regs[n++][1] = 0;
+}
+
+/// ------------------------------------------
+/// @brief sccb_burst_write_t of the fake bus, the address increments per data byte as on the sensor
+static int fake_burst(void* arg, uint16_t reg, const uint8_t* data, size_t len)
+{
+    fake_bus_t* bus = arg;
+    bus->transactions++;
+
+    // Each byte is 8 bits and an ack, plus start and stop
+    bus->bits += 2 + (1 + 2 + len) * 9;
+    for (size_t i = 0; i < len; i++)
+    {
+        bus->regs[(uint16_t)(reg + i)] = data[i];
+        if (bus->log_count < MAX_LOGGED_WRITES)
+        {
+            bus->log[bus->log_count++] = reg + i;
+        }
+    }
+    return 0;
+}
+
+/// ------------------------------------------
+/// @brief sccb_burst_delay_t of the fake bus, delays are not part of the bus time
+static void fake_delay(uint32_t ms)
+{
+}
+
+/// ------------------------------------------
+/// @brief Replays a table one register per transaction, as write_regs did before bursts
+static void replay_single(const uint16_t (*regs)[2], fake_bus_t* bus)
+{
+    for (size_t i = 0; regs[i][0] != REGLIST_TAIL; i++)
+    {
+        if (regs[i][0] != REG_DLY)
+        {
+            uint8_t value = regs[i][1];
+            fake_burst(bus, regs[i][0], &value, 1);
+        }
+    }
+}
+
+/// ------------------------------------------
+/// @brief Replays a table both ways and prints the counts
+///
+/// @return do both leave the same registers, written in the same order?
+static bool compare_table(const char* name, const uint16_t (*regs)[2], fake_bus_t* single, fake_bus_t* burst,
+                          const unsigned long freq)
+{
+    memset(single, 0, sizeof(fake_bus_t));
+    memset(burst, 0, sizeof(fake_bus_t));
+
+    replay_single(regs, single);
+    int ret = sccb_write_reg_table(regs, REGLIST_TAIL, REG_DLY, fake_burst, fake_delay, burst);
+
+    bool same = ret == 0 &&
+                memcmp(single->regs, burst->regs, sizeof(single->regs)) == 0 &&
+                single->log_count == burst->log_count &&
+                memcmp(single->log, burst->log, single->log_count * sizeof(uint16_t)) == 0;
+    printf("%-22s %12zu %12zu %10.1f %10.1f%s\n", name, single->transactions, burst->transactions,
+           single->bits * 1000.0 / freq, burst->bits * 1000.0 / freq, same ? "" : "  MISMATCH");
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long freq = 100000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f': freq = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-f SCCB Hz]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (freq == 0)
+    {
+        fprintf(stderr, "Bus clock must be above 0\n");
+        return 1;
+    }
+
+    fake_bus_t* single = malloc(sizeof(fake_bus_t));
+    fake_bus_t* burst = malloc(sizeof(fake_bus_t));
+    if (single == NULL || burst == NULL)
+    {
+        fprintf(stderr, "Failed to allocate buses\n");
+        return 1;
+    }
+
+    printf("%-22s %12s %12s %10s %10s\n", "table", "single txns", "burst txns", "single ms", "burst ms");
+    int failed = 0;
+    for (size_t t = 0; t < TABLE_COUNT; t++)
+    {
+        failed |= !compare_table(tables[t].name, tables[t].regs, single, burst, freq);
+    }
+
+    build_synthetic_table();
+    failed |= !compare_table("synthetic", (const uint16_t (*)[2])synthetic_regs, single, burst, freq);
+
+    free(single);
+    free(burst);
+    return failed;
+}
@@ -0,0 +1,205 @@
+/// ------------------------------------------
+/// @file sd_bench_host.c
+///
+/// @brief Host version of alternative_mains/SDBenchmark.c, runs the same write sweep
+/// against a file so chunking and preallocation can be compared off target, e.g. on a
+/// file on a mounted SD card reader or on a loop device backed by a card image
+///
+/// @note Build with: gcc -O2 -o sd_bench_host sd_bench_host.c
+///
+/// Usage: sd_bench_host [-d] PATH
+///     -d  open with O_DIRECT so the page cache does not hide device speed (Linux)
+/// ------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
+/// @brief Times each configuration is repeated, the mean is reported
+#define BENCH_REPEATS 3
+
+/// @brief Alignment of the aligned buffers, matches the FAT sector size
+#define BENCH_ALIGN 4096
+
+static const size_t file_sizes[] = {256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+static const size_t chunk_sizes[] = {4 * 1024, 8 * 1024, 16 * 1024, 32 * 1024, 64 * 1024};
+
+/// @brief Ways the source buffer reaches the file, mirrors the device benchmark
+typedef enum
+{
+    // One write of the whole buffer
+    PLACEMENT_WHOLE,
+
+    // Chunks written straight from a source buffer that is not sector aligned
+    PLACEMENT_UNALIGNED,
+
+    // Chunks copied through a sector aligned bounce buffer
+    PLACEMENT_BOUNCE,
+
+    PLACEMENT_COUNT
+} bench_placement_t;
+
+static const char* placement_names[PLACEMENT_COUNT] = {"whole", "unaligned", "bounce"};
+
+/// ------------------------------------------
+/// @brief Gets a monotonic time
+///
+/// @return time in us
+static int64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// ------------------------------------------
+/// @brief Writes the benchmark file once, same chunking as fwrite_chunked_SDSPI
+///
+/// @return time taken in us, negative on failure
+static int64_t bench_write(const char* path, const int flags, const uint8_t* src, const size_t file_size,
+                           const size_t chunk_size, const bench_placement_t placement, uint8_t* bounce,
+                           const int preallocate)
+{
+    unlink(path);
+
+    int64_t start_time = now_us();
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | flags, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (preallocate && posix_fallocate(fd, 0, file_size) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < file_size)
+    {
+        size_t chunk = placement == PLACEMENT_WHOLE ? file_size : chunk_size - (written % chunk_size);
+        if (chunk > file_size - written)
+        {
+            chunk = file_size - written;
+        }
+
+        const uint8_t* chunk_src = src + written;
+        if (placement == PLACEMENT_BOUNCE)
+        {
+            memcpy(bounce, chunk_src, chunk);
+            chunk_src = bounce;
+        }
+
+        ssize_t ret = write(fd, chunk_src, chunk);
+        if (ret <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        written += ret;
+    }
+
+    fsync(fd);
+    close(fd);
+    return now_us() - start_time;
+}
+
+int main(int argc, char** argv)
+{
+    int flags = 0;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0)
+        {
+            flags |= O_DIRECT;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "Usage: %s [-d] PATH\n", argv[0]);
+        return 2;
+    }
+
+    size_t max_file_size = file_sizes[sizeof(file_sizes) / sizeof(file_sizes[0]) - 1];
+    size_t max_chunk_size = chunk_sizes[sizeof(chunk_sizes) / sizeof(chunk_sizes[0]) - 1];
+
+    // One spare byte so the unaligned placement can start off a sector boundary
+    uint8_t* src_alloc = NULL;
+    uint8_t* bounce = NULL;
+    if (posix_memalign((void**)&src_alloc, BENCH_ALIGN, max_file_size + BENCH_ALIGN) != 0 ||
+        posix_memalign((void**)&bounce, BENCH_ALIGN, max_chunk_size) != 0)
+    {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < max_file_size + BENCH_ALIGN; i++)
+    {
+        src_alloc[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+
+    printf("file_bytes,chunk_bytes,placement,preallocated,mb_per_s\n");
+    for (size_t fi = 0; fi < sizeof(file_sizes) / sizeof(file_sizes[0]); fi++)
+    {
+        for (size_t ci = 0; ci < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ci++)
+        {
+            for (int placement = 0; placement < PLACEMENT_COUNT; placement++)
+            {
+                if (placement == PLACEMENT_WHOLE && ci > 0)
+                {
+                    continue;
+                }
+
+                const uint8_t* src = placement == PLACEMENT_UNALIGNED ? src_alloc + 1 : src_alloc;
+                for (int preallocate = 0; preallocate <= 1; preallocate++)
+                {
+                    int64_t total_us = 0;
+                    int r;
+                    for (r = 0; r < BENCH_REPEATS; r++)
+                    {
+                        int64_t us = bench_write(path, flags, src, file_sizes[fi], chunk_sizes[ci],
+                                                 placement, bounce, preallocate);
+                        if (us < 0)
+                        {
+                            break;
+                        }
+                        total_us += us;
+                    }
+
+                    if (r < BENCH_REPEATS)
+                    {
+                        // O_DIRECT refuses unaligned buffers, which is the point of the bounce buffer
+                        printf("%zu,%zu,%s,%i,failed (%s)\n", file_sizes[fi], chunk_sizes[ci],
+                               placement_names[placement], preallocate, strerror(errno));
+                        continue;
+                    }
+
+                    printf("%zu,%zu,%s,%i,%.3f\n", file_sizes[fi], chunk_sizes[ci], placement_names[placement],
+                           preallocate, (double)file_sizes[fi] * BENCH_REPEATS / total_us);
+                }
+            }
+        }
+    }
+
+    unlink(path);
+    free(bounce);
+    free(src_alloc);
+    return 0;
+}
@@ -0,0 +1,253 @@
+/// ------------------------------------------
+/// @file storage_bench_host.c
+///
+/// @brief Replays the writes of a wake's captures through the firmware's capture_store.c
+/// against the POSIX or RAM disk storage backends, so the cost of the capture layout can
+/// be measured off target. The POSIX backend can be throttled to the bandwidth and per
+/// operation latency of the SD card measured with SDBenchmark.c.
+///
+/// @note The layout is chosen at build time as on the device, add
+/// -DCONFIG_CAPTURE_STORAGE_CONTAINER for containers. Build with:
+///     gcc -O2 -DSTORAGE_HOST_BUILD -DCONFIG_TRACE_ENABLED -DCONFIG_CAPTURE_CONTAINER_SIZE_MB=64
+///         -I../main -o storage_bench_host storage_bench_host.c ../main/capture_store.c
+///         ../main/storage_dir.c ../main/storage_posix.c ../main/storage_ramdisk.c ../main/trace.c
+///
+/// Usage: storage_bench_host [-r] [-k KB/s] [-l us] [-n captures] [-w captures] [-t trace.json] [DIR]
+///     -r  use the RAM disk instead of DIR
+///     -k  throttle the POSIX backend to this data rate
+///     -l  add this latency to every POSIX operation
+///     -n  captures to replay, default 20
+///     -w  captures per wake, the store is opened and closed around each, default 5
+///     -t  write the sd_write spans of every file as Chrome trace JSON, as the device does
+///
+/// Captures are left in DIR afterwards, tcc_extract unpacks containers for checking
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture_store.h"
+#include "storage_backend.h"
+#include "trace.h"
+
+/// @brief A file the SD writer stores for every capture, in the order main.c queues them
+typedef struct
+{
+    const char* name;
+    size_t len;
+
+    // Is the writer asked to commit once the file is written?
+    bool commit;
+} bench_file_t;
+
+/// @brief Sizes are typical of an FHD OV5640 capture with a significant motion box
+static const bench_file_t capture_files[] = {
+    {"img1.jpg", 300 * 1024, false},
+    {"img2.jpg", 300 * 1024, false},
+    {"info.txt", 300, true},
+    {"motion.msk", 4 * 1024, false},
+    {"motion.jpg", 16 * 1024, false},
+    {"box.jpg", 60 * 1024, true},
+};
+
+#define CAPTURE_FILE_COUNT (sizeof(capture_files) / sizeof(capture_files[0]))
+
+/// @brief Trace events kept, enough for every file of the default run
+#define BENCH_TRACE_EVENTS 16384
+
+/// @brief Bytes capture_store has allocated on the backend, stands in for retention.c
+static uint64_t allocated_bytes = 0;
+
+/// ------------------------------------------
+void retention_note_allocated(const uint64_t bytes)
+{
+    allocated_bytes += bytes;
+}
+
+/// ------------------------------------------
+void retention_note_freed(const uint64_t bytes)
+{
+    allocated_bytes = bytes < allocated_bytes ? allocated_bytes - bytes : 0;
+}
+
+/// ------------------------------------------
+/// @brief Gets a monotonic time in us
+static int64_t time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// ------------------------------------------
+/// @brief Writes and commits one file as the SD writer task does
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t write_file(const uint32_t capture_num, const bench_file_t* file, const uint8_t* src)
+{
+    TRACE_BEGIN(TRACE_SPAN_SD_WRITE);
+    esp_err_t err = capture_store_write(capture_num, file->name, src, file->len);
+    TRACE_END(TRACE_SPAN_SD_WRITE);
+
+    if (err == ESP_OK && file->commit)
+    {
+        err = capture_store_commit(capture_num);
+    }
+    return err;
+}
+
+/// ------------------------------------------
+/// @brief Replays wakes of captures, opening and closing the store around each as main.c does
+///
+/// @param[out] close_us_out time spent closing the store
+///
+/// @return ESP_OK if sucsessful
+static esp_err_t replay_wakes(storage_backend_t* backend, const uint8_t* src, const int captures,
+                              const int wake_captures, int64_t* close_us_out)
+{
+    uint32_t next_num = 0;
+    int written = 0;
+    *close_us_out = 0;
+    while (written < captures)
+    {
+        esp_err_t err = capture_store_init(backend);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        next_num = capture_store_find_next_capture_num(next_num);
+
+        for (int c = 0; c < wake_captures && written < captures; c++, written++)
+        {
+            for (size_t f = 0; f < CAPTURE_FILE_COUNT; f++)
+            {
+                err = write_file(next_num, &capture_files[f], src);
+                if (err != ESP_OK)
+                {
+                    return err;
+                }
+            }
+            next_num++;
+        }
+
+        int64_t start = time_us();
+        err = capture_store_set_next_capture_num(next_num);
+        if (err == ESP_OK)
+        {
+            err = capture_store_close();
+        }
+        *close_us_out += time_us() - start;
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+int main(int argc, char** argv)
+{
+    bool use_ramdisk = false;
+    uint32_t throttle_kbps = 0;
+    uint32_t latency_us = 0;
+    int captures = 20;
+    int wake_captures = 5;
+    const char* trace_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "rk:l:n:w:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': use_ramdisk = true; break;
+            case 'k': throttle_kbps = strtoul(optarg, NULL, 10); break;
+            case 'l': latency_us = strtoul(optarg, NULL, 10); break;
+            case 'n': captures = atoi(optarg); break;
+            case 'w': wake_captures = atoi(optarg); break;
+            case 't': trace_path = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r] [-k KB/s] [-l us] [-n captures] [-w captures] [-t trace.json] [DIR]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if (use_ramdisk == false && optind >= argc)
+    {
+        fprintf(stderr, "A directory is needed unless -r is given\n");
+        return 1;
+    }
+    if (captures < 1 || wake_captures < 1)
+    {
+        fprintf(stderr, "Captures must be at least 1\n");
+        return 1;
+    }
+
+    size_t capture_bytes = 0;
+    size_t largest_file = 0;
+    for (size_t f = 0; f < CAPTURE_FILE_COUNT; f++)
+    {
+        capture_bytes += capture_files[f].len;
+        largest_file = capture_files[f].len > largest_file ? capture_files[f].len : largest_file;
+    }
+
+    // Room for every capture twice over, a container is preallocated in full before any is written
+    size_t ramdisk_bytes = (size_t)CONTAINER_CAPACITY * 2 + capture_bytes * captures * 2;
+    storage_backend_t* backend = use_ramdisk
+        ? storage_ramdisk_create(ramdisk_bytes)
+        : storage_posix_create(argv[optind], throttle_kbps * 1024, latency_us);
+    uint8_t* src = malloc(largest_file);
+    if (backend == NULL || src == NULL)
+    {
+        fprintf(stderr, "Failed to create backend\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < largest_file; i++)
+    {
+        src[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+
+    if (trace_path != NULL && trace_init(BENCH_TRACE_EVENTS) != ESP_OK)
+    {
+        fprintf(stderr, "Failed to start tracing\n");
+        return 1;
+    }
+
+#ifdef CONFIG_CAPTURE_STORAGE_CONTAINER
+    const char* layout = "container";
+#else
+    const char* layout = "directories";
+#endif
+    printf("%s backend, %s layout, %i captures in wakes of %i\n", backend->name, layout, captures, wake_captures);
+
+    int64_t close_us;
+    int64_t start = time_us();
+    esp_err_t err = replay_wakes(backend, src, captures, wake_captures, &close_us);
+    int64_t elapsed = time_us() - start;
+
+    if (err != ESP_OK)
+    {
+        printf("%-12s failed (0x%x)\n", layout, err);
+    }
+    else
+    {
+        // bytes/us is MB/s
+        printf("%-12s %8.1f ms/capture %8.2f MB/s, %.1f ms closing, %llu bytes allocated\n", layout,
+               (double)elapsed / 1000 / captures, (double)capture_bytes * captures / elapsed,
+               (double)close_us / 1000, (unsigned long long)allocated_bytes);
+    }
+
+    // Written to the working directory rather than through the backend under test
+    storage_backend_t* trace_backend = trace_path != NULL ? storage_posix_create(".", 0, 0) : NULL;
+    if (trace_backend != NULL && trace_dump(trace_backend, trace_path) != ESP_OK)
+    {
+        fprintf(stderr, "Failed to write %s\n", trace_path);
+    }
+
+    free(src);
+    return err == ESP_OK ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+/// ------------------------------------------
+/// @file tcc_extract.c
+///
+/// @brief Host tool unpacking trailcam capture containers (CAPnnnnn.TCC) into the
+/// CAPTURE<n>/<file> directory layout in the current directory
+///
+/// @note Build with: gcc -O2 -I../main -o tcc_extract tcc_extract.c
+///
+/// Usage: tcc_extract [-s] CAP00001.TCC [CAP00002.TCC ...]
+///     -s  salvage, keep walking past the committed tail for segments that
+///         were fully written but never committed before power was lost
+/// ------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#else
+#define make_dir(path) mkdir(path, 0777)
+#endif
+
+#include "capture_container.h"
+
+/// ------------------------------------------
+/// @brief Standard reflected CRC32, matches esp_rom_crc32_le with a starting crc of 0
+///
+/// @param data buffer to checksum
+/// @param len length of buffer
+///
+/// @return crc of the buffer
+static uint32_t crc32(const void* data, size_t len)
+{
+    const uint8_t* bytes = data;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/// ------------------------------------------
+/// @brief Checks a segment name is safe to use as a file name
+///
+/// @param name null terminated within CONTAINER_NAME_LEN
+///
+/// @return is the name usable?
+static int valid_segment_name(const char* name)
+{
+    if (memchr(name, '\0', CONTAINER_NAME_LEN) == NULL || name[0] == '\0' || name[0] == '.')
+    {
+        return 0;
+    }
+    return strchr(name, '/') == NULL && strchr(name, '\\') == NULL;
+}
+
+/// ------------------------------------------
+/// @brief Writes one segment out as CAPTURE<n>/<name>
+///
+/// @param segment header of the segment
+/// @param data of the segment
+///
+/// @return 0 if sucsessful
+static int write_segment_file(const container_segment_header_t* segment, const uint8_t* data)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "CAPTURE%u", (unsigned)segment->capture_num);
+    if (make_dir(path) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "CAPTURE%u/%s", (unsigned)segment->capture_num, segment->name);
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    size_t written = fwrite(data, 1, segment->len, f);
+    fclose(f);
+    if (written != segment->len)
+    {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/// ------------------------------------------
+/// @brief Extracts every capture segment of a container
+///
+/// @param path of the container
+/// @param salvage keep reading past the committed tail?
+///
+/// @return 0 if the whole container was extracted
+static int extract_container(const char* path, const int salvage)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    container_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != CONTAINER_MAGIC ||
+        header.version != CONTAINER_VERSION)
+    {
+        fprintf(stderr, "%s is not a capture container\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    uint32_t limit = header.tail;
+    if (header.header_crc != crc32(&header, offsetof(container_header_t, header_crc)))
+    {
+        fprintf(stderr, "%s has a bad header crc, salvaging\n", path);
+        limit = header.capacity;
+    }
+    else if (salvage)
+    {
+        limit = header.capacity;
+    }
+
+    int rc = 0;
+    unsigned files = 0;
+    uint32_t offset = CONTAINER_DATA_START;
+    while (offset + sizeof(container_segment_header_t) <= limit)
+    {
+        container_segment_header_t segment;
+        if (fseek(f, offset, SEEK_SET) != 0 || fread(&segment, sizeof(segment), 1, f) != 1)
+        {
+            break;
+        }
+
+        if (segment.magic != CONTAINER_SEGMENT_MAGIC ||
+            segment.header_crc != crc32(&segment, offsetof(container_segment_header_t, header_crc)))
+        {
+            if (offset < header.tail)
+            {
+                fprintf(stderr, "%s: bad segment header at %u\n", path, (unsigned)offset);
+                rc = -1;
+            }
+            break;
+        }
+
+        uint32_t next = offset + sizeof(segment) + container_pad_len(segment.len);
+        if (next > header.capacity || next < offset)
+        {
+            fprintf(stderr, "%s: segment at %u overruns container\n", path, (unsigned)offset);
+            rc = -1;
+            break;
+        }
+
+        uint8_t* data = malloc(segment.len ? segment.len : 1);
+        if (data == NULL || fread(data, 1, segment.len, f) != segment.len)
+        {
+            fprintf(stderr, "%s: failed to read segment at %u\n", path, (unsigned)offset);
+            free(data);
+            rc = -1;
+            break;
+        }
+
+        if (segment.data_crc != crc32(data, segment.len))
+        {
+            fprintf(stderr, "%s: crc mismatch in %u/%.*s\n", path, (unsigned)segment.capture_num,
+                    CONTAINER_NAME_LEN, segment.name);
+            rc = -1;
+        }
+        else if (segment.capture_num != CONTAINER_INDEX_CAPTURE_NUM)
+        {
+            if (!valid_segment_name(segment.name))
+            {
+                fprintf(stderr, "%s: bad segment name at %u\n", path, (unsigned)offset);
+                rc = -1;
+            }
+            else if (write_segment_file(&segment, data) == 0)
+            {
+                if (offset >= header.tail)
+                {
+                    printf("Salvaged CAPTURE%u/%s\n", (unsigned)segment.capture_num, segment.name);
+                }
+                files++;
+            }
+            else
+            {
+                rc = -1;
+            }
+        }
+
+        free(data);
+        offset = next;
+    }
+
+    printf("%s: %u files extracted, %u of %u bytes committed\n", path, files,
+           (unsigned)header.tail, (unsigned)header.capacity);
+    fclose(f);
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    int salvage = 0;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "-s") == 0)
+    {
+        salvage = 1;
+        first++;
+    }
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-s] CAP00001.TCC [CAP00002.TCC ...]\n", argv[0]);
+        return 2;
+    }
+
+    int rc = 0;
+    for (int i = first; i < argc; i++)
+    {
+        if (extract_container(argv[i], salvage) != 0)
+        {
+            rc = 1;
+        }
+    }
+    return rc;
+}